@@ -0,0 +1,115 @@
+//BOUNDED QUEUE BETWEEN PIPELINE STAGES
+//A PRODUCER BLOCKS WHILE THE QUEUE IS FULL AND A CONSUMER WHILE IT IS EMPTY, SO A FAST STAGE CANNOT RUN AHEAD OF A
+//SLOW ONE BY MORE THAN THE CAPACITY: MEMORY STAYS BOUNDED WHATEVER THE NUMBER OF SCENES OR OBJECTS
+
+#ifndef WP2_COMMON_BOUNDED_QUEUE_H_
+#define WP2_COMMON_BOUNDED_QUEUE_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+
+namespace wp2
+{
+  //  Any number of producers and consumers. Every producer calls close () when it is done; once all of them have,
+  //  pop () drains what is left and then returns false.
+  template <typename T>
+  class BoundedQueue : private boost::noncopyable
+  {
+    public:
+      BoundedQueue (size_t capacity = 4, int nr_producers = 1)
+        : capacity_ (capacity > 0 ? capacity : 1)
+        , producers_ (nr_producers)
+        , max_size_ (0)
+        , waits_ (0)
+      {
+      }
+
+      //  Waits for room; false if the queue was already closed
+      bool
+      push (const T &item)
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        if (items_.size () >= capacity_ && producers_ > 0)
+        {
+          ++waits_;
+          while (items_.size () >= capacity_ && producers_ > 0)
+          {
+            not_full_.wait (lock);
+          }
+        }
+        if (producers_ <= 0)
+        {
+          return (false);
+        }
+        items_.push_back (item);
+        if (items_.size () > max_size_)
+        {
+          max_size_ = items_.size ();
+        }
+        not_empty_.notify_one ();
+        return (true);
+      }
+
+      //  Waits for an item; false once the queue is closed and empty
+      bool
+      pop (T &item)
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        while (items_.empty () && producers_ > 0)
+        {
+          not_empty_.wait (lock);
+        }
+        if (items_.empty ())
+        {
+          return (false);
+        }
+        item = items_.front ();
+        items_.pop_front ();
+        not_full_.notify_one ();
+        return (true);
+      }
+
+      //  One producer is done
+      void
+      close ()
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        if (--producers_ <= 0)
+        {
+          not_empty_.notify_all ();
+          not_full_.notify_all ();
+        }
+      }
+
+      //  Most items ever queued at once
+      size_t
+      getMaxSize () const
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        return (max_size_);
+      }
+
+      //  Times a producer found the queue full, i.e. the next stage was the bottleneck
+      size_t
+      getNumberOfWaits () const
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        return (waits_);
+      }
+
+    protected:
+      const size_t capacity_;
+      int producers_;
+      size_t max_size_;
+      size_t waits_;
+      std::deque<T> items_;
+      mutable boost::mutex mutex_;
+      boost::condition_variable not_full_;
+      boost::condition_variable not_empty_;
+  };
+}
+
+#endif  // WP2_COMMON_BOUNDED_QUEUE_H_
@@ -0,0 +1,13 @@
+//RUNTIME CPU FEATURE CHECKS FOR THE VECTORIZED KERNELS
+
+#ifndef WP2_COMMON_CPU_FEATURES_H_
+#define WP2_COMMON_CPU_FEATURES_H_
+
+namespace wp2
+{
+  //  True when the CPU runs AVX2 and FMA, checked once
+  bool
+  hasAVX2 ();
+}
+
+#endif  // WP2_COMMON_CPU_FEATURES_H_
@@ -0,0 +1,31 @@
+//CSV HELPERS SHARED BY THE PROFILER AND THE EVALUATOR
+
+#ifndef WP2_COMMON_CSV_H_
+#define WP2_COMMON_CSV_H_
+
+#include <string>
+
+namespace wp2
+{
+  //  field as is, or quoted with its quotes doubled when it holds a comma, a quote or a newline (RFC 4180)
+  inline std::string
+  csvField (const std::string &field)
+  {
+    if (field.find_first_of (",\"\n") == std::string::npos)
+    {
+      return (field);
+    }
+    std::string quoted ("\"");
+    for (size_t i = 0; i < field.size (); ++i)
+    {
+      if (field[i] == '"')
+      {
+        quoted += '"';
+      }
+      quoted += field[i];
+    }
+    return (quoted + "\"");
+  }
+}
+
+#endif  // WP2_COMMON_CSV_H_
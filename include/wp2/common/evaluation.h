@@ -0,0 +1,116 @@
+//RECOGNITION QUALITY OF A PARAMETER SET
+//EACH MODEL-SCENE PAIR IS SCORED AGAINST THE OBJECT NAMES PRESENT IN THE SCENE (ANNOTATION XML OR FILE NAME),
+//GIVING PRECISION / RECALL / F1 PER OBJECT AND OVERALL, A CONFUSION MATRIX AND THE PAIR TIMES
+
+#ifndef WP2_COMMON_EVALUATION_H_
+#define WP2_COMMON_EVALUATION_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace wp2
+{
+  class Evaluator
+  {
+    public:
+      struct Counts
+      {
+        Counts () : tp (0), fp (0), fn (0), tn (0) {}
+
+        double
+        precision () const
+        {
+          return (tp + fp > 0 ? static_cast<double> (tp) / static_cast<double> (tp + fp) : 0.0);
+        }
+
+        double
+        recall () const
+        {
+          return (tp + fn > 0 ? static_cast<double> (tp) / static_cast<double> (tp + fn) : 0.0);
+        }
+
+        double
+        f1 () const
+        {
+          const double p = precision ();
+          const double r = recall ();
+          return (p + r > 0.0 ? 2.0 * p * r / (p + r) : 0.0);
+        }
+
+        long tp, fp, fn, tn;
+      };
+
+      Evaluator () {}
+
+      //  Free text naming the parameter set, written in the summaries
+      void
+      setParameters (const std::string &parameters)
+      {
+        parameters_ = parameters;
+      }
+
+      //  A pair is a detection when instances > 0, and is correct when model_label is among scene_labels
+      void
+      addPair (const std::string &model, const std::string &scene, const std::string &model_label,
+               const std::vector<std::string> &scene_labels, long instances, double ms);
+
+      size_t
+      getNumberOfPairs () const
+      {
+        return (pairs_.size ());
+      }
+
+      //  Over all pairs
+      Counts
+      getTotals () const;
+
+      //  Per-pair scores as CSV
+      bool
+      writePairs (const std::string &filename) const;
+
+      //  Appends one line (parameters, counts, P/R/F1, pair times) to filename, with a header when it is new,
+      //  so that runs over several parameter sets build one speed / accuracy table
+      bool
+      appendSummary (const std::string &filename) const;
+
+      //  Per-object P/R/F1, totals, pair times and the confusion matrix
+      void
+      printSummary (std::ostream &os) const;
+
+      //  Object name of a file named <object>-<anything>.pcd, as in the Obj-Obj data sets
+      static std::string
+      labelFromFilename (const std::string &filename);
+
+    protected:
+      struct Pair
+      {
+        std::string model;
+        std::string scene;
+        std::string model_label;
+        bool expected;
+        long instances;
+        double ms;
+      };
+
+      //  Labels in first-seen order
+      void
+      addLabel (const std::string &label);
+
+      void
+      timeStats (double &mean, double &p50, double &p90) const;
+
+      std::string parameters_;
+      std::vector<Pair> pairs_;
+      std::vector<std::string> labels_;
+      std::map<std::string, Counts> per_label_;
+
+      //  confusion_[truth][model]: pairs where the model was found in a scene holding the truth object;
+      //  truth_pairs_[truth]: pairs run on scenes holding it
+      std::map<std::string, std::map<std::string, long> > confusion_;
+      std::map<std::string, long> truth_pairs_;
+  };
+}
+
+#endif  // WP2_COMMON_EVALUATION_H_
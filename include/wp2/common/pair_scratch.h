@@ -0,0 +1,125 @@
+//TRANSIENT BUFFERS OF ONE MODEL-SCENE PAIR
+//OWNED ONCE PER WORKER AND RESET BETWEEN PAIRS: SIZES GO TO ZERO, CAPACITY STAYS, SO A RUN STOPS ALLOCATING AFTER ITS LARGEST PAIR
+
+#ifndef WP2_COMMON_PAIR_SCRATCH_H_
+#define WP2_COMMON_PAIR_SCRATCH_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/correspondence.h>
+#include <pcl/PCLPointCloud2.h>
+#include <pcl/io/pcd_io.h>
+#include <pcl/conversions.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include <wp2/features/descriptor_matrix.h>
+
+namespace wp2
+{
+  //  The clouds are handed out as the usual shared pointers, so PCL estimators fill them in place
+  //  (pcl::Feature::compute and pcl::copyPointCloud resize, which keeps the capacity). Not thread safe:
+  //  give each worker its own.
+  template <typename PointT, typename NormalT, typename RFT>
+  class PairScratch : private boost::noncopyable
+  {
+    public:
+      typedef pcl::PointCloud<PointT> PointCloud;
+      typedef pcl::PointCloud<NormalT> NormalCloud;
+      typedef pcl::PointCloud<RFT> RFCloud;
+      typedef std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > Transforms;
+
+      PairScratch ()
+        : model_cloud (new PointCloud ())
+        , scene_cloud (new PointCloud ())
+        , model_keypoints (new PointCloud ())
+        , scene_keypoints (new PointCloud ())
+        , model_normals (new NormalCloud ())
+        , scene_normals (new NormalCloud ())
+        , model_rf (new RFCloud ())
+        , scene_rf (new RFCloud ())
+        , correspondences (new pcl::Correspondences ())
+      {
+      }
+
+      //  Start of a pair
+      void
+      reset ()
+      {
+        model_cloud->clear ();
+        scene_cloud->clear ();
+        model_keypoints->clear ();
+        scene_keypoints->clear ();
+        model_normals->clear ();
+        scene_normals->clear ();
+        model_rf->clear ();
+        scene_rf->clear ();
+        model_descriptors.resize (0, model_descriptors.dims ());
+        scene_descriptors.resize (0, scene_descriptors.dims ());
+        sampled_indices.clear ();
+        correspondences->clear ();
+        neigh_indices.clear ();
+        neigh_sqr_dists.clear ();
+        rototranslations.clear ();
+        clustered_corrs.clear ();
+      }
+
+      //  pcl::io::loadPCDFile, reading through a blob kept here instead of a fresh one per file
+      int
+      loadPCDFile (const std::string &filename, PointCloud &cloud)
+      {
+        Eigen::Vector4f origin;
+        Eigen::Quaternionf orientation;
+        int version;
+        if (reader_.read (filename, blob_, origin, orientation, version) < 0)
+        {
+          return (-1);
+        }
+        pcl::fromPCLPointCloud2 (blob_, cloud);
+        cloud.sensor_origin_ = origin;
+        cloud.sensor_orientation_ = orientation;
+        return (0);
+      }
+
+      //  Bytes held by the vectors (the descriptor matrices and FLANN are not counted)
+      size_t
+      getCapacityBytes () const
+      {
+        return ((model_cloud->points.capacity () + scene_cloud->points.capacity () +
+                 model_keypoints->points.capacity () + scene_keypoints->points.capacity ()) * sizeof (PointT) +
+                (model_normals->points.capacity () + scene_normals->points.capacity ()) * sizeof (NormalT) +
+                (model_rf->points.capacity () + scene_rf->points.capacity ()) * sizeof (RFT) +
+                sampled_indices.points.capacity () * sizeof (int) +
+                correspondences->capacity () * sizeof (pcl::Correspondence) +
+                neigh_indices.capacity () * sizeof (int) + neigh_sqr_dists.capacity () * sizeof (float) +
+                blob_.data.capacity ());
+      }
+
+      typename PointCloud::Ptr model_cloud;
+      typename PointCloud::Ptr scene_cloud;
+      typename PointCloud::Ptr model_keypoints;
+      typename PointCloud::Ptr scene_keypoints;
+      typename NormalCloud::Ptr model_normals;
+      typename NormalCloud::Ptr scene_normals;
+      typename RFCloud::Ptr model_rf;
+      typename RFCloud::Ptr scene_rf;
+      wp2::DescriptorMatrix model_descriptors;
+      wp2::DescriptorMatrix scene_descriptors;
+
+      pcl::PointCloud<int> sampled_indices;
+      pcl::CorrespondencesPtr correspondences;
+      std::vector<int> neigh_indices;
+      std::vector<float> neigh_sqr_dists;
+      Transforms rototranslations;
+      std::vector<pcl::Correspondences> clustered_corrs;
+
+    protected:
+      pcl::PCDReader reader_;
+      pcl::PCLPointCloud2 blob_;
+  };
+}
+
+#endif  // WP2_COMMON_PAIR_SCRATCH_H_
@@ -0,0 +1,134 @@
+//PER-STAGE TIMERS AND COUNTERS FOR THE RECOGNITION BINARIES
+//ONE RECORD PER MODEL-SCENE PAIR, WRITTEN AS CSV OR JSON, PLUS A RUN SUMMARY WITH PERCENTILES
+
+#ifndef WP2_COMMON_PROFILER_H_
+#define WP2_COMMON_PROFILER_H_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace wp2
+{
+  class Profiler
+  {
+    public:
+      Profiler () : enabled_ (false), open_ (false), pair_start_ (0.0) {}
+
+      //  Nothing is recorded until enabled, so the timers cost two branches when profiling is off
+      void
+      setEnabled (bool enabled)
+      {
+        enabled_ = enabled;
+      }
+
+      bool
+      isEnabled () const
+      {
+        return (enabled_);
+      }
+
+      //  Starts the record of a pair; times and counts up to endPair go to it
+      void
+      beginPair (const std::string &model, const std::string &scene);
+
+      //  Closes the record and stores its wall time as "total"
+      void
+      endPair ();
+
+      //  Times of the same stage within a pair add up (model and scene are usually timed apart)
+      void
+      addTime (const std::string &stage, double ms);
+
+      void
+      setCount (const std::string &counter, long value);
+
+      //  Per-pair records as JSON when the name ends in .json, as CSV otherwise
+      bool
+      write (const std::string &filename) const;
+
+      void
+      writeCSV (std::ostream &os) const;
+
+      void
+      writeJSON (std::ostream &os) const;
+
+      //  Count, mean, p50, p90, p99 and max of every stage over all pairs
+      void
+      printSummary (std::ostream &os) const;
+
+      size_t
+      getNumberOfPairs () const
+      {
+        return (records_.size ());
+      }
+
+      //  Monotonic clock in milliseconds
+      static double
+      now ();
+
+    protected:
+      struct Record
+      {
+        std::string model;
+        std::string scene;
+        std::map<std::string, double> times;
+        std::map<std::string, long> counts;
+      };
+
+      struct Stats
+      {
+        Stats () : n (0), mean (0.0), p50 (0.0), p90 (0.0), p99 (0.0), max (0.0) {}
+
+        size_t n;
+        double mean, p50, p90, p99, max;
+      };
+
+      Stats
+      computeStats (const std::string &stage) const;
+
+      bool enabled_;
+      bool open_;
+      double pair_start_;
+      std::vector<Record> records_;
+
+      //  Column order: stages and counters in the order they were first seen
+      std::vector<std::string> stages_;
+      std::vector<std::string> counters_;
+  };
+
+  //  Adds the time between construction and stop, or destruction, to a stage of the current pair
+  class ScopedTimer
+  {
+    public:
+      ScopedTimer (Profiler &profiler, const char *stage)
+        : profiler_ (profiler), stage_ (stage), running_ (profiler.isEnabled ()),
+          start_ (running_ ? Profiler::now () : 0.0)
+      {
+      }
+
+      ~ScopedTimer ()
+      {
+        stop ();
+      }
+
+      void
+      stop ()
+      {
+        if (running_)
+        {
+          profiler_.addTime (stage_, Profiler::now () - start_);
+          running_ = false;
+        }
+      }
+
+    private:
+      Profiler &profiler_;
+      const char *stage_;
+      bool running_;
+      double start_;
+  };
+}
+
+#endif  // WP2_COMMON_PROFILER_H_
@@ -0,0 +1,53 @@
+//CONCURRENT UNION-FIND OVER AN ARRAY OF PARENTS
+//LOCK-FREE: ROOTS ARE LINKED WITH A COMPARE-AND-SWAP, SO THREADS CAN UNITE AND FIND ON THE SAME ARRAY. THE SMALLER
+//INDEX ALWAYS ENDS UP AS THE ROOT, SO THE COMPONENTS AND THEIR ROOTS DO NOT DEPEND ON THE THREAD COUNT
+
+#ifndef WP2_COMMON_UNION_FIND_H_
+#define WP2_COMMON_UNION_FIND_H_
+
+#include <algorithm>
+
+namespace wp2
+{
+  //  Root of an element, halving the path on the way; safe while other threads unite
+  inline int
+  findRoot (volatile int *parent, int element)
+  {
+    int next;
+    while ((next = parent[element]) != element)
+    {
+      const int grand = parent[next];
+      if (grand != next)
+      {
+        __sync_bool_compare_and_swap (&parent[element], next, grand);
+      }
+      element = grand;
+    }
+    return (element);
+  }
+
+  //  The larger root is linked under the smaller one, retried until a compare-and-swap lands
+  inline void
+  unite (volatile int *parent, int a, int b)
+  {
+    while (true)
+    {
+      a = findRoot (parent, a);
+      b = findRoot (parent, b);
+      if (a == b)
+      {
+        return;
+      }
+      if (a < b)
+      {
+        std::swap (a, b);
+      }
+      if (__sync_bool_compare_and_swap (&parent[a], a, b))
+      {
+        return;
+      }
+    }
+  }
+}
+
+#endif  // WP2_COMMON_UNION_FIND_H_
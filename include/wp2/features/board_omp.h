@@ -0,0 +1,103 @@
+//MULTITHREADED BOARD LOCAL REFERENCE FRAME ESTIMATION
+//SAME FRAMES AS pcl::BOARDLocalReferenceFrameEstimation, KEYPOINTS SPLIT OVER OPENMP THREADS
+
+#ifndef WP2_FEATURES_BOARD_OMP_H_
+#define WP2_FEATURES_BOARD_OMP_H_
+
+#include <pcl/features/board.h>
+
+#include <limits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  template <typename PointInT, typename PointNT, typename PointOutT = pcl::ReferenceFrame>
+  class BOARDLocalReferenceFrameEstimationOMP : public pcl::BOARDLocalReferenceFrameEstimation<PointInT, PointNT, PointOutT>
+  {
+    public:
+      typedef boost::shared_ptr<BOARDLocalReferenceFrameEstimationOMP<PointInT, PointNT, PointOutT> > Ptr;
+      typedef boost::shared_ptr<const BOARDLocalReferenceFrameEstimationOMP<PointInT, PointNT, PointOutT> > ConstPtr;
+      typedef typename pcl::Feature<PointInT, PointOutT>::PointCloudOut PointCloudOut;
+
+      BOARDLocalReferenceFrameEstimationOMP (unsigned int nr_threads = 0) : threads_ (nr_threads)
+      {
+        this->feature_name_ = "BOARDLocalReferenceFrameEstimationOMP";
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+    protected:
+      void
+      computeFeature (PointCloudOut &output);
+
+      unsigned int threads_;
+  };
+}
+
+template <typename PointInT, typename PointNT, typename PointOutT> void
+wp2::BOARDLocalReferenceFrameEstimationOMP<PointInT, PointNT, PointOutT>::computeFeature (PointCloudOut &output)
+{
+  if (this->getKSearch () != 0)
+  {
+    PCL_ERROR ("[wp2::%s::computeFeature] Error! Search method set to k-neighborhood. Call setKSearch (0) and setRadiusSearch (radius) to use this class.\n",
+               this->getClassName ().c_str ());
+    return;
+  }
+
+#ifdef _OPENMP
+  int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#else
+  int nr_threads = 1;
+#endif
+
+  //  The hole detection scratch arrays are members of the PCL estimator, so each thread
+  //  runs computePointLRF on its own copy. The copies share the search tree, clouds and normals.
+  std::vector<BOARDLocalReferenceFrameEstimationOMP> workers (nr_threads, *this);
+  for (int t = 0; t < nr_threads; ++t)
+  {
+    workers[t].setCheckMarginArraySize (this->getCheckMarginArraySize ());
+  }
+
+  const int nr_points = static_cast<int> (this->indices_->size ());
+  int invalid_frames = 0;
+
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 32) reduction (+:invalid_frames)
+  for (int idx = 0; idx < nr_points; ++idx)
+  {
+#ifdef _OPENMP
+    BOARDLocalReferenceFrameEstimationOMP &worker = workers[omp_get_thread_num ()];
+#else
+    BOARDLocalReferenceFrameEstimationOMP &worker = workers[0];
+#endif
+    Eigen::Matrix3f current_lrf;
+    PointOutT &rf = output[idx];
+
+    if (worker.computePointLRF ((*this->indices_)[idx], current_lrf) == std::numeric_limits<float>::max ())
+    {
+      ++invalid_frames;
+    }
+
+    for (int d = 0; d < 3; ++d)
+    {
+      rf.x_axis[d] = current_lrf (0, d);
+      rf.y_axis[d] = current_lrf (1, d);
+      rf.z_axis[d] = current_lrf (2, d);
+    }
+  }
+
+  if (invalid_frames > 0)
+  {
+    output.is_dense = false;
+  }
+}
+
+#endif  // WP2_FEATURES_BOARD_OMP_H_
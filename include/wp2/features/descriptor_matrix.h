@@ -0,0 +1,123 @@
+//DESCRIPTOR STORAGE FOR MATCHING
+//ONE CONTIGUOUS, 64-BYTE ALIGNED ROW-MAJOR BLOCK OF FLOATS (ROWS PADDED TO 64 BYTES) AND A BITMAP OF THE INVALID (NaN) ROWS
+
+#ifndef WP2_FEATURES_DESCRIPTOR_MATRIX_H_
+#define WP2_FEATURES_DESCRIPTOR_MATRIX_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace wp2
+{
+  class DescriptorMatrix : private boost::noncopyable
+  {
+    public:
+      typedef boost::shared_ptr<DescriptorMatrix> Ptr;
+      typedef boost::shared_ptr<const DescriptorMatrix> ConstPtr;
+
+      //  Bytes, and floats, per alignment unit
+      static const size_t ALIGNMENT = 64;
+      static const size_t ALIGNMENT_FLOATS = ALIGNMENT / sizeof (float);
+
+      DescriptorMatrix () : data_ (NULL), capacity_ (0), rows_ (0), dims_ (0), stride_ (0) {}
+
+      DescriptorMatrix (size_t rows, size_t dims) : data_ (NULL), capacity_ (0), rows_ (0), dims_ (0), stride_ (0)
+      {
+        resize (rows, dims);
+      }
+
+      ~DescriptorMatrix ();
+
+      //  Keeps the allocation when it is large enough, so a matrix reused across pairs allocates once.
+      //  Contents are undefined afterwards; all rows are valid and row i is keypoint i.
+      void
+      resize (size_t rows, size_t dims);
+
+      size_t
+      rows () const
+      {
+        return (rows_);
+      }
+
+      size_t
+      dims () const
+      {
+        return (dims_);
+      }
+
+      //  Floats from one row to the next, dims rounded up to ALIGNMENT_FLOATS
+      size_t
+      stride () const
+      {
+        return (stride_);
+      }
+
+      float *
+      row (size_t i)
+      {
+        return (data_ + i * stride_);
+      }
+
+      const float *
+      row (size_t i) const
+      {
+        return (data_ + i * stride_);
+      }
+
+      float *
+      data ()
+      {
+        return (data_);
+      }
+
+      const float *
+      data () const
+      {
+        return (data_);
+      }
+
+      bool
+      isValid (size_t i) const
+      {
+        return (((invalid_[i >> 6] >> (i & 63)) & 1) == 0);
+      }
+
+      //  Not thread safe: rows sharing a bitmap word must not be flagged concurrently
+      void
+      setValid (size_t i, bool valid);
+
+      //  Flags the rows whose first value is not finite, as the estimators leave them
+      void
+      updateValidity ();
+
+      size_t
+      getNumberOfValid () const;
+
+      //  Moves the valid rows to the front, in order, and drops the rest. getIndex () then maps a row
+      //  back to its keypoint, so matchers can run on a dense block without checking every row.
+      void
+      compact ();
+
+      //  Keypoint of row i (i itself until compact () removes rows)
+      int
+      getIndex (size_t i) const
+      {
+        return (indices_.empty () ? static_cast<int> (i) : indices_[i]);
+      }
+
+    protected:
+      float *data_;
+      size_t capacity_;   // floats
+      size_t rows_;
+      size_t dims_;
+      size_t stride_;
+      std::vector<boost::uint64_t> invalid_;
+      std::vector<int> indices_;
+  };
+}
+
+#endif  // WP2_FEATURES_DESCRIPTOR_MATRIX_H_
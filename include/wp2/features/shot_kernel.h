@@ -0,0 +1,86 @@
+//SHOT HISTOGRAM KERNEL
+//PORT OF pcl::SHOTEstimationBase::interpolateSingleChannel AND SHOTColorEstimation::interpolateDoubleChannel
+//ON A STRUCT-OF-ARRAYS NEIGHBOURHOOD, WITH A SCALAR AND AN AVX2 PATH PICKED AT RUNTIME
+
+#ifndef WP2_FEATURES_SHOT_KERNEL_H_
+#define WP2_FEATURES_SHOT_KERNEL_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace wp2
+{
+  namespace shot
+  {
+    enum Kernel
+    {
+      KERNEL_PCL,     // leave the work to the PCL estimator (handled by the estimator classes)
+      KERNEL_AUTO,    // AVX2 when the CPU has it, scalar otherwise
+      KERNEL_SCALAR,  // double precision, same arithmetic as PCL
+      KERNEL_AVX2     // 8 neighbours per step in single precision
+    };
+
+    //  Neighbours of one keypoint. Offsets are relative to the keypoint, normals are the surface
+    //  normals as stored, color is the color distance (0..1, scaled to the bins by the kernels) and is
+    //  only read for SHOT1344. The arrays are padded to a multiple of 8 with zero distances, which the kernels skip.
+    struct Neighborhood
+    {
+      typedef std::vector<float, Eigen::aligned_allocator<float> > Array;
+
+      Neighborhood () : size (0) {}
+
+      void
+      resize (size_t n);
+
+      size_t size;
+      Array dx, dy, dz, sqr_dist, nx, ny, nz, color;
+    };
+
+    struct Params
+    {
+      Params () : radius (0.0), nr_shape_bins (10), nr_color_bins (0) {}
+
+      double radius;
+      int nr_shape_bins;  // 10 for SHOT352 and SHOT1344
+      int nr_color_bins;  // 30 for SHOT1344, 0 for shape only
+    };
+
+    //  Descriptor length for the given bins: 32 volumes of (bins + 1) per channel
+    inline int
+    descriptorLength (const Params &params)
+    {
+      return (32 * (params.nr_shape_bins + 1) + (params.nr_color_bins > 0 ? 32 * (params.nr_color_bins + 1) : 0));
+    }
+
+    //  "pcl", "scalar", "avx2" or "auto"; false if the name is none of them
+    bool
+    parseKernel (const std::string &name, Kernel &kernel);
+
+    const char *
+    kernelName (Kernel kernel);
+
+    //  Maps KERNEL_AUTO to what this CPU runs, and KERNEL_AVX2 to scalar when AVX2 is missing
+    Kernel
+    resolveKernel (Kernel kernel);
+
+    //  Adds the votes of the neighbourhood into shot, which the caller zeroes.
+    //  frame is x_axis, y_axis, z_axis as in pcl::ReferenceFrame::rf.
+    void
+    interpolate (const Neighborhood &neighborhood, const float frame[9], const Params &params, Kernel kernel, float *shot);
+
+    void
+    interpolateScalar (const Neighborhood &neighborhood, const float frame[9], const Params &params, float *shot);
+
+    void
+    interpolateAVX2 (const Neighborhood &neighborhood, const float frame[9], const Params &params, float *shot);
+
+    //  Same L2 normalization as pcl::SHOTEstimationBase::normalizeHistogram
+    void
+    normalizeHistogram (float *shot, int length);
+  }
+}
+
+#endif  // WP2_FEATURES_SHOT_KERNEL_H_
@@ -0,0 +1,146 @@
+//FUSED SHOT + BOARD LRF ESTIMATION
+//ONE RADIUS SEARCH PER KEYPOINT AT max(descr_rad, rf_rad), REUSED BY THE LRF AND BY THE SHOT BINNING
+
+#ifndef WP2_FEATURES_SHOT_LRF_H_
+#define WP2_FEATURES_SHOT_LRF_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <algorithm>
+
+#include <wp2/features/board_omp.h>
+#include <wp2/features/shot_simd.h>
+#include <wp2/search/neighborhood_cache.h>
+
+namespace wp2
+{
+  //  The BOARD frames are handed to SHOT, so each SHOT point carries both its histogram and
+  //  the frame (descriptor[] and rf[9] in one record). The same frames are also returned as a
+  //  separate cloud for Hough3DGrouping. SHOTEstimatorT needs setKernel (), as wp2::SHOTEstimationSIMD.
+  template <typename PointInT, typename PointNT, typename PointOutT = pcl::SHOT352, typename PointRFT = pcl::ReferenceFrame,
+            typename SHOTEstimatorT = wp2::SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT> >
+  class SHOTLRFEstimation
+  {
+    public:
+      typedef typename pcl::PointCloud<PointInT>::ConstPtr PointCloudInConstPtr;
+      typedef typename pcl::PointCloud<PointNT>::ConstPtr PointCloudNConstPtr;
+      typedef typename pcl::PointCloud<PointRFT>::Ptr PointCloudLRFPtr;
+
+      SHOTLRFEstimation ()
+        : cache_ (new wp2::search::NeighborhoodCache<PointInT> ())
+        , descr_rad_ (0.0f)
+        , rf_rad_ (0.0f)
+        , find_holes_ (true)
+        , threads_ (0)
+        , kernel_ (wp2::shot::KERNEL_AUTO)
+        , nr_neighbors_ (0)
+      {
+      }
+
+      void
+      setDescriptorRadius (float radius)
+      {
+        descr_rad_ = radius;
+      }
+
+      void
+      setReferenceFrameRadius (float radius)
+      {
+        rf_rad_ = radius;
+      }
+
+      void
+      setFindHoles (bool find_holes)
+      {
+        find_holes_ = find_holes;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads)
+      {
+        threads_ = nr_threads;
+      }
+
+      void
+      setKernel (wp2::shot::Kernel kernel)
+      {
+        kernel_ = kernel;
+      }
+
+      void
+      setInputCloud (const PointCloudInConstPtr &keypoints)
+      {
+        keypoints_ = keypoints;
+      }
+
+      void
+      setInputNormals (const PointCloudNConstPtr &normals)
+      {
+        normals_ = normals;
+      }
+
+      void
+      setSearchSurface (const PointCloudInConstPtr &surface)
+      {
+        surface_ = surface;
+      }
+
+      //  Number of surface points gathered by the last compute (), i.e. the size of the shared neighbour lists
+      size_t
+      getNumberOfNeighbors () const
+      {
+        return (nr_neighbors_);
+      }
+
+      //  descriptors: a pcl::PointCloud<PointOutT> or a wp2::DescriptorMatrix
+      template <typename DescriptorsT> void
+      compute (DescriptorsT &descriptors, const PointCloudLRFPtr &frames)
+      {
+        PointCloudInConstPtr surface = surface_ ? surface_ : keypoints_;
+        cache_->build (keypoints_, surface, std::max (descr_rad_, rf_rad_), threads_);
+        nr_neighbors_ = cache_->getNumberOfNeighbors ();
+
+        wp2::BOARDLocalReferenceFrameEstimationOMP<PointInT, PointNT, PointRFT> rf_est (threads_);
+        rf_est.setFindHoles (find_holes_);
+        rf_est.setRadiusSearch (rf_rad_);
+        rf_est.setSearchMethod (cache_);
+        rf_est.setInputCloud (keypoints_);
+        rf_est.setInputNormals (normals_);
+        rf_est.setSearchSurface (surface);
+        rf_est.compute (*frames);
+
+        SHOTEstimatorT descr_est;
+        if (threads_ > 0)
+        {
+          descr_est.setNumberOfThreads (threads_);
+        }
+        descr_est.setKernel (kernel_);
+        descr_est.setRadiusSearch (descr_rad_);
+        descr_est.setSearchMethod (cache_);
+        descr_est.setInputCloud (keypoints_);
+        descr_est.setInputNormals (normals_);
+        descr_est.setSearchSurface (surface);
+        descr_est.setInputReferenceFrames (frames);
+        descr_est.compute (descriptors);
+
+        cache_->clear ();
+      }
+
+    protected:
+      typename wp2::search::NeighborhoodCache<PointInT>::Ptr cache_;
+      PointCloudInConstPtr keypoints_;
+      PointCloudInConstPtr surface_;
+      PointCloudNConstPtr normals_;
+
+      float descr_rad_;
+      float rf_rad_;
+      bool find_holes_;
+      unsigned int threads_;
+      wp2::shot::Kernel kernel_;
+      size_t nr_neighbors_;
+  };
+}
+
+#endif  // WP2_FEATURES_SHOT_LRF_H_
@@ -0,0 +1,425 @@
+//VECTORIZED SHOT / COLOR SHOT ESTIMATION
+//SAME NEIGHBOURHOODS, FRAMES AND OUTPUT AS pcl::SHOTEstimationOMP / pcl::SHOTColorEstimationOMP,
+//HISTOGRAM ACCUMULATION DONE BY wp2::shot::interpolate (SCALAR OR AVX2, PICKED AT RUNTIME)
+
+#ifndef WP2_FEATURES_SHOT_SIMD_H_
+#define WP2_FEATURES_SHOT_SIMD_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/features/shot_omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/features/shot_kernel.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  namespace shot
+  {
+    //  Offsets, squared distances and normals of the neighbours of center, in search order
+    template <typename PointInT, typename PointNT> void
+    gatherNeighborhood (const PointInT &center, const pcl::PointCloud<PointInT> &surface, const pcl::PointCloud<PointNT> &normals,
+                        const std::vector<int> &indices, const std::vector<float> &sqr_dists, Neighborhood &neighborhood);
+
+    template <typename PointRFT> void
+    frameToArray (const PointRFT &frame, float rf[9])
+    {
+      for (int d = 0; d < 3; ++d)
+      {
+        rf[d + 0] = frame.x_axis[d];
+        rf[d + 3] = frame.y_axis[d];
+        rf[d + 6] = frame.z_axis[d];
+      }
+    }
+
+    template <typename PointRFT> bool
+    isFiniteFrame (const PointRFT &frame)
+    {
+      return (pcl_isfinite (frame.x_axis[0]) && pcl_isfinite (frame.y_axis[0]) && pcl_isfinite (frame.z_axis[0]));
+    }
+
+    //  Rows written by the estimators: SHOT points of a cloud, or rows of a wp2::DescriptorMatrix (no frame)
+    template <typename PointOutT> inline float *
+    descriptorRow (pcl::PointCloud<PointOutT> &output, int idx)
+    {
+      return (output.points[idx].descriptor);
+    }
+
+    inline float *
+    descriptorRow (wp2::DescriptorMatrix &output, int idx)
+    {
+      return (output.row (idx));
+    }
+
+    template <typename PointOutT> inline float *
+    frameRow (pcl::PointCloud<PointOutT> &output, int idx)
+    {
+      return (output.points[idx].rf);
+    }
+
+    inline float *
+    frameRow (wp2::DescriptorMatrix &, int)
+    {
+      return (NULL);
+    }
+  }
+
+  template <typename PointInT, typename PointNT, typename PointOutT = pcl::SHOT352, typename PointRFT = pcl::ReferenceFrame>
+  class SHOTEstimationSIMD : public pcl::SHOTEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>
+  {
+    public:
+      typedef boost::shared_ptr<SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT> > Ptr;
+      typedef boost::shared_ptr<const SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT> > ConstPtr;
+      typedef typename pcl::Feature<PointInT, PointOutT>::PointCloudOut PointCloudOut;
+
+      using pcl::Feature<PointInT, PointOutT>::compute;
+
+      SHOTEstimationSIMD (unsigned int nr_threads = 0, wp2::shot::Kernel kernel = wp2::shot::KERNEL_AUTO)
+        : nr_threads_ (0)
+        , kernel_ (kernel)
+      {
+        this->feature_name_ = "SHOTEstimationSIMD";
+        setNumberOfThreads (nr_threads);
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        nr_threads_ = nr_threads;
+        if (nr_threads > 0)
+        {
+          pcl::SHOTEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>::setNumberOfThreads (nr_threads);
+        }
+      }
+
+      //  KERNEL_PCL runs pcl::SHOTEstimationOMP unchanged
+      void
+      setKernel (wp2::shot::Kernel kernel)
+      {
+        kernel_ = kernel;
+      }
+
+      wp2::shot::Kernel
+      getKernel () const
+      {
+        return (kernel_);
+      }
+
+      //  The same descriptors written straight into a matrix, one row per keypoint, invalid rows flagged.
+      //  KERNEL_PCL goes through a PointCloudOut and copies it.
+      void
+      compute (wp2::DescriptorMatrix &output);
+
+    protected:
+      void
+      computeFeature (PointCloudOut &output);
+
+      //  Returns the number of keypoints without a frame or neighbours
+      template <typename OutputT> int
+      computeSHOT (OutputT &output);
+
+      unsigned int nr_threads_;
+      wp2::shot::Kernel kernel_;
+  };
+
+  template <typename PointInT, typename PointNT, typename PointOutT = pcl::SHOT1344, typename PointRFT = pcl::ReferenceFrame>
+  class SHOTColorEstimationSIMD : public pcl::SHOTColorEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>
+  {
+    public:
+      typedef boost::shared_ptr<SHOTColorEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT> > Ptr;
+      typedef boost::shared_ptr<const SHOTColorEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT> > ConstPtr;
+      typedef typename pcl::Feature<PointInT, PointOutT>::PointCloudOut PointCloudOut;
+
+      SHOTColorEstimationSIMD (bool describe_shape = true, bool describe_color = true, unsigned int nr_threads = 0,
+                               wp2::shot::Kernel kernel = wp2::shot::KERNEL_AUTO)
+        : pcl::SHOTColorEstimationOMP<PointInT, PointNT, PointOutT, PointRFT> (describe_shape, describe_color)
+        , nr_threads_ (0)
+        , kernel_ (kernel)
+      {
+        this->feature_name_ = "SHOTColorEstimationSIMD";
+        setNumberOfThreads (nr_threads);
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        nr_threads_ = nr_threads;
+        if (nr_threads > 0)
+        {
+          pcl::SHOTColorEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>::setNumberOfThreads (nr_threads);
+        }
+      }
+
+      //  KERNEL_PCL runs pcl::SHOTColorEstimationOMP unchanged, as does a shape-only or color-only setup
+      void
+      setKernel (wp2::shot::Kernel kernel)
+      {
+        kernel_ = kernel;
+      }
+
+      wp2::shot::Kernel
+      getKernel () const
+      {
+        return (kernel_);
+      }
+
+    protected:
+      void
+      computeFeature (PointCloudOut &output);
+
+      unsigned int nr_threads_;
+      wp2::shot::Kernel kernel_;
+  };
+}
+
+template <typename PointInT, typename PointNT> void
+wp2::shot::gatherNeighborhood (const PointInT &center, const pcl::PointCloud<PointInT> &surface, const pcl::PointCloud<PointNT> &normals,
+                               const std::vector<int> &indices, const std::vector<float> &sqr_dists, Neighborhood &neighborhood)
+{
+  neighborhood.resize (indices.size ());
+  for (size_t i = 0; i < indices.size (); ++i)
+  {
+    const PointInT &point = surface[indices[i]];
+    const PointNT &normal = normals[indices[i]];
+    neighborhood.dx[i] = point.x - center.x;
+    neighborhood.dy[i] = point.y - center.y;
+    neighborhood.dz[i] = point.z - center.z;
+    neighborhood.sqr_dist[i] = sqr_dists[i];
+    neighborhood.nx[i] = normal.normal_x;
+    neighborhood.ny[i] = normal.normal_y;
+    neighborhood.nz[i] = normal.normal_z;
+  }
+}
+
+template <typename PointInT, typename PointNT, typename PointOutT, typename PointRFT> void
+wp2::SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT>::computeFeature (PointCloudOut &output)
+{
+  if (kernel_ == wp2::shot::KERNEL_PCL)
+  {
+    pcl::SHOTEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>::computeFeature (output);
+    return;
+  }
+
+  output.is_dense = computeSHOT (output) == 0;
+}
+
+template <typename PointInT, typename PointNT, typename PointOutT, typename PointRFT> void
+wp2::SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT>::compute (wp2::DescriptorMatrix &output)
+{
+  if (kernel_ == wp2::shot::KERNEL_PCL)
+  {
+    PointCloudOut cloud;
+    pcl::Feature<PointInT, PointOutT>::compute (cloud);
+    output.resize (cloud.size (), this->descLength_);
+    for (size_t i = 0; i < cloud.size (); ++i)
+    {
+      std::copy (cloud[i].descriptor, cloud[i].descriptor + this->descLength_, output.row (i));
+    }
+    output.updateValidity ();
+    return;
+  }
+
+  if (!this->initCompute ())
+  {
+    output.resize (0, 0);
+    return;
+  }
+
+  output.resize (this->indices_->size (), this->nr_grid_sector_ * (this->nr_shape_bins_ + 1));
+  computeSHOT (output);
+  output.updateValidity ();
+  this->deinitCompute ();
+}
+
+template <typename PointInT, typename PointNT, typename PointOutT, typename PointRFT> template <typename OutputT> int
+wp2::SHOTEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT>::computeSHOT (OutputT &output)
+{
+  this->descLength_ = this->nr_grid_sector_ * (this->nr_shape_bins_ + 1);
+
+  wp2::shot::Params params;
+  params.radius = this->search_radius_;
+  params.nr_shape_bins = this->nr_shape_bins_;
+  params.nr_color_bins = 0;
+  const wp2::shot::Kernel kernel = wp2::shot::resolveKernel (kernel_);
+
+#ifdef _OPENMP
+  int nr_threads = nr_threads_ == 0 ? omp_get_num_procs () : static_cast<int> (nr_threads_);
+#else
+  int nr_threads = 1;
+#endif
+
+  const int data_size = static_cast<int> (this->indices_->size ());
+  const float nan = std::numeric_limits<float>::quiet_NaN ();
+  int invalid_points = 0;
+
+#pragma omp parallel num_threads (nr_threads) reduction (+:invalid_points)
+  {
+    std::vector<int> nn_indices;
+    std::vector<float> nn_dists;
+    wp2::shot::Neighborhood neighborhood;
+    std::vector<float> shot (this->descLength_);
+    float rf[9];
+
+#pragma omp for schedule (dynamic, 32)
+    for (int idx = 0; idx < data_size; ++idx)
+    {
+      float *descriptor = wp2::shot::descriptorRow (output, idx);
+      float *out_rf = wp2::shot::frameRow (output, idx);
+      const PointRFT &frame = (*this->frames_)[idx];
+      const int index = (*this->indices_)[idx];
+
+      if (!wp2::shot::isFiniteFrame (frame) || !pcl::isFinite ((*this->input_)[index]) ||
+          this->searchForNeighbors (index, this->search_parameter_, nn_indices, nn_dists) == 0)
+      {
+        std::fill (descriptor, descriptor + this->descLength_, nan);
+        if (out_rf)
+        {
+          std::fill (out_rf, out_rf + 9, nan);
+        }
+        ++invalid_points;
+        continue;
+      }
+
+      wp2::shot::frameToArray (frame, rf);
+      if (out_rf)
+      {
+        std::copy (rf, rf + 9, out_rf);
+      }
+
+      //  Same cut as pcl::SHOTEstimation::computePointSHOT
+      if (nn_indices.size () < 5)
+      {
+        std::fill (descriptor, descriptor + this->descLength_, nan);
+        continue;
+      }
+
+      wp2::shot::gatherNeighborhood ((*this->input_)[index], *this->surface_, *this->normals_, nn_indices, nn_dists, neighborhood);
+      std::fill (shot.begin (), shot.end (), 0.0f);
+      wp2::shot::interpolate (neighborhood, rf, params, kernel, &shot[0]);
+      wp2::shot::normalizeHistogram (&shot[0], this->descLength_);
+      std::copy (shot.begin (), shot.end (), descriptor);
+    }
+  }
+
+  return (invalid_points);
+}
+
+template <typename PointInT, typename PointNT, typename PointOutT, typename PointRFT> void
+wp2::SHOTColorEstimationSIMD<PointInT, PointNT, PointOutT, PointRFT>::computeFeature (PointCloudOut &output)
+{
+  if (kernel_ == wp2::shot::KERNEL_PCL || !this->b_describe_shape_ || !this->b_describe_color_)
+  {
+    pcl::SHOTColorEstimationOMP<PointInT, PointNT, PointOutT, PointRFT>::computeFeature (output);
+    return;
+  }
+
+  this->descLength_ = this->nr_grid_sector_ * (this->nr_shape_bins_ + 1) + this->nr_grid_sector_ * (this->nr_color_bins_ + 1);
+
+  wp2::shot::Params params;
+  params.radius = this->search_radius_;
+  params.nr_shape_bins = this->nr_shape_bins_;
+  params.nr_color_bins = this->nr_color_bins_;
+  const wp2::shot::Kernel kernel = wp2::shot::resolveKernel (kernel_);
+
+#ifdef _OPENMP
+  int nr_threads = nr_threads_ == 0 ? omp_get_num_procs () : static_cast<int> (nr_threads_);
+#else
+  int nr_threads = 1;
+#endif
+
+  //  Normalized Lab of every surface point once, instead of once per (keypoint, neighbour) pair.
+  //  The first call fills the static conversion tables before the threads share them.
+  float L0, A0, B0;
+  this->RGB2CIELAB (0, 0, 0, L0, A0, B0);
+
+  const int surface_size = static_cast<int> (this->surface_->size ());
+  std::vector<float> lab (3 * surface_size);
+
+#pragma omp parallel for num_threads (nr_threads)
+  for (int i = 0; i < surface_size; ++i)
+  {
+    const PointInT &point = (*this->surface_)[i];
+    float L, A, B;
+    this->RGB2CIELAB (point.r, point.g, point.b, L, A, B);
+    lab[3 * i + 0] = L / 100.0f;
+    lab[3 * i + 1] = A / 120.0f;
+    lab[3 * i + 2] = B / 120.0f;
+  }
+
+  const int data_size = static_cast<int> (this->indices_->size ());
+  const float nan = std::numeric_limits<float>::quiet_NaN ();
+  int invalid_points = 0;
+
+#pragma omp parallel num_threads (nr_threads) reduction (+:invalid_points)
+  {
+    std::vector<int> nn_indices;
+    std::vector<float> nn_dists;
+    wp2::shot::Neighborhood neighborhood;
+    std::vector<float> shot (this->descLength_);
+    float rf[9];
+
+#pragma omp for schedule (dynamic, 32)
+    for (int idx = 0; idx < data_size; ++idx)
+    {
+      PointOutT &out = output.points[idx];
+      const PointRFT &frame = (*this->frames_)[idx];
+      const int index = (*this->indices_)[idx];
+
+      if (!wp2::shot::isFiniteFrame (frame) || !pcl::isFinite ((*this->input_)[index]) ||
+          this->searchForNeighbors (index, this->search_parameter_, nn_indices, nn_dists) == 0)
+      {
+        std::fill (out.descriptor, out.descriptor + this->descLength_, nan);
+        std::fill (out.rf, out.rf + 9, nan);
+        ++invalid_points;
+        continue;
+      }
+
+      wp2::shot::frameToArray (frame, rf);
+      std::copy (rf, rf + 9, out.rf);
+
+      if (nn_indices.size () < 5)
+      {
+        std::fill (out.descriptor, out.descriptor + this->descLength_, nan);
+        continue;
+      }
+
+      wp2::shot::gatherNeighborhood ((*this->input_)[index], *this->surface_, *this->normals_, nn_indices, nn_dists, neighborhood);
+
+      //  Color bin distance as in pcl::SHOTColorEstimation::computePointSHOT
+      const PointInT &center = (*this->input_)[index];
+      float LRef, aRef, bRef;
+      this->RGB2CIELAB (center.r, center.g, center.b, LRef, aRef, bRef);
+      LRef /= 100.0f;
+      aRef /= 120.0f;
+      bRef /= 120.0f;
+      for (size_t i = 0; i < nn_indices.size (); ++i)
+      {
+        const float *neighbor_lab = &lab[3 * nn_indices[i]];
+        double colorDistance = (std::fabs (LRef - neighbor_lab[0]) + ((std::fabs (aRef - neighbor_lab[1]) + std::fabs (bRef - neighbor_lab[2])) / 2)) / 3;
+        colorDistance = std::max (0.0, std::min (colorDistance, 1.0));
+        //  Exact in float, as the terms are; the kernels scale it to the bins
+        neighborhood.color[i] = static_cast<float> (colorDistance);
+      }
+
+      std::fill (shot.begin (), shot.end (), 0.0f);
+      wp2::shot::interpolate (neighborhood, rf, params, kernel, &shot[0]);
+      wp2::shot::normalizeHistogram (&shot[0], this->descLength_);
+      std::copy (shot.begin (), shot.end (), out.descriptor);
+    }
+  }
+
+  output.is_dense = invalid_points == 0;
+}
+
+#endif  // WP2_FEATURES_SHOT_SIMD_H_
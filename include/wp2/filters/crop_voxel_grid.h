@@ -0,0 +1,332 @@
+//FUSED CROP, NAN REMOVAL AND VOXEL GRID
+//ONE PARALLEL PASS OVER THE INPUT: EVERY THREAD TAKES A RANGE OF POINTS, DROPS THE NON-FINITE ONES AND THOSE WHOSE
+//VOXEL CANNOT REACH THE BOX, AND ADDS THE REST TO ITS OWN VOXEL SUMS, WHICH ARE THEN MERGED BY PARTITION. NO
+//INTERMEDIATE CLOUD IS MADE, UNLIKE A VOXELGRID -> PASSTHROUGH -> PASSTHROUGH CHAIN
+
+#ifndef WP2_FILTERS_CROP_VOXEL_GRID_H_
+#define WP2_FILTERS_CROP_VOXEL_GRID_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/console/print.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <wp2/filters/voxel_sum.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  //  Keeps the finite points within the limits on x, y and z (inclusive, as pcl::PassThrough) and, with a leaf size,
+  //  replaces them by the centroid of each voxel as pcl::VoxelGrid does. With a leaf size the box is applied to the
+  //  centroids, as a pcl::PassThrough after the pcl::VoxelGrid: every point of a voxel is averaged, also those outside
+  //  the box, and only points more than a leaf away from it are dropped before.
+  template <typename PointT>
+  class CropVoxelGrid
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+      typedef boost::shared_ptr<const std::vector<int> > IndicesConstPtr;
+
+      CropVoxelGrid (unsigned int nr_threads = 0)
+        : leaf_size_ (0.0f)
+        , min_points_ (0)
+        , threads_ (nr_threads)
+      {
+        for (int d = 0; d < 3; ++d)
+        {
+          min_[d] = -std::numeric_limits<float>::max ();
+          max_[d] = std::numeric_limits<float>::max ();
+        }
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      //  Only these points are filtered; all of them by default
+      void
+      setIndices (const IndicesConstPtr &indices)
+      {
+        indices_ = indices;
+      }
+
+      //  Limits on "x", "y" or "z"; each call adds to the box
+      bool
+      setFilterLimits (const std::string &field_name, float min, float max)
+      {
+        const int d = field_name == "x" ? 0 : field_name == "y" ? 1 : field_name == "z" ? 2 : -1;
+        if (d < 0)
+        {
+          PCL_ERROR ("[wp2::CropVoxelGrid::setFilterLimits] Error! Unknown field %s\n", field_name.c_str ());
+          return (false);
+        }
+        min_[d] = min;
+        max_[d] = max;
+        return (true);
+      }
+
+      //  0 keeps every point in the box
+      void
+      setLeafSize (float leaf_size)
+      {
+        leaf_size_ = leaf_size;
+      }
+
+      //  Voxels with fewer points are left out
+      void
+      setMinimumPointsNumberPerVoxel (unsigned int min_points)
+      {
+        min_points_ = min_points;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      void
+      filter (pcl::PointCloud<PointT> &output);
+
+      //  Indices of the points in the box, ascending; the leaf size is not used
+      void
+      filter (std::vector<int> &indices);
+
+    protected:
+      //  Within the box grown by margin on every side
+      bool
+      inside (const PointT &p, float margin = 0.0f) const
+      {
+        return ((boost::math::isfinite) (p.x) && (boost::math::isfinite) (p.y) && (boost::math::isfinite) (p.z) &&
+                p.x >= min_[0] - margin && p.x <= max_[0] + margin && p.y >= min_[1] - margin &&
+                p.y <= max_[1] + margin && p.z >= min_[2] - margin && p.z <= max_[2] + margin);
+      }
+
+      int
+      getNumberOfThreads () const
+      {
+#ifdef _OPENMP
+        return (threads_ == 0 ? omp_get_num_procs () : threads_);
+#else
+        return (1);
+#endif
+      }
+
+      //  Points in the box of every range, one range per thread
+      void
+      cropRanges (std::vector<std::vector<int> > &kept);
+
+      //  Voxel sums of the points of the voxels that reach into the box, one map per partition of the keys
+      void
+      voxelize (std::vector<detail::VoxelSumMap> &partitions);
+
+      PointCloudConstPtr input_;
+      IndicesConstPtr indices_;
+      float min_[3];
+      float max_[3];
+      float leaf_size_;
+      unsigned int min_points_;
+      unsigned int threads_;
+  };
+}
+
+template <typename PointT> void
+wp2::CropVoxelGrid<PointT>::cropRanges (std::vector<std::vector<int> > &kept)
+{
+  const int nr_threads = getNumberOfThreads ();
+  const long nr_points = static_cast<long> (indices_ ? indices_->size () : input_->points.size ());
+  kept.assign (nr_threads, std::vector<int> ());
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) schedule(static, 1)
+#endif
+  for (int t = 0; t < nr_threads; ++t)
+  {
+    const long begin = nr_points * t / nr_threads;
+    const long end = nr_points * (t + 1) / nr_threads;
+    for (long i = begin; i < end; ++i)
+    {
+      const int index = indices_ ? (*indices_)[i] : static_cast<int> (i);
+      if (inside (input_->points[index]))
+      {
+        kept[t].push_back (index);
+      }
+    }
+  }
+}
+
+template <typename PointT> void
+wp2::CropVoxelGrid<PointT>::voxelize (std::vector<detail::VoxelSumMap> &partitions)
+{
+  const int nr_threads = getNumberOfThreads ();
+  const long nr_points = static_cast<long> (indices_ ? indices_->size () : input_->points.size ());
+  const float inverse_leaf = 1.0f / leaf_size_;
+
+  //  Every thread sums its own range of points
+  std::vector<detail::VoxelSumMap> ranges (nr_threads);
+  long nr_out_of_range = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) schedule(static, 1) reduction(+:nr_out_of_range)
+#endif
+  for (int t = 0; t < nr_threads; ++t)
+  {
+    const long begin = nr_points * t / nr_threads;
+    const long end = nr_points * (t + 1) / nr_threads;
+    detail::VoxelSumMap &voxels = ranges[t];
+    for (long i = begin; i < end; ++i)
+    {
+      //  A voxel reaching into the box has all its points within a leaf of it; the others cannot give a centroid
+      //  in the box
+      const PointT &p = input_->points[indices_ ? (*indices_)[i] : i];
+      if (!inside (p, leaf_size_))
+      {
+        continue;
+      }
+      const unsigned long long key = detail::voxelKey (p.x, p.y, p.z, inverse_leaf);
+      if (key == detail::INVALID_VOXEL)
+      {
+        ++nr_out_of_range;
+        continue;
+      }
+      detail::VoxelSum &voxel = voxels[key];
+      voxel.add (p.x, p.y, p.z);
+      unsigned int rgba;
+      if (detail::getPointColor (p, rgba))
+      {
+        voxel.addColor (rgba);
+      }
+    }
+  }
+  if (nr_out_of_range > 0)
+  {
+    PCL_WARN ("[wp2::CropVoxelGrid::filter] %ld points are too far for leaf size %f and were dropped\n",
+              nr_out_of_range, leaf_size_);
+  }
+
+  if (nr_threads == 1)
+  {
+    partitions.swap (ranges);
+    return;
+  }
+
+  //  A voxel cut by the range boundaries is in several maps; every partition gathers its voxels from all of them
+  partitions.assign (nr_threads, detail::VoxelSumMap ());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) schedule(dynamic, 1)
+#endif
+  for (int t = 0; t < nr_threads; ++t)
+  {
+    for (int r = 0; r < nr_threads; ++r)
+    {
+      for (detail::VoxelSumMap::const_iterator it = ranges[r].begin (); it != ranges[r].end (); ++it)
+      {
+        if (detail::voxelPartition (it->first, nr_threads) == static_cast<unsigned int> (t))
+        {
+          partitions[t][it->first] += it->second;
+        }
+      }
+    }
+  }
+}
+
+template <typename PointT> void
+wp2::CropVoxelGrid<PointT>::filter (std::vector<int> &indices)
+{
+  indices.clear ();
+  if (!input_)
+  {
+    PCL_ERROR ("[wp2::CropVoxelGrid::filter] Error! No input cloud\n");
+    return;
+  }
+
+  std::vector<std::vector<int> > kept;
+  cropRanges (kept);
+  for (size_t t = 0; t < kept.size (); ++t)
+  {
+    indices.insert (indices.end (), kept[t].begin (), kept[t].end ());
+  }
+  if (indices_)
+  {
+    std::sort (indices.begin (), indices.end ());
+  }
+}
+
+template <typename PointT> void
+wp2::CropVoxelGrid<PointT>::filter (pcl::PointCloud<PointT> &output)
+{
+  output.points.clear ();
+  output.width = 0;
+  output.height = 1;
+  output.is_dense = true;
+  if (!input_)
+  {
+    PCL_ERROR ("[wp2::CropVoxelGrid::filter] Error! No input cloud\n");
+    return;
+  }
+  output.header = input_->header;
+  output.sensor_origin_ = input_->sensor_origin_;
+  output.sensor_orientation_ = input_->sensor_orientation_;
+
+  if (leaf_size_ <= 0.0f)
+  {
+    //  Ranges are in input order, so the points are copied straight to their place
+    std::vector<std::vector<int> > kept;
+    cropRanges (kept);
+    std::vector<size_t> offsets (kept.size () + 1, 0);
+    for (size_t t = 0; t < kept.size (); ++t)
+    {
+      offsets[t + 1] = offsets[t] + kept[t].size ();
+    }
+    output.points.resize (offsets.back ());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(static_cast<int> (kept.size ())) schedule(static, 1)
+#endif
+    for (int t = 0; t < static_cast<int> (kept.size ()); ++t)
+    {
+      for (size_t i = 0; i < kept[t].size (); ++i)
+      {
+        output.points[offsets[t] + i] = input_->points[kept[t][i]];
+      }
+    }
+  }
+  else
+  {
+    std::vector<detail::VoxelSumMap> partitions;
+    voxelize (partitions);
+
+    std::vector<std::pair<unsigned long long, const detail::VoxelSum *> > voxels;
+    for (size_t t = 0; t < partitions.size (); ++t)
+    {
+      for (detail::VoxelSumMap::const_iterator it = partitions[t].begin (); it != partitions[t].end (); ++it)
+      {
+        if (it->second.count >= min_points_ && detail::centroidInside (it->second, min_, max_))
+        {
+          voxels.push_back (std::make_pair (it->first, &it->second));
+        }
+      }
+    }
+    std::sort (voxels.begin (), voxels.end ());
+
+    output.points.resize (voxels.size ());
+    for (size_t i = 0; i < voxels.size (); ++i)
+    {
+      detail::getVoxelCentroid (*voxels[i].second, output.points[i]);
+    }
+  }
+  output.width = static_cast<uint32_t> (output.points.size ());
+}
+
+#endif  // WP2_FILTERS_CROP_VOXEL_GRID_H_
@@ -0,0 +1,165 @@
+//STREAMING VOXEL GRID
+//A PCD FILE IS READ IN BLOCKS OF POINTS THAT ARE HASHED IN PARALLEL INTO PER-VOXEL SUMS AND THEN DROPPED, SO MEMORY
+//GROWS WITH THE OCCUPIED VOXELS AND NOT WITH THE INPUT. SEVERAL FILES (E.G. THE FRAMES OF A MERGED CLOUD) CAN GO
+//INTO THE SAME GRID BEFORE THE CENTROIDS ARE TAKEN OUT
+
+#ifndef WP2_FILTERS_STREAMING_VOXEL_GRID_H_
+#define WP2_FILTERS_STREAMING_VOXEL_GRID_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <string>
+#include <vector>
+
+#include <wp2/filters/voxel_sum.h>
+
+namespace wp2
+{
+  //  Same centroids as pcl::VoxelGrid with downsampling of all data: the mean of x, y, z and, when the file has an rgb
+  //  or rgba field, of every colour channel, over the finite points of each voxel, ordered by voxel. Binary and ASCII
+  //  PCD files are streamed; binary_compressed ones cannot be read in parts, so their data is decompressed whole
+  //  (see getNumberOfDecompressedPoints).
+  class StreamingVoxelGrid : private boost::noncopyable
+  {
+    public:
+      StreamingVoxelGrid (unsigned int nr_threads = 0);
+
+      //  Clears the grid
+      void
+      setLeafSize (float leaf_size)
+      {
+        leaf_size_ = leaf_size;
+        clear ();
+      }
+
+      float
+      getLeafSize () const
+      {
+        return (leaf_size_);
+      }
+
+      //  Only centroids within the limits on "x", "y" or "z" (inclusive) are returned, as by a pcl::PassThrough after
+      //  the pcl::VoxelGrid; points more than a leaf away from the box are not hashed. Each call adds to the box
+      bool
+      setFilterLimits (const std::string &field_name, float min, float max);
+
+      //  Points read per block; the block buffers are the only memory that depends on the input
+      void
+      setBlockSize (size_t nr_points)
+      {
+        block_size_ = nr_points > 0 ? nr_points : 1;
+      }
+
+      //  Voxels with fewer points are left out of the centroids
+      void
+      setMinimumPointsNumberPerVoxel (unsigned int min_points)
+      {
+        min_points_ = min_points;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      //  Adds the points of a PCD file to the grid; false if it cannot be read, has no float x, y, z, or does not fit
+      //  in the grid (more than 2^20 voxels from the origin along an axis)
+      bool
+      addFile (const std::string &filename);
+
+      //  Adds points given as x, y, z (and packed colour, may be NULL) arrays
+      void
+      addPoints (const float *x, const float *y, const float *z, const unsigned int *rgba, size_t nr_points);
+
+      //  Centroids of the voxels with enough points; colour channels are filled when PointT has them
+      template <typename PointT> void
+      getCentroids (pcl::PointCloud<PointT> &output) const;
+
+      void
+      clear ();
+
+      //  Points added, finite or not
+      size_t
+      getNumberOfPoints () const
+      {
+        return (nr_points_);
+      }
+
+      //  Points of the binary_compressed files added: their whole data was held in memory at once, so the memory
+      //  bound of the grid did not hold for them
+      size_t
+      getNumberOfDecompressedPoints () const
+      {
+        return (nr_decompressed_);
+      }
+
+      size_t
+      getNumberOfVoxels () const;
+
+      //  Of the first file added; a frame (height > 1) is better kept whole
+      bool
+      isOrganized () const
+      {
+        return (organized_);
+      }
+
+    protected:
+      //  Voxels with enough points and their centroid in the box, by key
+      void
+      getVoxels (std::vector<const detail::VoxelSum *> &voxels) const;
+
+      //  Points of binary records at byte offsets of the fields (rgba_offset < 0: no colour)
+      void
+      addRecords (const unsigned char *data, size_t nr_points, size_t point_step, int x_offset, int y_offset,
+                  int z_offset, int rgba_offset);
+
+      //  Points of ASCII lines at token positions of the fields (rgba_token < 0: no colour)
+      void
+      addLines (const std::vector<std::string> &lines, int x_token, int y_token, int z_token, int rgba_token,
+                bool rgba_float);
+
+      float leaf_size_;
+      float min_[3];
+      float max_[3];
+      size_t block_size_;
+      unsigned int min_points_;
+      unsigned int threads_;
+
+      //  One map per partition of the keys, each filled by one thread; the partition count is fixed by the first add
+      std::vector<detail::VoxelSumMap> partitions_;
+      bool has_color_;
+      bool organized_;
+      size_t nr_points_;
+      size_t nr_out_of_range_;
+      size_t nr_decompressed_;
+
+      //  Block buffers
+      std::vector<float> x_, y_, z_;
+      std::vector<unsigned int> rgba_;
+      std::vector<unsigned long long> keys_;
+      std::vector<unsigned int> key_partitions_;
+      std::vector<size_t> order_;
+  };
+}
+
+template <typename PointT> void
+wp2::StreamingVoxelGrid::getCentroids (pcl::PointCloud<PointT> &output) const
+{
+  std::vector<const detail::VoxelSum *> voxels;
+  getVoxels (voxels);
+  output.points.resize (voxels.size ());
+  output.width = static_cast<uint32_t> (voxels.size ());
+  output.height = 1;
+  output.is_dense = true;
+  for (size_t i = 0; i < voxels.size (); ++i)
+  {
+    detail::getVoxelCentroid (*voxels[i], output.points[i]);
+  }
+}
+
+#endif  // WP2_FILTERS_STREAMING_VOXEL_GRID_H_
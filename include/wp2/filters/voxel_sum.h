@@ -0,0 +1,175 @@
+//PER-VOXEL SUMS SHARED BY THE VOXEL GRID FILTERS
+//A VOXEL IS KEYED BY ITS PACKED GRID COORDINATES AND HOLDS THE SUMS OF ITS POINTS, SO THAT VOXELS FILLED FROM
+//SEPARATE BLOCKS OR THREADS ARE MERGED BY ADDING THEM
+
+#ifndef WP2_FILTERS_VOXEL_SUM_H_
+#define WP2_FILTERS_VOXEL_SUM_H_
+
+#include <pcl/point_types.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <cmath>
+
+namespace wp2
+{
+  namespace detail
+  {
+    const unsigned long long INVALID_VOXEL = ~0ull;
+    const long long VOXEL_KEY_BITS = 21;
+    const long long VOXEL_KEY_HALF = 1ll << (VOXEL_KEY_BITS - 1);
+
+    //  21 bits per axis around the origin, z major as the voxel index of pcl::VoxelGrid, so that sorted keys give its
+    //  output order; INVALID_VOXEL for a non-finite point or one more than 2^20 voxels away along an axis
+    inline unsigned long long
+    voxelKey (float x, float y, float z, float inverse_leaf)
+    {
+      if (!(boost::math::isfinite) (x) || !(boost::math::isfinite) (y) || !(boost::math::isfinite) (z))
+      {
+        return (INVALID_VOXEL);
+      }
+      const float fx = std::floor (x * inverse_leaf);
+      const float fy = std::floor (y * inverse_leaf);
+      const float fz = std::floor (z * inverse_leaf);
+      if (std::fabs (fx) >= VOXEL_KEY_HALF || std::fabs (fy) >= VOXEL_KEY_HALF || std::fabs (fz) >= VOXEL_KEY_HALF)
+      {
+        return (INVALID_VOXEL);
+      }
+      const unsigned long long ix = static_cast<unsigned long long> (static_cast<long long> (fx) + VOXEL_KEY_HALF);
+      const unsigned long long iy = static_cast<unsigned long long> (static_cast<long long> (fy) + VOXEL_KEY_HALF);
+      const unsigned long long iz = static_cast<unsigned long long> (static_cast<long long> (fz) + VOXEL_KEY_HALF);
+      return ((iz << (2 * VOXEL_KEY_BITS)) | (iy << VOXEL_KEY_BITS) | ix);
+    }
+
+    //  Spreads neighbouring voxels over the partitions
+    inline unsigned int
+    voxelPartition (unsigned long long key, unsigned int nr_partitions)
+    {
+      return (static_cast<unsigned int> (((key * 0x9E3779B97F4A7C15ull) >> 40) % nr_partitions));
+    }
+
+    struct VoxelSum
+    {
+      VoxelSum () : x (0.0), y (0.0), z (0.0), r (0.0), g (0.0), b (0.0), a (0.0), count (0), nr_colored (0) {}
+
+      void
+      add (float px, float py, float pz)
+      {
+        x += px;
+        y += py;
+        z += pz;
+        ++count;
+      }
+
+      void
+      addColor (unsigned int rgba)
+      {
+        r += (rgba >> 16) & 0xff;
+        g += (rgba >> 8) & 0xff;
+        b += rgba & 0xff;
+        a += (rgba >> 24) & 0xff;
+        ++nr_colored;
+      }
+
+      VoxelSum &
+      operator += (const VoxelSum &other)
+      {
+        x += other.x;
+        y += other.y;
+        z += other.z;
+        r += other.r;
+        g += other.g;
+        b += other.b;
+        a += other.a;
+        count += other.count;
+        nr_colored += other.nr_colored;
+        return (*this);
+      }
+
+      double x, y, z;
+      double r, g, b, a;
+      unsigned int count;
+      unsigned int nr_colored;  // points that came with a colour
+    };
+
+    typedef boost::unordered_map<unsigned long long, VoxelSum> VoxelSumMap;
+
+    //  Whether the centroid of a voxel is within the limits (inclusive, as pcl::PassThrough), in the float precision of
+    //  getVoxelCentroid
+    inline bool
+    centroidInside (const VoxelSum &voxel, const float *min, const float *max)
+    {
+      const float x = static_cast<float> (voxel.x / voxel.count);
+      const float y = static_cast<float> (voxel.y / voxel.count);
+      const float z = static_cast<float> (voxel.z / voxel.count);
+      return (x >= min[0] && x <= max[0] && y >= min[1] && y <= max[1] && z >= min[2] && z <= max[2]);
+    }
+
+    //  Packed colour of a point, for the point types that have one
+    template <typename PointT> inline bool
+    getPointColor (const PointT &, unsigned int &)
+    {
+      return (false);
+    }
+
+    inline bool
+    getPointColor (const pcl::PointXYZRGB &p, unsigned int &rgba)
+    {
+      rgba = p.rgba;
+      return (true);
+    }
+
+    inline bool
+    getPointColor (const pcl::PointXYZRGBA &p, unsigned int &rgba)
+    {
+      rgba = p.rgba;
+      return (true);
+    }
+
+    template <typename PointT> inline void
+    setCentroidColor (PointT &, unsigned char, unsigned char, unsigned char, unsigned char)
+    {
+    }
+
+    inline void
+    setCentroidColor (pcl::PointXYZRGB &p, unsigned char r, unsigned char g, unsigned char b, unsigned char)
+    {
+      p.r = r;
+      p.g = g;
+      p.b = b;
+    }
+
+    inline void
+    setCentroidColor (pcl::PointXYZRGBA &p, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+    {
+      p.r = r;
+      p.g = g;
+      p.b = b;
+      p.a = a;
+    }
+
+    //  Mean of the points of a voxel; colour channels truncated, as pcl::VoxelGrid packs them, and averaged over the
+    //  points that had a colour
+    template <typename PointT> inline void
+    getVoxelCentroid (const VoxelSum &voxel, PointT &p)
+    {
+      p.x = static_cast<float> (voxel.x / voxel.count);
+      p.y = static_cast<float> (voxel.y / voxel.count);
+      p.z = static_cast<float> (voxel.z / voxel.count);
+      if (voxel.nr_colored > 0)
+      {
+        setCentroidColor (p, static_cast<unsigned char> (voxel.r / voxel.nr_colored),
+                          static_cast<unsigned char> (voxel.g / voxel.nr_colored),
+                          static_cast<unsigned char> (voxel.b / voxel.nr_colored),
+                          static_cast<unsigned char> (voxel.a / voxel.nr_colored));
+      }
+      else
+      {
+        setCentroidColor (p, 0, 0, 0, 0);
+      }
+    }
+  }
+}
+
+#endif  // WP2_FILTERS_VOXEL_SUM_H_
@@ -0,0 +1,158 @@
+//ASYNCHRONOUS PCD WRITER
+//FILES ARE WRITTEN BY ONE BACKGROUND THREAD IN THE ORDER THEY ARE QUEUED, SO SEGMENTATION GOES ON WHILE THE DISK WORKS.
+//A FILE CAN BE A SUBSET OF A SHARED CLOUD, GIVEN BY INDICES: THE POINTS ARE NEVER COPIED ON THE CALLER'S THREAD
+
+#ifndef WP2_IO_ASYNC_PCD_WRITER_H_
+#define WP2_IO_ASYNC_PCD_WRITER_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/io/pcd_io.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace wp2
+{
+  template <typename PointT>
+  class AsyncPCDWriter : private boost::noncopyable
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+      typedef boost::shared_ptr<const std::vector<int> > IndicesConstPtr;
+
+      AsyncPCDWriter (bool binary = false);
+
+      //  Writes what is still queued
+      ~AsyncPCDWriter ();
+
+      //  The cloud (and indices) must not change until the file is written; hand over clouds no one modifies
+      void
+      write (const std::string &filename, const PointCloudConstPtr &cloud, const IndicesConstPtr &indices = IndicesConstPtr ());
+
+      //  Waits until every queued file is written; returns the number of failed writes so far
+      int
+      flush ();
+
+    protected:
+      struct Job
+      {
+        std::string filename;
+        PointCloudConstPtr cloud;
+        IndicesConstPtr indices;
+      };
+
+      void
+      run ();
+
+      bool binary_;
+      std::deque<Job> jobs_;
+      bool busy_;
+      bool stop_;
+      int failures_;
+      boost::mutex mutex_;
+      boost::condition_variable queued_;
+      boost::condition_variable idle_;
+      boost::thread thread_;
+  };
+}
+
+template <typename PointT>
+wp2::AsyncPCDWriter<PointT>::AsyncPCDWriter (bool binary)
+  : binary_ (binary)
+  , busy_ (false)
+  , stop_ (false)
+  , failures_ (0)
+{
+  thread_ = boost::thread (&AsyncPCDWriter<PointT>::run, this);
+}
+
+template <typename PointT>
+wp2::AsyncPCDWriter<PointT>::~AsyncPCDWriter ()
+{
+  {
+    boost::mutex::scoped_lock lock (mutex_);
+    stop_ = true;
+  }
+  queued_.notify_one ();
+  thread_.join ();
+}
+
+template <typename PointT> void
+wp2::AsyncPCDWriter<PointT>::write (const std::string &filename, const PointCloudConstPtr &cloud,
+                                    const IndicesConstPtr &indices)
+{
+  Job job;
+  job.filename = filename;
+  job.cloud = cloud;
+  job.indices = indices;
+  {
+    boost::mutex::scoped_lock lock (mutex_);
+    jobs_.push_back (job);
+  }
+  queued_.notify_one ();
+}
+
+template <typename PointT> int
+wp2::AsyncPCDWriter<PointT>::flush ()
+{
+  boost::mutex::scoped_lock lock (mutex_);
+  while (busy_ || !jobs_.empty ())
+  {
+    idle_.wait (lock);
+  }
+  return (failures_);
+}
+
+template <typename PointT> void
+wp2::AsyncPCDWriter<PointT>::run ()
+{
+  pcl::PCDWriter writer;
+  boost::mutex::scoped_lock lock (mutex_);
+  while (true)
+  {
+    while (jobs_.empty () && !stop_)
+    {
+      queued_.wait (lock);
+    }
+    if (jobs_.empty ())
+    {
+      return;
+    }
+    Job job = jobs_.front ();
+    jobs_.pop_front ();
+    busy_ = true;
+    lock.unlock ();
+
+    int result;
+    if (job.indices)
+    {
+      result = writer.write<PointT> (job.filename, *job.cloud, *job.indices, binary_);
+    }
+    else
+    {
+      result = writer.write<PointT> (job.filename, *job.cloud, binary_);
+    }
+    if (result < 0)
+    {
+      std::cout << "Error writing " << job.filename << std::endl;
+    }
+
+    lock.lock ();
+    if (result < 0)
+    {
+      ++failures_;
+    }
+    busy_ = false;
+    idle_.notify_all ();
+  }
+}
+
+#endif  // WP2_IO_ASYNC_PCD_WRITER_H_
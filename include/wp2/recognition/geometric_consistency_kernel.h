@@ -0,0 +1,50 @@
+//GEOMETRIC CONSISTENCY CHECK
+//ONE CANDIDATE CORRESPONDENCE AGAINST EVERY MEMBER OF A CONSENSUS SET, 8 MEMBERS PER STEP WITH AVX
+
+#ifndef WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_KERNEL_H_
+#define WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_KERNEL_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace wp2
+{
+  namespace gc
+  {
+    //  Scene and model positions of the correspondences of a consensus set, struct of arrays
+    struct ConsensusSet
+    {
+      typedef std::vector<float, Eigen::aligned_allocator<float> > Array;
+
+      void
+      clear ();
+
+      void
+      push_back (const float scene[3], const float model[3]);
+
+      size_t
+      size () const
+      {
+        return (sx.size ());
+      }
+
+      Array sx, sy, sz, mx, my, mz;
+    };
+
+    //  True when | |s_k - scene| - |m_k - model| | <= gc_size for every member k, with the norms in
+    //  single precision, their difference in single precision and the comparison in double, as
+    //  pcl::GeometricConsistencyGrouping computes them (Vector3f norms, then fabs into a double)
+    bool
+    isConsistent (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size);
+
+    bool
+    isConsistentScalar (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size, size_t first = 0);
+
+    bool
+    isConsistentAVX2 (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size);
+  }
+}
+
+#endif  // WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_KERNEL_H_
@@ -0,0 +1,232 @@
+//GEOMETRIC CONSISTENCY GROUPING, VECTORIZED AND PARALLEL
+//SAME CLUSTERS AS pcl::GeometricConsistencyGrouping: CONSISTENCY CHECKED WITH wp2::gc::isConsistent ON
+//STRUCT-OF-ARRAYS POSITIONS, SEEDS TRIED IN PARALLEL BATCHES, SEEDS THAT CANNOT REACH THE THRESHOLD DROPPED EARLY
+//THE DISTANCE TEST ROUNDS AS PCL'S: FLOAT NORMS SUBTRACTED IN FLOAT, THEN COMPARED WITH THE DOUBLE GC SIZE
+
+#ifndef WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_SIMD_H_
+#define WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_SIMD_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+#include <pcl/common/io.h>
+#include <pcl/recognition/cg/geometric_consistency.h>
+#include <pcl/registration/correspondence_rejection_sample_consensus.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <wp2/recognition/geometric_consistency_kernel.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  template <typename PointModelT, typename PointSceneT>
+  class GeometricConsistencyGroupingSIMD : public pcl::GeometricConsistencyGrouping<PointModelT, PointSceneT>
+  {
+    public:
+      typedef boost::shared_ptr<GeometricConsistencyGroupingSIMD<PointModelT, PointSceneT> > Ptr;
+      typedef boost::shared_ptr<const GeometricConsistencyGroupingSIMD<PointModelT, PointSceneT> > ConstPtr;
+
+      GeometricConsistencyGroupingSIMD (unsigned int nr_threads = 0) : threads_ (nr_threads)
+      {
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+    protected:
+      static bool
+      distanceSorter (const pcl::Correspondence &i, const pcl::Correspondence &j)
+      {
+        return (i.distance < j.distance);
+      }
+
+      void
+      clusterCorrespondences (std::vector<pcl::Correspondences> &model_instances);
+
+      //  Greedy consensus of seed over the correspondences not taken yet, in sorted order as PCL builds it.
+      //  Returns false as soon as the set can no longer exceed the threshold.
+      bool
+      growConsensus (int seed, const std::vector<char> &taken, int nr_untaken,
+                     wp2::gc::ConsensusSet &set, std::vector<int> &consensus) const;
+
+      unsigned int threads_;
+
+      //  Positions of each sorted correspondence: scene_points_[3 * i], model_points_[3 * i]
+      std::vector<float> scene_points_;
+      std::vector<float> model_points_;
+  };
+}
+
+template <typename PointModelT, typename PointSceneT> bool
+wp2::GeometricConsistencyGroupingSIMD<PointModelT, PointSceneT>::growConsensus (
+    int seed, const std::vector<char> &taken, int nr_untaken, wp2::gc::ConsensusSet &set, std::vector<int> &consensus) const
+{
+  const int nr_corrs = static_cast<int> (taken.size ());
+  const int threshold = this->gc_threshold_;
+
+  set.clear ();
+  consensus.clear ();
+  set.push_back (&scene_points_[3 * seed], &model_points_[3 * seed]);
+  consensus.push_back (seed);
+
+  //  Candidates still to be looked at; the set can end up at most consensus + remaining large
+  int remaining = nr_untaken - 1;
+  for (int j = 0; j < nr_corrs; ++j)
+  {
+    if (j == seed || taken[j])
+    {
+      continue;
+    }
+    --remaining;
+
+    if (wp2::gc::isConsistent (set, &scene_points_[3 * j], &model_points_[3 * j], this->gc_size_))
+    {
+      set.push_back (&scene_points_[3 * j], &model_points_[3 * j]);
+      consensus.push_back (j);
+    }
+    else if (static_cast<int> (consensus.size ()) + remaining <= threshold)
+    {
+      return (false);
+    }
+  }
+  return (static_cast<int> (consensus.size ()) > threshold);
+}
+
+template <typename PointModelT, typename PointSceneT> void
+wp2::GeometricConsistencyGroupingSIMD<PointModelT, PointSceneT>::clusterCorrespondences (
+    std::vector<pcl::Correspondences> &model_instances)
+{
+  model_instances.clear ();
+  this->found_transformations_.clear ();
+
+  if (!this->model_scene_corrs_)
+  {
+    PCL_ERROR ("[wp2::GeometricConsistencyGroupingSIMD::clusterCorrespondences] Error! Correspondences not set, please set them before calling again this function.\n");
+    return;
+  }
+
+  pcl::CorrespondencesPtr sorted_corrs (new pcl::Correspondences (*this->model_scene_corrs_));
+  std::sort (sorted_corrs->begin (), sorted_corrs->end (), distanceSorter);
+  this->model_scene_corrs_ = sorted_corrs;
+
+  const int nr_corrs = static_cast<int> (sorted_corrs->size ());
+  scene_points_.resize (3 * nr_corrs);
+  model_points_.resize (3 * nr_corrs);
+  for (int i = 0; i < nr_corrs; ++i)
+  {
+    const PointSceneT &scene_point = this->scene_->at ((*sorted_corrs)[i].index_match);
+    const PointModelT &model_point = this->input_->at ((*sorted_corrs)[i].index_query);
+    scene_points_[3 * i + 0] = scene_point.x;
+    scene_points_[3 * i + 1] = scene_point.y;
+    scene_points_[3 * i + 2] = scene_point.z;
+    model_points_[3 * i + 0] = model_point.x;
+    model_points_[3 * i + 1] = model_point.y;
+    model_points_[3 * i + 2] = model_point.z;
+  }
+
+  //temp copy of scene cloud with the type cast to ModelT in order to use Ransac
+  typename pcl::PointCloud<PointModelT>::Ptr temp_scene_cloud_ptr (new pcl::PointCloud<PointModelT> ());
+  pcl::copyPointCloud<PointSceneT, PointModelT> (*this->scene_, *temp_scene_cloud_ptr);
+
+  pcl::registration::CorrespondenceRejectorSampleConsensus<PointModelT> corr_rejector;
+  corr_rejector.setMaximumIterations (10000);
+  corr_rejector.setInlierThreshold (this->gc_size_);
+  corr_rejector.setInputSource (this->input_);
+  corr_rejector.setInputTarget (temp_scene_cloud_ptr);
+
+#ifdef _OPENMP
+  const int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#else
+  const int nr_threads = 1;
+#endif
+
+  std::vector<char> taken (nr_corrs, 0);
+  int nr_untaken = nr_corrs;
+
+  std::vector<int> seeds;
+  std::vector<char> passed;
+  std::vector<std::vector<int> > consensus;
+  std::vector<wp2::gc::ConsensusSet> sets (nr_threads);
+
+  //  Seeds are tried a batch at a time against the same taken flags. A seed that fails leaves the
+  //  flags alone, so the results stay valid up to the first seed that forms a cluster; that one is
+  //  committed and the next batch starts right after it, exactly where the serial loop would go on.
+  //  Batches grow while no seed commits, and fall back to one seed per thread after a commit.
+  const int max_batch = 64 * nr_threads;
+  int batch = nr_threads;
+  int next = 0;
+  while (next < nr_corrs && nr_untaken > this->gc_threshold_)
+  {
+    seeds.clear ();
+    for (int i = next; i < nr_corrs && static_cast<int> (seeds.size ()) < batch; ++i)
+    {
+      if (!taken[i])
+      {
+        seeds.push_back (i);
+      }
+    }
+    if (seeds.empty ())
+    {
+      break;
+    }
+
+    const int nr_seeds = static_cast<int> (seeds.size ());
+    passed.resize (nr_seeds);
+    if (static_cast<int> (consensus.size ()) < nr_seeds)
+    {
+      consensus.resize (nr_seeds);
+    }
+
+#pragma omp parallel num_threads (nr_threads)
+    {
+#ifdef _OPENMP
+      wp2::gc::ConsensusSet &set = sets[omp_get_thread_num ()];
+#else
+      wp2::gc::ConsensusSet &set = sets[0];
+#endif
+#pragma omp for schedule (dynamic, 1)
+      for (int b = 0; b < nr_seeds; ++b)
+      {
+        passed[b] = growConsensus (seeds[b], taken, nr_untaken, set, consensus[b]);
+      }
+    }
+
+    next = seeds.back () + 1;
+    batch = std::min (2 * batch, max_batch);
+    for (int b = 0; b < nr_seeds; ++b)
+    {
+      if (!passed[b])
+      {
+        continue;
+      }
+
+      pcl::Correspondences temp_corrs, filtered_corrs;
+      for (size_t j = 0; j < consensus[b].size (); ++j)
+      {
+        temp_corrs.push_back ((*sorted_corrs)[consensus[b][j]]);
+        taken[consensus[b][j]] = 1;
+      }
+      nr_untaken -= static_cast<int> (consensus[b].size ());
+
+      //ransac filtering
+      corr_rejector.getRemainingCorrespondences (temp_corrs, filtered_corrs);
+      //save transformations for recognize
+      this->found_transformations_.push_back (corr_rejector.getBestTransformation ());
+      model_instances.push_back (filtered_corrs);
+
+      next = seeds[b] + 1;
+      batch = nr_threads;
+      break;
+    }
+  }
+}
+
+#endif  // WP2_RECOGNITION_GEOMETRIC_CONSISTENCY_SIMD_H_
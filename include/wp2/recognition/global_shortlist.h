@@ -0,0 +1,214 @@
+//GLOBAL DESCRIPTOR SHORTLIST OF CANDIDATE MODELS
+//ONE ESF OR VFH SIGNATURE PER OBJECT CLOUD, COMPUTED ONCE; THE k MODELS NEAREST TO A SCENE OBJECT ARE THE
+//ONLY ONES THAT GO THROUGH THE LOCAL (SHOT) PIPELINE, SO N x N OBJECT PAIRS BECOME N x k
+
+#ifndef WP2_RECOGNITION_GLOBAL_SHORTLIST_H_
+#define WP2_RECOGNITION_GLOBAL_SHORTLIST_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/features/esf.h>
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/features/vfh.h>
+#include <pcl/search/kdtree.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace wp2
+{
+  template <typename PointT>
+  class GlobalShortlist
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+      enum Descriptor
+      {
+        GLOBAL_ESF,   // ensemble of shape functions, no normals needed
+        GLOBAL_VFH    // viewpoint feature histogram, from k = 10 normals
+      };
+
+      GlobalShortlist () : descriptor_ (GLOBAL_ESF), size_ (5) {}
+
+      //  Clears the models, whose signatures no longer compare
+      void
+      setDescriptor (Descriptor descriptor)
+      {
+        descriptor_ = descriptor;
+        clear ();
+      }
+
+      Descriptor
+      getDescriptor () const
+      {
+        return (descriptor_);
+      }
+
+      //  Models kept per scene object
+      void
+      setShortlistSize (size_t size)
+      {
+        size_ = size;
+      }
+
+      size_t
+      getShortlistSize () const
+      {
+        return (size_);
+      }
+
+      //  Returns the model index used by shortlist ()
+      int
+      addModel (const std::string &name, const PointCloudConstPtr &cloud)
+      {
+        names_.push_back (name);
+        signatures_.push_back (std::vector<float> ());
+        computeSignature (cloud, signatures_.back ());
+        return (static_cast<int> (names_.size ()) - 1);
+      }
+
+      size_t
+      getNumberOfModels () const
+      {
+        return (names_.size ());
+      }
+
+      const std::string &
+      getModelName (int model) const
+      {
+        return (names_[model]);
+      }
+
+      void
+      clear ()
+      {
+        names_.clear ();
+        signatures_.clear ();
+      }
+
+      //  Indices of the shortlist size models nearest to the scene object, nearest first. The signatures are
+      //  normalized histograms, compared with the L1 distance.
+      void
+      shortlist (const PointCloudConstPtr &scene, std::vector<int> &models) const
+      {
+        std::vector<float> signature;
+        computeSignature (scene, signature);
+
+        std::vector<std::pair<float, int> > distances (signatures_.size ());
+        for (size_t m = 0; m < signatures_.size (); ++m)
+        {
+          distances[m] = std::make_pair (distance (signature, signatures_[m]), static_cast<int> (m));
+        }
+        const size_t k = std::min (size_, distances.size ());
+        std::partial_sort (distances.begin (), distances.begin () + k, distances.end ());
+
+        models.resize (k);
+        for (size_t i = 0; i < k; ++i)
+        {
+          models[i] = distances[i].second;
+        }
+      }
+
+      //  "esf" or "vfh"; false if the name is none of them
+      static bool
+      parseDescriptor (const std::string &name, Descriptor &descriptor)
+      {
+        if (name == "esf")
+        {
+          descriptor = GLOBAL_ESF;
+        }
+        else if (name == "vfh")
+        {
+          descriptor = GLOBAL_VFH;
+        }
+        else
+        {
+          return (false);
+        }
+        return (true);
+      }
+
+      static const char *
+      descriptorName (Descriptor descriptor)
+      {
+        return (descriptor == GLOBAL_VFH ? "vfh" : "esf");
+      }
+
+    protected:
+      void
+      computeSignature (const PointCloudConstPtr &cloud, std::vector<float> &signature) const
+      {
+        signature.clear ();
+        if (descriptor_ == GLOBAL_VFH)
+        {
+          pcl::PointCloud<pcl::Normal>::Ptr normals (new pcl::PointCloud<pcl::Normal> ());
+          typename pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
+          pcl::NormalEstimationOMP<PointT, pcl::Normal> norm_est;
+          norm_est.setKSearch (10);
+          norm_est.setSearchMethod (tree);
+          norm_est.setInputCloud (cloud);
+          norm_est.compute (*normals);
+
+          pcl::PointCloud<pcl::VFHSignature308> vfh;
+          pcl::VFHEstimation<PointT, pcl::Normal, pcl::VFHSignature308> vfh_est;
+          vfh_est.setSearchMethod (tree);
+          vfh_est.setInputCloud (cloud);
+          vfh_est.setInputNormals (normals);
+          vfh_est.compute (vfh);
+          if (!vfh.empty ())
+          {
+            signature.assign (vfh[0].histogram, vfh[0].histogram + 308);
+          }
+        }
+        else
+        {
+          pcl::PointCloud<pcl::ESFSignature640> esf;
+          pcl::ESFEstimation<PointT, pcl::ESFSignature640> esf_est;
+          esf_est.setInputCloud (cloud);
+          esf_est.compute (esf);
+          if (!esf.empty ())
+          {
+            signature.assign (esf[0].histogram, esf[0].histogram + 640);
+          }
+        }
+
+        //  Unit sum, so objects with different point counts compare
+        float sum = 0.0f;
+        for (size_t i = 0; i < signature.size (); ++i)
+        {
+          sum += std::abs (signature[i]);
+        }
+        for (size_t i = 0; sum > 0.0f && i < signature.size (); ++i)
+        {
+          signature[i] /= sum;
+        }
+      }
+
+      //  An object whose signature could not be computed is the farthest from everything
+      static float
+      distance (const std::vector<float> &a, const std::vector<float> &b)
+      {
+        if (a.empty () || a.size () != b.size ())
+        {
+          return (2.0f);
+        }
+        float sum = 0.0f;
+        for (size_t i = 0; i < a.size (); ++i)
+        {
+          sum += std::abs (a[i] - b[i]);
+        }
+        return (sum);
+      }
+
+      Descriptor descriptor_;
+      size_t size_;
+      std::vector<std::string> names_;
+      std::vector<std::vector<float> > signatures_;
+  };
+}
+
+#endif  // WP2_RECOGNITION_GLOBAL_SHORTLIST_H_
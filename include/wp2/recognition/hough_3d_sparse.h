@@ -0,0 +1,360 @@
+//HOUGH 3D GROUPING ON A SPARSE ACCUMULATOR
+//SAME VOTES, MAXIMA AND RANSAC AS pcl::Hough3DGrouping, BUT ONLY THE OCCUPIED BINS ARE STORED (HASHED),
+//VOTES ARE CAST BY OPENMP THREADS INTO PARTIAL ACCUMULATORS AND MERGED, AND THE BUCKETS ARE KEPT BETWEEN PAIRS
+
+#ifndef WP2_RECOGNITION_HOUGH_3D_SPARSE_H_
+#define WP2_RECOGNITION_HOUGH_3D_SPARSE_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/correspondence.h>
+#include <pcl/recognition/cg/hough_3d.h>
+#include <pcl/registration/correspondence_rejection_sample_consensus.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  template <typename PointModelT, typename PointSceneT, typename PointModelRfT = pcl::ReferenceFrame, typename PointSceneRfT = pcl::ReferenceFrame>
+  class SparseHough3DGrouping : public pcl::Hough3DGrouping<PointModelT, PointSceneT, PointModelRfT, PointSceneRfT>
+  {
+    public:
+      typedef boost::shared_ptr<SparseHough3DGrouping<PointModelT, PointSceneT, PointModelRfT, PointSceneRfT> > Ptr;
+      typedef boost::shared_ptr<const SparseHough3DGrouping<PointModelT, PointSceneT, PointModelRfT, PointSceneRfT> > ConstPtr;
+
+      SparseHough3DGrouping (unsigned int nr_threads = 0) : threads_ (nr_threads), nr_bins_ (0)
+      {
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      //  Occupied bins after the last voting, i.e. what the dense space would have had to hold as non-zero
+      size_t
+      getNumberOfOccupiedBins () const
+      {
+        return (nr_bins_);
+      }
+
+    protected:
+      //  One occupied bin: accumulated weight and the correspondences that voted for it, in correspondence order
+      struct HoughBin
+      {
+        HoughBin () : value (0.0) {}
+
+        double value;
+        std::vector<int> voters;
+      };
+
+      typedef boost::unordered_map<boost::int64_t, HoughBin> Accumulator;
+
+      //  Bin coordinates packed as x + y * count_x + z * count_x * count_y, the index of the dense PCL space
+      struct Grid
+      {
+        Eigen::Vector3d min;
+        double bin_size;
+        boost::int64_t count[3];
+
+        boost::int64_t
+        key (const boost::int64_t bin[3]) const
+        {
+          return (bin[0] + count[0] * (bin[1] + count[1] * bin[2]));
+        }
+      };
+
+      void
+      clusterCorrespondences (std::vector<pcl::Correspondences> &model_instances);
+
+      //  Casts the votes of correspondences [first, last), bin key k going to accumulators[k % nr_shards]
+      void
+      castVotes (const Grid &grid, int first, int last, double max_distance, Accumulator *accumulators, int nr_shards) const;
+
+      double
+      binValue (boost::int64_t key) const
+      {
+        const Accumulator &shard = shards_[key % shards_.size ()];
+        typename Accumulator::const_iterator it = shard.find (key);
+        return (it == shard.end () ? 0.0 : it->second.value);
+      }
+
+      unsigned int threads_;
+      size_t nr_bins_;
+
+      std::vector<Eigen::Vector3d> scene_votes_;
+
+      //  partial_[t * nr_shards + s] holds the votes of thread t for shard s,
+      //  shards_[s] the merged bins with key % nr_shards == s
+      std::vector<Accumulator> partial_;
+      std::vector<Accumulator> shards_;
+  };
+}
+
+template <typename PointModelT, typename PointSceneT, typename PointModelRfT, typename PointSceneRfT> void
+wp2::SparseHough3DGrouping<PointModelT, PointSceneT, PointModelRfT, PointSceneRfT>::castVotes (
+    const Grid &grid, int first, int last, double max_distance, Accumulator *accumulators, int nr_shards) const
+{
+  for (int i = first; i < last; ++i)
+  {
+    double weight = 1.0;
+    if (this->use_distance_weight_ && max_distance != 0)
+    {
+      weight = 1.0 - (this->model_scene_corrs_->at (i).distance / max_distance);
+    }
+
+    //  Bin of the vote and offset from the bin centre, in bins. Votes outside the space are dropped as in PCL.
+    boost::int64_t bin[3];
+    double offset[3];
+    bool inside = true;
+    for (int n = 0; n < 3; ++n)
+    {
+      const double coord = (scene_votes_[i][n] - grid.min[n]) / grid.bin_size;
+      bin[n] = static_cast<boost::int64_t> (std::floor (coord));
+      offset[n] = coord - static_cast<double> (bin[n]) - 0.5;
+      inside = inside && bin[n] >= 0 && bin[n] < grid.count[n];
+    }
+    if (!inside)
+    {
+      continue;
+    }
+
+    if (!this->use_interpolation_)
+    {
+      const boost::int64_t key = grid.key (bin);
+      HoughBin &hough_bin = accumulators[key % nr_shards][key];
+      hough_bin.value += weight;
+      hough_bin.voters.push_back (i);
+      continue;
+    }
+
+    //  Trilinear share between the bin and its neighbours on the side of the vote
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      boost::int64_t corner_bin[3];
+      double corner_weight = weight;
+      bool corner_inside = true;
+      for (int n = 0; n < 3; ++n)
+      {
+        const bool shifted = (corner >> n) & 1;
+        corner_bin[n] = bin[n] + (shifted ? (offset[n] >= 0 ? 1 : -1) : 0);
+        corner_weight *= shifted ? std::fabs (offset[n]) : 1.0 - std::fabs (offset[n]);
+        corner_inside = corner_inside && corner_bin[n] >= 0 && corner_bin[n] < grid.count[n];
+      }
+      if (!corner_inside || corner_weight == 0.0)
+      {
+        continue;
+      }
+      const boost::int64_t key = grid.key (corner_bin);
+      HoughBin &hough_bin = accumulators[key % nr_shards][key];
+      hough_bin.value += corner_weight;
+      hough_bin.voters.push_back (i);
+    }
+  }
+}
+
+template <typename PointModelT, typename PointSceneT, typename PointModelRfT, typename PointSceneRfT> void
+wp2::SparseHough3DGrouping<PointModelT, PointSceneT, PointModelRfT, PointSceneRfT>::clusterCorrespondences (
+    std::vector<pcl::Correspondences> &model_instances)
+{
+  model_instances.clear ();
+  this->found_transformations_.clear ();
+  nr_bins_ = 0;
+
+  if (this->needs_training_ && !this->train ())
+  {
+    return;
+  }
+  if (!this->scene_rf_ || this->scene_rf_->size () != this->scene_->size ())
+  {
+    PCL_ERROR ("[wp2::SparseHough3DGrouping::clusterCorrespondences] Scene reference frames not set or not matching the scene cloud.\n");
+    return;
+  }
+  if (this->model_scene_corrs_->empty ())
+  {
+    PCL_ERROR ("[wp2::SparseHough3DGrouping::clusterCorrespondences] Correspondences not set, please set them before calling again this function.\n");
+    return;
+  }
+
+#ifdef _OPENMP
+  const int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#else
+  const int nr_threads = 1;
+#endif
+
+  const int n_matches = static_cast<int> (this->model_scene_corrs_->size ());
+
+  //  Vote position of each match: the model centroid, seen from the scene keypoint through its frame
+  scene_votes_.resize (n_matches);
+#pragma omp parallel for num_threads (nr_threads) schedule (static)
+  for (int i = 0; i < n_matches; ++i)
+  {
+    const int scene_index = this->model_scene_corrs_->at (i).index_match;
+    const int model_index = this->model_scene_corrs_->at (i).index_query;
+    const Eigen::Vector3f scene_point = this->scene_->at (scene_index).getVector3fMap ();
+    const PointSceneRfT &scene_point_rf = this->scene_rf_->at (scene_index);
+    const Eigen::Vector3f &model_point_vote = this->model_votes_[model_index];
+
+    for (int n = 0; n < 3; ++n)
+    {
+      scene_votes_[i][n] = scene_point_rf.x_axis[n] * model_point_vote.x () + scene_point_rf.y_axis[n] * model_point_vote.y () +
+                           scene_point_rf.z_axis[n] * model_point_vote.z () + scene_point[n];
+    }
+  }
+
+  Grid grid;
+  Eigen::Vector3d d_max;
+  grid.min.setConstant (std::numeric_limits<double>::max ());
+  d_max.setConstant (-std::numeric_limits<double>::max ());
+  float max_distance = -std::numeric_limits<float>::max ();
+  for (int i = 0; i < n_matches; ++i)
+  {
+    grid.min = grid.min.cwiseMin (scene_votes_[i]);
+    d_max = d_max.cwiseMax (scene_votes_[i]);
+    if (this->use_distance_weight_ && this->model_scene_corrs_->at (i).distance > max_distance)
+    {
+      max_distance = this->model_scene_corrs_->at (i).distance;
+    }
+  }
+  grid.bin_size = this->hough_bin_size_;
+  for (int n = 0; n < 3; ++n)
+  {
+    grid.count[n] = static_cast<boost::int64_t> (std::ceil ((d_max[n] - grid.min[n]) / grid.bin_size));
+  }
+
+  //  Each thread votes for a contiguous block of matches, so merging the partial accumulators
+  //  in thread order keeps every voter list in correspondence order.
+  //  clear () keeps the bucket arrays, so later pairs vote into already sized tables
+  partial_.resize (nr_threads * nr_threads);
+  shards_.resize (nr_threads);
+  for (size_t a = 0; a < partial_.size (); ++a)
+  {
+    partial_[a].clear ();
+  }
+
+#pragma omp parallel for num_threads (nr_threads) schedule (static, 1)
+  for (int t = 0; t < nr_threads; ++t)
+  {
+    castVotes (grid, static_cast<int> (static_cast<boost::int64_t> (n_matches) * t / nr_threads),
+               static_cast<int> (static_cast<boost::int64_t> (n_matches) * (t + 1) / nr_threads),
+               max_distance, &partial_[t * nr_threads], nr_threads);
+  }
+
+#pragma omp parallel for num_threads (nr_threads) schedule (static, 1)
+  for (int s = 0; s < nr_threads; ++s)
+  {
+    Accumulator &shard = shards_[s];
+    shard.clear ();
+    for (int t = 0; t < nr_threads; ++t)
+    {
+      const Accumulator &partial = partial_[t * nr_threads + s];
+      for (typename Accumulator::const_iterator it = partial.begin (); it != partial.end (); ++it)
+      {
+        HoughBin &hough_bin = shard[it->first];
+        hough_bin.value += it->second.value;
+        hough_bin.voters.insert (hough_bin.voters.end (), it->second.voters.begin (), it->second.voters.end ());
+      }
+    }
+  }
+
+  //  A negative threshold is a fraction of the highest bin, as in pcl::recognition::HoughSpace3D::findMaxima
+  double threshold = this->hough_threshold_;
+  if (threshold < 0)
+  {
+    double hough_maximum = std::numeric_limits<double>::min ();
+    for (int s = 0; s < nr_threads; ++s)
+    {
+      for (typename Accumulator::const_iterator it = shards_[s].begin (); it != shards_[s].end (); ++it)
+      {
+        hough_maximum = std::max (hough_maximum, it->second.value);
+      }
+    }
+    threshold = threshold >= -1 ? -threshold * hough_maximum : hough_maximum;
+  }
+
+  //  Local maxima over the 26 neighbours; empty neighbours count as 0
+  std::vector<std::vector<std::pair<boost::int64_t, const HoughBin *> > > shard_maxima (nr_threads);
+#pragma omp parallel for num_threads (nr_threads) schedule (static, 1)
+  for (int s = 0; s < nr_threads; ++s)
+  {
+    for (typename Accumulator::const_iterator it = shards_[s].begin (); it != shards_[s].end (); ++it)
+    {
+      const double value = it->second.value;
+      if (value < threshold)
+      {
+        continue;
+      }
+
+      boost::int64_t bin[3];
+      bin[0] = it->first % grid.count[0];
+      bin[1] = (it->first / grid.count[0]) % grid.count[1];
+      bin[2] = it->first / (grid.count[0] * grid.count[1]);
+
+      bool is_maximum = true;
+      for (int dz = -1; dz <= 1 && is_maximum; ++dz)
+        for (int dy = -1; dy <= 1 && is_maximum; ++dy)
+          for (int dx = -1; dx <= 1 && is_maximum; ++dx)
+          {
+            const boost::int64_t neighbor[3] = { bin[0] + dx, bin[1] + dy, bin[2] + dz };
+            if ((dx == 0 && dy == 0 && dz == 0) ||
+                neighbor[0] < 0 || neighbor[0] >= grid.count[0] ||
+                neighbor[1] < 0 || neighbor[1] >= grid.count[1] ||
+                neighbor[2] < 0 || neighbor[2] >= grid.count[2])
+            {
+              continue;
+            }
+            if (binValue (grid.key (neighbor)) > value)
+            {
+              is_maximum = false;
+            }
+          }
+
+      if (is_maximum)
+      {
+        shard_maxima[s].push_back (std::make_pair (it->first, &it->second));
+      }
+    }
+  }
+
+  //  Dense bin order, the order PCL reports its maxima in
+  std::vector<std::pair<boost::int64_t, const HoughBin *> > maxima;
+  for (int s = 0; s < nr_threads; ++s)
+  {
+    nr_bins_ += shards_[s].size ();
+    maxima.insert (maxima.end (), shard_maxima[s].begin (), shard_maxima[s].end ());
+  }
+  std::sort (maxima.begin (), maxima.end ());
+
+  pcl::registration::CorrespondenceRejectorSampleConsensus<PointModelT> corr_rejector;
+  corr_rejector.setMaximumIterations (10000);
+  corr_rejector.setInlierThreshold (this->hough_bin_size_);
+  corr_rejector.setInputSource (this->input_);
+  corr_rejector.setInputTarget (this->scene_);
+
+  for (size_t j = 0; j < maxima.size (); ++j)
+  {
+    pcl::Correspondences temp_corrs, filtered_corrs;
+    const std::vector<int> &voters = maxima[j].second->voters;
+    for (size_t i = 0; i < voters.size (); ++i)
+    {
+      temp_corrs.push_back (this->model_scene_corrs_->at (voters[i]));
+    }
+    corr_rejector.getRemainingCorrespondences (temp_corrs, filtered_corrs);
+
+    this->found_transformations_.push_back (corr_rejector.getBestTransformation ());
+    model_instances.push_back (filtered_corrs);
+  }
+}
+
+#endif  // WP2_RECOGNITION_HOUGH_3D_SPARSE_H_
@@ -0,0 +1,170 @@
+//EARLY TERMINATION FOR MODEL-SCENE PAIRS THAT CANNOT BE RECOGNIZED
+//CHEAP CHECKS RUN BEFORE THE REFERENCE FRAMES AND THE GROUPING: POINT COUNT RATIO, PRINCIPAL EXTENTS,
+//KEYPOINT COUNT AND CORRESPONDENCE COUNT AGAINST THE GROUPING THRESHOLD, EACH FAILURE WITH ITS REASON
+
+#ifndef WP2_RECOGNITION_PAIR_GATES_H_
+#define WP2_RECOGNITION_PAIR_GATES_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/common/centroid.h>
+
+#include <Eigen/Eigenvalues>
+
+#include <algorithm>
+#include <cmath>
+
+namespace wp2
+{
+  enum GateReason
+  {
+    GATE_PASS,
+    GATE_POINT_RATIO,       // one cloud has many times the points of the other
+    GATE_EXTENT,            // the principal extents of the clouds differ too much
+    GATE_KEYPOINTS,         // too few keypoints to ever give enough correspondences
+    GATE_CORRESPONDENCES,   // too few correspondences to reach the grouping threshold
+    GATE_SHORTLIST,         // the model is not among the nearest by global descriptor (wp2::GlobalShortlist)
+    GATE_NR_REASONS
+  };
+
+  inline const char *
+  gateReasonName (GateReason reason)
+  {
+    switch (reason)
+    {
+      case GATE_POINT_RATIO:
+        return ("point_ratio");
+      case GATE_EXTENT:
+        return ("extent");
+      case GATE_KEYPOINTS:
+        return ("keypoints");
+      case GATE_CORRESPONDENCES:
+        return ("correspondences");
+      case GATE_SHORTLIST:
+        return ("shortlist");
+      default:
+        return ("pass");
+    }
+  }
+
+  //  The keypoint and correspondence gates only drop pairs the grouping would reject anyway and are always on.
+  //  The point ratio and extent gates assume model and scene are whole objects at the same scale; they are off
+  //  until given a bound.
+  template <typename PointT>
+  class PairGates
+  {
+    public:
+      PairGates () : max_point_ratio_ (0.0f), max_extent_ratio_ (0.0f), min_correspondences_ (1) {}
+
+      //  Larger over smaller point count; 0 disables
+      void
+      setMaxPointRatio (float max_point_ratio)
+      {
+        max_point_ratio_ = max_point_ratio;
+      }
+
+      //  Larger over smaller extent along each of the two main principal axes; 0 disables
+      void
+      setMaxExtentRatio (float max_extent_ratio)
+      {
+        max_extent_ratio_ = max_extent_ratio;
+      }
+
+      //  A correspondence adds at most one vote to the Hough space, which needs threshold votes in a bin;
+      //  geometric consistency needs more than threshold correspondences in a cluster. A negative Hough
+      //  threshold is relative to the highest bin and only needs one.
+      void
+      setGroupingThreshold (float threshold, bool hough)
+      {
+        if (hough)
+        {
+          min_correspondences_ = threshold > 1.0f ? static_cast<size_t> (std::ceil (threshold)) : 1;
+        }
+        else
+        {
+          min_correspondences_ = threshold >= 0.0f ? static_cast<size_t> (std::floor (threshold)) + 1 : 1;
+        }
+      }
+
+      size_t
+      getMinCorrespondences () const
+      {
+        return (min_correspondences_);
+      }
+
+      //  Right after loading
+      GateReason
+      checkClouds (const pcl::PointCloud<PointT> &model, const pcl::PointCloud<PointT> &scene) const
+      {
+        if (model.empty () || scene.empty ())
+        {
+          return (GATE_POINT_RATIO);
+        }
+        if (max_point_ratio_ > 0.0f)
+        {
+          const float larger = static_cast<float> (std::max (model.size (), scene.size ()));
+          const float smaller = static_cast<float> (std::min (model.size (), scene.size ()));
+          if (larger > max_point_ratio_ * smaller)
+          {
+            return (GATE_POINT_RATIO);
+          }
+        }
+        if (max_extent_ratio_ > 0.0f)
+        {
+          const Eigen::Vector3f model_extents = principalExtents (model);
+          const Eigen::Vector3f scene_extents = principalExtents (scene);
+          //  The thinnest axis is left out: it is mostly noise on flat objects and partial views
+          for (int axis = 0; axis < 2; ++axis)
+          {
+            const float larger = std::max (model_extents[axis], scene_extents[axis]);
+            const float smaller = std::min (model_extents[axis], scene_extents[axis]);
+            if (larger > max_extent_ratio_ * smaller)
+            {
+              return (GATE_EXTENT);
+            }
+          }
+        }
+        return (GATE_PASS);
+      }
+
+      //  After sampling: every scene keypoint gives at most one correspondence
+      GateReason
+      checkKeypoints (size_t nr_model_keypoints, size_t nr_scene_keypoints) const
+      {
+        if (nr_model_keypoints == 0 || nr_scene_keypoints < min_correspondences_)
+        {
+          return (GATE_KEYPOINTS);
+        }
+        return (GATE_PASS);
+      }
+
+      //  After matching
+      GateReason
+      checkCorrespondences (size_t nr_correspondences) const
+      {
+        return (nr_correspondences < min_correspondences_ ? GATE_CORRESPONDENCES : GATE_PASS);
+      }
+
+      //  Standard deviations along the principal axes, largest first; rotation invariant
+      static Eigen::Vector3f
+      principalExtents (const pcl::PointCloud<PointT> &cloud)
+      {
+        Eigen::Matrix3f covariance;
+        Eigen::Vector4f centroid;
+        if (pcl::computeMeanAndCovarianceMatrix (cloud, covariance, centroid) == 0)
+        {
+          return (Eigen::Vector3f::Zero ());
+        }
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver (covariance, Eigen::EigenvaluesOnly);
+        const Eigen::Vector3f eigenvalues = solver.eigenvalues ();
+        return (Eigen::Vector3f (std::sqrt (std::max (eigenvalues[2], 0.0f)), std::sqrt (std::max (eigenvalues[1], 0.0f)),
+                                 std::sqrt (std::max (eigenvalues[0], 0.0f))));
+      }
+
+    protected:
+      float max_point_ratio_;
+      float max_extent_ratio_;
+      size_t min_correspondences_;
+  };
+}
+
+#endif  // WP2_RECOGNITION_PAIR_GATES_H_
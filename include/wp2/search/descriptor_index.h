@@ -0,0 +1,118 @@
+//NEAREST DESCRIPTOR SEARCH OVER A wp2::DescriptorMatrix
+//FLANN INDEXES BUILT ON THE MATRIX ROWS IN PLACE: NO COPY INTO A FLANN BUFFER, NO NaN CHECK PER QUERY.
+//EXACT BY DEFAULT (THE KD-TREE pcl::KdTreeFLANN BUILDS); RANDOMIZED KD-FOREST, HIERARCHICAL K-MEANS OR LINEAR
+//SCAN, OR AN HNSW GRAPH ON REQUEST, WITH AN AUTOTUNER THAT PICKS THE CHEAPEST SETTINGS MEETING A TARGET RECALL
+
+#ifndef WP2_SEARCH_DESCRIPTOR_INDEX_H_
+#define WP2_SEARCH_DESCRIPTOR_INDEX_H_
+
+#include <flann/flann.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/search/hnsw_index.h>
+
+namespace wp2
+{
+  namespace search
+  {
+    struct IndexParams
+    {
+      enum Type
+      {
+        INDEX_EXACT,    // single kd-tree, unlimited checks: exact, as pcl::KdTreeFLANN
+        INDEX_KDTREE,   // randomized kd-forest of trees trees, approximate
+        INDEX_KMEANS,   // hierarchical k-means tree, approximate
+        INDEX_LINEAR,   // brute force, exact
+        INDEX_HNSW      // hierarchical navigable small world graph, approximate
+      };
+
+      IndexParams ()
+        : type (INDEX_EXACT), trees (4), branching (32), iterations (11), neighbors (16), ef_construction (200), checks (-1)
+      {
+      }
+
+      Type type;
+      int trees;            // INDEX_KDTREE
+      int branching;        // INDEX_KMEANS
+      int iterations;       // INDEX_KMEANS
+      int neighbors;        // INDEX_HNSW links per node
+      int ef_construction;  // INDEX_HNSW candidates while linking
+      int checks;           // leaves visited per query by kdtree and kmeans, -1 is unlimited;
+                            // candidate list size of the hnsw queries, -1 is HNSWIndex's default
+
+      //  "exact", "kdtree", "kmeans", "linear" or "hnsw"; false if the name is none of them
+      static bool
+      parseType (const std::string &name, Type &type);
+
+      static const char *
+      typeName (Type type);
+
+      //  e.g. "kdtree trees=4 checks=64"
+      std::string
+      toString () const;
+    };
+
+    class DescriptorIndex
+    {
+      public:
+        typedef boost::shared_ptr<DescriptorIndex> Ptr;
+        typedef flann::L2_Simple<float> Distance;
+
+        DescriptorIndex () : matrix_ (NULL) {}
+
+        //  Used by the next setInputMatrix
+        void
+        setParams (const IndexParams &params)
+        {
+          params_ = params;
+        }
+
+        const IndexParams &
+        getParams () const
+        {
+          return (params_);
+        }
+
+        //  Compacts matrix (see DescriptorMatrix::compact) and indexes its rows. The matrix is read in place,
+        //  so it must outlive the index and stay unchanged. The exact kd-tree leaves are not reordered, which
+        //  would copy it. The HNSW graph keeps its own copy of the rows.
+        void
+        setInputMatrix (wp2::DescriptorMatrix &matrix);
+
+        size_t
+        size () const
+        {
+          return (index_ || graph_ ? matrix_->rows () : 0);
+        }
+
+        //  k nearest indexed rows of every row of queries (compact it first), in one batch.
+        //  Row q owns indices[q * k .. q * k + k), closest first; k is cut to the index size.
+        //  Indices are rows of the input matrix: getIndex () maps them to keypoints.
+        //  nr_threads = 0 uses all cores.
+        size_t
+        knnSearch (const wp2::DescriptorMatrix &queries, size_t k, std::vector<int> &indices, std::vector<float> &sqr_dists,
+                   unsigned int nr_threads = 0) const;
+
+        //  Tries exact, kd-forest and k-means settings on up to nr_samples rows of queries against data and
+        //  returns the one with the lowest build + query time whose nearest neighbour matches the exact one
+        //  for at least target_recall of the samples. Falls back to INDEX_EXACT. Compacts both matrices.
+        //  The HNSW graph is left out: it pays off on a library built once, not rebuilt per pair.
+        static IndexParams
+        autotune (wp2::DescriptorMatrix &data, wp2::DescriptorMatrix &queries, float target_recall,
+                  size_t nr_samples = 256, unsigned int nr_threads = 0);
+
+      protected:
+        IndexParams params_;
+        const wp2::DescriptorMatrix *matrix_;
+        boost::shared_ptr<flann::Index<Distance> > index_;
+        HNSWIndex::Ptr graph_;
+    };
+  }
+}
+
+#endif  // WP2_SEARCH_DESCRIPTOR_INDEX_H_
@@ -0,0 +1,157 @@
+//MODEL-SCENE DESCRIPTOR MATCHING
+//NEAREST MODEL DESCRIPTOR OF EVERY SCENE DESCRIPTOR, KEPT UNDER AN ABSOLUTE THRESHOLD AND OPTIONALLY
+//A LOWE RATIO TEST (k = 2) AND A MUTUAL NEAREST NEIGHBOUR CHECK, EACH SEARCH DONE AS ONE BATCH.
+//AGAINST ONE MODEL, OR AGAINST A WHOLE OBJECT LIBRARY HELD IN AN HNSW GRAPH
+
+#ifndef WP2_SEARCH_DESCRIPTOR_MATCHER_H_
+#define WP2_SEARCH_DESCRIPTOR_MATCHER_H_
+
+#include <pcl/correspondence.h>
+
+#include <string>
+#include <vector>
+
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/search/descriptor_index.h>
+#include <wp2/search/hnsw_index.h>
+
+namespace wp2
+{
+  namespace search
+  {
+    class DescriptorMatcher
+    {
+      public:
+        enum Mode
+        {
+          MATCH_THRESHOLD,  // nearest neighbour under the threshold, as the recognition binaries did
+          MATCH_RATIO,      // and clearly closer than the second nearest
+          MATCH_MUTUAL      // and the scene descriptor is also the nearest of its model match
+        };
+
+        DescriptorMatcher ()
+          : mode_ (MATCH_THRESHOLD)
+          , max_sqr_dist_ (0.25f)
+          , ratio_ (0.8f)
+          , threads_ (0)
+          , library_neighbors_ (0)
+          , nr_candidates_ (0)
+        {
+        }
+
+        void
+        setMode (Mode mode)
+        {
+          mode_ = mode;
+        }
+
+        Mode
+        getMode () const
+        {
+          return (mode_);
+        }
+
+        //  Squared descriptor distance; SHOT distances are between 0 and 1 by design
+        void
+        setMaxSquaredDistance (float max_sqr_dist)
+        {
+          max_sqr_dist_ = max_sqr_dist;
+        }
+
+        //  MATCH_RATIO keeps d1 < ratio * d2 (distances, not squared)
+        void
+        setRatio (float ratio)
+        {
+          ratio_ = ratio;
+        }
+
+        //  Index built on the model (and on the scene for MATCH_MUTUAL); exact by default
+        void
+        setIndexParams (const IndexParams &params)
+        {
+          model_index_.setParams (params);
+          scene_index_.setParams (params);
+        }
+
+        const IndexParams &
+        getIndexParams () const
+        {
+          return (model_index_.getParams ());
+        }
+
+        //0 means one thread per core
+        void
+        setNumberOfThreads (unsigned int nr_threads = 0)
+        {
+          threads_ = nr_threads;
+        }
+
+        //  Library descriptors searched per scene descriptor; every model keeps its own nearest among them.
+        //  0 means 4 per model (8 with the ratio test), so that each model is likely to be among them.
+        void
+        setLibraryNeighbors (size_t library_neighbors)
+        {
+          library_neighbors_ = library_neighbors;
+        }
+
+        //  Compacts both matrices (see DescriptorMatrix::compact); the correspondences refer to keypoints,
+        //  index_query to the model and index_match to the scene, as the groupers expect
+        void
+        match (wp2::DescriptorMatrix &model, wp2::DescriptorMatrix &scene, pcl::Correspondences &correspondences);
+
+        //  Scene against every model of library at once: correspondences[label] holds the matches to that model,
+        //  index_query being the node id (its model keypoint). One k nearest search over the library, then every model
+        //  keeps the nearest of its own descriptors among the k, as if the scene were matched to it alone: the ratio
+        //  test compares with the runner-up of the same model (with the k-th distance as its bound when it is not among
+        //  them), and the mutual check searches the scene from the kept library descriptors. Compacts scene.
+        void
+        match (const HNSWIndex &library, wp2::DescriptorMatrix &scene, std::vector<pcl::Correspondences> &correspondences);
+
+        //  Scene descriptors whose nearest model descriptor was under the threshold in the last match, before the
+        //  ratio and mutual checks; against a library, counted once per model
+        size_t
+        getNumberOfCandidates () const
+        {
+          return (nr_candidates_);
+        }
+
+        //  "nn", "ratio" or "mutual"; false if the name is none of them
+        static bool
+        parseMode (const std::string &name, Mode &mode);
+
+        static const char *
+        modeName (Mode mode);
+
+      protected:
+        //  Nearest descriptor of one model to one scene descriptor, from the library search
+        struct LabelMatch
+        {
+          int row;
+          int node;
+          float sqr_dist;
+          float runner_up;  // squared distance of the next descriptor of that model, or its lower bound
+        };
+
+        Mode mode_;
+        float max_sqr_dist_;
+        float ratio_;
+        unsigned int threads_;
+        size_t library_neighbors_;
+        size_t nr_candidates_;
+
+        //  Kept between calls so the result buffers keep their capacity
+        DescriptorIndex model_index_;
+        DescriptorIndex scene_index_;
+        std::vector<int> forward_indices_;
+        std::vector<float> forward_dists_;
+        std::vector<int> reverse_indices_;
+        std::vector<float> reverse_dists_;
+        std::vector<int> library_nodes_;
+        wp2::DescriptorMatrix library_descriptors_;
+        std::vector<LabelMatch> label_matches_;
+        std::vector<int> label_slots_;
+    };
+  }
+}
+
+#endif  // WP2_SEARCH_DESCRIPTOR_MATCHER_H_
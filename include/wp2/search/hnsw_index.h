@@ -0,0 +1,236 @@
+//HIERARCHICAL NAVIGABLE SMALL WORLD GRAPH OVER DESCRIPTORS
+//APPROXIMATE NEAREST NEIGHBOURS FOR LARGE DESCRIPTOR LIBRARIES (MANY MODELS, HUNDREDS OF THOUSANDS OF SHOT352):
+//INCREMENTAL INSERTION, BATCHED MULTITHREADED QUERIES, SAVE TO FILE AND mmap LOADING
+
+#ifndef WP2_SEARCH_HNSW_INDEX_H_
+#define WP2_SEARCH_HNSW_INDEX_H_
+
+#include <boost/noncopyable.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <wp2/features/descriptor_matrix.h>
+
+namespace wp2
+{
+  namespace search
+  {
+    //  Every node keeps a label (e.g. the model it came from) and an id (e.g. its keypoint), so one graph can hold a whole
+    //  object library and a match still tells which model and keypoint it hit. Insertion is serial; queries are const and
+    //  run in parallel. A loaded index reads the file mapping in place until the next insertion copies it into memory.
+    class HNSWIndex : private boost::noncopyable
+    {
+      public:
+        typedef boost::shared_ptr<HNSWIndex> Ptr;
+        typedef boost::shared_ptr<const HNSWIndex> ConstPtr;
+
+        //  neighbors: links per node on the upper layers (twice that on the bottom one); ef_construction: candidate list
+        //  size while linking a new node. Larger values give a better graph and slower insertion.
+        HNSWIndex (size_t dims = 352, int neighbors = 16, int ef_construction = 200, unsigned int seed = 1);
+
+        ~HNSWIndex ();
+
+        //  Candidate list size of the queries, at least k; larger is slower and more accurate
+        void
+        setEfSearch (int ef_search)
+        {
+          ef_search_ = ef_search;
+        }
+
+        int
+        getEfSearch () const
+        {
+          return (ef_search_);
+        }
+
+        size_t
+        dims () const
+        {
+          return (dims_);
+        }
+
+        size_t
+        size () const
+        {
+          return (size_);
+        }
+
+        //  Names of the labels, e.g. model file names; returns the new label
+        int
+        addLabel (const std::string &name);
+
+        size_t
+        getNumberOfLabels () const
+        {
+          return (label_names_.size ());
+        }
+
+        const std::string &
+        getLabelName (int label) const
+        {
+          return (label_names_[label]);
+        }
+
+        //  -1 if no label has that name
+        int
+        findLabel (const std::string &name) const;
+
+        //  Keypoint sampling size and descriptor support radius the descriptors were computed with; saved with the
+        //  index so that a library is not reused with other features. 0 when not set.
+        void
+        setDescriptorParams (float sampling_size, float support_radius)
+        {
+          sampling_size_ = sampling_size;
+          support_radius_ = support_radius;
+        }
+
+        float
+        getSamplingSize () const
+        {
+          return (sampling_size_);
+        }
+
+        float
+        getSupportRadius () const
+        {
+          return (support_radius_);
+        }
+
+        void
+        insert (const float *descriptor, int label, int id);
+
+        //  Inserts the valid rows of matrix, in order, with id = matrix.getIndex (row)
+        void
+        insert (const wp2::DescriptorMatrix &matrix, int label);
+
+        int
+        getLabel (int node) const
+        {
+          return (labelData ()[node]);
+        }
+
+        int
+        getId (int node) const
+        {
+          return (idData ()[node]);
+        }
+
+        //  dims () floats
+        const float *
+        getDescriptor (int node) const
+        {
+          return (vector (node));
+        }
+
+        //  k approximate nearest nodes of every row of queries (compact it first), as DescriptorIndex::knnSearch.
+        //  k is cut to the index size; a neighbour the graph walk did not reach gets node -1. nr_threads = 0 uses all cores.
+        size_t
+        knnSearch (const wp2::DescriptorMatrix &queries, size_t k, std::vector<int> &indices, std::vector<float> &sqr_dists,
+                   unsigned int nr_threads = 0) const;
+
+        bool
+        save (const std::string &filename) const;
+
+        //  Replaces the index with the file, mapped read-only. A non-zero sampling_size or support_radius must equal the
+        //  one saved with the index, otherwise nothing is loaded and false is returned.
+        bool
+        load (const std::string &filename, float sampling_size = 0.0f, float support_radius = 0.0f);
+
+        void
+        clear ();
+
+      protected:
+        typedef std::pair<float, int> Candidate;  // squared distance, node
+
+        const float *
+        vector (int node) const
+        {
+          return ((mapped_ ? map_vectors_ : &vectors_[0]) + static_cast<size_t> (node) * stride_);
+        }
+
+        const int *labelData () const { return (mapped_ ? map_labels_ : &labels_[0]); }
+        const int *idData () const { return (mapped_ ? map_ids_ : &ids_[0]); }
+        const int *levelData () const { return (mapped_ ? map_levels_ : &levels_[0]); }
+
+        //  [count, neighbour...] of a node on a layer
+        const int *
+        links (int node, int level) const;
+
+        int *
+        mutableLinks (int node, int level);
+
+        float
+        distance (const float *a, const float *b) const;
+
+        //  Closest node to query on a layer, walking greedily from entry
+        int
+        greedySearch (const float *query, int entry, float &entry_dist, int level) const;
+
+        //  ef closest nodes to query on a layer, ascending. visited holds tags per node, tag is bumped by the call.
+        void
+        searchLayer (const float *query, int entry, float entry_dist, size_t ef, int level,
+                     std::vector<unsigned int> &visited, unsigned int &tag, std::vector<Candidate> &result) const;
+
+        //  Keeps up to max_links candidates that are closer to the base than to any kept one (HNSW heuristic)
+        void
+        selectNeighbors (std::vector<Candidate> &candidates, size_t max_links) const;
+
+        //  Adds node to the links of neighbour, pruning them when full
+        void
+        connect (int neighbour, int node, float sqr_dist, int level);
+
+        //  Copies a mapped index into memory before it changes
+        void
+        detach ();
+
+        void
+        unmap ();
+
+        size_t dims_;
+        size_t stride_;
+        int neighbors_;
+        int max_links0_;
+        int ef_construction_;
+        int ef_search_;
+        double level_mult_;
+        boost::mt19937 rng_;
+        float sampling_size_;
+        float support_radius_;
+
+        size_t size_;
+        int entry_;
+        int max_level_;
+        std::vector<std::string> label_names_;
+
+        //  In memory
+        std::vector<float> vectors_;
+        std::vector<int> labels_;
+        std::vector<int> ids_;
+        std::vector<int> levels_;
+        std::vector<int> links0_;
+        std::vector<std::vector<int> > upper_links_;
+
+        //  Mapped from a file
+        bool mapped_;
+        void *map_base_;
+        size_t map_size_;
+        const float *map_vectors_;
+        const int *map_labels_;
+        const int *map_ids_;
+        const int *map_levels_;
+        const int *map_links0_;
+        const long long *map_upper_offsets_;
+        const int *map_upper_links_;
+
+        //  Insertion scratch
+        std::vector<unsigned int> visited_;
+        unsigned int visited_tag_;
+    };
+  }
+}
+
+#endif  // WP2_SEARCH_HNSW_INDEX_H_
@@ -0,0 +1,199 @@
+//NEIGHBOURHOOD CACHE SEARCH
+//ONE RADIUS SEARCH PER QUERY POINT, SERVED AGAIN TO EVERY FEATURE THAT ASKS FOR A SMALLER OR EQUAL RADIUS
+
+#ifndef WP2_SEARCH_NEIGHBORHOOD_CACHE_H_
+#define WP2_SEARCH_NEIGHBORHOOD_CACHE_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/search/search.h>
+#include <pcl/search/kdtree.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  namespace search
+  {
+    //  Drop-in pcl::search::Search for pcl::Feature estimators. After build (), a query by
+    //  (query cloud, index) returns the cached neighbours closer than the requested radius.
+    //  Lists are kept sorted by distance, so a smaller radius is a prefix of the cached list.
+    //  Any other query falls back to the kd-tree built on the surface.
+    template <typename PointT>
+    class NeighborhoodCache : public pcl::search::Search<PointT>
+    {
+      public:
+        typedef boost::shared_ptr<NeighborhoodCache<PointT> > Ptr;
+        typedef boost::shared_ptr<const NeighborhoodCache<PointT> > ConstPtr;
+        typedef typename pcl::search::Search<PointT>::PointCloud PointCloud;
+        typedef typename pcl::search::Search<PointT>::PointCloudConstPtr PointCloudConstPtr;
+        typedef typename pcl::search::Search<PointT>::IndicesConstPtr IndicesConstPtr;
+
+        using pcl::search::Search<PointT>::radiusSearch;
+        using pcl::search::Search<PointT>::nearestKSearch;
+
+        NeighborhoodCache ()
+          : pcl::search::Search<PointT> ("NeighborhoodCache", true)
+          , tree_ (new pcl::search::KdTree<PointT> (true))
+          , radius_ (0.0)
+        {
+        }
+
+        //  Search every point of queries in surface within radius. nr_threads = 0 uses all cores.
+        void
+        build (const PointCloudConstPtr &queries, const PointCloudConstPtr &surface, double radius, unsigned int nr_threads = 0);
+
+        void
+        clear ()
+        {
+          queries_.reset ();
+          offsets_.clear ();
+          neighbors_.clear ();
+          sqr_distances_.clear ();
+        }
+
+        double
+        getRadius () const
+        {
+          return (radius_);
+        }
+
+        size_t
+        getNumberOfNeighbors () const
+        {
+          return (neighbors_.size ());
+        }
+
+        void
+        setInputCloud (const PointCloudConstPtr &cloud, const IndicesConstPtr &indices = IndicesConstPtr ())
+        {
+          if (cloud != this->input_ || indices != this->indices_)
+          {
+            clear ();
+            tree_->setInputCloud (cloud, indices);
+          }
+          pcl::search::Search<PointT>::setInputCloud (cloud, indices);
+        }
+
+        int
+        nearestKSearch (const PointT &point, int k, std::vector<int> &k_indices, std::vector<float> &k_sqr_distances) const
+        {
+          return (tree_->nearestKSearch (point, k, k_indices, k_sqr_distances));
+        }
+
+        int
+        radiusSearch (const PointT &point, double radius, std::vector<int> &k_indices, std::vector<float> &k_sqr_distances,
+                      unsigned int max_nn = 0) const
+        {
+          return (tree_->radiusSearch (point, radius, k_indices, k_sqr_distances, max_nn));
+        }
+
+        int
+        radiusSearch (const PointCloud &cloud, int index, double radius, std::vector<int> &k_indices,
+                      std::vector<float> &k_sqr_distances, unsigned int max_nn = 0) const
+        {
+          if (!queries_ || &cloud != queries_.get () || radius > radius_)
+          {
+            return (tree_->radiusSearch (cloud[index], radius, k_indices, k_sqr_distances, max_nn));
+          }
+          return (cachedSearch (index, radius, k_indices, k_sqr_distances, max_nn));
+        }
+
+      protected:
+        int
+        cachedSearch (int index, double radius, std::vector<int> &k_indices, std::vector<float> &k_sqr_distances,
+                      unsigned int max_nn) const;
+
+        boost::shared_ptr<pcl::search::KdTree<PointT> > tree_;
+        PointCloudConstPtr queries_;
+        double radius_;
+
+        //  CSR layout: neighbours of query i are [offsets_[i], offsets_[i+1])
+        std::vector<size_t> offsets_;
+        std::vector<int> neighbors_;
+        std::vector<float> sqr_distances_;
+    };
+  }
+}
+
+template <typename PointT> void
+wp2::search::NeighborhoodCache<PointT>::build (const PointCloudConstPtr &queries, const PointCloudConstPtr &surface,
+                                               double radius, unsigned int nr_threads)
+{
+  //  The binaries reload clouds into the same pointers, so the tree is always rebuilt
+  clear ();
+  tree_->setInputCloud (surface);
+  pcl::search::Search<PointT>::setInputCloud (surface);
+  queries_ = queries;
+  radius_ = radius;
+
+#ifdef _OPENMP
+  int threads = nr_threads == 0 ? omp_get_num_procs () : static_cast<int> (nr_threads);
+#else
+  int threads = 1;
+  (void) nr_threads;
+#endif
+
+  const int nr_queries = static_cast<int> (queries->size ());
+  std::vector<std::vector<int> > indices (nr_queries);
+  std::vector<std::vector<float> > distances (nr_queries);
+
+#pragma omp parallel for num_threads (threads) schedule (dynamic, 32)
+  for (int i = 0; i < nr_queries; ++i)
+  {
+    if (!pcl::isFinite ((*queries)[i]))
+    {
+      continue;
+    }
+    tree_->radiusSearch ((*queries)[i], radius, indices[i], distances[i]);
+  }
+
+  offsets_.resize (nr_queries + 1);
+  offsets_[0] = 0;
+  for (int i = 0; i < nr_queries; ++i)
+  {
+    offsets_[i + 1] = offsets_[i] + indices[i].size ();
+  }
+
+  neighbors_.resize (offsets_[nr_queries]);
+  sqr_distances_.resize (offsets_[nr_queries]);
+
+#pragma omp parallel for num_threads (threads) schedule (static)
+  for (int i = 0; i < nr_queries; ++i)
+  {
+    std::copy (indices[i].begin (), indices[i].end (), neighbors_.begin () + offsets_[i]);
+    std::copy (distances[i].begin (), distances[i].end (), sqr_distances_.begin () + offsets_[i]);
+  }
+}
+
+template <typename PointT> int
+wp2::search::NeighborhoodCache<PointT>::cachedSearch (int index, double radius, std::vector<int> &k_indices,
+                                                      std::vector<float> &k_sqr_distances, unsigned int max_nn) const
+{
+  k_indices.clear ();
+  k_sqr_distances.clear ();
+  if (index < 0 || index + 1 >= static_cast<int> (offsets_.size ()) || offsets_[index] == offsets_[index + 1])
+  {
+    return (0);
+  }
+
+  const float *first = &sqr_distances_[0] + offsets_[index];
+  const float *last = &sqr_distances_[0] + offsets_[index + 1];
+
+  //  Same strict test as the FLANN radius search: keep d^2 < r^2
+  size_t count = std::lower_bound (first, last, static_cast<float> (radius * radius)) - first;
+  if (max_nn > 0 && count > max_nn)
+  {
+    count = max_nn;
+  }
+
+  k_indices.assign (neighbors_.begin () + offsets_[index], neighbors_.begin () + offsets_[index] + count);
+  k_sqr_distances.assign (first, first + count);
+  return (static_cast<int> (count));
+}
+
+#endif  // WP2_SEARCH_NEIGHBORHOOD_CACHE_H_
@@ -0,0 +1,462 @@
+//PARALLEL COLOUR REGION GROWING
+//THE NEIGHBOURS WITHIN THE DISTANCE THRESHOLD ARE SEARCHED ONCE, IN PARALLEL, INTO ONE CSR ADJACENCY AND THE COLOURS
+//ARE CONVERTED TO CIE LAB ONCE. REGIONS ARE THE COMPONENTS OF THE NEIGHBOUR GRAPH WITH CLOSE POINT COLOURS, JOINED IN
+//A CONCURRENT UNION-FIND; THEY ARE MERGED BY MEAN COLOUR, AND THE SMALL ONES INTO THEIR NEAREST NEIGHBOUR, WITH A
+//SECOND UNION-FIND OVER THE REGION ADJACENCY INSTEAD OF THE QUADRATIC MERGING PASSES OF pcl::RegionGrowingRGB
+
+#ifndef WP2_SEGMENTATION_COLOR_REGION_GROWING_H_
+#define WP2_SEGMENTATION_COLOR_REGION_GROWING_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+#include <pcl/console/print.h>
+#include <pcl/search/kdtree.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <wp2/common/union_find.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  //  The steps of pcl::RegionGrowingRGB without normals: points closer than the distance threshold and with a colour
+  //  difference below the point threshold are in one region, neighbouring regions whose mean colours differ by less
+  //  than the region threshold are merged, then every region smaller than the minimum size is merged into the nearest
+  //  region it touches. Every point has at most the given number of nearest neighbours, so a large distance threshold
+  //  does not mean a quadratic search.
+  template <typename PointT>
+  class ColorRegionGrowing
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+      typedef boost::shared_ptr<const std::vector<int> > IndicesConstPtr;
+
+      ColorRegionGrowing (unsigned int nr_threads = 0)
+        : distance_threshold_ (0.05f)
+        , nr_neighbours_ (30)
+        , point_color_threshold_ (3.0f)
+        , region_color_threshold_ (2.5f)
+        , min_size_ (1)
+        , max_size_ (std::numeric_limits<int>::max ())
+        , threads_ (nr_threads)
+      {
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      //  Only these points are segmented; all of them by default
+      void
+      setIndices (const IndicesConstPtr &indices)
+      {
+        indices_ = indices;
+      }
+
+      //  Radius of the neighbour search (RegionGrowingRGB::setDistanceThreshold)
+      void
+      setDistanceThreshold (float distance)
+      {
+        distance_threshold_ = distance;
+      }
+
+      //  Nearest neighbours kept within the radius
+      void
+      setNumberOfNeighbours (int k)
+      {
+        nr_neighbours_ = k;
+      }
+
+      //  CIE76 delta E between neighbouring points (euclidean in Lab, 0 to about 100 in lightness), not the RGB
+      //  distance of pcl::RegionGrowingRGB::setPointColorThreshold. Over mid-tone colours a step of d in RGB is about
+      //  d / 2 in delta E, so the RegionGrowingRGB 6 and 5 are about 3 and 2.5 (the defaults)
+      void
+      setPointColorThreshold (float threshold)
+      {
+        point_color_threshold_ = threshold;
+      }
+
+      //  CIE76 delta E between the mean colours of neighbouring regions, as above
+      void
+      setRegionColorThreshold (float threshold)
+      {
+        region_color_threshold_ = threshold;
+      }
+
+      void
+      setMinClusterSize (int min_size)
+      {
+        min_size_ = min_size;
+      }
+
+      void
+      setMaxClusterSize (int max_size)
+      {
+        max_size_ = max_size;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      //  Regions in the order of their first point, indices ascending
+      void
+      extract (std::vector<pcl::PointIndices> &clusters);
+
+    protected:
+      //  CSR adjacency over positions in points_: the neighbours of position i, nearest first and without i itself, are
+      //  neighbours_[offsets_[i] .. offsets_[i + 1]), their squared distances in sqr_distances_
+      void
+      computeNeighbours (int nr_threads);
+
+      //  sRGB (D65) to Lab, three floats per position
+      void
+      computeLab (int nr_threads);
+
+      float
+      sqrColorDistance (const float *a, const float *b) const
+      {
+        const float dl = a[0] - b[0], da = a[1] - b[1], db = a[2] - b[2];
+        return (dl * dl + da * da + db * db);
+      }
+
+      PointCloudConstPtr input_;
+      IndicesConstPtr indices_;
+      float distance_threshold_;
+      int nr_neighbours_;
+      float point_color_threshold_;
+      float region_color_threshold_;
+      int min_size_;
+      int max_size_;
+      unsigned int threads_;
+
+      //  Finite input points: cloud index per position
+      std::vector<int> points_;
+      std::vector<int> offsets_;
+      std::vector<int> neighbours_;
+      std::vector<float> sqr_distances_;
+      std::vector<float> lab_;
+  };
+}
+
+template <typename PointT> void
+wp2::ColorRegionGrowing<PointT>::computeNeighbours (int nr_threads)
+{
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const int n = static_cast<int> (points_.size ());
+  pcl::search::KdTree<PointT> tree;
+  tree.setInputCloud (input_, boost::shared_ptr<const std::vector<int> > (new std::vector<int> (points_)));
+
+  std::vector<int> position (cloud.size (), -1);
+  for (int i = 0; i < n; ++i)
+  {
+    position[points_[i]] = i;
+  }
+
+  //  Fixed stride first, then packed; the searches are const and run in parallel. The point itself is found too
+  const int k = nr_neighbours_ + 1;
+  std::vector<int> found (static_cast<size_t> (n) * k);
+  std::vector<float> found_distances (static_cast<size_t> (n) * k);
+  std::vector<int> counts (n, 0);
+#ifdef _OPENMP
+#pragma omp parallel num_threads (nr_threads)
+#endif
+  {
+    std::vector<int> nn_indices;
+    std::vector<float> nn_dists;
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 256)
+#endif
+    for (int i = 0; i < n; ++i)
+    {
+      const int count = tree.radiusSearch (cloud.points[points_[i]], distance_threshold_, nn_indices, nn_dists, k);
+      for (int j = 0; j < count; ++j)
+      {
+        const int p = position[nn_indices[j]];
+        if (p != i && p >= 0)
+        {
+          found[static_cast<size_t> (i) * k + counts[i]] = p;
+          found_distances[static_cast<size_t> (i) * k + counts[i]] = nn_dists[j];
+          ++counts[i];
+        }
+      }
+    }
+  }
+
+  offsets_.resize (n + 1);
+  offsets_[0] = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    offsets_[i + 1] = offsets_[i] + counts[i];
+  }
+  neighbours_.resize (offsets_[n]);
+  sqr_distances_.resize (offsets_[n]);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    const size_t begin = static_cast<size_t> (i) * k;
+    std::copy (found.begin () + begin, found.begin () + begin + counts[i], neighbours_.begin () + offsets_[i]);
+    std::copy (found_distances.begin () + begin, found_distances.begin () + begin + counts[i],
+               sqr_distances_.begin () + offsets_[i]);
+  }
+}
+
+template <typename PointT> void
+wp2::ColorRegionGrowing<PointT>::computeLab (int nr_threads)
+{
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const int n = static_cast<int> (points_.size ());
+
+  //  The sRGB transfer function of the 256 channel values
+  float linear[256];
+  for (int c = 0; c < 256; ++c)
+  {
+    const float v = static_cast<float> (c) / 255.0f;
+    linear[c] = v <= 0.04045f ? v / 12.92f : std::pow ((v + 0.055f) / 1.055f, 2.4f);
+  }
+
+  lab_.resize (static_cast<size_t> (n) * 3);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (static)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    const PointT &p = cloud.points[points_[i]];
+    const float r = linear[p.r], g = linear[p.g], b = linear[p.b];
+    //  XYZ relative to the D65 white point
+    float t[3];
+    t[0] = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+    t[1] = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    t[2] = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+    for (int c = 0; c < 3; ++c)
+    {
+      t[c] = t[c] > 0.008856f ? std::pow (t[c], 1.0f / 3.0f) : 7.787f * t[c] + 16.0f / 116.0f;
+    }
+    float *lab = &lab_[static_cast<size_t> (i) * 3];
+    lab[0] = 116.0f * t[1] - 16.0f;
+    lab[1] = 500.0f * (t[0] - t[1]);
+    lab[2] = 200.0f * (t[1] - t[2]);
+  }
+}
+
+template <typename PointT> void
+wp2::ColorRegionGrowing<PointT>::extract (std::vector<pcl::PointIndices> &clusters)
+{
+  clusters.clear ();
+  if (!input_ || distance_threshold_ <= 0.0f || nr_neighbours_ < 1)
+  {
+    PCL_ERROR ("[wp2::ColorRegionGrowing::extract] Error! No input cloud, no positive distance threshold or no neighbours.\n");
+    return;
+  }
+#ifdef _OPENMP
+  int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#else
+  int nr_threads = 1;
+#endif
+
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const size_t nr_input = indices_ ? indices_->size () : cloud.size ();
+  points_.clear ();
+  points_.reserve (nr_input);
+  for (size_t i = 0; i < nr_input; ++i)
+  {
+    const int index = indices_ ? (*indices_)[i] : static_cast<int> (i);
+    const PointT &p = cloud.points[index];
+    if (pcl_isfinite (p.x) && pcl_isfinite (p.y) && pcl_isfinite (p.z))
+    {
+      points_.push_back (index);
+    }
+  }
+  const int n = static_cast<int> (points_.size ());
+  if (n == 0)
+  {
+    return;
+  }
+
+  computeNeighbours (nr_threads);
+  computeLab (nr_threads);
+
+  //  Point regions: neighbours of close colour
+  const float sqr_point_threshold = point_color_threshold_ * point_color_threshold_;
+  std::vector<int> parent (n);
+  for (int i = 0; i < n; ++i)
+  {
+    parent[i] = i;
+  }
+  volatile int *roots = &parent[0];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 256)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    for (int e = offsets_[i]; e < offsets_[i + 1]; ++e)
+    {
+      const int j = neighbours_[e];
+      if (sqrColorDistance (&lab_[i * 3], &lab_[j * 3]) < sqr_point_threshold)
+      {
+        unite (roots, i, j);
+      }
+    }
+  }
+
+  //  Dense region numbers, with their sizes and mean colours
+  std::vector<int> region (n);
+  std::vector<int> sizes;
+  std::vector<float> means;
+  for (int i = 0; i < n; ++i)
+  {
+    const int root = findRoot (roots, i);
+    if (root == i)
+    {
+      region[i] = static_cast<int> (sizes.size ());
+      sizes.push_back (0);
+      means.resize (means.size () + 3, 0.0f);
+    }
+    else
+    {
+      region[i] = region[root];
+    }
+    ++sizes[region[i]];
+    for (int c = 0; c < 3; ++c)
+    {
+      means[region[i] * 3 + c] += lab_[i * 3 + c];
+    }
+  }
+  const int nr_regions = static_cast<int> (sizes.size ());
+  for (int r = 0; r < nr_regions; ++r)
+  {
+    for (int c = 0; c < 3; ++c)
+    {
+      means[r * 3 + c] /= static_cast<float> (sizes[r]);
+    }
+  }
+
+  //  Region adjacency, each pair once with the squared distance of its closest points
+  typedef std::pair<std::pair<int, int>, float> Adjacency;
+  std::vector<Adjacency> adjacency;
+#ifdef _OPENMP
+#pragma omp parallel num_threads (nr_threads)
+#endif
+  {
+    std::vector<Adjacency> local;
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 256) nowait
+#endif
+    for (int i = 0; i < n; ++i)
+    {
+      for (int e = offsets_[i]; e < offsets_[i + 1]; ++e)
+      {
+        const int a = region[i], b = region[neighbours_[e]];
+        if (a < b)
+        {
+          local.push_back (std::make_pair (std::make_pair (a, b), sqr_distances_[e]));
+        }
+        else if (b < a)
+        {
+          local.push_back (std::make_pair (std::make_pair (b, a), sqr_distances_[e]));
+        }
+      }
+    }
+    std::sort (local.begin (), local.end ());
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    adjacency.insert (adjacency.end (), local.begin (), local.end ());
+  }
+  std::sort (adjacency.begin (), adjacency.end ());
+  size_t nr_pairs = 0;
+  for (size_t p = 0; p < adjacency.size (); ++p)
+  {
+    if (nr_pairs == 0 || adjacency[p].first != adjacency[nr_pairs - 1].first)
+    {
+      adjacency[nr_pairs++] = adjacency[p];
+    }
+  }
+  adjacency.resize (nr_pairs);
+
+  //  Neighbouring regions of close mean colour, over the original means as pcl::RegionGrowingRGB does
+  const float sqr_region_threshold = region_color_threshold_ * region_color_threshold_;
+  std::vector<int> group (nr_regions);
+  for (int r = 0; r < nr_regions; ++r)
+  {
+    group[r] = r;
+  }
+  volatile int *groups = &group[0];
+  for (size_t p = 0; p < adjacency.size (); ++p)
+  {
+    const int a = adjacency[p].first.first, b = adjacency[p].first.second;
+    if (sqrColorDistance (&means[a * 3], &means[b * 3]) < sqr_region_threshold)
+    {
+      unite (groups, a, b);
+    }
+  }
+  std::vector<int> group_sizes (nr_regions, 0);
+  for (int r = 0; r < nr_regions; ++r)
+  {
+    group_sizes[findRoot (groups, r)] += sizes[r];
+  }
+
+  //  Small groups into the nearest group they touch, closest pairs first. Sizes only grow, so a group still small
+  //  at the end touches no other one
+  std::vector<std::pair<float, int> > by_distance (adjacency.size ());
+  for (size_t p = 0; p < adjacency.size (); ++p)
+  {
+    by_distance[p] = std::make_pair (adjacency[p].second, static_cast<int> (p));
+  }
+  std::sort (by_distance.begin (), by_distance.end ());
+  for (size_t d = 0; d < by_distance.size (); ++d)
+  {
+    const Adjacency &edge = adjacency[by_distance[d].second];
+    const int a = findRoot (groups, edge.first.first), b = findRoot (groups, edge.first.second);
+    if (a != b && (group_sizes[a] < min_size_ || group_sizes[b] < min_size_))
+    {
+      const int size = group_sizes[a] + group_sizes[b];
+      unite (groups, a, b);
+      group_sizes[findRoot (groups, a)] = size;
+    }
+  }
+
+  //  Size limits; indices ascending
+  std::vector<int> slot (nr_regions, -1);
+  for (int r = 0; r < nr_regions; ++r)
+  {
+    if (findRoot (groups, r) == r && group_sizes[r] >= min_size_ && group_sizes[r] <= max_size_)
+    {
+      slot[r] = static_cast<int> (clusters.size ());
+      clusters.push_back (pcl::PointIndices ());
+      clusters.back ().header = cloud.header;
+      clusters.back ().indices.reserve (group_sizes[r]);
+    }
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    const int s = slot[findRoot (groups, region[i])];
+    if (s >= 0)
+    {
+      clusters[s].indices.push_back (points_[i]);
+    }
+  }
+  for (size_t c = 0; c < clusters.size (); ++c)
+  {
+    std::sort (clusters[c].indices.begin (), clusters[c].indices.end ());
+  }
+}
+
+#endif  // WP2_SEGMENTATION_COLOR_REGION_GROWING_H_
@@ -0,0 +1,52 @@
+//CLUSTERS PAINTED FOR THE VIEWER
+
+#ifndef WP2_SEGMENTATION_COLORED_CLUSTERS_H_
+#define WP2_SEGMENTATION_COLORED_CLUSTERS_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+namespace wp2
+{
+  //  The cloud with one random colour per cluster and the other points white, as pcl::RegionGrowing::getColoredCloud;
+  //  keeps the width and height of an organized cloud
+  template <typename PointT> pcl::PointCloud<pcl::PointXYZRGB>::Ptr
+  getColoredCloud (const pcl::PointCloud<PointT> &cloud, const std::vector<pcl::PointIndices> &clusters)
+  {
+    pcl::PointCloud<pcl::PointXYZRGB>::Ptr colored (new pcl::PointCloud<pcl::PointXYZRGB>);
+    colored->points.resize (cloud.size ());
+    colored->width = cloud.width;
+    colored->height = cloud.height;
+    colored->is_dense = cloud.is_dense;
+    colored->header = cloud.header;
+    for (size_t i = 0; i < cloud.size (); ++i)
+    {
+      colored->points[i].x = cloud.points[i].x;
+      colored->points[i].y = cloud.points[i].y;
+      colored->points[i].z = cloud.points[i].z;
+      colored->points[i].r = colored->points[i].g = colored->points[i].b = 255;
+    }
+    srand (static_cast<unsigned int> (time (0)));
+    for (size_t c = 0; c < clusters.size (); ++c)
+    {
+      const uint8_t r = static_cast<uint8_t> (rand () % 256);
+      const uint8_t g = static_cast<uint8_t> (rand () % 256);
+      const uint8_t b = static_cast<uint8_t> (rand () % 256);
+      for (size_t i = 0; i < clusters[c].indices.size (); ++i)
+      {
+        pcl::PointXYZRGB &p = colored->points[clusters[c].indices[i]];
+        p.r = r;
+        p.g = g;
+        p.b = b;
+      }
+    }
+    return (colored);
+  }
+}
+
+#endif  // WP2_SEGMENTATION_COLORED_CLUSTERS_H_
@@ -0,0 +1,169 @@
+//ITERATIVE PLANE REMOVAL OVER ONE CLOUD
+//THE LARGEST PLANE IS FOUND BY RANSAC AMONG THE POINTS STILL ACTIVE, ITS INLIERS ARE DROPPED FROM THE ACTIVE SET
+//AND THE NEXT PLANE IS SEARCHED, UNTIL A FRACTION OF THE POINTS REMAINS. THE CLOUD IS NEVER COPIED: PLANES AND
+//THE REMAINDER ARE INDICES INTO IT. THE PLANES ARE FOUND BY wp2::ParallelRansac
+
+#ifndef WP2_SEGMENTATION_MULTI_PLANE_EXTRACTOR_H_
+#define WP2_SEGMENTATION_MULTI_PLANE_EXTRACTOR_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <wp2/segmentation/ransac.h>
+
+namespace wp2
+{
+  //  Same planes as repeated pcl::SACSegmentation (SACMODEL_PLANE, SAC_RANSAC, optimized coefficients) followed by
+  //  two pcl::ExtractIndices per plane, up to the random draws
+  template <typename PointT>
+  class MultiPlaneExtractor
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+      MultiPlaneExtractor (unsigned int nr_threads = 0)
+        : ransac_ (nr_threads)
+        , remaining_fraction_ (0.0f)
+        , max_planes_ (0)
+        , seed_ (1)
+      {
+        ransac_.setModel (ParallelRansac::MODEL_PLANE);
+        ransac_.setMaxIterations (200);
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      void
+      setDistanceThreshold (float threshold)
+      {
+        ransac_.setDistanceThreshold (threshold);
+      }
+
+      //  RANSAC hypotheses per plane, at most
+      void
+      setMaxIterations (int max_iterations)
+      {
+        ransac_.setMaxIterations (max_iterations);
+      }
+
+      //  See ParallelRansac
+      void
+      setProbability (double probability)
+      {
+        ransac_.setProbability (probability);
+      }
+
+      void
+      setEarlyExit (ParallelRansac::EarlyExit early_exit)
+      {
+        ransac_.setEarlyExit (early_exit);
+      }
+
+      //  Stops once no more than this fraction of the input points is left
+      void
+      setRemainingFraction (float fraction)
+      {
+        remaining_fraction_ = fraction;
+      }
+
+      //  0 means no limit
+      void
+      setMaxPlanes (int max_planes)
+      {
+        max_planes_ = max_planes;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        ransac_.setNumberOfThreads (nr_threads);
+      }
+
+      void
+      setSeed (unsigned int seed)
+      {
+        seed_ = seed;
+        ransac_.setSeed (seed);
+      }
+
+      //  Planes in extraction order, as ascending indices into the input cloud and [a b c d] with a unit normal
+      void
+      extract (std::vector<pcl::PointIndices> &planes, std::vector<pcl::ModelCoefficients> &coefficients);
+
+      //  Input points in no plane (non-finite points excluded), ascending, valid after extract
+      const std::vector<int> &
+      getRemainingIndices () const
+      {
+        return (remaining_);
+      }
+
+    protected:
+      ParallelRansac ransac_;
+      PointCloudConstPtr input_;
+      float remaining_fraction_;
+      int max_planes_;
+      unsigned int seed_;
+
+      //  Active points, shuffled once and compacted after every plane
+      SACPoints points_;
+      std::vector<int> remaining_;
+  };
+}
+
+template <typename PointT> void
+wp2::MultiPlaneExtractor<PointT>::extract (std::vector<pcl::PointIndices> &planes,
+                                           std::vector<pcl::ModelCoefficients> &coefficients)
+{
+  planes.clear ();
+  coefficients.clear ();
+  remaining_.clear ();
+  if (!input_)
+  {
+    return;
+  }
+
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  points_.assign (cloud, NULL, NULL, seed_);
+
+  const float stop_size = remaining_fraction_ * static_cast<float> (cloud.size ());
+  std::vector<float> plane;
+  std::vector<int> positions;
+  while (static_cast<float> (points_.size ()) > stop_size && (max_planes_ <= 0 || static_cast<int> (planes.size ()) < max_planes_))
+  {
+    if (!ransac_.computeModel (points_, plane))
+    {
+      break;
+    }
+
+    //  Inliers out, the rest stays in the active set
+    ransac_.selectWithinDistance (points_, plane, positions);
+    planes.push_back (pcl::PointIndices ());
+    planes.back ().header = cloud.header;
+    std::vector<int> &inliers = planes.back ().indices;
+    inliers.resize (positions.size ());
+    for (size_t i = 0; i < positions.size (); ++i)
+    {
+      inliers[i] = points_.indices[positions[i]];
+    }
+    std::sort (inliers.begin (), inliers.end ());
+    points_.erase (positions);
+
+    coefficients.push_back (pcl::ModelCoefficients ());
+    coefficients.back ().header = cloud.header;
+    coefficients.back ().values = plane;
+  }
+
+  remaining_ = points_.indices;
+  std::sort (remaining_.begin (), remaining_.end ());
+}
+
+#endif  // WP2_SEGMENTATION_MULTI_PLANE_EXTRACTOR_H_
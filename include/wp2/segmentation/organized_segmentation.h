@@ -0,0 +1,392 @@
+//SEGMENTATION OF ORGANIZED (RGB-D) FRAMES IN IMAGE SPACE
+//NORMALS FROM INTEGRAL IMAGES, PLANES FROM pcl::OrganizedMultiPlaneSegmentation, THEN CONNECTED COMPONENTS OF THE
+//REMAINING PIXELS, TWO 4-NEIGHBOURS JOINED WHEN THEY ARE CLOSE IN SPACE (AND IN COLOUR AND NORMAL, WHEN ASKED).
+//NO KD-TREE: EVERY STEP WALKS THE PIXEL GRID, SO A 640x480 FRAME SEGMENTS AT SENSOR RATE
+
+#ifndef WP2_SEGMENTATION_ORGANIZED_SEGMENTATION_H_
+#define WP2_SEGMENTATION_ORGANIZED_SEGMENTATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/console/print.h>
+#include <pcl/features/integral_image_normal.h>
+#include <pcl/segmentation/comparator.h>
+#include <pcl/segmentation/organized_connected_component_segmentation.h>
+#include <pcl/segmentation/organized_multi_plane_segmentation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace wp2
+{
+  //  Squared RGB distance within threshold; points without colour always pass
+  template <typename PointT> inline bool
+  colorClose (const PointT &a, const PointT &b, float sqr_threshold)
+  {
+    const float dr = static_cast<float> (a.r) - static_cast<float> (b.r);
+    const float dg = static_cast<float> (a.g) - static_cast<float> (b.g);
+    const float db = static_cast<float> (a.b) - static_cast<float> (b.b);
+    return (dr * dr + dg * dg + db * db <= sqr_threshold);
+  }
+
+  inline bool
+  colorClose (const pcl::PointXYZ &, const pcl::PointXYZ &, float)
+  {
+    return (true);
+  }
+
+  //  Joins two pixels closer than the distance threshold, neither on an excluded label (e.g. a plane), and optionally
+  //  within a colour distance (as pcl::RegionGrowingRGB::setPointColorThreshold) and a normal angle (as
+  //  pcl::RegionGrowing::setSmoothnessThreshold)
+  template <typename PointT>
+  class OrganizedClusterComparator : public pcl::Comparator<PointT>
+  {
+    public:
+      typedef boost::shared_ptr<OrganizedClusterComparator<PointT> > Ptr;
+      typedef boost::shared_ptr<const OrganizedClusterComparator<PointT> > ConstPtr;
+
+      OrganizedClusterComparator ()
+        : sqr_distance_ (0.0001f)
+        , sqr_color_ (-1.0f)
+        , min_cosine_ (-2.0f)
+      {
+      }
+
+      void
+      setLabels (const pcl::PointCloud<pcl::Label>::ConstPtr &labels, const std::vector<bool> &exclude_labels)
+      {
+        labels_ = labels;
+        exclude_labels_ = exclude_labels;
+      }
+
+      void
+      setInputNormals (const pcl::PointCloud<pcl::Normal>::ConstPtr &normals)
+      {
+        normals_ = normals;
+      }
+
+      void
+      setDistanceThreshold (float threshold)
+      {
+        sqr_distance_ = threshold * threshold;
+      }
+
+      //  RGB distance; negative disables
+      void
+      setColorThreshold (float threshold)
+      {
+        sqr_color_ = threshold < 0.0f ? -1.0f : threshold * threshold;
+      }
+
+      //  Radians between the normals, which must be set; negative disables
+      void
+      setAngularThreshold (float threshold)
+      {
+        min_cosine_ = threshold < 0.0f ? -2.0f : std::cos (threshold);
+      }
+
+      virtual bool
+      compare (int idx1, int idx2) const
+      {
+        if (labels_ && (excluded (idx1) || excluded (idx2)))
+        {
+          return (false);
+        }
+        const PointT &a = this->input_->points[idx1];
+        const PointT &b = this->input_->points[idx2];
+        const float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+        if (dx * dx + dy * dy + dz * dz >= sqr_distance_)
+        {
+          return (false);
+        }
+        if (sqr_color_ >= 0.0f && !colorClose (a, b, sqr_color_))
+        {
+          return (false);
+        }
+        if (min_cosine_ > -1.0f && normals_)
+        {
+          const pcl::Normal &na = normals_->points[idx1];
+          const pcl::Normal &nb = normals_->points[idx2];
+          const float cosine = std::abs (na.normal_x * nb.normal_x + na.normal_y * nb.normal_y + na.normal_z * nb.normal_z);
+          //  NaN normals (depth edges) fail here
+          if (!(cosine >= min_cosine_))
+          {
+            return (false);
+          }
+        }
+        return (true);
+      }
+
+    protected:
+      bool
+      excluded (int idx) const
+      {
+        const unsigned int label = labels_->points[idx].label;
+        return (label < exclude_labels_.size () && exclude_labels_[label]);
+      }
+
+      pcl::PointCloud<pcl::Label>::ConstPtr labels_;
+      std::vector<bool> exclude_labels_;
+      pcl::PointCloud<pcl::Normal>::ConstPtr normals_;
+      float sqr_distance_;
+      float sqr_color_;
+      float min_cosine_;
+  };
+
+  //  Organized counterpart of MultiPlaneExtractor + VoxelClusterExtraction: planes, then clusters of what is left,
+  //  all as indices into the frame, clusters by decreasing size
+  template <typename PointT>
+  class OrganizedSegmentation
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+      OrganizedSegmentation ()
+        : plane_distance_ (0.02f)
+        , plane_angle_ (0.0349f)
+        , min_plane_inliers_ (10000)
+        , max_depth_change_ (0.02f)
+        , smoothing_size_ (20.0f)
+        , cluster_tolerance_ (0.02f)
+        , color_threshold_ (-1.0f)
+        , smoothness_threshold_ (-1.0f)
+        , min_cluster_size_ (1)
+        , max_cluster_size_ (std::numeric_limits<int>::max ())
+        , normals_ (new pcl::PointCloud<pcl::Normal>)
+        , labels_ (new pcl::PointCloud<pcl::Label>)
+      {
+      }
+
+      //  Must be organized (height > 1)
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      //  Of a point to its plane
+      void
+      setDistanceThreshold (float threshold)
+      {
+        plane_distance_ = threshold;
+      }
+
+      //  Radians between a normal and its plane
+      void
+      setAngularThreshold (float threshold)
+      {
+        plane_angle_ = threshold;
+      }
+
+      //  Smaller planar regions are left to the clustering; 0 skips the planes altogether
+      void
+      setMinPlaneInliers (int min_inliers)
+      {
+        min_plane_inliers_ = min_inliers;
+      }
+
+      //  Integral image normals: depth step that breaks a smoothing window, and the window size in pixels
+      void
+      setNormalParameters (float max_depth_change, float smoothing_size)
+      {
+        max_depth_change_ = max_depth_change;
+        smoothing_size_ = smoothing_size;
+      }
+
+      //  Between neighbouring pixels of one cluster
+      void
+      setClusterTolerance (float tolerance)
+      {
+        cluster_tolerance_ = tolerance;
+      }
+
+      //  RGB distance between neighbouring pixels of one cluster; negative (default) ignores colour
+      void
+      setColorThreshold (float threshold)
+      {
+        color_threshold_ = threshold;
+      }
+
+      //  Radians between the normals of neighbouring pixels of one cluster; negative (default) ignores normals
+      void
+      setSmoothnessThreshold (float threshold)
+      {
+        smoothness_threshold_ = threshold;
+      }
+
+      void
+      setMinClusterSize (int min_size)
+      {
+        min_cluster_size_ = min_size;
+      }
+
+      void
+      setMaxClusterSize (int max_size)
+      {
+        max_cluster_size_ = max_size;
+      }
+
+      void
+      segment (std::vector<pcl::PointIndices> &planes, std::vector<pcl::ModelCoefficients> &coefficients,
+               std::vector<pcl::PointIndices> &clusters);
+
+      //  Valid pixels on no plane, ascending, valid after segment
+      const std::vector<int> &
+      getRemainingIndices () const
+      {
+        return (remaining_);
+      }
+
+      //  Normals of the last frame
+      pcl::PointCloud<pcl::Normal>::ConstPtr
+      getNormals () const
+      {
+        return (normals_);
+      }
+
+    protected:
+      PointCloudConstPtr input_;
+      float plane_distance_;
+      float plane_angle_;
+      int min_plane_inliers_;
+      float max_depth_change_;
+      float smoothing_size_;
+      float cluster_tolerance_;
+      float color_threshold_;
+      float smoothness_threshold_;
+      int min_cluster_size_;
+      int max_cluster_size_;
+
+      pcl::PointCloud<pcl::Normal>::Ptr normals_;
+      pcl::PointCloud<pcl::Label>::Ptr labels_;
+      std::vector<int> remaining_;
+  };
+}
+
+template <typename PointT> void
+wp2::OrganizedSegmentation<PointT>::segment (std::vector<pcl::PointIndices> &planes,
+                                             std::vector<pcl::ModelCoefficients> &coefficients,
+                                             std::vector<pcl::PointIndices> &clusters)
+{
+  planes.clear ();
+  coefficients.clear ();
+  clusters.clear ();
+  remaining_.clear ();
+  if (!input_ || !input_->isOrganized ())
+  {
+    PCL_ERROR ("[wp2::OrganizedSegmentation::segment] Error! The input cloud is not organized.\n");
+    return;
+  }
+
+  const bool need_normals = min_plane_inliers_ > 0 || smoothness_threshold_ >= 0.0f;
+  if (need_normals)
+  {
+    pcl::IntegralImageNormalEstimation<PointT, pcl::Normal> ne;
+    ne.setNormalEstimationMethod (pcl::IntegralImageNormalEstimation<PointT, pcl::Normal>::COVARIANCE_MATRIX);
+    ne.setMaxDepthChangeFactor (max_depth_change_);
+    ne.setNormalSmoothingSize (smoothing_size_);
+    ne.setInputCloud (input_);
+    ne.compute (*normals_);
+  }
+
+  //  Planes: the labels of the plane inliers are left out of the clusters
+  std::vector<bool> plane_labels;
+  labels_->clear ();
+  if (min_plane_inliers_ > 0)
+  {
+    pcl::OrganizedMultiPlaneSegmentation<PointT, pcl::Normal, pcl::Label> mps;
+    mps.setMinInliers (min_plane_inliers_);
+    mps.setAngularThreshold (plane_angle_);
+    mps.setDistanceThreshold (plane_distance_);
+    mps.setInputNormals (normals_);
+    mps.setInputCloud (input_);
+
+    std::vector<pcl::PlanarRegion<PointT>, Eigen::aligned_allocator<pcl::PlanarRegion<PointT> > > regions;
+    std::vector<pcl::PointIndices> label_indices;
+    std::vector<pcl::PointIndices> boundary_indices;
+    mps.segmentAndRefine (regions, coefficients, planes, labels_, label_indices, boundary_indices);
+
+    //  Taken from the inliers rather than from the label sizes: a large region that segmentAndRefine rejected (too
+    //  curved) has no plane, and its pixels go to the clusters
+    plane_labels.resize (label_indices.size (), false);
+    for (size_t p = 0; p < planes.size (); ++p)
+    {
+      for (size_t i = 0; i < planes[p].indices.size (); ++i)
+      {
+        const unsigned int label = labels_->points[planes[p].indices[i]].label;
+        if (label >= plane_labels.size ())
+        {
+          plane_labels.resize (label + 1, false);
+        }
+        plane_labels[label] = true;
+      }
+      std::sort (planes[p].indices.begin (), planes[p].indices.end ());
+    }
+  }
+
+  typename OrganizedClusterComparator<PointT>::Ptr comparator (new OrganizedClusterComparator<PointT>);
+  comparator->setInputCloud (input_);
+  comparator->setDistanceThreshold (cluster_tolerance_);
+  comparator->setColorThreshold (color_threshold_);
+  if (smoothness_threshold_ >= 0.0f)
+  {
+    comparator->setInputNormals (normals_);
+    comparator->setAngularThreshold (smoothness_threshold_);
+  }
+  if (!labels_->empty ())
+  {
+    comparator->setLabels (labels_, plane_labels);
+  }
+
+  for (size_t i = 0; i < input_->size (); ++i)
+  {
+    const PointT &p = input_->points[i];
+    if (pcl_isfinite (p.x) && pcl_isfinite (p.y) && pcl_isfinite (p.z))
+    {
+      const unsigned int label = labels_->empty () ? 0 : labels_->points[i].label;
+      if (label >= plane_labels.size () || !plane_labels[label])
+      {
+        remaining_.push_back (static_cast<int> (i));
+      }
+    }
+  }
+
+  pcl::PointCloud<pcl::Label> cluster_labels;
+  std::vector<pcl::PointIndices> components;
+  pcl::OrganizedConnectedComponentSegmentation<PointT, pcl::Label> connected (comparator);
+  connected.setInputCloud (input_);
+  connected.segment (cluster_labels, components);
+
+  //  As pcl::EuclideanClusterExtraction: size limits, indices ascending, largest first. Plane pixels join nothing and
+  //  come back as single pixel components, which are dropped
+  std::vector<std::pair<int, int> > sizes;
+  for (size_t c = 0; c < components.size (); ++c)
+  {
+    const int size = static_cast<int> (components[c].indices.size ());
+    if (size == 0)
+    {
+      continue;
+    }
+    const unsigned int label = labels_->empty () ? 0 : labels_->points[components[c].indices[0]].label;
+    const bool on_plane = label < plane_labels.size () && plane_labels[label];
+    if (!on_plane && size >= min_cluster_size_ && size <= max_cluster_size_)
+    {
+      sizes.push_back (std::make_pair (-size, static_cast<int> (c)));
+    }
+  }
+  std::sort (sizes.begin (), sizes.end ());
+  clusters.resize (sizes.size ());
+  for (size_t c = 0; c < sizes.size (); ++c)
+  {
+    clusters[c].header = input_->header;
+    clusters[c].indices.swap (components[sizes[c].second].indices);
+    std::sort (clusters[c].indices.begin (), clusters[c].indices.end ());
+  }
+}
+
+#endif  // WP2_SEGMENTATION_ORGANIZED_SEGMENTATION_H_
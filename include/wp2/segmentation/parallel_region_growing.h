@@ -0,0 +1,426 @@
+//PARALLEL SMOOTHNESS REGION GROWING
+//THE K NEAREST NEIGHBOURS OF EVERY POINT ARE SEARCHED ONCE, IN PARALLEL, AND KEPT AS ONE CSR ADJACENCY; NORMALS AND
+//CURVATURE ARE COMPUTED FROM THOSE LISTS, AND THE REGIONS ARE THE COMPONENTS OF THE SMOOTH NEIGHBOUR GRAPH, JOINED
+//IN A CONCURRENT UNION-FIND INSTEAD OF ONE SERIAL FLOOD FILL PER SEED
+
+#ifndef WP2_SEGMENTATION_PARALLEL_REGION_GROWING_H_
+#define WP2_SEGMENTATION_PARALLEL_REGION_GROWING_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+#include <pcl/console/print.h>
+#include <pcl/features/normal_3d.h>
+#include <pcl/search/kdtree.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <wp2/common/union_find.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  //  The thresholds mean what they mean in pcl::RegionGrowing (smooth mode): two neighbours are in one region when the
+  //  angle between their normals is below the smoothness threshold, and a point whose curvature is above the curvature
+  //  threshold joins a region but does not grow it. pcl::RegionGrowing grows one region at a time from the flattest
+  //  free point, so where the k-nearest-neighbour relation is not symmetric its regions depend on the growing order;
+  //  here an edge counts in both directions. A high curvature point touching several regions joins the one whose
+  //  flattest point is the flattest, as it would be reached first.
+  template <typename PointT>
+  class ParallelRegionGrowing
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+
+      ParallelRegionGrowing (unsigned int nr_threads = 0)
+        : normal_k_ (50)
+        , grow_k_ (30)
+        , cos_smoothness_ (std::cos (30.0f / 180.0f * static_cast<float> (M_PI)))
+        , curvature_threshold_ (0.05f)
+        , curvature_test_ (true)
+        , min_size_ (1)
+        , max_size_ (std::numeric_limits<int>::max ())
+        , threads_ (nr_threads)
+        , normals_ (new pcl::PointCloud<pcl::Normal>)
+      {
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+        user_normals_.reset ();
+      }
+
+      //  Skips the normal estimation
+      void
+      setInputNormals (const pcl::PointCloud<pcl::Normal>::ConstPtr &normals)
+      {
+        user_normals_ = normals;
+      }
+
+      //  Neighbours of the normal estimation (NormalEstimation::setKSearch)
+      void
+      setNormalKSearch (int k)
+      {
+        normal_k_ = k;
+      }
+
+      //  Neighbours a point grows to (RegionGrowing::setNumberOfNeighbours)
+      void
+      setNumberOfNeighbours (int k)
+      {
+        grow_k_ = k;
+      }
+
+      //  Radians
+      void
+      setSmoothnessThreshold (float theta)
+      {
+        cos_smoothness_ = std::cos (theta);
+      }
+
+      void
+      setCurvatureThreshold (float curvature)
+      {
+        curvature_threshold_ = curvature;
+      }
+
+      void
+      setCurvatureTestFlag (bool value)
+      {
+        curvature_test_ = value;
+      }
+
+      void
+      setMinClusterSize (int min_size)
+      {
+        min_size_ = min_size;
+      }
+
+      void
+      setMaxClusterSize (int max_size)
+      {
+        max_size_ = max_size;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      //  Regions in growing order (flattest first), indices ascending
+      void
+      extract (std::vector<pcl::PointIndices> &clusters);
+
+      //  Estimated (or given) normals, valid after extract
+      pcl::PointCloud<pcl::Normal>::ConstPtr
+      getNormals () const
+      {
+        return (user_normals_ ? user_normals_ : pcl::PointCloud<pcl::Normal>::ConstPtr (normals_));
+      }
+
+    protected:
+      //  CSR adjacency: the neighbours of point i, nearest first, are neighbours_[offsets_[i] .. offsets_[i + 1])
+      void
+      computeNeighbours (int k, int nr_threads);
+
+      void
+      computeNormals (int nr_threads);
+
+      bool
+      smooth (const pcl::Normal &a, const pcl::Normal &b) const
+      {
+        //  NaN normals fail
+        return (std::abs (a.normal_x * b.normal_x + a.normal_y * b.normal_y + a.normal_z * b.normal_z) >= cos_smoothness_);
+      }
+
+      PointCloudConstPtr input_;
+      pcl::PointCloud<pcl::Normal>::ConstPtr user_normals_;
+      int normal_k_;
+      int grow_k_;
+      float cos_smoothness_;
+      float curvature_threshold_;
+      bool curvature_test_;
+      int min_size_;
+      int max_size_;
+      unsigned int threads_;
+
+      std::vector<int> offsets_;
+      std::vector<int> neighbours_;
+      pcl::PointCloud<pcl::Normal>::Ptr normals_;
+  };
+}
+
+template <typename PointT> void
+wp2::ParallelRegionGrowing<PointT>::computeNeighbours (int k, int nr_threads)
+{
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const int n = static_cast<int> (cloud.size ());
+  pcl::search::KdTree<PointT> tree;
+  tree.setInputCloud (input_);
+
+  //  Fixed stride first, then packed; the searches are const and run in parallel
+  std::vector<int> found (static_cast<size_t> (n) * k);
+  std::vector<int> counts (n, 0);
+#ifdef _OPENMP
+#pragma omp parallel num_threads (nr_threads)
+#endif
+  {
+    std::vector<int> nn_indices (k);
+    std::vector<float> nn_dists (k);
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 256)
+#endif
+    for (int i = 0; i < n; ++i)
+    {
+      const PointT &p = cloud.points[i];
+      if (!pcl_isfinite (p.x) || !pcl_isfinite (p.y) || !pcl_isfinite (p.z))
+      {
+        continue;
+      }
+      counts[i] = tree.nearestKSearch (i, k, nn_indices, nn_dists);
+      std::copy (nn_indices.begin (), nn_indices.begin () + counts[i], found.begin () + static_cast<size_t> (i) * k);
+    }
+  }
+
+  offsets_.resize (n + 1);
+  offsets_[0] = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    offsets_[i + 1] = offsets_[i] + counts[i];
+  }
+  neighbours_.resize (offsets_[n]);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    std::copy (found.begin () + static_cast<size_t> (i) * k, found.begin () + static_cast<size_t> (i) * k + counts[i],
+               neighbours_.begin () + offsets_[i]);
+  }
+}
+
+template <typename PointT> void
+wp2::ParallelRegionGrowing<PointT>::computeNormals (int nr_threads)
+{
+  //  As pcl::NormalEstimation: PCA of the neighbourhood, flipped towards the viewpoint at the origin
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const int n = static_cast<int> (cloud.size ());
+  normals_->points.resize (n);
+  normals_->width = cloud.width;
+  normals_->height = cloud.height;
+  normals_->header = cloud.header;
+  normals_->is_dense = true;
+#ifdef _OPENMP
+#pragma omp parallel num_threads (nr_threads)
+#endif
+  {
+    std::vector<int> neighbourhood;
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 256)
+#endif
+    for (int i = 0; i < n; ++i)
+    {
+      pcl::Normal &normal = normals_->points[i];
+      const int count = std::min (offsets_[i + 1] - offsets_[i], normal_k_);
+      neighbourhood.assign (neighbours_.begin () + offsets_[i], neighbours_.begin () + offsets_[i] + count);
+      if (count < 3 || !pcl::computePointNormal (cloud, neighbourhood, normal.normal_x, normal.normal_y, normal.normal_z,
+                                                 normal.curvature))
+      {
+        normal.normal_x = normal.normal_y = normal.normal_z = normal.curvature = std::numeric_limits<float>::quiet_NaN ();
+        continue;
+      }
+      pcl::flipNormalTowardsViewpoint (cloud.points[i], 0.0f, 0.0f, 0.0f, normal.normal_x, normal.normal_y, normal.normal_z);
+    }
+  }
+}
+
+template <typename PointT> void
+wp2::ParallelRegionGrowing<PointT>::extract (std::vector<pcl::PointIndices> &clusters)
+{
+  clusters.clear ();
+  if (!input_ || input_->empty ())
+  {
+    PCL_ERROR ("[wp2::ParallelRegionGrowing::extract] Error! No input cloud.\n");
+    return;
+  }
+  if (user_normals_ && user_normals_->size () != input_->size ())
+  {
+    PCL_ERROR ("[wp2::ParallelRegionGrowing::extract] Error! The normals do not match the cloud.\n");
+    return;
+  }
+#ifdef _OPENMP
+  int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#else
+  int nr_threads = 1;
+#endif
+
+  computeNeighbours (user_normals_ ? grow_k_ : std::max (normal_k_, grow_k_), nr_threads);
+  if (!user_normals_)
+  {
+    computeNormals (nr_threads);
+  }
+  const pcl::PointCloud<pcl::Normal> &normals = user_normals_ ? *user_normals_ : *normals_;
+  const int n = static_cast<int> (input_->size ());
+
+  //  Points that grow their region; the others only join one
+  std::vector<char> grows (n);
+  for (int i = 0; i < n; ++i)
+  {
+    const bool valid = offsets_[i + 1] > offsets_[i] && pcl_isfinite (normals.points[i].normal_x);
+    grows[i] = valid && (!curvature_test_ || normals.points[i].curvature <= curvature_threshold_);
+  }
+
+  std::vector<int> parent (n);
+  for (int i = 0; i < n; ++i)
+  {
+    parent[i] = i;
+  }
+  volatile int *roots = &parent[0];
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 256)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    if (!grows[i])
+    {
+      continue;
+    }
+    const int end = std::min (offsets_[i + 1], offsets_[i] + grow_k_);
+    for (int e = offsets_[i]; e < end; ++e)
+    {
+      const int j = neighbours_[e];
+      if (j != i && grows[j] && smooth (normals.points[i], normals.points[j]))
+      {
+        unite (roots, i, j);
+      }
+    }
+  }
+
+  //  Regions ranked by their flattest point, as pcl::RegionGrowing picks its seeds
+  std::vector<std::pair<float, int> > flattest (n, std::make_pair (std::numeric_limits<float>::max (), n));
+  for (int i = 0; i < n; ++i)
+  {
+    if (grows[i])
+    {
+      const int root = findRoot (roots, i);
+      flattest[root] = std::min (flattest[root], std::make_pair (normals.points[i].curvature, i));
+    }
+  }
+  std::vector<std::pair<std::pair<float, int>, int> > order;
+  for (int i = 0; i < n; ++i)
+  {
+    if (grows[i] && findRoot (roots, i) == i)
+    {
+      order.push_back (std::make_pair (flattest[i], i));
+    }
+  }
+  std::sort (order.begin (), order.end ());
+  std::vector<int> rank (n, -1);
+  for (size_t r = 0; r < order.size (); ++r)
+  {
+    rank[order[r].second] = static_cast<int> (r);
+  }
+
+  //  A point that does not grow joins the first ranked region with a smooth edge to it
+  std::vector<int> region (n, -1);
+  volatile int *regions = &region[0];
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 256)
+#endif
+  for (int i = 0; i < n; ++i)
+  {
+    if (!grows[i])
+    {
+      continue;
+    }
+    const int r = rank[findRoot (roots, i)];
+    regions[i] = r;
+    const int end = std::min (offsets_[i + 1], offsets_[i] + grow_k_);
+    for (int e = offsets_[i]; e < end; ++e)
+    {
+      const int j = neighbours_[e];
+      if (grows[j] || !smooth (normals.points[i], normals.points[j]))
+      {
+        continue;
+      }
+      int current;
+      while (((current = regions[j]) < 0 || r < current) && !__sync_bool_compare_and_swap (&regions[j], current, r))
+      {
+      }
+    }
+  }
+
+  //  What no region reached starts its own, flattest first, and takes its unreached smooth neighbours with it
+  std::vector<std::pair<float, int> > stranded;
+  for (int i = 0; i < n; ++i)
+  {
+    if (region[i] < 0 && offsets_[i + 1] > offsets_[i])
+    {
+      const float curvature = normals.points[i].curvature;
+      stranded.push_back (std::make_pair (pcl_isfinite (curvature) ? curvature : std::numeric_limits<float>::max (), i));
+    }
+  }
+  std::sort (stranded.begin (), stranded.end ());
+  int nr_regions = static_cast<int> (order.size ());
+  for (size_t s = 0; s < stranded.size (); ++s)
+  {
+    const int i = stranded[s].second;
+    if (region[i] >= 0)
+    {
+      continue;
+    }
+    region[i] = nr_regions;
+    const int end = std::min (offsets_[i + 1], offsets_[i] + grow_k_);
+    for (int e = offsets_[i]; e < end; ++e)
+    {
+      const int j = neighbours_[e];
+      if (region[j] < 0 && smooth (normals.points[i], normals.points[j]))
+      {
+        region[j] = nr_regions;
+      }
+    }
+    ++nr_regions;
+  }
+
+  //  Size limits; indices come out ascending
+  std::vector<int> sizes (nr_regions, 0);
+  for (int i = 0; i < n; ++i)
+  {
+    if (region[i] >= 0)
+    {
+      ++sizes[region[i]];
+    }
+  }
+  std::vector<int> slot (nr_regions, -1);
+  for (int r = 0; r < nr_regions; ++r)
+  {
+    if (sizes[r] >= min_size_ && sizes[r] <= max_size_)
+    {
+      slot[r] = static_cast<int> (clusters.size ());
+      clusters.push_back (pcl::PointIndices ());
+      clusters.back ().header = input_->header;
+      clusters.back ().indices.reserve (sizes[r]);
+    }
+  }
+  for (int i = 0; i < n; ++i)
+  {
+    if (region[i] >= 0 && slot[region[i]] >= 0)
+    {
+      clusters[slot[region[i]]].indices.push_back (i);
+    }
+  }
+}
+
+#endif  // WP2_SEGMENTATION_PARALLEL_REGION_GROWING_H_
@@ -0,0 +1,228 @@
+//SEQUENTIAL PLANE, CYLINDER AND SPHERE SEGMENTATION OVER ONE CLOUD
+//THE FINITE POINTS AND THEIR NORMALS ARE COPIED ONCE, AS PACKED COORDINATES, INTO THE ACTIVE SET OF
+//wp2::ParallelRansac. EVERY PRIMITIVE IS FITTED ON WHAT IS STILL ACTIVE AND ITS INLIERS ARE COMPACTED OUT OF THE SET
+//BEFORE THE NEXT ONE: NO EXTRACTINDICES AND NO NEW CLOUD PER MODEL. PRIMITIVES AND THE REMAINDER ARE INDICES INTO THE
+//INPUT
+
+#ifndef WP2_SEGMENTATION_PRIMITIVE_SEGMENTATION_H_
+#define WP2_SEGMENTATION_PRIMITIVE_SEGMENTATION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/PointIndices.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/console/print.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <wp2/segmentation/ransac.h>
+
+namespace wp2
+{
+  //  Same inliers as a pcl::SACSegmentationFromNormals per primitive with pcl::ExtractIndices in between, up to the
+  //  random draws
+  template <typename PointT>
+  class PrimitiveSegmentation
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+      typedef pcl::PointCloud<pcl::Normal>::ConstPtr NormalCloudConstPtr;
+      typedef boost::shared_ptr<const std::vector<int> > IndicesConstPtr;
+
+      //  One step of the sequence: up to max_instances models of one kind, each with at least min_inliers points
+      struct Primitive
+      {
+        Primitive (ParallelRansac::Model model = ParallelRansac::MODEL_PLANE)
+          : model (model)
+          , threshold (0.01f)
+          , normal_weight (0.1f)
+          , min_radius (0.0f)
+          , max_radius (std::numeric_limits<float>::max ())
+          , max_iterations (1000)
+          , max_instances (1)
+          , min_inliers (0)
+        {
+        }
+
+        ParallelRansac::Model model;
+        float threshold;
+        float normal_weight;
+        float min_radius;
+        float max_radius;
+        int max_iterations;
+        int max_instances;
+        int min_inliers;
+      };
+
+      //  A fitted model, with ascending inliers into the input cloud and the RANSAC statistics of its search
+      struct Segment
+      {
+        ParallelRansac::Model model;
+        pcl::PointIndices inliers;
+        pcl::ModelCoefficients coefficients;
+        int iterations;
+        int rejected;
+      };
+
+      PrimitiveSegmentation (unsigned int nr_threads = 0)
+        : ransac_ (nr_threads)
+        , seed_ (1)
+      {
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      //  One normal per input point; required by cylinders, used by the others when their weight is positive
+      void
+      setInputNormals (const NormalCloudConstPtr &normals)
+      {
+        normals_ = normals;
+      }
+
+      //  Only these points are segmented; all of them by default
+      void
+      setIndices (const IndicesConstPtr &indices)
+      {
+        indices_ = indices;
+      }
+
+      //  Appended to the sequence, which runs in the order of the calls
+      void
+      addPrimitive (const Primitive &primitive)
+      {
+        primitives_.push_back (primitive);
+      }
+
+      void
+      clearPrimitives ()
+      {
+        primitives_.clear ();
+      }
+
+      void
+      setEarlyExit (ParallelRansac::EarlyExit early_exit)
+      {
+        ransac_.setEarlyExit (early_exit);
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        ransac_.setNumberOfThreads (nr_threads);
+      }
+
+      void
+      setSeed (unsigned int seed)
+      {
+        seed_ = seed;
+        ransac_.setSeed (seed);
+      }
+
+      //  Models in fitting order
+      void
+      segment (std::vector<Segment> &segments);
+
+      //  Input points in no model (non-finite points and normals excluded), ascending, valid after segment
+      const std::vector<int> &
+      getRemainingIndices () const
+      {
+        return (remaining_);
+      }
+
+    protected:
+      ParallelRansac ransac_;
+      PointCloudConstPtr input_;
+      NormalCloudConstPtr normals_;
+      IndicesConstPtr indices_;
+      std::vector<Primitive> primitives_;
+      unsigned int seed_;
+
+      //  Copy of the finite points and normals (x, y, z and normal arrays), shuffled once and compacted after every
+      //  model
+      SACPoints points_;
+      std::vector<int> remaining_;
+  };
+}
+
+template <typename PointT> void
+wp2::PrimitiveSegmentation<PointT>::segment (std::vector<Segment> &segments)
+{
+  segments.clear ();
+  remaining_.clear ();
+  if (!input_)
+  {
+    return;
+  }
+  if (normals_ && normals_->size () != input_->size ())
+  {
+    PCL_ERROR ("[wp2::PrimitiveSegmentation::segment] Error! %lu normals for %lu points\n",
+               static_cast<unsigned long> (normals_->size ()), static_cast<unsigned long> (input_->size ()));
+    return;
+  }
+
+  //  Coordinates and normals are copied here, packed; the models then work on this set alone
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  points_.assign (cloud, normals_.get (), indices_.get (), seed_);
+
+  std::vector<float> model;
+  std::vector<int> positions;
+  for (size_t p = 0; p < primitives_.size (); ++p)
+  {
+    const Primitive &primitive = primitives_[p];
+    if (primitive.model == ParallelRansac::MODEL_CYLINDER && !points_.hasNormals ())
+    {
+      PCL_ERROR ("[wp2::PrimitiveSegmentation::segment] Error! Cylinders need normals\n");
+      continue;
+    }
+    ransac_.setModel (primitive.model);
+    ransac_.setDistanceThreshold (primitive.threshold);
+    ransac_.setNormalDistanceWeight (primitive.normal_weight);
+    ransac_.setRadiusLimits (primitive.min_radius, primitive.max_radius);
+    ransac_.setMaxIterations (primitive.max_iterations);
+
+    for (int instance = 0; instance < primitive.max_instances; ++instance)
+    {
+      if (static_cast<int> (points_.size ()) < ransac_.sampleSize () || !ransac_.computeModel (points_, model))
+      {
+        break;
+      }
+      ransac_.selectWithinDistance (points_, model, positions);
+      if (static_cast<int> (positions.size ()) < primitive.min_inliers)
+      {
+        break;
+      }
+
+      //  Inliers out, the rest stays in the active set for the next model
+      segments.push_back (Segment ());
+      Segment &segment = segments.back ();
+      segment.model = primitive.model;
+      segment.iterations = ransac_.getIterations ();
+      segment.rejected = ransac_.getRejected ();
+      segment.inliers.header = cloud.header;
+      segment.inliers.indices.resize (positions.size ());
+      for (size_t i = 0; i < positions.size (); ++i)
+      {
+        segment.inliers.indices[i] = points_.indices[positions[i]];
+      }
+      std::sort (segment.inliers.indices.begin (), segment.inliers.indices.end ());
+      segment.coefficients.header = cloud.header;
+      segment.coefficients.values = model;
+      //  In place, the set only shrinks
+      points_.erase (positions);
+    }
+  }
+
+  remaining_ = points_.indices;
+  std::sort (remaining_.begin (), remaining_.end ());
+}
+
+#endif  // WP2_SEGMENTATION_PRIMITIVE_SEGMENTATION_H_
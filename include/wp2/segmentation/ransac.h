@@ -0,0 +1,315 @@
+//PARALLEL RANSAC FOR PLANES, CYLINDERS AND SPHERES
+//HYPOTHESES ARE DRAWN IN BATCHES ON ONE GENERATOR AND SCORED IN PARALLEL OVER PACKED, SHUFFLED POINTS. A BAD
+//HYPOTHESIS IS DROPPED EARLY BY A T(d,d) PRE-TEST OR BY WALD'S SEQUENTIAL PROBABILITY RATIO TEST, AND THE NUMBER
+//OF ITERATIONS ADAPTS TO THE BEST INLIER RATIO FOUND SO FAR
+
+#ifndef WP2_SEGMENTATION_RANSAC_H_
+#define WP2_SEGMENTATION_RANSAC_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace wp2
+{
+  //  Structure of arrays of the points a RANSAC runs on, in random order so that any prefix is a random subset
+  struct SACPoints
+  {
+    std::vector<int> indices;   // into the input cloud
+    std::vector<float> x, y, z;
+    std::vector<float> nx, ny, nz;  // empty without normals
+    std::vector<float> curvature;   // of the normals, empty without them
+
+    size_t
+    size () const
+    {
+      return (indices.size ());
+    }
+
+    bool
+    hasNormals () const
+    {
+      return (!nx.empty ());
+    }
+
+    //  Drops the points at the given positions (ascending), keeping the order of the others
+    void
+    erase (const std::vector<int> &positions);
+
+    //  Finite points (and normals) of the cloud, or of its indices, shuffled with seed
+    template <typename PointT> void
+    assign (const pcl::PointCloud<PointT> &cloud, const pcl::PointCloud<pcl::Normal> *normals,
+            const std::vector<int> *cloud_indices, unsigned int seed);
+  };
+
+  //  Coefficients are those of the matching pcl::SACMODEL: plane [a b c d] with a unit normal, cylinder
+  //  [point on axis, unit axis direction, radius], sphere [center, radius]. Distances with normals follow
+  //  pcl::SACSegmentationFromNormals: w * angle between the normals + (1 - w) * euclidean distance, where w is the
+  //  weight for cylinders and weight * (1 - curvature of the point) for planes, as SACMODEL_NORMAL_PLANE.
+  class ParallelRansac
+  {
+    public:
+      enum Model
+      {
+        MODEL_PLANE,      // 3 points; normals used when present and the weight is positive
+        MODEL_CYLINDER,   // 2 points with normals
+        MODEL_SPHERE      // 4 points
+      };
+
+      enum EarlyExit
+      {
+        EARLY_EXIT_NONE,  // every hypothesis is scored on all points
+        EARLY_EXIT_TDD,   // scored only if d random points are all inliers
+        EARLY_EXIT_SPRT   // scoring stops once the hypothesis is unlikely to be the good one
+      };
+
+      ParallelRansac (unsigned int nr_threads = 0);
+
+      void
+      setModel (Model model)
+      {
+        model_ = model;
+      }
+
+      Model
+      getModel () const
+      {
+        return (model_);
+      }
+
+      void
+      setDistanceThreshold (float threshold)
+      {
+        threshold_ = threshold;
+      }
+
+      void
+      setNormalDistanceWeight (float weight)
+      {
+        normal_weight_ = weight;
+      }
+
+      //  Cylinders and spheres outside are never hypotheses
+      void
+      setRadiusLimits (float min_radius, float max_radius)
+      {
+        min_radius_ = min_radius;
+        max_radius_ = max_radius;
+      }
+
+      //  Upper bound on the hypotheses; fewer are drawn once probability is reached
+      void
+      setMaxIterations (int max_iterations)
+      {
+        max_iterations_ = max_iterations;
+      }
+
+      //  Probability of drawing at least one all-inlier sample; 1 draws max iterations
+      void
+      setProbability (double probability)
+      {
+        probability_ = probability;
+      }
+
+      void
+      setEarlyExit (EarlyExit early_exit)
+      {
+        early_exit_ = early_exit;
+      }
+
+      //  Inlier ratio of the smallest model sought: the SPRT's first guess of the good model's ratio, and its floor once
+      //  it follows the best model found. 0 scores every hypothesis on all points until a first model is found.
+      void
+      setMinInlierRatio (double ratio)
+      {
+        min_inlier_ratio_ = ratio;
+      }
+
+      //  Points of the T(d,d) pre-test
+      void
+      setPreTestSize (int d)
+      {
+        pretest_size_ = d;
+      }
+
+      //  Least squares fit of the inliers of the best hypothesis, kept if it has no fewer inliers
+      void
+      setOptimizeCoefficients (bool optimize)
+      {
+        optimize_ = optimize;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      void
+      setSeed (unsigned int seed)
+      {
+        seed_ = seed;
+      }
+
+      //  Best model of the points; false if no hypothesis has a minimal sample of inliers
+      bool
+      computeModel (const SACPoints &points, std::vector<float> &coefficients);
+
+      //  Positions (not cloud indices) of the points within the threshold of a model
+      void
+      selectWithinDistance (const SACPoints &points, const std::vector<float> &coefficients, std::vector<int> &positions) const;
+
+      //  computeModel, then the cloud indices of its inliers, as pcl::SACSegmentation::segment
+      bool
+      segment (const SACPoints &points, std::vector<int> &inliers, std::vector<float> &coefficients);
+
+      //  Of the last computeModel
+      int
+      getIterations () const
+      {
+        return (iterations_);
+      }
+
+      int
+      getRejected () const
+      {
+        return (rejected_);
+      }
+
+      int
+      sampleSize () const;
+
+      //  "plane", "cylinder", "sphere"
+      static bool
+      parseModel (const std::string &name, Model &model);
+
+      static const char *
+      modelName (Model model);
+
+      //  "none", "tdd", "sprt"
+      static bool
+      parseEarlyExit (const std::string &name, EarlyExit &early_exit);
+
+      static const char *
+      earlyExitName (EarlyExit early_exit);
+
+    protected:
+      struct Hypothesis
+      {
+        float c[7];
+        bool valid;
+        int score;      // inliers, -1 if rejected early
+        int checked;    // points looked at before a rejection
+        int seen;       // inliers among them
+      };
+
+      bool
+      fit (const SACPoints &points, const int *sample, float *c) const;
+
+      //  Distances of the points at positions [begin, end), at most one block
+      void
+      computeDistances (const SACPoints &points, const float *c, size_t begin, size_t end, float *distances) const;
+
+      //  Inliers among positions [begin, end)
+      int
+      countInliers (const SACPoints &points, const float *c, size_t begin, size_t end) const;
+
+      //  Sets the inliers of the hypothesis, or leaves -1 when the early exit drops it
+      void
+      score (const SACPoints &points, const int *pretest, int pretest_size, Hypothesis &h) const;
+
+      void
+      refine (const SACPoints &points, std::vector<float> &coefficients) const;
+
+      //  SPRT decision threshold for the current epsilon and delta
+      void
+      updateSPRT ();
+
+      Model model_;
+      float threshold_;
+      float normal_weight_;
+      float min_radius_;
+      float max_radius_;
+      int max_iterations_;
+      double probability_;
+      EarlyExit early_exit_;
+      double min_inlier_ratio_;
+      int pretest_size_;
+      bool optimize_;
+      unsigned int threads_;
+      unsigned int seed_;
+
+      //  SPRT state: inlier ratio of the good model, of bad models, and log of the threshold A
+      double epsilon_;
+      double delta_;
+      double log_a_;
+
+      int iterations_;
+      int rejected_;
+  };
+}
+
+template <typename PointT> void
+wp2::SACPoints::assign (const pcl::PointCloud<PointT> &cloud, const pcl::PointCloud<pcl::Normal> *normals,
+                        const std::vector<int> *cloud_indices, unsigned int seed)
+{
+  const size_t nr_input = cloud_indices ? cloud_indices->size () : cloud.size ();
+  indices.clear ();
+  indices.reserve (nr_input);
+  for (size_t i = 0; i < nr_input; ++i)
+  {
+    const int index = cloud_indices ? (*cloud_indices)[i] : static_cast<int> (i);
+    const PointT &p = cloud[index];
+    if (!pcl_isfinite (p.x) || !pcl_isfinite (p.y) || !pcl_isfinite (p.z))
+    {
+      continue;
+    }
+    if (normals)
+    {
+      const pcl::Normal &n = (*normals)[index];
+      if (!pcl_isfinite (n.normal_x) || !pcl_isfinite (n.normal_y) || !pcl_isfinite (n.normal_z))
+      {
+        continue;
+      }
+    }
+    indices.push_back (index);
+  }
+
+  //  Fisher-Yates with a fixed linear congruential generator, the same on every platform
+  unsigned int state = seed;
+  for (size_t i = indices.size (); i > 1; --i)
+  {
+    state = state * 1664525u + 1013904223u;
+    std::swap (indices[i - 1], indices[(state >> 8) % i]);
+  }
+
+  const size_t n = indices.size ();
+  x.resize (n);
+  y.resize (n);
+  z.resize (n);
+  nx.resize (normals ? n : 0);
+  ny.resize (normals ? n : 0);
+  nz.resize (normals ? n : 0);
+  curvature.resize (normals ? n : 0);
+  for (size_t i = 0; i < n; ++i)
+  {
+    const PointT &p = cloud[indices[i]];
+    x[i] = p.x;
+    y[i] = p.y;
+    z[i] = p.z;
+    if (normals)
+    {
+      const pcl::Normal &nrm = (*normals)[indices[i]];
+      nx[i] = nrm.normal_x;
+      ny[i] = nrm.normal_y;
+      nz[i] = nrm.normal_z;
+      curvature[i] = nrm.curvature;
+    }
+  }
+}
+
+#endif  // WP2_SEGMENTATION_RANSAC_H_
@@ -0,0 +1,299 @@
+//PARALLEL EUCLIDEAN CLUSTER EXTRACTION OVER A VOXEL GRID
+//THE POINTS ARE BINNED IN VOXELS SMALL ENOUGH (TOLERANCE / SQRT (3)) THAT EVERY VOXEL IS CONNECTED ON ITS OWN; TWO
+//NEIGHBOURING VOXELS ARE JOINED IN A CONCURRENT UNION-FIND AS SOON AS ONE PAIR OF THEIR POINTS IS CLOSER THAN THE
+//TOLERANCE. NO KD-TREE AND NO RADIUS SEARCH PER POINT
+
+#ifndef WP2_SEGMENTATION_VOXEL_CLUSTER_EXTRACTION_H_
+#define WP2_SEGMENTATION_VOXEL_CLUSTER_EXTRACTION_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+#include <pcl/console/print.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <wp2/common/union_find.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace wp2
+{
+  //  Same clusters as pcl::EuclideanClusterExtraction: connected components of the points closer than the tolerance,
+  //  those with fewer than min or more than max points dropped, indices ascending, largest cluster first
+  template <typename PointT>
+  class VoxelClusterExtraction
+  {
+    public:
+      typedef typename pcl::PointCloud<PointT>::ConstPtr PointCloudConstPtr;
+      typedef boost::shared_ptr<const std::vector<int> > IndicesConstPtr;
+
+      VoxelClusterExtraction (unsigned int nr_threads = 0)
+        : tolerance_ (0.0f)
+        , min_size_ (1)
+        , max_size_ (std::numeric_limits<int>::max ())
+        , threads_ (nr_threads)
+      {
+      }
+
+      void
+      setInputCloud (const PointCloudConstPtr &cloud)
+      {
+        input_ = cloud;
+      }
+
+      //  Only these points are clustered; all of them by default
+      void
+      setIndices (const IndicesConstPtr &indices)
+      {
+        indices_ = indices;
+      }
+
+      void
+      setClusterTolerance (float tolerance)
+      {
+        tolerance_ = tolerance;
+      }
+
+      void
+      setMinClusterSize (int min_size)
+      {
+        min_size_ = min_size;
+      }
+
+      void
+      setMaxClusterSize (int max_size)
+      {
+        max_size_ = max_size;
+      }
+
+      //0 means one thread per core
+      void
+      setNumberOfThreads (unsigned int nr_threads = 0)
+      {
+        threads_ = nr_threads;
+      }
+
+      void
+      extract (std::vector<pcl::PointIndices> &clusters);
+
+    protected:
+      //  Any point of voxel a closer than the tolerance to any point of voxel b
+      bool
+      touching (int a, int b, float sqr_tolerance) const
+      {
+        for (int i = starts_[a]; i < starts_[a + 1]; ++i)
+        {
+          const float x = xs_[i], y = ys_[i], z = zs_[i];
+          for (int j = starts_[b]; j < starts_[b + 1]; ++j)
+          {
+            const float dx = xs_[j] - x, dy = ys_[j] - y, dz = zs_[j] - z;
+            if (dx * dx + dy * dy + dz * dz < sqr_tolerance)
+            {
+              return (true);
+            }
+          }
+        }
+        return (false);
+      }
+
+      PointCloudConstPtr input_;
+      IndicesConstPtr indices_;
+      float tolerance_;
+      int min_size_;
+      int max_size_;
+      unsigned int threads_;
+
+      //  Points sorted by voxel: input index and coordinates; voxel v holds [starts_[v], starts_[v + 1])
+      std::vector<int> order_;
+      std::vector<float> xs_;
+      std::vector<float> ys_;
+      std::vector<float> zs_;
+      std::vector<unsigned long long> keys_;
+      std::vector<int> starts_;
+  };
+}
+
+template <typename PointT> void
+wp2::VoxelClusterExtraction<PointT>::extract (std::vector<pcl::PointIndices> &clusters)
+{
+  clusters.clear ();
+  if (!input_ || tolerance_ <= 0.0f)
+  {
+    PCL_ERROR ("[wp2::VoxelClusterExtraction::extract] Error! No input cloud or no positive tolerance.\n");
+    return;
+  }
+  const pcl::PointCloud<PointT> &cloud = *input_;
+  const size_t nr_input = indices_ ? indices_->size () : cloud.size ();
+
+  //  A voxel diagonal below the tolerance, so the points of one voxel are all connected
+  const float leaf = tolerance_ / std::sqrt (3.0f) * 0.9999f;
+  Eigen::Vector3f min_pt = Eigen::Vector3f::Constant (std::numeric_limits<float>::max ());
+  std::vector<int> finite;
+  finite.reserve (nr_input);
+  for (size_t i = 0; i < nr_input; ++i)
+  {
+    const int index = indices_ ? (*indices_)[i] : static_cast<int> (i);
+    const PointT &p = cloud[index];
+    if (pcl_isfinite (p.x) && pcl_isfinite (p.y) && pcl_isfinite (p.z))
+    {
+      finite.push_back (index);
+      min_pt = min_pt.cwiseMin (Eigen::Vector3f (p.x, p.y, p.z));
+    }
+  }
+  const int n = static_cast<int> (finite.size ());
+  if (n == 0)
+  {
+    return;
+  }
+
+  //  21 bits per axis in one key, x major; coordinates start at 2, so a neighbour key never borrows across axes
+  const unsigned long long kAxis = 1ull << 21;
+  std::vector<std::pair<unsigned long long, int> > keyed (n);
+  for (int i = 0; i < n; ++i)
+  {
+    const PointT &p = cloud[finite[i]];
+    const unsigned long long vx = static_cast<unsigned long long> ((p.x - min_pt[0]) / leaf) + 2;
+    const unsigned long long vy = static_cast<unsigned long long> ((p.y - min_pt[1]) / leaf) + 2;
+    const unsigned long long vz = static_cast<unsigned long long> ((p.z - min_pt[2]) / leaf) + 2;
+    if (vx >= kAxis - 2 || vy >= kAxis - 2 || vz >= kAxis - 2)
+    {
+      PCL_ERROR ("[wp2::VoxelClusterExtraction::extract] Error! The tolerance is too small for the extent of the cloud.\n");
+      return;
+    }
+    keyed[i] = std::make_pair ((vx << 42) | (vy << 21) | vz, finite[i]);
+  }
+  std::sort (keyed.begin (), keyed.end ());
+
+  order_.resize (n);
+  xs_.resize (n);
+  ys_.resize (n);
+  zs_.resize (n);
+  keys_.clear ();
+  starts_.clear ();
+  for (int i = 0; i < n; ++i)
+  {
+    order_[i] = keyed[i].second;
+    xs_[i] = cloud[order_[i]].x;
+    ys_[i] = cloud[order_[i]].y;
+    zs_[i] = cloud[order_[i]].z;
+    if (i == 0 || keyed[i].first != keyed[i - 1].first)
+    {
+      keys_.push_back (keyed[i].first);
+      starts_.push_back (i);
+    }
+  }
+  starts_.push_back (n);
+  const int nr_voxels = static_cast<int> (keys_.size ());
+
+  //  Half of the 5x5x5 neighbourhood (two voxels per tolerance) as rows along z, which are contiguous in key order.
+  //  The corners (2, 2, 2) are kept: their closest points are one leaf apart per axis, sqrt (3) leaf = 0.9999
+  //  tolerance, so they can still touch.
+  std::vector<long long> rows;
+  std::vector<int> row_begin;
+  for (int dx = 0; dx <= 2; ++dx)
+  {
+    for (int dy = dx == 0 ? 0 : -2; dy <= 2; ++dy)
+    {
+      rows.push_back ((static_cast<long long> (dx) << 42) + (static_cast<long long> (dy) << 21));
+      row_begin.push_back (dx == 0 && dy == 0 ? 1 : -2);
+    }
+  }
+
+  std::vector<int> parent (nr_voxels);
+  for (int v = 0; v < nr_voxels; ++v)
+  {
+    parent[v] = v;
+  }
+  volatile int *roots = &parent[0];
+  const float sqr_tolerance = tolerance_ * tolerance_;
+
+#ifdef _OPENMP
+  int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 256)
+#endif
+  for (int v = 0; v < nr_voxels; ++v)
+  {
+    std::vector<unsigned long long>::iterator it = keys_.begin () + v;
+    for (size_t r = 0; r < rows.size (); ++r)
+    {
+      const long long row = static_cast<long long> (keys_[v]) + rows[r];
+      it = std::lower_bound (it, keys_.end (), static_cast<unsigned long long> (row + row_begin[r]));
+      for (; it != keys_.end () && *it <= static_cast<unsigned long long> (row + 2); ++it)
+      {
+        const int u = static_cast<int> (it - keys_.begin ());
+        if (findRoot (roots, u) != findRoot (roots, v) && touching (v, u, sqr_tolerance))
+        {
+          unite (roots, u, v);
+        }
+      }
+    }
+  }
+
+  //  Components, in the order of their smallest voxel key
+  std::vector<int> component (nr_voxels, -1);
+  std::vector<int> sizes;
+  for (int v = 0; v < nr_voxels; ++v)
+  {
+    const int root = findRoot (roots, v);
+    if (component[root] < 0)
+    {
+      component[root] = static_cast<int> (sizes.size ());
+      sizes.push_back (0);
+    }
+    component[v] = component[root];
+    sizes[component[v]] += starts_[v + 1] - starts_[v];
+  }
+
+  std::vector<int> slot (sizes.size (), -1);
+  for (size_t c = 0; c < sizes.size (); ++c)
+  {
+    if (sizes[c] >= min_size_ && sizes[c] <= max_size_)
+    {
+      slot[c] = static_cast<int> (clusters.size ());
+      clusters.push_back (pcl::PointIndices ());
+      clusters.back ().header = cloud.header;
+      clusters.back ().indices.reserve (sizes[c]);
+    }
+  }
+  for (int v = 0; v < nr_voxels; ++v)
+  {
+    const int s = slot[component[v]];
+    if (s >= 0)
+    {
+      clusters[s].indices.insert (clusters[s].indices.end (), order_.begin () + starts_[v], order_.begin () + starts_[v + 1]);
+    }
+  }
+
+  //  As pcl::extractEuclideanClusters: indices ascending, clusters by decreasing size (then by first index)
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 1)
+#endif
+  for (int c = 0; c < static_cast<int> (clusters.size ()); ++c)
+  {
+    std::sort (clusters[c].indices.begin (), clusters[c].indices.end ());
+  }
+  std::vector<std::pair<std::pair<int, int>, int> > ranks (clusters.size ());
+  for (size_t c = 0; c < clusters.size (); ++c)
+  {
+    ranks[c] = std::make_pair (std::make_pair (-static_cast<int> (clusters[c].indices.size ()), clusters[c].indices.front ()),
+                               static_cast<int> (c));
+  }
+  std::sort (ranks.begin (), ranks.end ());
+  std::vector<pcl::PointIndices> sorted (clusters.size ());
+  for (size_t c = 0; c < clusters.size (); ++c)
+  {
+    sorted[c].header = cloud.header;
+    sorted[c].indices.swap (clusters[ranks[c].second].indices);
+  }
+  clusters.swap (sorted);
+}
+
+#endif  // WP2_SEGMENTATION_VOXEL_CLUSTER_EXTRACTION_H_
@@ -3,14 +3,13 @@
 #include <pcl/ModelCoefficients.h>
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/features/normal_3d.h>
-#include <pcl/kdtree/kdtree.h>
-#include <pcl/sample_consensus/method_types.h>
-#include <pcl/sample_consensus/model_types.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_clusters.h>
+
+#include <wp2/filters/streaming_voxel_grid.h>
+#include <wp2/io/async_pcd_writer.h>
+#include <wp2/segmentation/multi_plane_extractor.h>
+#include <wp2/segmentation/organized_segmentation.h>
+#include <wp2/segmentation/voxel_cluster_extraction.h>
+
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -31,33 +30,44 @@ main (int argc, char** argv)
     exit(0);
   }
   pcl::PCDReader reader;
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud (new pcl::PointCloud<pcl::PointXYZ>), cloud_f (new pcl::PointCloud<pcl::PointXYZ>);
-  reader.read (argv[1], *cloud);
-  std::cout << "PointCloud before filtering has: " << cloud->points.size () << " data points." << std::endl; //*
+  pcl::PCLPointCloud2 header;
+  Eigen::Vector4f origin;
+  Eigen::Quaternionf orientation;
+  int version, data_type;
+  unsigned int data_idx;
+  if (reader.readHeader (argv[1], header, origin, orientation, version, data_type, data_idx) < 0)
+  {
+    std::cout << "Could not read " << argv[1] << std::endl;
+    exit(1);
+  }
 
-  // Create the filtering object: downsample the dataset using a leaf size of 1cm
-  pcl::VoxelGrid<pcl::PointXYZ> vg;
   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_filtered (new pcl::PointCloud<pcl::PointXYZ>);
-  vg.setInputCloud (cloud);
-  vg.setLeafSize (0.0014f, 0.0014f, 0.0014f);
-  vg.filter (*cloud_filtered);
+  if (header.height > 1)
+  {
+    // An organized frame keeps its pixel grid: no downsampling, it is segmented in image space below
+    reader.read (argv[1], *cloud_filtered);
+    std::cout << "PointCloud before filtering has: " << cloud_filtered->points.size () << " data points." << std::endl; //*
+  }
+  else
+  {
+    // Downsample while reading, with a leaf size of 1.4mm: only the occupied voxels are kept in memory, never the
+    // whole cloud, so merged clouds larger than the RAM still go through
+    wp2::StreamingVoxelGrid vg;
+    vg.setLeafSize (0.0014f);
+    if (!vg.addFile (argv[1]))
+    {
+      exit(1);
+    }
+    if (vg.getNumberOfDecompressedPoints () > 0)
+    {
+      std::cerr << "WARNING: " << argv[1] << " is binary_compressed and was decompressed whole in memory; "
+                << "save it as binary to stream it" << std::endl;
+    }
+    std::cout << "PointCloud before filtering has: " << vg.getNumberOfPoints () << " data points." << std::endl; //*
+    vg.getCentroids (*cloud_filtered);
+  }
   std::cout << "PointCloud after filtering has: " << cloud_filtered->points.size ()  << " data points." << std::endl; //*
 
-  // Create the segmentation object for the planar model and set all the parameters
-  pcl::SACSegmentation<pcl::PointXYZ> seg;
-  pcl::PointIndices::Ptr inliers (new pcl::PointIndices);
-  pcl::ModelCoefficients::Ptr coefficients (new pcl::ModelCoefficients);
-  pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_plane (new pcl::PointCloud<pcl::PointXYZ> ());
-  pcl::PCDWriter writer;
-  seg.setOptimizeCoefficients (true);
-  seg.setModelType (pcl::SACMODEL_PLANE);
-  seg.setMethodType (pcl::SAC_RANSAC);
-  seg.setMaxIterations (200);
-  seg.setDistanceThreshold (atof(argv[2]));//0.01
-
-  int i=0, pl =0, nr_points = (int) cloud_filtered->points.size ();
-
-
   time_t     now = time(0);
   struct tm  tstruct;
   char       buf[20];
@@ -74,72 +84,83 @@ main (int argc, char** argv)
     printf("Error creating directory!");
     exit(1);
 	}	
-   
 
-  while (cloud_filtered->points.size () > atof(argv[3]) * nr_points) //0.6
+  // Planes and clusters are written in the background, as indices into cloud_filtered, which no longer changes
+  wp2::AsyncPCDWriter<pcl::PointXYZ> writer;
+
+  std::vector<pcl::PointIndices> planes;
+  std::vector<pcl::ModelCoefficients> coefficients;
+  boost::shared_ptr<std::vector<int> > remaining (new std::vector<int>);
+  std::vector<pcl::PointIndices> cluster_indices;
+  if (cloud_filtered->isOrganized ())
+  {
+    // Planes from the integral image normals, then connected components of the other pixels; argv[3] is not used
+    wp2::OrganizedSegmentation<pcl::PointXYZ> organized;
+    organized.setInputCloud (cloud_filtered);
+    organized.setDistanceThreshold (atof(argv[2]));//0.01
+    organized.setClusterTolerance (atof(argv[4])); // 0.02
+    organized.setMinClusterSize (100);
+    organized.setMaxClusterSize (40000);
+    organized.segment (planes, coefficients, cluster_indices);
+    *remaining = organized.getRemainingIndices ();
+  }
+  else
   {
-    // Segment the largest planar component from the remaining cloud
-    seg.setInputCloud (cloud_filtered);
-    seg.segment (*inliers, *coefficients);
-    if (inliers->indices.size () == 0)
+    // Remove the largest planes until the argv[3] fraction of the points remains (0.6), each plane found by RANSAC
+    // among the points left over by the previous ones
+    wp2::MultiPlaneExtractor<pcl::PointXYZ> plane_extractor;
+    plane_extractor.setInputCloud (cloud_filtered);
+    plane_extractor.setDistanceThreshold (atof(argv[2]));//0.01
+    plane_extractor.setMaxIterations (200);
+    plane_extractor.setRemainingFraction (atof(argv[3]));
+    plane_extractor.extract (planes, coefficients);
+
+    int nr_points = (int) cloud_filtered->points.size ();
+    if (plane_extractor.getRemainingIndices ().size () > atof(argv[3]) * nr_points)
     {
       std::cout << "Could not estimate a planar model for the given dataset." << std::endl;
-      break;
     }
+    *remaining = plane_extractor.getRemainingIndices ();
+
+    // Euclidean clusters of the points in no plane, over a voxel grid instead of a kd-tree
+    wp2::VoxelClusterExtraction<pcl::PointXYZ> ec;
+    ec.setClusterTolerance (atof(argv[4])); // 0.02
+    ec.setMinClusterSize (100);
+    ec.setMaxClusterSize (40000);
+    ec.setInputCloud (cloud_filtered);
+    ec.setIndices (remaining);
+    ec.extract (cluster_indices);
+  }
 
-    // Extract the planar inliers from the input cloud
-    pcl::ExtractIndices<pcl::PointXYZ> extract;
-    extract.setInputCloud (cloud_filtered);
-    extract.setIndices (inliers);
-    extract.setNegative (false);
-
-    // Get the points associated with the planar surface
-    extract.filter (*cloud_plane);
-    std::cout << "PointCloud representing the planar component: " << cloud_plane->points.size () << " data points." << std::endl;
+  for (size_t pl = 0; pl < planes.size (); ++pl)
+  {
+    std::cout << "PointCloud representing the planar component: " << planes[pl].indices.size () << " data points." << std::endl;
+    boost::shared_ptr<std::vector<int> > plane_indices (new std::vector<int>);
+    plane_indices->swap (planes[pl].indices);
     std::stringstream sp;
     sp << dir << "/cloud_plane_" << pl << ".pcd";
-    writer.write<pcl::PointXYZ> (sp.str(), *cloud_plane, false);
-    pl++;
-
-    // Remove the planar inliers, extract the rest
-    extract.setNegative (true);
-    extract.filter (*cloud_f);
-    *cloud_filtered = *cloud_f;
+    writer.write (sp.str(), cloud_filtered, plane_indices);
   }
-  
+
   std::stringstream sf;
   sf << dir << "/cloud_filtered.pcd";
-  writer.write<pcl::PointXYZ> (sf.str(), *cloud_filtered, false);
-
-  // Creating the KdTree object for the search method of the extraction
-  pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
-  tree->setInputCloud (cloud_filtered);
-
-  std::vector<pcl::PointIndices> cluster_indices;
-  pcl::EuclideanClusterExtraction<pcl::PointXYZ> ec;
-  ec.setClusterTolerance (atof(argv[4])); // 0.02
-  ec.setMinClusterSize (100);
-  ec.setMaxClusterSize (40000);
-  ec.setSearchMethod (tree);
-  ec.setInputCloud (cloud_filtered);
-  ec.extract (cluster_indices);
+  writer.write (sf.str(), cloud_filtered, remaining);
 
   int j = 0;
-  for (std::vector<pcl::PointIndices>::const_iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it)
+  for (std::vector<pcl::PointIndices>::iterator it = cluster_indices.begin (); it != cluster_indices.end (); ++it)
   {
-    pcl::PointCloud<pcl::PointXYZ>::Ptr cloud_cluster (new pcl::PointCloud<pcl::PointXYZ>);
-    for (std::vector<int>::const_iterator pit = it->indices.begin (); pit != it->indices.end (); ++pit)
-      cloud_cluster->points.push_back (cloud_filtered->points[*pit]); //*
-    cloud_cluster->width = cloud_cluster->points.size ();
-    cloud_cluster->height = 1;
-    cloud_cluster->is_dense = true;
-
-    std::cout << "PointCloud representing the Cluster: " << cloud_cluster->points.size () << " data points." << std::endl;
+    std::cout << "PointCloud representing the Cluster: " << it->indices.size () << " data points." << std::endl;
+    boost::shared_ptr<std::vector<int> > cluster (new std::vector<int>);
+    cluster->swap (it->indices);
     std::stringstream ss;
     ss << dir << "/cloud_cluster_" << j << ".pcd";
-    writer.write<pcl::PointXYZ> (ss.str (), *cloud_cluster, false); //*
+    writer.write (ss.str (), cloud_filtered, cluster); //*
     j++;
   }
 
+  if (writer.flush () > 0)
+  {
+    return (1);
+  }
   return (0);
 }
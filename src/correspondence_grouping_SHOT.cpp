@@ -15,6 +15,8 @@
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/common/profiler.h>
+
 typedef pcl::PointXYZRGBA PointType;
 typedef pcl::Normal NormalType;
 typedef pcl::ReferenceFrame RFType;
@@ -35,6 +37,10 @@ float descr_rad_ (0.08f); //GeoCon - 0.08f
 float cg_size_ (0.03f);//GeoCon - 0.015f
 float cg_thresh_ (8.0f);//GeoCon - 16.0f
 
+//Instrumentation
+wp2::Profiler profiler_;
+std::string profile_filename_;
+
 void
 showHelp (char *filename)
 {
@@ -57,7 +63,10 @@ showHelp (char *filename)
   std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
   std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
   std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
-  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl;
+  std::cout << "     --profile file:         Write the time of each stage and the point and" << std::endl;
+  std::cout << "                             match counts to file (.csv or .json) and print" << std::endl;
+  std::cout << "                             a summary." << std::endl << std::endl;
 }
 
 void
@@ -122,6 +131,26 @@ parseCommandLine (int argc, char *argv[])
   pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
   pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
   pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+
+  if (pcl::console::parse_argument (argc, argv, "--profile", profile_filename_) != -1)
+  {
+    profiler_.setEnabled (true);
+  }
+}
+
+void
+saveProfile ()
+{
+  if (!profiler_.isEnabled ())
+  {
+    return;
+  }
+  profiler_.endPair ();
+  if (!profiler_.write (profile_filename_))
+  {
+    std::cout << "Error writing profile " << profile_filename_ << std::endl;
+  }
+  profiler_.printSummary (std::cout);
 }
 
 double
@@ -160,6 +189,7 @@ int
 main (int argc, char *argv[])
 {
   parseCommandLine (argc, argv);
+  profiler_.beginPair (model_filename_, scene_filename_);
 
   pcl::PointCloud<PointType>::Ptr model (new pcl::PointCloud<PointType> ());
   pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
@@ -173,6 +203,7 @@ main (int argc, char *argv[])
   //
   //  Load clouds
   //
+  wp2::ScopedTimer load_timer (profiler_, "load");
   if (pcl::io::loadPCDFile (model_filename_, *model) < 0)
   {
     std::cout << "Error loading model cloud." << std::endl;
@@ -185,13 +216,18 @@ main (int argc, char *argv[])
     showHelp (argv[0]);
     return (-1);
   }
+  load_timer.stop ();
+  profiler_.setCount ("model_points", static_cast<long> (model->size ()));
+  profiler_.setCount ("scene_points", static_cast<long> (scene->size ()));
 
   //
   //  Set up resolution invariance
   //
   if (use_cloud_resolution_)
   {
+    wp2::ScopedTimer resolution_timer (profiler_, "resolution");
     float resolution = static_cast<float> (computeCloudResolution (model));
+    resolution_timer.stop ();
     if (resolution != 0.0f)
     {
       model_ss_   *= resolution;
@@ -212,6 +248,7 @@ main (int argc, char *argv[])
   //
   //  Compute Normals
   //
+  wp2::ScopedTimer normals_timer (profiler_, "normals");
   pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
   norm_est.setKSearch (10);
   norm_est.setInputCloud (model);
@@ -219,10 +256,12 @@ main (int argc, char *argv[])
 
   norm_est.setInputCloud (scene);
   norm_est.compute (*scene_normals);
+  normals_timer.stop ();
 
   //
   //  Downsample Clouds to Extract keypoints
   //
+  wp2::ScopedTimer sampling_timer (profiler_, "sampling");
   pcl::PointCloud<int> sampled_indices;
 
   pcl::UniformSampling<PointType> uniform_sampling;
@@ -236,12 +275,16 @@ main (int argc, char *argv[])
   uniform_sampling.setRadiusSearch (scene_ss_);
   uniform_sampling.compute (sampled_indices);
   pcl::copyPointCloud (*scene, sampled_indices.points, *scene_keypoints);
+  sampling_timer.stop ();
+  profiler_.setCount ("model_keypoints", static_cast<long> (model_keypoints->size ()));
+  profiler_.setCount ("scene_keypoints", static_cast<long> (scene_keypoints->size ()));
   std::cout << "Scene total points: " << scene->size () << "; Selected Keypoints: " << scene_keypoints->size () << std::endl;
 
 
   //
   //  Compute Descriptor for keypoints
   //
+  wp2::ScopedTimer descriptor_timer (profiler_, "shot");
   pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
   descr_est.setRadiusSearch (descr_rad_);
 
@@ -254,6 +297,7 @@ main (int argc, char *argv[])
   descr_est.setInputNormals (scene_normals);
   descr_est.setSearchSurface (scene);
   descr_est.compute (*scene_descriptors);
+  descriptor_timer.stop ();
 
   //
 
@@ -277,6 +321,7 @@ main (int argc, char *argv[])
 
   //  Find Model-Scene Correspondences with KdTree
   //
+  wp2::ScopedTimer matching_timer (profiler_, "matching");
   pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
 
   pcl::KdTreeFLANN<DescriptorType> match_search;
@@ -309,6 +354,8 @@ main (int argc, char *argv[])
       
     }
   }
+  matching_timer.stop ();
+  profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
   std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
 
   //
@@ -323,6 +370,7 @@ main (int argc, char *argv[])
     //
     //  Compute (Keypoints) Reference Frames only for Hough
     //
+    wp2::ScopedTimer lrf_timer (profiler_, "lrf");
     pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
     pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
 
@@ -339,8 +387,10 @@ main (int argc, char *argv[])
     rf_est.setInputNormals (scene_normals);
     rf_est.setSearchSurface (scene);
     rf_est.compute (*scene_rf);
+    lrf_timer.stop ();
 
     //  Clustering
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::Hough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
     clusterer.setHoughBinSize (cg_size_);
     clusterer.setHoughThreshold (cg_thresh_);
@@ -358,6 +408,7 @@ main (int argc, char *argv[])
   }
   else // Using GeometricConsistency
   {
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::GeometricConsistencyGrouping<PointType, PointType> gc_clusterer;
     gc_clusterer.setGCSize (cg_size_);
     gc_clusterer.setGCThreshold (cg_thresh_);
@@ -373,6 +424,8 @@ main (int argc, char *argv[])
   //
   //  Output results
   //
+  profiler_.setCount ("instances", static_cast<long> (rototranslations.size ()));
+  saveProfile ();
   std::cout << "Model instances found: " << rototranslations.size () << std::endl;
   for (size_t i = 0; i < rototranslations.size (); ++i)
   {
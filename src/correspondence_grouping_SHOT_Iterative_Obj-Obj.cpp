@@ -16,6 +16,16 @@
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/common/evaluation.h>
+#include <wp2/common/profiler.h>
+#include <wp2/features/board_omp.h>
+#include <wp2/features/shot_lrf.h>
+#include <wp2/features/shot_simd.h>
+#include <wp2/recognition/geometric_consistency_simd.h>
+#include <wp2/recognition/global_shortlist.h>
+#include <wp2/recognition/hough_3d_sparse.h>
+#include <wp2/recognition/pair_gates.h>
+
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/path.hpp"
 #include "boost/progress.hpp"
@@ -27,6 +37,7 @@
 #define BOOST_FILESYSTEM_NO_DEPRECATED 
 #include <boost/filesystem.hpp>
 
+#include <set>
 #include <string>
 #include <signal.h>
 
@@ -42,6 +53,9 @@ bool show_keypoints_ (false);
 bool show_correspondences_ (false);
 bool use_cloud_resolution_ (false);
 bool use_hough_ (true);
+bool share_lrf_ (false);
+bool fuse_features_ (false);
+wp2::shot::Kernel shot_kernel_ (wp2::shot::KERNEL_PCL);
 
 float model_ss_ (0.015f);
 float scene_ss_ (0.015f);
@@ -54,6 +68,27 @@ float cg_thresh_ (6.0f);
 
 float kd_thresh_ (0.24f);
 
+//Early termination
+wp2::PairGates<PointType> gates_;
+float gate_points_ (0.0f);
+float gate_extent_ (0.0f);
+int gated_pairs_[wp2::GATE_NR_REASONS] = {};
+
+//Global descriptor prefilter
+wp2::GlobalShortlist<PointType> shortlist_;
+int shortlist_size_ (0);
+
+//Instrumentation
+wp2::Profiler profiler_;
+std::string profile_filename_;
+
+//Evaluation
+bool evaluate_ (false);
+wp2::Evaluator evaluator_;
+std::string eval_filename_;
+std::string eval_summary_filename_;
+float min_f1_ (0.0f);
+
 pcl::PointCloud<PointType>::Ptr model (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr scene (new pcl::PointCloud<PointType> ());
@@ -93,13 +128,39 @@ showHelp (char *filename)
   std::cout << "     -c:                     Show used correspondences." << std::endl;
   std::cout << "     -r:                     Compute the model cloud resolution and multiply" << std::endl;
   std::cout << "                             each radius given by that value." << std::endl;
+  std::cout << "     -l:                     Share the BOARD reference frames with SHOT instead of" << std::endl;
+  std::cout << "                             letting SHOT compute its own (one LRF per keypoint)." << std::endl;
+  std::cout << "     -f:                     Compute SHOT and LRF from one shared neighbourhood" << std::endl;
+  std::cout << "                             search per keypoint (implies -l)." << std::endl;
   std::cout << "     --algorithm (Hough|GC): Clustering algorithm used (default Hough)." << std::endl;
+  std::cout << "     --shot_kernel (pcl|scalar|avx2|auto):" << std::endl;
+  std::cout << "                             SHOT histogram code (default pcl). auto uses AVX2" << std::endl;
+  std::cout << "                             when the CPU has it." << std::endl;
   std::cout << "     --model_ss val:         Model uniform sampling radius (default 0.01)" << std::endl;
   std::cout << "     --scene_ss val:         Scene uniform sampling radius (default 0.03)" << std::endl;
   std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
   std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
   std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
-  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl;
+  std::cout << "     --gate_points val:      Skip pairs whose point counts differ by more than" << std::endl;
+  std::cout << "                             this factor (default off)" << std::endl;
+  std::cout << "     --gate_extent val:      Skip pairs whose principal extents differ by more" << std::endl;
+  std::cout << "                             than this factor (default off)" << std::endl;
+  std::cout << "                             Pairs with too few keypoints or correspondences to" << std::endl;
+  std::cout << "                             reach --cg_thresh always skip the LRF and grouping." << std::endl;
+  std::cout << "     --shortlist k:          Run the local pipeline only on the k models nearest" << std::endl;
+  std::cout << "                             to each scene object by global descriptor (default" << std::endl;
+  std::cout << "                             off)" << std::endl;
+  std::cout << "     --global (esf|vfh):     Global descriptor of --shortlist (default esf)" << std::endl;
+  std::cout << "     --profile file:         Write the time of each stage and the point and" << std::endl;
+  std::cout << "                             match counts to file (.csv or .json) and print" << std::endl;
+  std::cout << "                             a summary." << std::endl;
+  std::cout << "     --eval file:            Score each pair against the object name before the" << std::endl;
+  std::cout << "                             first '-' of the file names, write the pairs to" << std::endl;
+  std::cout << "                             file and print P/R/F1 and the confusion matrix." << std::endl;
+  std::cout << "     --eval_summary file:    Append the P/R/F1 and pair times of this parameter" << std::endl;
+  std::cout << "                             set to file, one line per run." << std::endl;
+  std::cout << "     --min_f1 val:           Exit with 1 when the F1 score is below val." << std::endl << std::endl;
 }
 
 void
@@ -154,6 +215,15 @@ parseCommandLine (int argc, char *argv[])
   {
     use_cloud_resolution_ = true;
   }
+  if (pcl::console::find_switch (argc, argv, "-l"))
+  {
+    share_lrf_ = true;
+  }
+  if (pcl::console::find_switch (argc, argv, "-f"))
+  {
+    fuse_features_ = true;
+    share_lrf_ = true;
+  }
 
   std::string used_algorithm;
   if (pcl::console::parse_argument (argc, argv, "--algorithm", used_algorithm) != -1)
@@ -173,6 +243,17 @@ parseCommandLine (int argc, char *argv[])
     }
   }
 
+  std::string shot_kernel;
+  if (pcl::console::parse_argument (argc, argv, "--shot_kernel", shot_kernel) != -1)
+  {
+    if (!wp2::shot::parseKernel (shot_kernel, shot_kernel_))
+    {
+      std::cout << "Wrong SHOT kernel name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
 //General parameters
   pcl::console::parse_argument (argc, argv, "--model_ss", model_ss_);
   pcl::console::parse_argument (argc, argv, "--scene_ss", scene_ss_);
@@ -181,6 +262,63 @@ parseCommandLine (int argc, char *argv[])
   pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
   pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
   pcl::console::parse_argument (argc, argv, "--kd_thresh", kd_thresh_);
+  pcl::console::parse_argument (argc, argv, "--gate_points", gate_points_);
+  pcl::console::parse_argument (argc, argv, "--gate_extent", gate_extent_);
+  gates_.setMaxPointRatio (gate_points_);
+  gates_.setMaxExtentRatio (gate_extent_);
+  gates_.setGroupingThreshold (cg_thresh_, use_hough_);
+
+  std::string global_descriptor;
+  if (pcl::console::parse_argument (argc, argv, "--global", global_descriptor) != -1)
+  {
+    wp2::GlobalShortlist<PointType>::Descriptor descriptor;
+    if (!wp2::GlobalShortlist<PointType>::parseDescriptor (global_descriptor, descriptor))
+    {
+      std::cout << "Wrong global descriptor name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+    shortlist_.setDescriptor (descriptor);
+  }
+  pcl::console::parse_argument (argc, argv, "--shortlist", shortlist_size_);
+  shortlist_.setShortlistSize (shortlist_size_ > 0 ? static_cast<size_t> (shortlist_size_) : 0);
+
+  if (pcl::console::parse_argument (argc, argv, "--profile", profile_filename_) != -1)
+  {
+    profiler_.setEnabled (true);
+  }
+
+  if (pcl::console::parse_argument (argc, argv, "--eval", eval_filename_) != -1)
+  {
+    evaluate_ = true;
+  }
+  if (pcl::console::parse_argument (argc, argv, "--eval_summary", eval_summary_filename_) != -1)
+  {
+    evaluate_ = true;
+  }
+  if (pcl::console::parse_argument (argc, argv, "--min_f1", min_f1_) != -1)
+  {
+    evaluate_ = true;
+  }
+  std::stringstream parameters;
+  parameters << (use_hough_ ? "Hough" : "GC") << " model_ss=" << model_ss_ << " scene_ss=" << scene_ss_
+             << " rf_rad=" << rf_rad_ << " descr_rad=" << descr_rad_ << " cg_size=" << cg_size_
+             << " cg_thresh=" << cg_thresh_ << " kd_thresh=" << kd_thresh_ << " shot_kernel="
+             << wp2::shot::kernelName (shot_kernel_) << (fuse_features_ ? " fused" : (share_lrf_ ? " shared_lrf" : ""));
+  if (gate_points_ > 0.0f)
+  {
+    parameters << " gate_points=" << gate_points_;
+  }
+  if (gate_extent_ > 0.0f)
+  {
+    parameters << " gate_extent=" << gate_extent_;
+  }
+  if (shortlist_size_ > 0)
+  {
+    parameters << " shortlist=" << shortlist_size_ << " global="
+               << wp2::GlobalShortlist<PointType>::descriptorName (shortlist_.getDescriptor ());
+  }
+  evaluator_.setParameters (parameters.str ());
 }
 
 void
@@ -251,19 +389,67 @@ loadCloud ()
   }
 }
 
+void
+computeReferenceFrames (pcl::PointCloud<RFType>::Ptr &model_rf, pcl::PointCloud<RFType>::Ptr &scene_rf)
+{
+  wp2::ScopedTimer lrf_timer (profiler_, "lrf");
+  wp2::BOARDLocalReferenceFrameEstimationOMP<PointType, NormalType, RFType> rf_est;
+  rf_est.setFindHoles (true);
+  rf_est.setRadiusSearch (rf_rad_);
+
+  rf_est.setInputCloud (model_keypoints);
+  rf_est.setInputNormals (model_normals);
+  rf_est.setSearchSurface (model);
+  rf_est.compute (*model_rf);
+
+  rf_est.setInputCloud (scene_keypoints);
+  rf_est.setInputNormals (scene_normals);
+  rf_est.setSearchSurface (scene);
+  rf_est.compute (*scene_rf);
+}
+
+//  Result of a pair stopped by a gate: correspondences so far, no instance, the reason
+std::vector<int>
+gatePair (wp2::GateReason reason, size_t nr_correspondences)
+{
+  ++gated_pairs_[reason];
+  profiler_.setCount ("gate", static_cast<long> (reason));
+  profiler_.setCount ("instances", 0);
+  profiler_.endPair ();
+  std::cout << "Pair skipped: " << wp2::gateReasonName (reason) << std::endl;
+
+  std::vector<int> result;
+  result.push_back (static_cast<int> (nr_correspondences));
+  result.push_back (0);
+  result.push_back (static_cast<int> (reason));
+  return result;
+}
+
 std::vector<int>
 correspondenceGroup ()
 {
-  
+  profiler_.beginPair (model_filename_, scene_filename_);
+
 //  Load clouds
+  wp2::ScopedTimer load_timer (profiler_, "load");
   loadCloud ();
+  load_timer.stop ();
+
+  wp2::GateReason gate = gates_.checkClouds (*model, *scene);
+  if (gate != wp2::GATE_PASS)
+  {
+    return gatePair (gate, 0);
+  }
 
 //  Compute Cloud Resolution
 
+  wp2::ScopedTimer resolution_timer (profiler_, "resolution");
   computeCloudResolution(model);
+  resolution_timer.stop ();
 
 //  Compute Normals
 
+  wp2::ScopedTimer normals_timer (profiler_, "normals");
   pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
   norm_est.setKSearch (10);
   norm_est.setInputCloud (model);
@@ -271,9 +457,11 @@ correspondenceGroup ()
 
   norm_est.setInputCloud (scene);
   norm_est.compute (*scene_normals);
+  normals_timer.stop ();
 
 //  Downsample Clouds to Extract keypoints
 
+  wp2::ScopedTimer sampling_timer (profiler_, "sampling");
   pcl::PointCloud<int> sampled_indices;
 
   pcl::UniformSampling<PointType> uniform_sampling;
@@ -287,25 +475,79 @@ correspondenceGroup ()
   uniform_sampling.setRadiusSearch (scene_ss_);
   uniform_sampling.compute (sampled_indices);
   pcl::copyPointCloud (*scene, sampled_indices.points, *scene_keypoints);
+  sampling_timer.stop ();
+  profiler_.setCount ("model_points", static_cast<long> (model->size ()));
+  profiler_.setCount ("scene_points", static_cast<long> (scene->size ()));
+  profiler_.setCount ("model_keypoints", static_cast<long> (model_keypoints->size ()));
+  profiler_.setCount ("scene_keypoints", static_cast<long> (scene_keypoints->size ()));
   std::cout << "Scene total points: " << scene->size () << "; Selected Keypoints: " << scene_keypoints->size () << std::endl;
 
-//  Compute Descriptor for keypoints
+  gate = gates_.checkKeypoints (model_keypoints->size (), scene_keypoints->size ());
+  if (gate != wp2::GATE_PASS)
+  {
+    return gatePair (gate, 0);
+  }
 
-  pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
-  descr_est.setRadiusSearch (descr_rad_);
+//  Compute (Keypoints) Reference Frames for SHOT when they are shared; for Hough alone they wait for the matches
 
-  descr_est.setInputCloud (model_keypoints);
-  descr_est.setInputNormals (model_normals);
-  descr_est.setSearchSurface (model);
-  descr_est.compute (*model_descriptors);
+  pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
+  pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
 
-  descr_est.setInputCloud (scene_keypoints);
-  descr_est.setInputNormals (scene_normals);
-  descr_est.setSearchSurface (scene);
-  descr_est.compute (*scene_descriptors);
+  if (fuse_features_)
+  {
+    //  SHOT and LRF from one neighbourhood search per keypoint
+    wp2::ScopedTimer feature_timer (profiler_, "shot_lrf");
+    wp2::SHOTLRFEstimation<PointType, NormalType, DescriptorType, RFType> feature_est;
+    feature_est.setKernel (shot_kernel_);
+    feature_est.setDescriptorRadius (descr_rad_);
+    feature_est.setReferenceFrameRadius (rf_rad_);
+
+    feature_est.setInputCloud (model_keypoints);
+    feature_est.setInputNormals (model_normals);
+    feature_est.setSearchSurface (model);
+    feature_est.compute (*model_descriptors, model_rf);
+
+    feature_est.setInputCloud (scene_keypoints);
+    feature_est.setInputNormals (scene_normals);
+    feature_est.setSearchSurface (scene);
+    feature_est.compute (*scene_descriptors, scene_rf);
+  }
+  else
+  {
+    if (share_lrf_)
+    {
+      computeReferenceFrames (model_rf, scene_rf);
+    }
+
+    //  Compute Descriptor for keypoints
+
+    wp2::ScopedTimer descriptor_timer (profiler_, "shot");
+    wp2::SHOTEstimationSIMD<PointType, NormalType, DescriptorType> descr_est;
+    descr_est.setKernel (shot_kernel_);
+    descr_est.setRadiusSearch (descr_rad_);
+
+    descr_est.setInputCloud (model_keypoints);
+    descr_est.setInputNormals (model_normals);
+    descr_est.setSearchSurface (model);
+    if (share_lrf_)
+    {
+      descr_est.setInputReferenceFrames (model_rf);
+    }
+    descr_est.compute (*model_descriptors);
+
+    descr_est.setInputCloud (scene_keypoints);
+    descr_est.setInputNormals (scene_normals);
+    descr_est.setSearchSurface (scene);
+    if (share_lrf_)
+    {
+      descr_est.setInputReferenceFrames (scene_rf);
+    }
+    descr_est.compute (*scene_descriptors);
+  }
 
 //  Find Model-Scene Correspondences with KdTree
 
+  wp2::ScopedTimer matching_timer (profiler_, "matching");
   pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
 
   pcl::KdTreeFLANN<DescriptorType> match_search;
@@ -328,7 +570,20 @@ correspondenceGroup ()
     }
   }
 
+  matching_timer.stop ();
+  profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
   std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
+
+  gate = gates_.checkCorrespondences (model_scene_corrs->size ());
+  if (gate != wp2::GATE_PASS)
+  {
+    return gatePair (gate, model_scene_corrs->size ());
+  }
+
+  if (use_hough_ && !share_lrf_)
+  {
+    computeReferenceFrames (model_rf, scene_rf);
+  }
   
 //  Actual Clustering
 
@@ -338,28 +593,9 @@ correspondenceGroup ()
 //  Using Hough3D
   if (use_hough_)
   {
-    //
-    //  Compute (Keypoints) Reference Frames only for Hough
-    //
-    pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
-    pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
-
-    pcl::BOARDLocalReferenceFrameEstimation<PointType, NormalType, RFType> rf_est;
-    rf_est.setFindHoles (true);
-    rf_est.setRadiusSearch (rf_rad_);
-
-    rf_est.setInputCloud (model_keypoints);
-    rf_est.setInputNormals (model_normals);
-    rf_est.setSearchSurface (model);
-    rf_est.compute (*model_rf);
-
-    rf_est.setInputCloud (scene_keypoints);
-    rf_est.setInputNormals (scene_normals);
-    rf_est.setSearchSurface (scene);
-    rf_est.compute (*scene_rf);
-
-    //  Clustering
-    pcl::Hough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
+    //  Clustering. Kept across pairs so the hashed accumulator reuses its buckets
+    static wp2::SparseHough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
     clusterer.setHoughBinSize (cg_size_);
     clusterer.setHoughThreshold (cg_thresh_);
     clusterer.setUseInterpolation (true);
@@ -377,7 +613,8 @@ correspondenceGroup ()
 
   else // Using GeometricConsistency
   {
-    pcl::GeometricConsistencyGrouping<PointType, PointType> gc_clusterer;
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
+    wp2::GeometricConsistencyGroupingSIMD<PointType, PointType> gc_clusterer;
     gc_clusterer.setGCSize (cg_size_);
     gc_clusterer.setGCThreshold (cg_thresh_);
 
@@ -391,6 +628,8 @@ correspondenceGroup ()
 
 //  Output results
 
+  profiler_.setCount ("instances", static_cast<long> (rototranslations.size ()));
+  profiler_.endPair ();
   std::cout << "Model instances found: " << rototranslations.size () << std::endl;
 
   /*for (size_t i = 0; i < rototranslations.size (); ++i)
@@ -412,6 +651,7 @@ correspondenceGroup ()
   std::vector<int> result;
   result.push_back (int(model_scene_corrs->size ()));
   result.push_back (rototranslations.size());
+  result.push_back (wp2::GATE_PASS);
   return result;
 }
  
@@ -423,10 +663,101 @@ void calculate_save()
     myfile << "True negative: "<< true_neg << "\t" << "Rate:  " << (float)true_neg/total_iter << std::endl;
     myfile << "False positive: "<< false_pos << "\t" << "Rate:  " << (float)false_pos/total_iter << std::endl;
     myfile << "False negative: "<< false_neg << "\t" << "Rate:  " << (float)false_neg/total_iter << std::endl;
+    for (int reason = wp2::GATE_PASS + 1; reason < wp2::GATE_NR_REASONS; ++reason)
+    {
+      myfile << "Skipped (" << wp2::gateReasonName (static_cast<wp2::GateReason> (reason)) << "): " << gated_pairs_[reason] << std::endl;
+    }
 
     myfile.close();
 }
 
+void
+saveProfile ()
+{
+  if (!profiler_.isEnabled ())
+  {
+    return;
+  }
+  profiler_.endPair ();
+  if (!profiler_.write (profile_filename_))
+  {
+    std::cout << "Error writing profile " << profile_filename_ << std::endl;
+  }
+  profiler_.printSummary (std::cout);
+}
+
+//  True unless --min_f1 is set and not reached
+bool
+saveEvaluation ()
+{
+  if (!evaluate_)
+  {
+    return (true);
+  }
+  if (!eval_filename_.empty () && !evaluator_.writePairs (eval_filename_))
+  {
+    std::cout << "Error writing evaluation " << eval_filename_ << std::endl;
+  }
+  if (!eval_summary_filename_.empty () && !evaluator_.appendSummary (eval_summary_filename_))
+  {
+    std::cout << "Error writing evaluation summary " << eval_summary_filename_ << std::endl;
+  }
+  evaluator_.printSummary (std::cout);
+
+  const double f1 = evaluator_.getTotals ().f1 ();
+  if (f1 < min_f1_)
+  {
+    std::cout << "F1 " << f1 << " is below the required " << min_f1_ << std::endl;
+    return (false);
+  }
+  return (true);
+}
+
+//  Global descriptor of every model, once, for --shortlist
+void
+computeModelSignatures ()
+{
+  const double start = wp2::Profiler::now ();
+  pcl::PointCloud<PointType>::Ptr cloud (new pcl::PointCloud<PointType> ());
+  fs::recursive_directory_iterator it_m (model_path);
+  fs::recursive_directory_iterator endit_m;
+  for (; it_m != endit_m; ++it_m)
+  {
+    if (fs::is_regular_file (*it_m) && it_m->path ().extension () == ".pcd")
+    {
+      const std::string filename = model_path.string () + it_m->path ().filename ().string ();
+      if (pcl::io::loadPCDFile (filename, *cloud) < 0)
+      {
+        std::cout << "Error loading model cloud " << filename << std::endl;
+        continue;
+      }
+      shortlist_.addModel (filename, cloud);
+    }
+  }
+  std::cout << "Global descriptors of " << shortlist_.getNumberOfModels () << " models: "
+            << wp2::Profiler::now () - start << " ms" << std::endl;
+}
+
+//  Models of the scene object's shortlist, by file name
+std::set<std::string>
+sceneShortlist ()
+{
+  std::set<std::string> models;
+  pcl::PointCloud<PointType>::Ptr cloud (new pcl::PointCloud<PointType> ());
+  if (pcl::io::loadPCDFile (scene_filename_, *cloud) < 0)
+  {
+    std::cout << "Error loading scene cloud." << std::endl;
+    return models;
+  }
+  std::vector<int> shortlist;
+  shortlist_.shortlist (cloud, shortlist);
+  for (size_t i = 0; i < shortlist.size (); ++i)
+  {
+    models.insert (shortlist_.getModelName (shortlist[i]));
+  }
+  return models;
+}
+
 void
 pathIteration()
 {
@@ -447,12 +778,18 @@ pathIteration()
     myfile << "rf_rad_ : " << rf_rad_ << std::endl << "descr_rad_ : " << descr_rad_ << std::endl;
     myfile << "cg_size_ : " <<  cg_size_ << std::endl << "cg_thresh_ : " <<  cg_thresh_ << std::endl;
     myfile << "kd_thresh_ : " << kd_thresh_ << std::endl;
+
+    if (shortlist_size_ > 0)
+      computeModelSignatures ();
     
     while(it_s != endit_s) //for every scene
     {  
       if(fs::is_regular_file(*it_s) && it_s->path().extension() == ext) 
       {
         scene_filename_ = scene_path.string() + it_s->path().filename().string();
+        std::set<std::string> shortlist;
+        if (shortlist_size_ > 0)
+          shortlist = sceneShortlist ();
         fs::recursive_directory_iterator it_m(model_path);
         fs::recursive_directory_iterator endit_m;
 
@@ -462,8 +799,23 @@ pathIteration()
           { 
             model_filename_ = model_path.string() + it_m->path().filename().string();
             // DO CORRESPONDENCE GROUPING
-            std::vector<int> res = correspondenceGroup();
-            myfile << it_s->path().filename().string() << " <<<>>> " << it_m->path().filename().string() << " : " << res[0] << " -> " << res[1] << std::endl;
+            const double pair_start = wp2::Profiler::now ();
+            std::vector<int> res;
+            if (shortlist_size_ > 0 && shortlist.find (model_filename_) == shortlist.end ())
+            {
+              profiler_.beginPair (model_filename_, scene_filename_);
+              res = gatePair (wp2::GATE_SHORTLIST, 0);
+            }
+            else
+              res = correspondenceGroup();
+            if (evaluate_)
+              evaluator_.addPair (model_filename_, scene_filename_, wp2::Evaluator::labelFromFilename (model_filename_),
+                                  std::vector<std::string> (1, wp2::Evaluator::labelFromFilename (scene_filename_)),
+                                  res[1], wp2::Profiler::now () - pair_start);
+            myfile << it_s->path().filename().string() << " <<<>>> " << it_m->path().filename().string() << " : " << res[0] << " -> " << res[1];
+            if (res[2] != wp2::GATE_PASS)
+              myfile << " (" << wp2::gateReasonName (static_cast<wp2::GateReason> (res[2])) << ")";
+            myfile << std::endl;
             std::size_t  s_idx = it_s->path().filename().string().find("-");
             std::size_t  m_idx = it_m->path().filename().string().find("-");
             if (s_idx!=std::string::npos || m_idx!=std::string::npos)
@@ -515,7 +867,8 @@ pathIteration()
 void save_function(int sig)
 { // can be called asynchronously
   calculate_save();
-  exit(0);
+  saveProfile ();
+  exit(saveEvaluation () ? 0 : 1);
 } 
 
 int
@@ -525,5 +878,8 @@ main (int argc, char *argv[])
 
 	parseCommandLine (argc, argv);
 	pathIteration();
+	saveProfile ();
+	if (!saveEvaluation ())
+	  return (1);
   	//displayScore();
 }
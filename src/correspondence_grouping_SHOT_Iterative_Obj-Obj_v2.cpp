@@ -17,6 +17,8 @@
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/common/profiler.h>
+
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/path.hpp"
 #include "boost/progress.hpp"
@@ -84,6 +86,10 @@ float descr_rad_ (0.02f);
 float cg_size_ (0.01f);
 float cg_thresh_ (5.0f);
 
+//Instrumentation
+wp2::Profiler profiler_;
+std::string profile_filename_;
+
 pcl::PointCloud<PointType>::Ptr model_cloud (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr scene_cloud (new pcl::PointCloud<PointType> ());
@@ -122,7 +128,10 @@ showHelp (char *filename)
   std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
   std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
   std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
-  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl;
+  std::cout << "     --profile file:         Write the time of each stage and the point and" << std::endl;
+  std::cout << "                             match counts to file (.csv or .json) and print" << std::endl;
+  std::cout << "                             a summary." << std::endl << std::endl;
 }
 
 
@@ -197,6 +206,11 @@ parseCommandLine (int argc, char *argv[])
   pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
   pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
   pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+
+  if (pcl::console::parse_argument (argc, argv, "--profile", profile_filename_) != -1)
+  {
+    profiler_.setEnabled (true);
+  }
   return folder_path.string();
 }
 
@@ -388,7 +402,10 @@ void extractPCD(std::vector<object> objList, std::string folder, pcl::PointCloud
 int
 correspondenceGrouping (std::string model, std::string scene)
 { 
+  profiler_.beginPair (model, scene);
+
 //  Load clouds
+  wp2::ScopedTimer load_timer (profiler_, "load");
 	if (pcl::io::loadPCDFile (model, *model_cloud) < 0)
   	{
    		std::cout << "Error loading model cloud." << std::endl;
@@ -400,13 +417,17 @@ correspondenceGrouping (std::string model, std::string scene)
    		std::cout << "Error loading scene cloud." << std::endl;
     	return (-1);
  	 }
+  load_timer.stop ();
 
 //  Compute Cloud Resolution
 
+  wp2::ScopedTimer resolution_timer (profiler_, "resolution");
   computeCloudResolution(model_cloud);
+  resolution_timer.stop ();
 
 //  Compute Normals
 
+  wp2::ScopedTimer normals_timer (profiler_, "normals");
   pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
   norm_est.setKSearch (10);
   norm_est.setInputCloud (model_cloud);
@@ -414,9 +435,11 @@ correspondenceGrouping (std::string model, std::string scene)
 
   norm_est.setInputCloud (scene_cloud);
   norm_est.compute (*scene_normals);
+  normals_timer.stop ();
 
 //  Downsample Clouds to Extract keypoints
 
+  wp2::ScopedTimer sampling_timer (profiler_, "sampling");
   pcl::PointCloud<int> sampled_indices;
 
   pcl::UniformSampling<PointType> uniform_sampling;
@@ -430,10 +453,16 @@ correspondenceGrouping (std::string model, std::string scene)
   uniform_sampling.setRadiusSearch (scene_ss_);
   uniform_sampling.compute (sampled_indices);
   pcl::copyPointCloud (*scene_cloud, sampled_indices.points, *scene_keypoints);
+  sampling_timer.stop ();
+  profiler_.setCount ("model_points", static_cast<long> (model_cloud->size ()));
+  profiler_.setCount ("scene_points", static_cast<long> (scene_cloud->size ()));
+  profiler_.setCount ("model_keypoints", static_cast<long> (model_keypoints->size ()));
+  profiler_.setCount ("scene_keypoints", static_cast<long> (scene_keypoints->size ()));
   std::cout << "Scene total points: " << scene_cloud->size () << "; Selected Keypoints: " << scene_keypoints->size () << std::endl;
 
 //  Compute Descriptor for keypoints
 
+  wp2::ScopedTimer descriptor_timer (profiler_, "shot");
   pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
   descr_est.setRadiusSearch (descr_rad_);
 
@@ -446,9 +475,11 @@ correspondenceGrouping (std::string model, std::string scene)
   descr_est.setInputNormals (scene_normals);
   descr_est.setSearchSurface (scene_cloud);
   descr_est.compute (*scene_descriptors);
+  descriptor_timer.stop ();
 
 //  Find Model-Scene Correspondences with KdTree
 
+  wp2::ScopedTimer matching_timer (profiler_, "matching");
   pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
 
   pcl::KdTreeFLANN<DescriptorType> match_search;
@@ -470,6 +501,8 @@ correspondenceGrouping (std::string model, std::string scene)
       model_scene_corrs->push_back (corr);
     }
   }
+  matching_timer.stop ();
+  profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
   std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
 
 //  Actual Clustering
@@ -483,6 +516,7 @@ correspondenceGrouping (std::string model, std::string scene)
     //
     //  Compute (Keypoints) Reference Frames only for Hough
     //
+    wp2::ScopedTimer lrf_timer (profiler_, "lrf");
     pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
     pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
 
@@ -499,8 +533,10 @@ correspondenceGrouping (std::string model, std::string scene)
     rf_est.setInputNormals (scene_normals);
     rf_est.setSearchSurface (scene_cloud);
     rf_est.compute (*scene_rf);
+    lrf_timer.stop ();
 
     //  Clustering
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::Hough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
     clusterer.setHoughBinSize (cg_size_);
     clusterer.setHoughThreshold (cg_thresh_);
@@ -519,6 +555,7 @@ correspondenceGrouping (std::string model, std::string scene)
 
   else // Using GeometricConsistency
   {
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::GeometricConsistencyGrouping<PointType, PointType> gc_clusterer;
     gc_clusterer.setGCSize (cg_size_);
     gc_clusterer.setGCThreshold (cg_thresh_);
@@ -533,6 +570,8 @@ correspondenceGrouping (std::string model, std::string scene)
 
 //  Output results
 
+  profiler_.setCount ("instances", static_cast<long> (rototranslations.size ()));
+  profiler_.endPair ();
   std::cout << "Model instances found: " << rototranslations.size () << std::endl;
 
   /*for (size_t i = 0; i < rototranslations.size (); ++i)
@@ -556,6 +595,21 @@ correspondenceGrouping (std::string model, std::string scene)
 }
 
 
+void
+saveProfile ()
+{
+  if (!profiler_.isEnabled ())
+  {
+    return;
+  }
+  profiler_.endPair ();
+  if (!profiler_.write (profile_filename_))
+  {
+    std::cout << "Error writing profile " << profile_filename_ << std::endl;
+  }
+  profiler_.printSummary (std::cout);
+}
+
 void
 CorrespondenceIteration(std::vector<std::string> fileNamesV, fs::path rootFolder)
 {	
@@ -649,5 +703,6 @@ main (int argc, char *argv[])
   fs::path folderName_ = parseCommandLine (argc, argv);
   std::vector<std::string> fileNames_ = pathIteration(folderName_);
   CorrespondenceIteration(fileNames_,folderName_);
+  saveProfile ();
   //displayScore();
 }
@@ -16,6 +16,8 @@
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/common/profiler.h>
+
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/path.hpp"
 #include "boost/progress.hpp"
@@ -45,6 +47,10 @@ float descr_rad_ (0.02f);
 float cg_size_ (0.01f);
 float cg_thresh_ (5.0f);
 
+//Instrumentation
+wp2::Profiler profiler_;
+std::string profile_filename_;
+
 pcl::PointCloud<PointType>::Ptr model (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
 pcl::PointCloud<PointType>::Ptr scene (new pcl::PointCloud<PointType> ());
@@ -86,7 +92,10 @@ showHelp (char *filename)
   std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
   std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
   std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
-  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl;
+  std::cout << "     --profile file:         Write the time of each stage and the point and" << std::endl;
+  std::cout << "                             match counts to file (.csv or .json) and print" << std::endl;
+  std::cout << "                             a summary." << std::endl << std::endl;
 }
 
 void
@@ -167,6 +176,11 @@ parseCommandLine (int argc, char *argv[])
   pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
   pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
   pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+
+  if (pcl::console::parse_argument (argc, argv, "--profile", profile_filename_) != -1)
+  {
+    profiler_.setEnabled (true);
+  }
 }
 
 void
@@ -240,16 +254,22 @@ loadCloud ()
 int
 correspondenceGroup ()
 {
-  
+  profiler_.beginPair (model_filename_, scene_filename_);
+
 //  Load clouds
+  wp2::ScopedTimer load_timer (profiler_, "load");
   loadCloud ();
+  load_timer.stop ();
 
 //  Compute Cloud Resolution
 
+  wp2::ScopedTimer resolution_timer (profiler_, "resolution");
   computeCloudResolution(model);
+  resolution_timer.stop ();
 
 //  Compute Normals
 
+  wp2::ScopedTimer normals_timer (profiler_, "normals");
   pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
   norm_est.setKSearch (10);
   norm_est.setInputCloud (model);
@@ -257,9 +277,11 @@ correspondenceGroup ()
 
   norm_est.setInputCloud (scene);
   norm_est.compute (*scene_normals);
+  normals_timer.stop ();
 
 //  Downsample Clouds to Extract keypoints
 
+  wp2::ScopedTimer sampling_timer (profiler_, "sampling");
   pcl::PointCloud<int> sampled_indices;
 
   pcl::UniformSampling<PointType> uniform_sampling;
@@ -273,10 +295,16 @@ correspondenceGroup ()
   uniform_sampling.setRadiusSearch (scene_ss_);
   uniform_sampling.compute (sampled_indices);
   pcl::copyPointCloud (*scene, sampled_indices.points, *scene_keypoints);
+  sampling_timer.stop ();
+  profiler_.setCount ("model_points", static_cast<long> (model->size ()));
+  profiler_.setCount ("scene_points", static_cast<long> (scene->size ()));
+  profiler_.setCount ("model_keypoints", static_cast<long> (model_keypoints->size ()));
+  profiler_.setCount ("scene_keypoints", static_cast<long> (scene_keypoints->size ()));
   std::cout << "Scene total points: " << scene->size () << "; Selected Keypoints: " << scene_keypoints->size () << std::endl;
 
 //  Compute Descriptor for keypoints
 
+  wp2::ScopedTimer descriptor_timer (profiler_, "shot");
   pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
   descr_est.setRadiusSearch (descr_rad_);
 
@@ -289,9 +317,11 @@ correspondenceGroup ()
   descr_est.setInputNormals (scene_normals);
   descr_est.setSearchSurface (scene);
   descr_est.compute (*scene_descriptors);
+  descriptor_timer.stop ();
 
 //  Find Model-Scene Correspondences with KdTree
 
+  wp2::ScopedTimer matching_timer (profiler_, "matching");
   pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
 
   pcl::KdTreeFLANN<DescriptorType> match_search;
@@ -313,6 +343,8 @@ correspondenceGroup ()
       model_scene_corrs->push_back (corr);
     }
   }
+  matching_timer.stop ();
+  profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
   std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
 
 //  Actual Clustering
@@ -326,6 +358,7 @@ correspondenceGroup ()
     //
     //  Compute (Keypoints) Reference Frames only for Hough
     //
+    wp2::ScopedTimer lrf_timer (profiler_, "lrf");
     pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
     pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
 
@@ -342,8 +375,10 @@ correspondenceGroup ()
     rf_est.setInputNormals (scene_normals);
     rf_est.setSearchSurface (scene);
     rf_est.compute (*scene_rf);
+    lrf_timer.stop ();
 
     //  Clustering
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::Hough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
     clusterer.setHoughBinSize (cg_size_);
     clusterer.setHoughThreshold (cg_thresh_);
@@ -362,6 +397,7 @@ correspondenceGroup ()
 
   else // Using GeometricConsistency
   {
+    wp2::ScopedTimer grouping_timer (profiler_, "grouping");
     pcl::GeometricConsistencyGrouping<PointType, PointType> gc_clusterer;
     gc_clusterer.setGCSize (cg_size_);
     gc_clusterer.setGCThreshold (cg_thresh_);
@@ -376,6 +412,8 @@ correspondenceGroup ()
 
 //  Output results
 
+  profiler_.setCount ("instances", static_cast<long> (rototranslations.size ()));
+  profiler_.endPair ();
   std::cout << "Model instances found: " << rototranslations.size () << std::endl;
 
   /*for (size_t i = 0; i < rototranslations.size (); ++i)
@@ -398,6 +436,21 @@ correspondenceGroup ()
  return rototranslations.size();
 }
 
+void
+saveProfile ()
+{
+  if (!profiler_.isEnabled ())
+  {
+    return;
+  }
+  profiler_.endPair ();
+  if (!profiler_.write (profile_filename_))
+  {
+    std::cout << "Error writing profile " << profile_filename_ << std::endl;
+  }
+  profiler_.printSummary (std::cout);
+}
+
 void
 pathIteration()
 {
@@ -483,5 +536,6 @@ main (int argc, char *argv[])
 {
   parseCommandLine (argc, argv);
   pathIteration();
+  saveProfile ();
   //displayScore();
 }
@@ -18,6 +18,19 @@
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/common/evaluation.h>
+#include <wp2/common/pair_scratch.h>
+#include <wp2/common/profiler.h>
+#include <wp2/features/board_omp.h>
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/features/shot_lrf.h>
+#include <wp2/features/shot_simd.h>
+#include <wp2/recognition/geometric_consistency_simd.h>
+#include <wp2/recognition/hough_3d_sparse.h>
+#include <wp2/recognition/pair_gates.h>
+#include <wp2/search/descriptor_matcher.h>
+#include <wp2/search/hnsw_index.h>
+
 #include "boost/filesystem/operations.hpp"
 #include "boost/filesystem/path.hpp"
 #include "boost/progress.hpp"
@@ -25,6 +38,7 @@
 #include <fstream>
 
 #include <ios>
+#include <map>
 #include <sstream>
 #include <boost/property_tree/xml_parser.hpp>
 
@@ -78,21 +92,37 @@ bool show_keypoints_ (false);
 bool show_correspondences_ (false);
 bool use_cloud_resolution_ (false);
 bool use_hough_ (true);
+bool share_lrf_ (false);
+bool fuse_features_ (false);
+wp2::shot::Kernel shot_kernel_ (wp2::shot::KERNEL_PCL);
+wp2::search::DescriptorMatcher::Mode match_mode_ (wp2::search::DescriptorMatcher::MATCH_THRESHOLD);
+float match_thresh_ (0.25f);
+float match_ratio_ (0.8f);
+wp2::search::IndexParams index_params_;
+float index_recall_ (0.0f);
+std::string library_filename_;
 float model_ss_ (0.01f);
 float scene_ss_ (0.03f);
 float rf_rad_ (0.015f);
 float descr_rad_ (0.02f);
 float cg_size_ (0.01f);
 float cg_thresh_ (5.0f);
+wp2::PairGates<PointType> gates_;
+
+//Instrumentation
+wp2::Profiler profiler_;
+std::string profile_filename_;
 
-pcl::PointCloud<PointType>::Ptr model_cloud (new pcl::PointCloud<PointType> ());
-pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
-pcl::PointCloud<PointType>::Ptr scene_cloud (new pcl::PointCloud<PointType> ());
-pcl::PointCloud<PointType>::Ptr scene_keypoints (new pcl::PointCloud<PointType> ());
-pcl::PointCloud<NormalType>::Ptr model_normals (new pcl::PointCloud<NormalType> ());
-pcl::PointCloud<NormalType>::Ptr scene_normals (new pcl::PointCloud<NormalType> ());
-pcl::PointCloud<DescriptorType>::Ptr model_descriptors (new pcl::PointCloud<DescriptorType> ());
-pcl::PointCloud<DescriptorType>::Ptr scene_descriptors (new pcl::PointCloud<DescriptorType> ());
+//Evaluation
+bool evaluate_ (false);
+wp2::Evaluator evaluator_;
+std::string eval_filename_;
+std::string eval_summary_filename_;
+float min_f1_ (0.0f);
+std::map<std::string, std::vector<std::string> > scene_objects_;
+
+//Clouds, descriptors and matches of the current pair, reset between pairs with their capacity kept
+wp2::PairScratch<PointType, NormalType, RFType> scratch_;
 
 int score[10][10] = {};
 int s_file_count = 0;
@@ -100,6 +130,12 @@ int m_file_count = 0;
 
 std::string model_filename;
 
+//Descriptor library labelled by model file, the model and scene files of the current pair
+wp2::search::HNSWIndex::Ptr library_;
+bool library_changed_ (false);
+std::string model_label_;
+std::string scene_filename_;
+
 
 void
 showHelp (char *filename)
@@ -117,13 +153,54 @@ showHelp (char *filename)
   std::cout << "     -c:                     Show used correspondences." << std::endl;
   std::cout << "     -r:                     Compute the model cloud resolution and multiply" << std::endl;
   std::cout << "                             each radius given by that value." << std::endl;
+  std::cout << "     -l:                     Share the BOARD reference frames with SHOT instead of" << std::endl;
+  std::cout << "                             letting SHOT compute its own (one LRF per keypoint)." << std::endl;
+  std::cout << "     -f:                     Compute SHOT and LRF from one shared neighbourhood" << std::endl;
+  std::cout << "                             search per keypoint (implies -l)." << std::endl;
   std::cout << "     --algorithm (Hough|GC): Clustering algorithm used (default Hough)." << std::endl;
+  std::cout << "     --shot_kernel (pcl|scalar|avx2|auto):" << std::endl;
+  std::cout << "                             SHOT histogram code (default pcl). auto uses AVX2" << std::endl;
+  std::cout << "                             when the CPU has it." << std::endl;
+  std::cout << "     --match (nn|ratio|mutual):" << std::endl;
+  std::cout << "                             Keep the nearest model descriptor under --match_thresh" << std::endl;
+  std::cout << "                             (nn, default), and only if it passes the ratio test" << std::endl;
+  std::cout << "                             against the second nearest (ratio) or is a mutual" << std::endl;
+  std::cout << "                             nearest neighbour (mutual)." << std::endl;
+  std::cout << "     --match_thresh val:     Squared descriptor distance threshold (default 0.25)" << std::endl;
+  std::cout << "     --match_ratio val:      Ratio test bound (default 0.8)" << std::endl;
+  std::cout << "     --index (exact|kdtree|kmeans|linear|hnsw):" << std::endl;
+  std::cout << "                             Descriptor index (default exact). kdtree is a" << std::endl;
+  std::cout << "                             randomized kd-forest, kmeans a hierarchical k-means" << std::endl;
+  std::cout << "                             tree, hnsw a navigable small world graph; all three" << std::endl;
+  std::cout << "                             are approximate." << std::endl;
+  std::cout << "     --index_trees val:      Trees of the kd-forest (default 4)" << std::endl;
+  std::cout << "     --index_neighbors val:  Links per node of the hnsw graph (default 16)" << std::endl;
+  std::cout << "     --index_checks val:     Leaves visited per query by kdtree and kmeans" << std::endl;
+  std::cout << "                             (default unlimited), candidates kept per query" << std::endl;
+  std::cout << "                             by hnsw and --library (default 64)" << std::endl;
+  std::cout << "     --index_recall val:     Pick the fastest index reaching this nearest" << std::endl;
+  std::cout << "                             neighbour recall against exact search, tuned on" << std::endl;
+  std::cout << "                             the first pair (overrides --index)." << std::endl;
+  std::cout << "     --library file:         Match each scene once against all the models held in" << std::endl;
+  std::cout << "                             an hnsw descriptor library file, which is mapped," << std::endl;
+  std::cout << "                             not read (overrides --index). Models missing from it" << std::endl;
+  std::cout << "                             are added and the file saved at the end; keep" << std::endl;
+  std::cout << "                             --model_ss and --descr_rad as when it was built." << std::endl;
   std::cout << "     --model_ss val:         Model uniform sampling radius (default 0.01)" << std::endl;
   std::cout << "     --scene_ss val:         Scene uniform sampling radius (default 0.03)" << std::endl;
   std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
   std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
   std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
-  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl;
+  std::cout << "     --profile file:         Write the time of each stage and the point and" << std::endl;
+  std::cout << "                             match counts to file (.csv or .json) and print" << std::endl;
+  std::cout << "                             a summary." << std::endl;
+  std::cout << "     --eval file:            Score each pair against the object names in the" << std::endl;
+  std::cout << "                             scene annotation XML, write the pairs to file and" << std::endl;
+  std::cout << "                             print P/R/F1 and the confusion matrix." << std::endl;
+  std::cout << "     --eval_summary file:    Append the P/R/F1 and pair times of this parameter" << std::endl;
+  std::cout << "                             set to file, one line per run." << std::endl;
+  std::cout << "     --min_f1 val:           Exit with 1 when the F1 score is below val." << std::endl << std::endl;
 }
 
 
@@ -140,7 +217,7 @@ parseCommandLine (int argc, char *argv[])
   //Directory path
   	fs::path folder_path( fs::initial_path<fs::path>());
 
- 	if ( argc == 2 )
+ 	if ( argc > 1 )
  	{
     	folder_path = fs::system_complete( fs::path( argv[1]));
     	std::cout << folder_path.string() << std::endl;
@@ -172,6 +249,15 @@ parseCommandLine (int argc, char *argv[])
   {
     use_cloud_resolution_ = true;
   }
+  if (pcl::console::find_switch (argc, argv, "-l"))
+  {
+    share_lrf_ = true;
+  }
+  if (pcl::console::find_switch (argc, argv, "-f"))
+  {
+    fuse_features_ = true;
+    share_lrf_ = true;
+  }
 
   std::string used_algorithm;
   if (pcl::console::parse_argument (argc, argv, "--algorithm", used_algorithm) != -1)
@@ -191,6 +277,46 @@ parseCommandLine (int argc, char *argv[])
     }
   }
 
+  std::string shot_kernel;
+  if (pcl::console::parse_argument (argc, argv, "--shot_kernel", shot_kernel) != -1)
+  {
+    if (!wp2::shot::parseKernel (shot_kernel, shot_kernel_))
+    {
+      std::cout << "Wrong SHOT kernel name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string match_mode;
+  if (pcl::console::parse_argument (argc, argv, "--match", match_mode) != -1)
+  {
+    if (!wp2::search::DescriptorMatcher::parseMode (match_mode, match_mode_))
+    {
+      std::cout << "Wrong matching mode.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+  pcl::console::parse_argument (argc, argv, "--match_thresh", match_thresh_);
+  pcl::console::parse_argument (argc, argv, "--match_ratio", match_ratio_);
+
+  std::string index_type;
+  if (pcl::console::parse_argument (argc, argv, "--index", index_type) != -1)
+  {
+    if (!wp2::search::IndexParams::parseType (index_type, index_params_.type))
+    {
+      std::cout << "Wrong index type.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+  pcl::console::parse_argument (argc, argv, "--index_trees", index_params_.trees);
+  pcl::console::parse_argument (argc, argv, "--index_neighbors", index_params_.neighbors);
+  pcl::console::parse_argument (argc, argv, "--index_checks", index_params_.checks);
+  pcl::console::parse_argument (argc, argv, "--index_recall", index_recall_);
+  pcl::console::parse_argument (argc, argv, "--library", library_filename_);
+
 //General parameters
   pcl::console::parse_argument (argc, argv, "--model_ss", model_ss_);
   pcl::console::parse_argument (argc, argv, "--scene_ss", scene_ss_);
@@ -198,6 +324,48 @@ parseCommandLine (int argc, char *argv[])
   pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
   pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
   pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+  gates_.setGroupingThreshold (cg_thresh_, use_hough_);
+
+  if (pcl::console::parse_argument (argc, argv, "--profile", profile_filename_) != -1)
+  {
+    profiler_.setEnabled (true);
+  }
+
+  if (pcl::console::parse_argument (argc, argv, "--eval", eval_filename_) != -1)
+  {
+    evaluate_ = true;
+  }
+  if (pcl::console::parse_argument (argc, argv, "--eval_summary", eval_summary_filename_) != -1)
+  {
+    evaluate_ = true;
+  }
+  if (pcl::console::parse_argument (argc, argv, "--min_f1", min_f1_) != -1)
+  {
+    evaluate_ = true;
+  }
+  std::stringstream parameters;
+  parameters << (use_hough_ ? "Hough" : "GC") << " model_ss=" << model_ss_ << " scene_ss=" << scene_ss_
+             << " rf_rad=" << rf_rad_ << " descr_rad=" << descr_rad_ << " cg_size=" << cg_size_
+             << " cg_thresh=" << cg_thresh_ << " shot_kernel=" << wp2::shot::kernelName (shot_kernel_)
+             << (fuse_features_ ? " fused" : (share_lrf_ ? " shared_lrf" : ""))
+             << " match=" << wp2::search::DescriptorMatcher::modeName (match_mode_) << " match_thresh=" << match_thresh_;
+  if (match_mode_ == wp2::search::DescriptorMatcher::MATCH_RATIO)
+  {
+    parameters << " match_ratio=" << match_ratio_;
+  }
+  if (!library_filename_.empty ())
+  {
+    parameters << " library neighbors=" << index_params_.neighbors << " checks=" << index_params_.checks;
+  }
+  else if (index_recall_ > 0.0f)
+  {
+    parameters << " index_recall=" << index_recall_;
+  }
+  else
+  {
+    parameters << " index=" << index_params_.toString ();
+  }
+  evaluator_.setParameters (parameters.str ());
   return folder_path.string();
 }
 
@@ -314,6 +482,39 @@ void importObjectsInformation(const char* xmlFile)
 }
 
 
+//  Object names annotated in the XML next to a scene PCD, read once per scene
+const std::vector<std::string> &
+sceneObjectNames (const std::string &scene_filename)
+{
+  std::map<std::string, std::vector<std::string> >::iterator found = scene_objects_.find (scene_filename);
+  if (found != scene_objects_.end ())
+  {
+    return (found->second);
+  }
+
+  std::vector<std::string> &names = scene_objects_[scene_filename];
+  std::string xmlFile = scene_filename;
+  xmlFile = xmlFile.erase (xmlFile.find_last_of ("."), 4) + ".xml";
+  try
+  {
+    ptree root;
+    read_xml (xmlFile, root);
+    ptree &allObjects = root.get_child (TAG_SCENARIO + "." + TAG_ALLOBJECTS);
+    ptree::iterator it = allObjects.begin ();
+    it++;
+    for (; it != allObjects.end (); it++)
+    {
+      names.push_back (it->second.get<std::string> (TAG_NAME));
+    }
+  }
+  catch (const ptree_error &e)
+  {
+    std::cout << "No annotation for " << scene_filename << ": " << e.what () << std::endl;
+  }
+  return (names);
+}
+
+
 void displayObjects()
 {
 	for (std::vector<object>::const_iterator it = _objectList.begin (); it != _objectList.end (); ++it)
@@ -361,48 +562,87 @@ void
 keypointExtraction (std::string model, std::string scene)
 { 
 //  Load clouds
-	if (pcl::io::loadPCDFile (model, *model_cloud) < 0)
+  wp2::ScopedTimer load_timer (profiler_, "load");
+  scratch_.reset ();
+	if (scratch_.loadPCDFile (model, *scratch_.model_cloud) < 0)
   	{
    		std::cout << "Error loading model cloud." << std::endl;
     	exit(0);
   	}
 
-  	if (pcl::io::loadPCDFile (scene, *scene_cloud) < 0)
+  	if (scratch_.loadPCDFile (scene, *scratch_.scene_cloud) < 0)
   	{
    		std::cout << "Error loading scene cloud." << std::endl;
     	exit(0);
  	 }
+  load_timer.stop ();
 
 //  Compute Cloud Resolution
 
-  computeCloudResolution(model_cloud);
+  wp2::ScopedTimer resolution_timer (profiler_, "resolution");
+  computeCloudResolution(scratch_.model_cloud);
+  resolution_timer.stop ();
 
 //  Compute Normals
 
+  wp2::ScopedTimer normals_timer (profiler_, "normals");
   pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
   norm_est.setKSearch (10);
-  norm_est.setInputCloud (model_cloud);
-  norm_est.compute (*model_normals);
+  norm_est.setInputCloud (scratch_.model_cloud);
+  norm_est.compute (*scratch_.model_normals);
 
-  norm_est.setInputCloud (scene_cloud);
-  norm_est.compute (*scene_normals);
+  norm_est.setInputCloud (scratch_.scene_cloud);
+  norm_est.compute (*scratch_.scene_normals);
+  normals_timer.stop ();
 
 //  Downsample Clouds to Extract keypoints
 
-  pcl::PointCloud<int> sampled_indices;
+  wp2::ScopedTimer sampling_timer (profiler_, "sampling");
+  pcl::PointCloud<int> &sampled_indices = scratch_.sampled_indices;
 
   pcl::UniformSampling<PointType> uniform_sampling;
-  uniform_sampling.setInputCloud (model_cloud);
+  uniform_sampling.setInputCloud (scratch_.model_cloud);
   uniform_sampling.setRadiusSearch (model_ss_);
   uniform_sampling.compute (sampled_indices);
-  pcl::copyPointCloud (*model_cloud, sampled_indices.points, *model_keypoints);
-  std::cout << "Model total points: " << model_cloud->size () << "; Selected Keypoints: " << model_keypoints->size () << std::endl;
+  pcl::copyPointCloud (*scratch_.model_cloud, sampled_indices.points, *scratch_.model_keypoints);
+  std::cout << "Model total points: " << scratch_.model_cloud->size () << "; Selected Keypoints: " << scratch_.model_keypoints->size () << std::endl;
 
-  uniform_sampling.setInputCloud (scene_cloud);
+  uniform_sampling.setInputCloud (scratch_.scene_cloud);
   uniform_sampling.setRadiusSearch (scene_ss_);
   uniform_sampling.compute (sampled_indices);
-  pcl::copyPointCloud (*scene_cloud, sampled_indices.points, *scene_keypoints);
-  std::cout << "Scene total points: " << scene_cloud->size () << "; Selected Keypoints: " << scene_keypoints->size () << std::endl;
+  pcl::copyPointCloud (*scratch_.scene_cloud, sampled_indices.points, *scratch_.scene_keypoints);
+  sampling_timer.stop ();
+  profiler_.setCount ("model_points", static_cast<long> (scratch_.model_cloud->size ()));
+  profiler_.setCount ("scene_points", static_cast<long> (scratch_.scene_cloud->size ()));
+  profiler_.setCount ("model_keypoints", static_cast<long> (scratch_.model_keypoints->size ()));
+  profiler_.setCount ("scene_keypoints", static_cast<long> (scratch_.scene_keypoints->size ()));
+  std::cout << "Scene total points: " << scratch_.scene_cloud->size () << "; Selected Keypoints: " << scratch_.scene_keypoints->size () << std::endl;
+}
+
+void
+modelReferenceFrameComputation (wp2::BOARDLocalReferenceFrameEstimationOMP<PointType, NormalType, RFType> &rf_est)
+{
+  rf_est.setFindHoles (true);
+  rf_est.setRadiusSearch (rf_rad_);
+  rf_est.setInputCloud (scratch_.model_keypoints);
+  rf_est.setInputNormals (scratch_.model_normals);
+  rf_est.setSearchSurface (scratch_.model_cloud);
+  rf_est.compute (*scratch_.model_rf);
+}
+
+void
+referenceFrameComputation ()
+{
+//  Compute (Keypoints) Reference Frames for Hough, and for SHOT when they are shared
+
+  wp2::ScopedTimer timer (profiler_, "lrf");
+  wp2::BOARDLocalReferenceFrameEstimationOMP<PointType, NormalType, RFType> rf_est;
+  modelReferenceFrameComputation (rf_est);
+
+  rf_est.setInputCloud (scratch_.scene_keypoints);
+  rf_est.setInputNormals (scratch_.scene_normals);
+  rf_est.setSearchSurface (scratch_.scene_cloud);
+  rf_est.compute (*scratch_.scene_rf);
 }
 
 void
@@ -410,18 +650,63 @@ descriptorComputation ()
 { 
 //  Compute Descriptor for keypoints
 
-  pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
+  wp2::ScopedTimer timer (profiler_, "shot");
+  wp2::SHOTEstimationSIMD<PointType, NormalType, DescriptorType> descr_est;
+  descr_est.setKernel (shot_kernel_);
   descr_est.setRadiusSearch (descr_rad_);
 
-  descr_est.setInputCloud (model_keypoints);
-  descr_est.setInputNormals (model_normals);
-  descr_est.setSearchSurface (model_cloud);
-  descr_est.compute (*model_descriptors);
+  //  A model already in the library is matched from there
+  if (!library_ || library_->findLabel (model_label_) < 0)
+  {
+    descr_est.setInputCloud (scratch_.model_keypoints);
+    descr_est.setInputNormals (scratch_.model_normals);
+    descr_est.setSearchSurface (scratch_.model_cloud);
+    if (share_lrf_)
+    {
+      descr_est.setInputReferenceFrames (scratch_.model_rf);
+    }
+    descr_est.compute (scratch_.model_descriptors);
+  }
+
+  descr_est.setInputCloud (scratch_.scene_keypoints);
+  descr_est.setInputNormals (scratch_.scene_normals);
+  descr_est.setSearchSurface (scratch_.scene_cloud);
+  if (share_lrf_)
+  {
+    descr_est.setInputReferenceFrames (scratch_.scene_rf);
+  }
+  descr_est.compute (scratch_.scene_descriptors);
+}
+
+void
+featureComputation ()
+{
+//  Compute SHOT and LRF together from one neighbourhood search per keypoint
 
-  descr_est.setInputCloud (scene_keypoints);
-  descr_est.setInputNormals (scene_normals);
-  descr_est.setSearchSurface (scene_cloud);
-  descr_est.compute (*scene_descriptors);
+  wp2::ScopedTimer timer (profiler_, "shot_lrf");
+  wp2::SHOTLRFEstimation<PointType, NormalType, DescriptorType, RFType> feature_est;
+  feature_est.setKernel (shot_kernel_);
+  feature_est.setDescriptorRadius (descr_rad_);
+  feature_est.setReferenceFrameRadius (rf_rad_);
+
+  //  A model already in the library is matched from there: only its frames are computed, and only for Hough
+  if (!library_ || library_->findLabel (model_label_) < 0)
+  {
+    feature_est.setInputCloud (scratch_.model_keypoints);
+    feature_est.setInputNormals (scratch_.model_normals);
+    feature_est.setSearchSurface (scratch_.model_cloud);
+    feature_est.compute (scratch_.model_descriptors, scratch_.model_rf);
+  }
+  else if (use_hough_)
+  {
+    wp2::BOARDLocalReferenceFrameEstimationOMP<PointType, NormalType, RFType> rf_est;
+    modelReferenceFrameComputation (rf_est);
+  }
+
+  feature_est.setInputCloud (scratch_.scene_keypoints);
+  feature_est.setInputNormals (scratch_.scene_normals);
+  feature_est.setSearchSurface (scratch_.scene_cloud);
+  feature_est.compute (scratch_.scene_descriptors, scratch_.scene_rf);
 }
 
 pcl::CorrespondencesPtr
@@ -429,27 +714,61 @@ findingCorrespondence()
 { 
 //  Find Model-Scene Correspondences with KdTree
 
-  pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
+  wp2::ScopedTimer timer (profiler_, "matching");
+  pcl::CorrespondencesPtr model_scene_corrs = scratch_.correspondences;
 
-  pcl::KdTreeFLANN<DescriptorType> match_search;
-  match_search.setInputCloud (model_descriptors);
+  //  For each scene keypoint descriptor, find nearest neighbor into the model keypoints descriptors (batched searches) and
+  //  keep it if it passes the matching mode. Kept across pairs so the search buffers are reused.
+  static wp2::search::DescriptorMatcher matcher;
+  matcher.setMode (match_mode_);
+  matcher.setMaxSquaredDistance (match_thresh_);
+  matcher.setRatio (match_ratio_);
 
-  //  For each scene keypoint descriptor, find nearest neighbor into the model keypoints descriptor cloud and add it to the correspondences vector.
-  for (size_t i = 0; i < scene_descriptors->size (); ++i)
+  //  Against the library: one search per scene covers all its models. A model inserted while the scene is current is
+  //  matched on its own, as the library search would give it its own nearest matches, so the others stay valid.
+  if (library_)
   {
-    std::vector<int> neigh_indices (1);
-    std::vector<float> neigh_sqr_dists (1);
-    if (!pcl_isfinite (scene_descriptors->at (i).descriptor[0])) //skipping NaNs
+    static std::string matched_scene;
+    static std::vector<pcl::Correspondences> library_corrs;
+    int label = library_->findLabel (model_label_);
+    if (label < 0)
     {
-      continue;
+      wp2::ScopedTimer insert_timer (profiler_, "library_insert");
+      scratch_.model_descriptors.compact ();
+      label = library_->addLabel (model_label_);
+      library_->insert (scratch_.model_descriptors, label);
+      library_changed_ = true;
+      if (matched_scene == scene_filename_)
+      {
+        library_corrs.resize (library_->getNumberOfLabels ());
+        matcher.match (scratch_.model_descriptors, scratch_.scene_descriptors, library_corrs[label]);
+        profiler_.setCount ("match_candidates", static_cast<long> (matcher.getNumberOfCandidates ()));
+      }
     }
-    int found_neighs = match_search.nearestKSearch (scene_descriptors->at (i), 1, neigh_indices, neigh_sqr_dists);
-    if(found_neighs == 1 && neigh_sqr_dists[0] < 0.25f) //  add match only if the squared descriptor distance is less than 0.25 (SHOT descriptor distances are between 0 and 1 by design)
+    if (matched_scene != scene_filename_)
     {
-      pcl::Correspondence corr (neigh_indices[0], static_cast<int> (i), neigh_sqr_dists[0]);
-      model_scene_corrs->push_back (corr);
+      matcher.match (*library_, scratch_.scene_descriptors, library_corrs);
+      matched_scene = scene_filename_;
+      profiler_.setCount ("match_candidates", static_cast<long> (matcher.getNumberOfCandidates ()));
     }
+    *model_scene_corrs = library_corrs[label];
+    profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
+    std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
+    return model_scene_corrs;
   }
+
+  static bool index_tuned = false;
+  if (index_recall_ > 0.0f && !index_tuned)
+  {
+    wp2::ScopedTimer tune_timer (profiler_, "index_tuning");
+    index_params_ = wp2::search::DescriptorIndex::autotune (scratch_.model_descriptors, scratch_.scene_descriptors, index_recall_);
+    index_tuned = true;
+    std::cout << "Descriptor index for recall " << index_recall_ << ": " << index_params_.toString () << std::endl;
+  }
+  matcher.setIndexParams (index_params_);
+  matcher.match (scratch_.model_descriptors, scratch_.scene_descriptors, *model_scene_corrs);
+  profiler_.setCount ("match_candidates", static_cast<long> (matcher.getNumberOfCandidates ()));
+  profiler_.setCount ("correspondences", static_cast<long> (model_scene_corrs->size ()));
   std::cout << "Correspondences found: " << model_scene_corrs->size () << std::endl;
 
   return model_scene_corrs;
@@ -460,43 +779,24 @@ correspondenceGrouping (pcl::CorrespondencesPtr model_scene_corrs)
 { 
 //  Actual Clustering
 
-  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > rototranslations;
-  std::vector<pcl::Correspondences> clustered_corrs;
+  wp2::ScopedTimer timer (profiler_, "grouping");
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > &rototranslations = scratch_.rototranslations;
+  std::vector<pcl::Correspondences> &clustered_corrs = scratch_.clustered_corrs;
 
 //  Using Hough3D
   if (use_hough_)
   {
-    //
-    //  Compute (Keypoints) Reference Frames only for Hough
-    //
-    pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
-    pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
-
-    pcl::BOARDLocalReferenceFrameEstimation<PointType, NormalType, RFType> rf_est;
-    rf_est.setFindHoles (true);
-    rf_est.setRadiusSearch (rf_rad_);
-
-    rf_est.setInputCloud (model_keypoints);
-    rf_est.setInputNormals (model_normals);
-    rf_est.setSearchSurface (model_cloud);
-    rf_est.compute (*model_rf);
-
-    rf_est.setInputCloud (scene_keypoints);
-    rf_est.setInputNormals (scene_normals);
-    rf_est.setSearchSurface (scene_cloud);
-    rf_est.compute (*scene_rf);
-
-    //  Clustering
-    pcl::Hough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
+    //  Clustering. Kept across pairs so the hashed accumulator reuses its buckets
+    static wp2::SparseHough3DGrouping<PointType, PointType, RFType, RFType> clusterer;
     clusterer.setHoughBinSize (cg_size_);
     clusterer.setHoughThreshold (cg_thresh_);
     clusterer.setUseInterpolation (true);
     clusterer.setUseDistanceWeight (false);
 
-    clusterer.setInputCloud (model_keypoints);
-    clusterer.setInputRf (model_rf);
-    clusterer.setSceneCloud (scene_keypoints);
-    clusterer.setSceneRf (scene_rf);
+    clusterer.setInputCloud (scratch_.model_keypoints);
+    clusterer.setInputRf (scratch_.model_rf);
+    clusterer.setSceneCloud (scratch_.scene_keypoints);
+    clusterer.setSceneRf (scratch_.scene_rf);
     clusterer.setModelSceneCorrespondences (model_scene_corrs);
 
     //clusterer.cluster (clustered_corrs);
@@ -505,12 +805,12 @@ correspondenceGrouping (pcl::CorrespondencesPtr model_scene_corrs)
 
   else // Using GeometricConsistency
   {
-    pcl::GeometricConsistencyGrouping<PointType, PointType> gc_clusterer;
+    wp2::GeometricConsistencyGroupingSIMD<PointType, PointType> gc_clusterer;
     gc_clusterer.setGCSize (cg_size_);
     gc_clusterer.setGCThreshold (cg_thresh_);
 
-    gc_clusterer.setInputCloud (model_keypoints);
-    gc_clusterer.setSceneCloud (scene_keypoints);
+    gc_clusterer.setInputCloud (scratch_.model_keypoints);
+    gc_clusterer.setSceneCloud (scratch_.scene_keypoints);
     gc_clusterer.setModelSceneCorrespondences (model_scene_corrs);
 
     //gc_clusterer.cluster (clustered_corrs);
@@ -519,6 +819,9 @@ correspondenceGrouping (pcl::CorrespondencesPtr model_scene_corrs)
 
 //  Output results
 
+  timer.stop ();
+  profiler_.setCount ("instances", static_cast<long> (rototranslations.size ()));
+  profiler_.setCount ("scratch_bytes", static_cast<long> (scratch_.getCapacityBytes ()));
   std::cout << "Model instances found: " << rototranslations.size () << std::endl;
 
   /*for (size_t i = 0; i < rototranslations.size (); ++i)
@@ -542,6 +845,48 @@ correspondenceGrouping (pcl::CorrespondencesPtr model_scene_corrs)
 }
 
 
+void
+saveProfile ()
+{
+  if (!profiler_.isEnabled ())
+  {
+    return;
+  }
+  profiler_.endPair ();
+  if (!profiler_.write (profile_filename_))
+  {
+    std::cout << "Error writing profile " << profile_filename_ << std::endl;
+  }
+  profiler_.printSummary (std::cout);
+}
+
+//  True unless --min_f1 is set and not reached
+bool
+saveEvaluation ()
+{
+  if (!evaluate_)
+  {
+    return (true);
+  }
+  if (!eval_filename_.empty () && !evaluator_.writePairs (eval_filename_))
+  {
+    std::cout << "Error writing evaluation " << eval_filename_ << std::endl;
+  }
+  if (!eval_summary_filename_.empty () && !evaluator_.appendSummary (eval_summary_filename_))
+  {
+    std::cout << "Error writing evaluation summary " << eval_summary_filename_ << std::endl;
+  }
+  evaluator_.printSummary (std::cout);
+
+  const double f1 = evaluator_.getTotals ().f1 ();
+  if (f1 < min_f1_)
+  {
+    std::cout << "F1 " << f1 << " is below the required " << min_f1_ << std::endl;
+    return (false);
+  }
+  return (true);
+}
+
 void
 CorrespondenceIteration(std::vector<std::string> fileNames, fs::path rootFolder)
 {	
@@ -596,9 +941,39 @@ CorrespondenceIteration(std::vector<std::string> fileNames, fs::path rootFolder)
             	   //std::cout << scene_filename << " <<<<<>>>>> " << model_filename << std::endl;
             	   //std::cout << it_s->path().filename().string() << " <<<<<>>>>> " << it_m->path().filename().string() << std::endl;
             	   //std::cout << "scene_" << j << "     model_" << i << "   Correspondence:  " <<  correspondenceGrouping(model_filename,scene_filename) <<std::endl;
+                 const double pair_start = wp2::Profiler::now ();
+                 profiler_.beginPair (model_filename, scene_filename);
+                 model_label_ = model_filename;
+                 scene_filename_ = scene_filename;
             	   keypointExtraction (model_filename,scene_filename);
-                 descriptorComputation (); 
-                 myfile << it_s->path().filename().string() << " <<<<<--->>>>> " << it_m->path().filename().string()<< "   :  " << correspondenceGrouping(findingCorrespondence()) <<std::endl;
+                 if (fuse_features_)
+                   featureComputation ();
+                 else
+                 {
+                   if (share_lrf_)
+                     referenceFrameComputation ();
+                   descriptorComputation ();
+                 }
+                 //  Too few matches to reach cg_thresh_: no LRF or grouping
+                 pcl::CorrespondencesPtr model_scene_corrs = findingCorrespondence ();
+                 int instances = 0;
+                 const wp2::GateReason gate = gates_.checkCorrespondences (model_scene_corrs->size ());
+                 if (gate == wp2::GATE_PASS)
+                 {
+                   if (use_hough_ && !fuse_features_ && !share_lrf_)
+                     referenceFrameComputation ();
+                   instances = correspondenceGrouping (model_scene_corrs);
+                 }
+                 else
+                 {
+                   profiler_.setCount ("gate", static_cast<long> (gate));
+                   std::cout << "Pair skipped: " << wp2::gateReasonName (gate) << std::endl;
+                 }
+                 myfile << it_s->path().filename().string() << " <<<<<--->>>>> " << it_m->path().filename().string()<< "   :  " << instances <<std::endl;
+                 profiler_.endPair ();
+                 if (evaluate_)
+                   evaluator_.addPair (model_filename, scene_filename, it_m->path().stem().string(),
+                                       sceneObjectNames (scene_filename), instances, wp2::Profiler::now () - pair_start);
           		}
 
           		++it_m;
@@ -619,6 +994,22 @@ int
 main (int argc, char *argv[])
 {
   fs::path folderName_ = parseCommandLine (argc, argv);
+  if (!library_filename_.empty ())
+  {
+    library_.reset (new wp2::search::HNSWIndex (DescriptorType::descriptorSize (), index_params_.neighbors, index_params_.ef_construction));
+    library_->setDescriptorParams (model_ss_, descr_rad_);
+    //  A library of descriptors computed with another sampling size or radius is refused
+    if (fs::exists (library_filename_) && !library_->load (library_filename_, model_ss_, descr_rad_))
+      return (1);
+    if (index_params_.checks > 0)
+      library_->setEfSearch (index_params_.checks);
+    std::cout << "Descriptor library: " << library_->getNumberOfLabels () << " models, " << library_->size () << " descriptors" << std::endl;
+  }
   std::vector<std::string> fileNames_ = pathIteration(folderName_);
   CorrespondenceIteration(fileNames_,folderName_);
+  if (library_changed_)
+    library_->save (library_filename_);
+  saveProfile ();
+  if (!saveEvaluation ())
+    return (1);
 }
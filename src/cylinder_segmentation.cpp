@@ -1,113 +1,409 @@
+//PLANE, CYLINDER AND SPHERE SEGMENTATION OF A BATCH OF SCENES
+//EVERY SCENE IS CROPPED IN ONE PASS, GETS ONE NORMAL BUFFER AND IS SEGMENTED BY wp2::PrimitiveSegmentation; SEVERAL
+//SCENES ARE PROCESSED AT ONCE, EACH WITH ITS SHARE OF THE CORES. --check_pcl REFITS EVERY CYLINDER WITH
+//pcl::SACSegmentationFromNormals ON THE SAME POINTS AND COMPARES THE TWO
+
 #include <pcl/ModelCoefficients.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/features/normal_3d.h>
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/search/kdtree.h>
 #include <pcl/sample_consensus/method_types.h>
 #include <pcl/sample_consensus/model_types.h>
 #include <pcl/segmentation/sac_segmentation.h>
+#include <pcl/console/parse.h>
+
+#include <wp2/filters/crop_voxel_grid.h>
+#include <wp2/segmentation/primitive_segmentation.h>
+#include <wp2/segmentation/ransac.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 typedef pcl::PointXYZ PointT;
+typedef wp2::PrimitiveSegmentation<PointT> Segmentation;
 
-int
-main (int argc, char** argv)
+//Filter and normal params
+float z_min_ (0.0f);
+float z_max_ (1.5f);
+int normal_k_ (50);
+
+//Primitive params; planes as the first table_scene_mug_stereo_textured step, cylinders as the second
+std::string primitives_ ("plane,cylinder");
+float plane_thresh_ (0.03f);
+int plane_iter_ (100);
+int planes_ (1);
+float cylinder_thresh_ (0.05f);
+int cylinder_iter_ (10000);
+float cylinder_radius_ (0.1f);
+int cylinders_ (1);
+float sphere_thresh_ (0.01f);
+int sphere_iter_ (10000);
+float sphere_radius_ (0.1f);
+int spheres_ (1);
+float normal_weight_ (0.1f);
+int min_inliers_ (0);
+wp2::ParallelRansac::EarlyExit early_exit_ (wp2::ParallelRansac::EARLY_EXIT_SPRT);
+
+//Batch
+int jobs_ (1);
+int threads_ (0);
+bool check_pcl_ (false);
+
+std::vector<std::string> scene_filenames_;
+std::vector<Segmentation::Primitive> sequence_;
+
+void
+showHelp (char *filename)
 {
-  // All the objects needed
-  pcl::PCDReader reader;
-  pcl::PassThrough<PointT> pass;
-  pcl::NormalEstimation<PointT, pcl::Normal> ne;
-  pcl::SACSegmentationFromNormals<PointT, pcl::Normal> seg; 
-  pcl::PCDWriter writer;
-  pcl::ExtractIndices<PointT> extract;
-  pcl::ExtractIndices<pcl::Normal> extract_normals;
-  pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
+  std::cout << std::endl;
+  std::cout << "***************************************************************************" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "*               Primitive Segmentation - Usage Guide                      *" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "***************************************************************************" << std::endl << std::endl;
+  std::cout << "Usage: " << filename << " scene1.pcd [scene2.pcd ...] [Options]" << std::endl << std::endl;
+  std::cout << "The inliers of every model are written to <scene>_<model>.pcd, then" << std::endl;
+  std::cout << "<scene>_<model>_1.pcd ... for further instances." << std::endl << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "     -h:                     Show this help." << std::endl;
+  std::cout << "     --z_min val:            Lowest z kept (default 0)" << std::endl;
+  std::cout << "     --z_max val:            Highest z kept (default 1.5)" << std::endl;
+  std::cout << "     --normal_k val:         Neighbours of a normal (default 50)" << std::endl;
+  std::cout << "     --primitives list:      Models fitted in order, among plane, cylinder and" << std::endl;
+  std::cout << "                             sphere (default plane,cylinder)" << std::endl;
+  std::cout << "     --plane_thresh val:     Plane distance threshold (default 0.03)" << std::endl;
+  std::cout << "     --plane_iter val:       Plane RANSAC iterations, at most (default 100)" << std::endl;
+  std::cout << "     --planes val:           Planes per scene, at most (default 1)" << std::endl;
+  std::cout << "     --cylinder_thresh val:  Cylinder distance threshold (default 0.05)" << std::endl;
+  std::cout << "     --cylinder_iter val:    Cylinder RANSAC iterations, at most (default 10000)" << std::endl;
+  std::cout << "     --cylinder_radius val:  Largest cylinder radius (default 0.1)" << std::endl;
+  std::cout << "     --cylinders val:        Cylinders per scene, at most (default 1)" << std::endl;
+  std::cout << "     --sphere_thresh val:    Sphere distance threshold (default 0.01)" << std::endl;
+  std::cout << "     --sphere_iter val:      Sphere RANSAC iterations, at most (default 10000)" << std::endl;
+  std::cout << "     --sphere_radius val:    Largest sphere radius (default 0.1)" << std::endl;
+  std::cout << "     --spheres val:          Spheres per scene, at most (default 1)" << std::endl;
+  std::cout << "     --normal_weight val:    Weight of the normal angle in the distances (default 0.1)" << std::endl;
+  std::cout << "     --min_inliers val:      Smallest model kept (default 0)" << std::endl;
+  std::cout << "     --early_exit (none|tdd|sprt):" << std::endl;
+  std::cout << "                             RANSAC early exit (default sprt)" << std::endl;
+  std::cout << "     --jobs val:             Scenes segmented at once (default 1)" << std::endl;
+  std::cout << "     --threads val:          Threads in all, 0 for one per core (default 0)" << std::endl;
+  std::cout << "     --check_pcl:            Refit every cylinder with pcl::SACSegmentationFromNormals on" << std::endl;
+  std::cout << "                             the same points and compare; fails if they disagree." << std::endl << std::endl;
+}
+
+void
+parseCommandLine (int argc, char *argv[])
+{
+  //Show help
+  if (pcl::console::find_switch (argc, argv, "-h"))
+  {
+    showHelp (argv[0]);
+    exit (0);
+  }
+
+  //Scene files
+  std::vector<int> filenames = pcl::console::parse_file_extension_argument (argc, argv, ".pcd");
+  if (filenames.empty ())
+  {
+    showHelp (argv[0]);
+    exit (-1);
+  }
+  for (size_t i = 0; i < filenames.size (); ++i)
+  {
+    scene_filenames_.push_back (argv[filenames[i]]);
+  }
+
+  std::string early_exit;
+  if (pcl::console::parse_argument (argc, argv, "--early_exit", early_exit) != -1)
+  {
+    if (!wp2::ParallelRansac::parseEarlyExit (early_exit, early_exit_))
+    {
+      std::cout << "Wrong early exit name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+//Filter and normal parameters
+  pcl::console::parse_argument (argc, argv, "--z_min", z_min_);
+  pcl::console::parse_argument (argc, argv, "--z_max", z_max_);
+  pcl::console::parse_argument (argc, argv, "--normal_k", normal_k_);
+
+//Primitive parameters
+  pcl::console::parse_argument (argc, argv, "--primitives", primitives_);
+  pcl::console::parse_argument (argc, argv, "--plane_thresh", plane_thresh_);
+  pcl::console::parse_argument (argc, argv, "--plane_iter", plane_iter_);
+  pcl::console::parse_argument (argc, argv, "--planes", planes_);
+  pcl::console::parse_argument (argc, argv, "--cylinder_thresh", cylinder_thresh_);
+  pcl::console::parse_argument (argc, argv, "--cylinder_iter", cylinder_iter_);
+  pcl::console::parse_argument (argc, argv, "--cylinder_radius", cylinder_radius_);
+  pcl::console::parse_argument (argc, argv, "--cylinders", cylinders_);
+  pcl::console::parse_argument (argc, argv, "--sphere_thresh", sphere_thresh_);
+  pcl::console::parse_argument (argc, argv, "--sphere_iter", sphere_iter_);
+  pcl::console::parse_argument (argc, argv, "--sphere_radius", sphere_radius_);
+  pcl::console::parse_argument (argc, argv, "--spheres", spheres_);
+  pcl::console::parse_argument (argc, argv, "--normal_weight", normal_weight_);
+  pcl::console::parse_argument (argc, argv, "--min_inliers", min_inliers_);
+
+//Batch
+  pcl::console::parse_argument (argc, argv, "--jobs", jobs_);
+  jobs_ = std::max (jobs_, 1);
+  pcl::console::parse_argument (argc, argv, "--threads", threads_);
+  if (pcl::console::find_switch (argc, argv, "--check_pcl"))
+  {
+    check_pcl_ = true;
+  }
+
+  //Sequence of models, in the order given
+  std::stringstream list (primitives_);
+  std::string name;
+  while (std::getline (list, name, ','))
+  {
+    wp2::ParallelRansac::Model model;
+    if (!wp2::ParallelRansac::parseModel (name, model))
+    {
+      std::cout << "Wrong primitive name: " << name << std::endl;
+      showHelp (argv[0]);
+      exit (-1);
+    }
+    Segmentation::Primitive primitive (model);
+    primitive.normal_weight = normal_weight_;
+    primitive.min_inliers = min_inliers_;
+    if (model == wp2::ParallelRansac::MODEL_PLANE)
+    {
+      primitive.threshold = plane_thresh_;
+      primitive.max_iterations = plane_iter_;
+      primitive.max_instances = planes_;
+    }
+    else if (model == wp2::ParallelRansac::MODEL_CYLINDER)
+    {
+      primitive.threshold = cylinder_thresh_;
+      primitive.max_iterations = cylinder_iter_;
+      primitive.max_radius = cylinder_radius_;
+      primitive.max_instances = cylinders_;
+    }
+    else
+    {
+      primitive.threshold = sphere_thresh_;
+      primitive.max_iterations = sphere_iter_;
+      primitive.max_radius = sphere_radius_;
+      primitive.max_instances = spheres_;
+    }
+    sequence_.push_back (primitive);
+  }
+}
+
+//  Refits cylinder s with pcl::SACSegmentationFromNormals on the points it was fitted on (finite normals, in no earlier
+//  model) with the same parameters. They agree when the axes are within 5 degrees and the axis lines and radii within
+//  the distance threshold.
+bool
+checkCylinder (const pcl::PointCloud<PointT>::ConstPtr &cloud, const pcl::PointCloud<pcl::Normal>::ConstPtr &normals,
+               const std::vector<Segmentation::Segment> &segments, size_t s, std::stringstream &report)
+{
+  std::vector<char> taken (cloud->size (), 0);
+  for (size_t t = 0; t < s; ++t)
+  {
+    for (size_t i = 0; i < segments[t].inliers.indices.size (); ++i)
+    {
+      taken[segments[t].inliers.indices[i]] = 1;
+    }
+  }
+  boost::shared_ptr<std::vector<int> > active (new std::vector<int>);
+  for (size_t i = 0; i < cloud->size (); ++i)
+  {
+    const pcl::Normal &n = normals->points[i];
+    if (!taken[i] && pcl_isfinite (n.normal_x) && pcl_isfinite (n.normal_y) && pcl_isfinite (n.normal_z))
+    {
+      active->push_back (static_cast<int> (i));
+    }
+  }
+
+  pcl::SACSegmentationFromNormals<PointT, pcl::Normal> seg;
+  seg.setOptimizeCoefficients (true);
+  seg.setModelType (pcl::SACMODEL_CYLINDER);
+  seg.setMethodType (pcl::SAC_RANSAC);
+  seg.setNormalDistanceWeight (normal_weight_);
+  seg.setMaxIterations (cylinder_iter_);
+  seg.setDistanceThreshold (cylinder_thresh_);
+  seg.setRadiusLimits (0, cylinder_radius_);
+  seg.setInputCloud (cloud);
+  seg.setInputNormals (normals);
+  seg.setIndices (active);
+  pcl::PointIndices inliers;
+  pcl::ModelCoefficients coefficients;
+  seg.segment (inliers, coefficients);
+  if (coefficients.values.size () < 7)
+  {
+    report << "  PCL check: pcl::SACSegmentationFromNormals found no cylinder, DIFFERS" << std::endl;
+    return (false);
+  }
+
+  //  Axis angle, distance from the wp2 axis point to the PCL axis line, radius difference, inlier overlap
+  const std::vector<float> &c = segments[s].coefficients.values;
+  const std::vector<float> &p = coefficients.values;
+  const Eigen::Vector3f point (c[0], c[1], c[2]), pcl_point (p[0], p[1], p[2]);
+  const Eigen::Vector3f axis = Eigen::Vector3f (c[3], c[4], c[5]).normalized ();
+  const Eigen::Vector3f pcl_axis = Eigen::Vector3f (p[3], p[4], p[5]).normalized ();
+  const float angle = std::acos (std::min (1.0f, std::fabs (axis.dot (pcl_axis)))) * 180.0f / static_cast<float> (M_PI);
+  const float axis_dist = (point - pcl_point).cross (pcl_axis).norm ();
+  const float radius_diff = std::fabs (c[6] - p[6]);
+
+  const std::vector<int> &own = segments[s].inliers.indices;
+  std::vector<int> pcl_inliers = inliers.indices;
+  std::sort (pcl_inliers.begin (), pcl_inliers.end ());
+  std::vector<int> common;
+  std::set_intersection (own.begin (), own.end (), pcl_inliers.begin (), pcl_inliers.end (), std::back_inserter (common));
+  const size_t united = own.size () + pcl_inliers.size () - common.size ();
+
+  const bool agree = angle <= 5.0f && axis_dist <= cylinder_thresh_ && radius_diff <= cylinder_thresh_;
+  report << "  PCL check: cylinder coefficients:";
+  for (size_t i = 0; i < p.size (); ++i)
+  {
+    report << " " << p[i];
+  }
+  report << std::endl << "  PCL check: " << pcl_inliers.size () << " inliers against " << own.size () << ", "
+         << (united > 0 ? 100.0 * common.size () / united : 100.0) << "% shared, axes " << angle << " deg and "
+         << axis_dist << " apart, radii " << radius_diff << " apart, " << (agree ? "agrees" : "DIFFERS") << std::endl;
+  return (agree);
+}
+
+//  Crop, normals and models of one scene; the report is returned so that scenes run at once do not interleave.
+//  passed is cleared when a --check_pcl comparison fails.
+std::string
+segmentScene (const std::string &filename, int nr_threads, bool &passed)
+{
+  std::stringstream report;
+  report << filename << std::endl;
 
-  // Datasets
   pcl::PointCloud<PointT>::Ptr cloud (new pcl::PointCloud<PointT>);
+  if (pcl::io::loadPCDFile (filename, *cloud) < 0)
+  {
+    report << "  Could not read the scene." << std::endl;
+    return (report.str ());
+  }
+  report << "  PointCloud has: " << cloud->points.size () << " data points." << std::endl;
+
+  // z limits and NaN removal in one pass; the input cloud is released right after
   pcl::PointCloud<PointT>::Ptr cloud_filtered (new pcl::PointCloud<PointT>);
+  wp2::CropVoxelGrid<PointT> crop (nr_threads);
+  crop.setInputCloud (cloud);
+  crop.setFilterLimits ("z", z_min_, z_max_);
+  crop.filter (*cloud_filtered);
+  cloud.reset ();
+  report << "  PointCloud after filtering has: " << cloud_filtered->points.size () << " data points." << std::endl;
+
+  // One normal buffer, shared by every model
   pcl::PointCloud<pcl::Normal>::Ptr cloud_normals (new pcl::PointCloud<pcl::Normal>);
-  pcl::PointCloud<PointT>::Ptr cloud_filtered2 (new pcl::PointCloud<PointT>);
-  pcl::PointCloud<pcl::Normal>::Ptr cloud_normals2 (new pcl::PointCloud<pcl::Normal>);
-  pcl::ModelCoefficients::Ptr coefficients_plane (new pcl::ModelCoefficients), coefficients_cylinder (new pcl::ModelCoefficients);
-  pcl::PointIndices::Ptr inliers_plane (new pcl::PointIndices), inliers_cylinder (new pcl::PointIndices);
-
-  // Read in the cloud data
-  reader.read ("table_scene_mug_stereo_textured.pcd", *cloud);
-  std::cerr << "PointCloud has: " << cloud->points.size () << " data points." << std::endl;
-
-  // Build a passthrough filter to remove spurious NaNs
-  pass.setInputCloud (cloud);
-  pass.setFilterFieldName ("z");
-  pass.setFilterLimits (0, 1.5);
-  pass.filter (*cloud_filtered);
-  std::cerr << "PointCloud after filtering has: " << cloud_filtered->points.size () << " data points." << std::endl;
-
-  // Estimate point normals
+  pcl::NormalEstimationOMP<PointT, pcl::Normal> ne (nr_threads);
+  pcl::search::KdTree<PointT>::Ptr tree (new pcl::search::KdTree<PointT> ());
   ne.setSearchMethod (tree);
   ne.setInputCloud (cloud_filtered);
-  ne.setKSearch (50);
+  ne.setKSearch (normal_k_);
   ne.compute (*cloud_normals);
 
-  // Create the segmentation object for the planar model and set all the parameters
-  seg.setOptimizeCoefficients (true);
-  seg.setModelType (pcl::SACMODEL_NORMAL_PLANE);
-  seg.setNormalDistanceWeight (0.1);
-  seg.setMethodType (pcl::SAC_RANSAC);
-  seg.setMaxIterations (100);
-  seg.setDistanceThreshold (0.03);
+  Segmentation seg (nr_threads);
   seg.setInputCloud (cloud_filtered);
   seg.setInputNormals (cloud_normals);
-  // Obtain the plane inliers and coefficients
-  seg.segment (*inliers_plane, *coefficients_plane);
-  std::cerr << "Plane coefficients: " << *coefficients_plane << std::endl;
-
-  // Extract the planar inliers from the input cloud
-  extract.setInputCloud (cloud_filtered);
-  extract.setIndices (inliers_plane);
-  extract.setNegative (false);
-
-  // Write the planar inliers to disk
-  pcl::PointCloud<PointT>::Ptr cloud_plane (new pcl::PointCloud<PointT> ());
-  extract.filter (*cloud_plane);
-  std::cerr << "PointCloud representing the planar component: " << cloud_plane->points.size () << " data points." << std::endl;
-  writer.write ("table_scene_mug_stereo_textured_plane.pcd", *cloud_plane, false);
-
-  // Remove the planar inliers, extract the rest
-  extract.setNegative (true);
-  extract.filter (*cloud_filtered2);
-  extract_normals.setNegative (true);
-  extract_normals.setInputCloud (cloud_normals);
-  extract_normals.setIndices (inliers_plane);
-  extract_normals.filter (*cloud_normals2);
-
-  // Create the segmentation object for cylinder segmentation and set all the parameters
-  seg.setOptimizeCoefficients (true);
-  seg.setModelType (pcl::SACMODEL_CYLINDER);
-  seg.setMethodType (pcl::SAC_RANSAC);
-  seg.setNormalDistanceWeight (0.1);
-  seg.setMaxIterations (10000);
-  seg.setDistanceThreshold (0.05);
-  seg.setRadiusLimits (0, 0.1);
-  seg.setInputCloud (cloud_filtered2);
-  seg.setInputNormals (cloud_normals2);
-
-  // Obtain the cylinder inliers and coefficients
-  seg.segment (*inliers_cylinder, *coefficients_cylinder);
-  std::cerr << "Cylinder coefficients: " << *coefficients_cylinder << std::endl;
-
-  // Write the cylinder inliers to disk
-  extract.setInputCloud (cloud_filtered2);
-  extract.setIndices (inliers_cylinder);
-  extract.setNegative (false);
-  pcl::PointCloud<PointT>::Ptr cloud_cylinder (new pcl::PointCloud<PointT> ());
-  extract.filter (*cloud_cylinder);
-  if (cloud_cylinder->points.empty ()) 
-    std::cerr << "Can't find the cylindrical component." << std::endl;
-  else
-  {
-	  std::cerr << "PointCloud representing the cylindrical component: " << cloud_cylinder->points.size () << " data points." << std::endl;
-	  writer.write ("table_scene_mug_stereo_textured_cylinder.pcd", *cloud_cylinder, false);
-  }
-  return (0);
+  seg.setEarlyExit (early_exit_);
+  for (size_t p = 0; p < sequence_.size (); ++p)
+  {
+    seg.addPrimitive (sequence_[p]);
+  }
+  std::vector<Segmentation::Segment> segments;
+  seg.segment (segments);
+
+  // Inliers written as indices into the filtered scene, next to the scene name
+  const std::string stem = filename.substr (0, filename.size () - 4);
+  pcl::PCDWriter writer;
+  std::vector<int> instances (3, 0);
+  for (size_t s = 0; s < segments.size (); ++s)
+  {
+    const Segmentation::Segment &segment = segments[s];
+    const char *name = wp2::ParallelRansac::modelName (segment.model);
+    report << "  " << name << " coefficients:";
+    for (size_t c = 0; c < segment.coefficients.values.size (); ++c)
+    {
+      report << " " << segment.coefficients.values[c];
+    }
+    report << std::endl;
+    report << "  PointCloud representing the " << name << ": " << segment.inliers.indices.size ()
+           << " data points, " << segment.iterations << " hypotheses (" << segment.rejected << " rejected early)"
+           << std::endl;
+
+    std::stringstream ss;
+    ss << stem << "_" << name;
+    if (instances[segment.model] > 0)
+    {
+      ss << "_" << instances[segment.model];
+    }
+    ss << ".pcd";
+    ++instances[segment.model];
+    writer.write (ss.str (), *cloud_filtered, segment.inliers.indices, false);
+
+    if (check_pcl_ && segment.model == wp2::ParallelRansac::MODEL_CYLINDER &&
+        !checkCylinder (cloud_filtered, cloud_normals, segments, s, report))
+    {
+      passed = false;
+    }
+  }
+  for (size_t p = 0; p < sequence_.size (); ++p)
+  {
+    if (instances[sequence_[p].model] == 0)
+    {
+      report << "  Can't find the " << wp2::ParallelRansac::modelName (sequence_[p].model) << " component."
+             << std::endl;
+    }
+  }
+  report << "  Points in no model: " << seg.getRemainingIndices ().size () << std::endl;
+  return (report.str ());
+}
+
+int
+main (int argc, char** argv)
+{
+  parseCommandLine (argc, argv);
+
+  // The cores are split between the scenes run at once; every scene uses its share for the crop, the normals and
+  // the RANSAC scoring
+  int nr_threads = threads_;
+#ifdef _OPENMP
+  if (nr_threads <= 0)
+  {
+    nr_threads = omp_get_num_procs ();
+  }
+#endif
+  const int nr_jobs = std::min (jobs_, static_cast<int> (scene_filenames_.size ()));
+  const int scene_threads = std::max (nr_threads / nr_jobs, 1);
+#ifdef _OPENMP
+  omp_set_nested (nr_jobs > 1 && scene_threads > 1);
+#endif
+
+  bool passed = true;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_jobs) schedule(dynamic, 1)
+#endif
+  for (int i = 0; i < static_cast<int> (scene_filenames_.size ()); ++i)
+  {
+    bool scene_passed = true;
+    const std::string report = segmentScene (scene_filenames_[i], scene_threads, scene_passed);
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+    {
+      std::cerr << report;
+      passed = passed && scene_passed;
+    }
+  }
+  return (passed ? 0 : 1);
 }
@@ -2,17 +2,17 @@
 #include <vector>
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
-#include <pcl/search/search.h>
-#include <pcl/search/kdtree.h>
 #include <pcl/visualization/cloud_viewer.h>
 #include <pcl/filters/passthrough.h>
-#include <pcl/segmentation/region_growing_rgb.h>
+
+#include <wp2/filters/crop_voxel_grid.h>
+#include <wp2/segmentation/color_region_growing.h>
+#include <wp2/segmentation/colored_clusters.h>
+#include <wp2/segmentation/organized_segmentation.h>
 
 int
 main (int argc, char** argv)
 {
-  pcl::search::Search <pcl::PointXYZRGB>::Ptr tree = boost::shared_ptr<pcl::search::Search<pcl::PointXYZRGB> > (new pcl::search::KdTree<pcl::PointXYZRGB>);
-
   pcl::PointCloud <pcl::PointXYZRGB>::Ptr cloud (new pcl::PointCloud <pcl::PointXYZRGB>);
   if ( pcl::io::loadPCDFile <pcl::PointXYZRGB> (argv[1], *cloud) == -1 )
   {
@@ -20,26 +20,58 @@ main (int argc, char** argv)
     return (-1);
   }
 
-  pcl::IndicesPtr indices (new std::vector <int>);
-  pcl::PassThrough<pcl::PointXYZRGB> pass;
-  pass.setInputCloud (cloud);
-  pass.setFilterFieldName ("z");
-  pass.setFilterLimits (0.0, 1.0);
-  pass.filter (*indices);
-
-  pcl::RegionGrowingRGB<pcl::PointXYZRGB> reg;
-  reg.setInputCloud (cloud);
-  reg.setIndices (indices);
-  reg.setSearchMethod (tree);
-  reg.setDistanceThreshold (10);
-  reg.setPointColorThreshold (6);
-  reg.setRegionColorThreshold (5);
-  reg.setMinClusterSize (600);
-
-  std::vector <pcl::PointIndices> clusters;
-  reg.extract (clusters);
-
-  pcl::PointCloud <pcl::PointXYZRGB>::Ptr colored_cloud = reg.getColoredCloud ();
+  pcl::PointCloud <pcl::PointXYZRGB>::Ptr colored_cloud;
+  if (cloud->isOrganized ())
+  {
+    // RGB-D frame: the same z limits as NaNs, so the pixel grid stays, then connected components in image space with
+    // the point colour threshold; regions are not merged by mean colour afterwards
+    pcl::PointCloud <pcl::PointXYZRGB>::Ptr cloud_cut (new pcl::PointCloud <pcl::PointXYZRGB>);
+    pcl::PassThrough<pcl::PointXYZRGB> pass;
+    pass.setInputCloud (cloud);
+    pass.setFilterFieldName ("z");
+    pass.setFilterLimits (0.0, 1.0);
+    pass.setKeepOrganized (true);
+    pass.filter (*cloud_cut);
+
+    wp2::OrganizedSegmentation<pcl::PointXYZRGB> reg;
+    reg.setInputCloud (cloud_cut);
+    reg.setMinPlaneInliers (0);
+    reg.setClusterTolerance (10);
+    reg.setColorThreshold (6);
+    reg.setMinClusterSize (600);
+
+    std::vector <pcl::PointIndices> planes;
+    std::vector <pcl::ModelCoefficients> coefficients;
+    std::vector <pcl::PointIndices> clusters;
+    reg.segment (planes, coefficients, clusters);
+    colored_cloud = wp2::getColoredCloud (*cloud_cut, clusters);
+  }
+  else
+  {
+    // z limits and NaN removal in one parallel pass, as indices into the cloud
+    pcl::IndicesPtr indices (new std::vector <int>);
+    wp2::CropVoxelGrid<pcl::PointXYZRGB> crop;
+    crop.setInputCloud (cloud);
+    crop.setFilterLimits ("z", 0.0, 1.0);
+    crop.filter (*indices);
+
+    // Nearest neighbours within the distance once, in parallel, colours compared in Lab, regions merged over their
+    // adjacency. The colour thresholds are delta E, about half the RGB distances 6 and 5 used before
+    wp2::ColorRegionGrowing<pcl::PointXYZRGB> reg;
+    reg.setInputCloud (cloud);
+    reg.setIndices (indices);
+    reg.setDistanceThreshold (10);
+    reg.setNumberOfNeighbours (30);
+    reg.setPointColorThreshold (3);
+    reg.setRegionColorThreshold (2.5);
+    reg.setMinClusterSize (600);
+
+    std::vector <pcl::PointIndices> clusters;
+    reg.extract (clusters);
+
+    colored_cloud = wp2::getColoredCloud (*cloud, clusters);
+  }
+
   pcl::visualization::CloudViewer viewer ("Cluster viewer");
   viewer.showCloud (colored_cloud);
   while (!viewer.wasStopped ())
@@ -2,12 +2,12 @@
 #include <vector>
 #include <pcl/point_types.h>
 #include <pcl/io/pcd_io.h>
-#include <pcl/search/search.h>
-#include <pcl/search/kdtree.h>
-#include <pcl/features/normal_3d.h>
 #include <pcl/visualization/cloud_viewer.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/segmentation/region_growing.h>
+
+#include <wp2/filters/crop_voxel_grid.h>
+#include <wp2/segmentation/colored_clusters.h>
+#include <wp2/segmentation/organized_segmentation.h>
+#include <wp2/segmentation/parallel_region_growing.h>
 
 int
 main (int argc, char** argv)
@@ -19,34 +19,48 @@ main (int argc, char** argv)
     return (-1);
   }
 
-  pcl::search::Search<pcl::PointXYZ>::Ptr tree = boost::shared_ptr<pcl::search::Search<pcl::PointXYZ> > (new pcl::search::KdTree<pcl::PointXYZ>);
-  pcl::PointCloud <pcl::Normal>::Ptr normals (new pcl::PointCloud <pcl::Normal>);
-  pcl::NormalEstimation<pcl::PointXYZ, pcl::Normal> normal_estimator;
-  normal_estimator.setSearchMethod (tree);
-  normal_estimator.setInputCloud (cloud);
-  normal_estimator.setKSearch (50);
-  normal_estimator.compute (*normals);
+  std::vector <pcl::PointIndices> clusters;
+  pcl::PointCloud <pcl::PointXYZRGB>::Ptr colored_cloud;
+  if (cloud->isOrganized ())
+  {
+    // RGB-D frame: integral image normals and connected components of the pixels whose normals are within the
+    // smoothness threshold, no kd-tree; there is no curvature test
+    wp2::OrganizedSegmentation<pcl::PointXYZ> reg;
+    reg.setInputCloud (cloud);
+    reg.setMinPlaneInliers (0);
+    reg.setClusterTolerance (0.02);
+    reg.setSmoothnessThreshold (3.0 / 180.0 * M_PI);
+    reg.setMinClusterSize (50);
+    reg.setMaxClusterSize (1000000);
 
-  pcl::IndicesPtr indices (new std::vector <int>);
-  pcl::PassThrough<pcl::PointXYZ> pass;
-  pass.setInputCloud (cloud);
-  pass.setFilterFieldName ("z");
-  pass.setFilterLimits (0.0, 1.0);
-  pass.filter (*indices);
+    std::vector <pcl::PointIndices> planes;
+    std::vector <pcl::ModelCoefficients> coefficients;
+    reg.segment (planes, coefficients, clusters);
+    colored_cloud = wp2::getColoredCloud (*cloud, clusters);
+  }
+  else
+  {
+    // z limits and NaN removal in one parallel pass, as indices into the cloud
+    pcl::IndicesPtr indices (new std::vector <int>);
+    wp2::CropVoxelGrid<pcl::PointXYZ> crop;
+    crop.setInputCloud (cloud);
+    crop.setFilterLimits ("z", 0.0, 1.0);
+    crop.filter (*indices);
 
-  pcl::RegionGrowing<pcl::PointXYZ, pcl::Normal> reg;
-  reg.setMinClusterSize (50);
-  reg.setMaxClusterSize (1000000);
-  reg.setSearchMethod (tree);
-  reg.setNumberOfNeighbours (30);
-  reg.setInputCloud (cloud);
-  //reg.setIndices (indices);
-  reg.setInputNormals (normals);
-  reg.setSmoothnessThreshold (3.0 / 180.0 * M_PI);
-  reg.setCurvatureThreshold (1.0);
+    // Neighbour lists searched once (k = 50 for the normals, the first 30 to grow), normals and regions in parallel
+    wp2::ParallelRegionGrowing<pcl::PointXYZ> reg;
+    reg.setMinClusterSize (50);
+    reg.setMaxClusterSize (1000000);
+    reg.setNormalKSearch (50);
+    reg.setNumberOfNeighbours (30);
+    reg.setInputCloud (cloud);
+    //reg.setIndices (indices);
+    reg.setSmoothnessThreshold (3.0 / 180.0 * M_PI);
+    reg.setCurvatureThreshold (1.0);
 
-  std::vector <pcl::PointIndices> clusters;
-  reg.extract (clusters);
+    reg.extract (clusters);
+    colored_cloud = wp2::getColoredCloud (*cloud, clusters);
+  }
 
   std::cout << "Number of clusters is equal to " << clusters.size () << std::endl;
   std::cout << "First cluster has " << clusters[0].indices.size () << " points." << endl;
@@ -62,7 +76,6 @@ main (int argc, char** argv)
   }
   std::cout << std::endl;
 
-  pcl::PointCloud <pcl::PointXYZRGB>::Ptr colored_cloud = reg.getColoredCloud ();
   pcl::visualization::CloudViewer viewer ("Cluster viewer");
   viewer.showCloud(colored_cloud);
   while (!viewer.wasStopped ())
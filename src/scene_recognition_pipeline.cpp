@@ -0,0 +1,630 @@
+//SEGMENTATION-TO-RECOGNITION PIPELINE
+//RAW SCENE PCD -> VOXEL FILTER -> PLANE REMOVAL -> EUCLIDEAN CLUSTERS -> SHOT + LRF PER CLUSTER -> MATCHING AGAINST THE
+//MODEL LIBRARY -> LABELED OBJECTS. EVERY STAGE IS A THREAD THAT HANDS ITS OUTPUT TO THE NEXT ONE IN MEMORY THROUGH A
+//BOUNDED QUEUE: NOTHING IS WRITTEN TO DISK BETWEEN THE STAGES, AND SCENE n + 1 IS SEGMENTED WHILE SCENE n IS MATCHED
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/correspondence.h>
+#include <pcl/common/centroid.h>
+#include <pcl/common/io.h>
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/keypoints/uniform_sampling.h>
+#include <pcl/console/parse.h>
+
+#include <wp2/common/bounded_queue.h>
+#include <wp2/common/evaluation.h>
+#include <wp2/common/profiler.h>
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/features/shot_lrf.h>
+#include <wp2/recognition/geometric_consistency_simd.h>
+#include <wp2/recognition/hough_3d_sparse.h>
+#include <wp2/recognition/pair_gates.h>
+#include <wp2/search/descriptor_matcher.h>
+#include <wp2/search/hnsw_index.h>
+#include <wp2/segmentation/multi_plane_extractor.h>
+#include <wp2/segmentation/voxel_cluster_extraction.h>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#define BOOST_FILESYSTEM_VERSION 3
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = boost::filesystem;
+
+typedef pcl::PointXYZRGBA PointType;
+typedef pcl::Normal NormalType;
+typedef pcl::ReferenceFrame RFType;
+typedef pcl::SHOT352 DescriptorType;
+
+//Segmentation params, as cluster_extraction_v2
+float leaf_size_ (0.0014f);
+float plane_thresh_ (0.01f);
+float remaining_fraction_ (0.6f);
+float cluster_tol_ (0.02f);
+int min_cluster_size_ (100);
+int max_cluster_size_ (40000);
+
+//Recognition params, as correspondence_grouping_SHOT_Iterative_Obj-Obj
+bool use_hough_ (true);
+wp2::shot::Kernel shot_kernel_ (wp2::shot::KERNEL_AUTO);
+wp2::search::DescriptorMatcher::Mode match_mode_ (wp2::search::DescriptorMatcher::MATCH_THRESHOLD);
+float match_thresh_ (0.25f);
+int library_k_ (0);
+float model_ss_ (0.015f);
+float scene_ss_ (0.015f);
+float rf_rad_ (0.06f);
+float descr_rad_ (0.08f);
+float cg_size_ (0.035f);
+float cg_thresh_ (6.0f);
+
+//Pipeline
+int queue_size_ (4);
+int feature_workers_ (1);
+std::string labels_filename_;
+
+fs::path model_path;
+fs::path scene_path;
+
+//  What goes from one stage to the next
+struct Scene
+{
+  std::string name;
+  pcl::PointCloud<PointType>::Ptr cloud;
+};
+
+struct Object
+{
+  std::string scene;
+  int id;
+  pcl::PointCloud<PointType>::Ptr cloud;
+};
+
+struct ObjectFeatures
+{
+  std::string scene;
+  int id;
+  pcl::PointCloud<PointType>::Ptr cloud;
+  pcl::PointCloud<PointType>::Ptr keypoints;
+  pcl::PointCloud<RFType>::Ptr rf;
+  boost::shared_ptr<wp2::DescriptorMatrix> descriptors;
+};
+
+struct ObjectLabel
+{
+  std::string scene;
+  int id;
+  size_t points;
+  float centroid[3];
+  std::string model;        // empty when no model was recognized
+  int instances;
+  size_t correspondences;
+};
+
+//  Model keypoints and frames, by library label
+struct Model
+{
+  std::string filename;
+  pcl::PointCloud<PointType>::Ptr keypoints;
+  pcl::PointCloud<RFType>::Ptr rf;
+};
+
+//  Busy time and items of a stage, over all its threads
+struct StageStats
+{
+  StageStats () : busy_ms (0.0), items (0) {}
+  double busy_ms;
+  long items;
+};
+
+boost::mutex stats_mutex_;
+StageStats load_stats_;
+StageStats segment_stats_;
+StageStats feature_stats_;
+StageStats library_stats_;
+StageStats match_stats_;
+
+void
+addStats (StageStats &stats, double ms, long items)
+{
+  boost::mutex::scoped_lock lock (stats_mutex_);
+  stats.busy_ms += ms;
+  stats.items += items;
+}
+
+void
+showHelp (char *filename)
+{
+  std::cout << std::endl;
+  std::cout << "***************************************************************************" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "*             Segmentation-to-Recognition Pipeline - Usage Guide          *" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "***************************************************************************" << std::endl << std::endl;
+  std::cout << "Usage: " << filename << " model_path scene_path [Options]" << std::endl << std::endl;
+  std::cout << "model_path is a directory of object PCDs named <object>-<anything>.pcd; scene_path" << std::endl;
+  std::cout << "a raw scene PCD or a directory of them." << std::endl << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "     -h:                     Show this help." << std::endl;
+  std::cout << "     --leaf val:             Voxel filter leaf size (default 0.0014)" << std::endl;
+  std::cout << "     --plane_thresh val:     Plane distance threshold (default 0.01)" << std::endl;
+  std::cout << "     --remaining val:        Remove planes until this fraction of the points is" << std::endl;
+  std::cout << "                             left (default 0.6)" << std::endl;
+  std::cout << "     --cluster_tol val:      Cluster tolerance (default 0.02)" << std::endl;
+  std::cout << "     --min_cluster val:      Minimum cluster size (default 100)" << std::endl;
+  std::cout << "     --max_cluster val:      Maximum cluster size (default 40000)" << std::endl;
+  std::cout << "     --algorithm (Hough|GC): Clustering algorithm used (default Hough)." << std::endl;
+  std::cout << "     --shot_kernel (pcl|scalar|avx2|auto):" << std::endl;
+  std::cout << "                             SHOT histogram code (default auto)" << std::endl;
+  std::cout << "     --match (nn|ratio|mutual):" << std::endl;
+  std::cout << "                             Descriptor matching mode (default nn)" << std::endl;
+  std::cout << "     --match_thresh val:     Squared descriptor distance of a match (default 0.25)" << std::endl;
+  std::cout << "     --library_k val:        Library descriptors searched per object descriptor, each model keeping" << std::endl;
+  std::cout << "                             its nearest among them (default 0: 4 per model, 8 with ratio)" << std::endl;
+  std::cout << "     --model_ss val:         Model uniform sampling radius (default 0.015)" << std::endl;
+  std::cout << "     --scene_ss val:         Object uniform sampling radius (default 0.015)" << std::endl;
+  std::cout << "     --rf_rad val:           Reference frame radius (default 0.06)" << std::endl;
+  std::cout << "     --descr_rad val:        Descriptor radius (default 0.08)" << std::endl;
+  std::cout << "     --cg_size val:          Cluster size (default 0.035)" << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 6)" << std::endl;
+  std::cout << "     --queue val:            Items held between two stages (default 4)" << std::endl;
+  std::cout << "     --feature_workers val:  Threads of the feature stage (default 1)" << std::endl;
+  std::cout << "     --labels file:          Write the labeled objects to file (CSV)" << std::endl << std::endl;
+}
+
+void
+parseCommandLine (int argc, char *argv[])
+{
+  //Show help
+  if (pcl::console::find_switch (argc, argv, "-h"))
+  {
+    showHelp (argv[0]);
+    exit (0);
+  }
+
+  //Model directory & scene path
+  if (argc > 2)
+  {
+    model_path = fs::system_complete (fs::path (argv[1]));
+    scene_path = fs::system_complete (fs::path (argv[2]));
+  }
+  else
+  {
+    showHelp (argv[0]);
+    exit (-1);
+  }
+  if (!fs::is_directory (model_path))
+  {
+    std::cout << "\nNot a directory: " << model_path.string () << std::endl;
+    exit (-1);
+  }
+  if (!fs::exists (scene_path))
+  {
+    std::cout << "\nNot found: " << scene_path.string () << std::endl;
+    exit (-1);
+  }
+
+  std::string used_algorithm;
+  if (pcl::console::parse_argument (argc, argv, "--algorithm", used_algorithm) != -1)
+  {
+    if (used_algorithm.compare ("Hough") == 0)
+    {
+      use_hough_ = true;
+    }
+    else if (used_algorithm.compare ("GC") == 0)
+    {
+      use_hough_ = false;
+    }
+    else
+    {
+      std::cout << "Wrong algorithm name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string shot_kernel;
+  if (pcl::console::parse_argument (argc, argv, "--shot_kernel", shot_kernel) != -1)
+  {
+    if (!wp2::shot::parseKernel (shot_kernel, shot_kernel_))
+    {
+      std::cout << "Wrong SHOT kernel name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string match_mode;
+  if (pcl::console::parse_argument (argc, argv, "--match", match_mode) != -1)
+  {
+    if (!wp2::search::DescriptorMatcher::parseMode (match_mode, match_mode_))
+    {
+      std::cout << "Wrong matching mode.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+//Segmentation parameters
+  pcl::console::parse_argument (argc, argv, "--leaf", leaf_size_);
+  pcl::console::parse_argument (argc, argv, "--plane_thresh", plane_thresh_);
+  pcl::console::parse_argument (argc, argv, "--remaining", remaining_fraction_);
+  pcl::console::parse_argument (argc, argv, "--cluster_tol", cluster_tol_);
+  pcl::console::parse_argument (argc, argv, "--min_cluster", min_cluster_size_);
+  pcl::console::parse_argument (argc, argv, "--max_cluster", max_cluster_size_);
+
+//Recognition parameters
+  pcl::console::parse_argument (argc, argv, "--match_thresh", match_thresh_);
+  pcl::console::parse_argument (argc, argv, "--library_k", library_k_);
+  pcl::console::parse_argument (argc, argv, "--model_ss", model_ss_);
+  pcl::console::parse_argument (argc, argv, "--scene_ss", scene_ss_);
+  pcl::console::parse_argument (argc, argv, "--rf_rad", rf_rad_);
+  pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
+  pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
+  pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+
+//Pipeline
+  pcl::console::parse_argument (argc, argv, "--queue", queue_size_);
+  pcl::console::parse_argument (argc, argv, "--feature_workers", feature_workers_);
+  feature_workers_ = std::max (feature_workers_, 1);
+  pcl::console::parse_argument (argc, argv, "--labels", labels_filename_);
+}
+
+//  PCD files of a directory, sorted, or the file itself
+std::vector<std::string>
+listPCDFiles (const fs::path &path)
+{
+  std::vector<std::string> files;
+  if (!fs::is_directory (path))
+  {
+    files.push_back (path.string ());
+    return (files);
+  }
+  for (fs::directory_iterator it (path), end; it != end; ++it)
+  {
+    if (fs::is_regular_file (*it) && it->path ().extension () == ".pcd")
+    {
+      files.push_back (it->path ().string ());
+    }
+  }
+  std::sort (files.begin (), files.end ());
+  return (files);
+}
+
+//  Normals, uniformly sampled keypoints, then SHOT and BOARD frames from one neighbourhood search per keypoint
+void
+computeFeatures (const pcl::PointCloud<PointType>::Ptr &cloud, float sampling_radius, pcl::PointCloud<PointType>::Ptr &keypoints,
+                 pcl::PointCloud<RFType>::Ptr &rf, wp2::DescriptorMatrix &descriptors)
+{
+  pcl::PointCloud<NormalType>::Ptr normals (new pcl::PointCloud<NormalType> ());
+  pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
+  norm_est.setKSearch (10);
+  norm_est.setInputCloud (cloud);
+  norm_est.compute (*normals);
+
+  pcl::PointCloud<int> sampled_indices;
+  pcl::UniformSampling<PointType> uniform_sampling;
+  uniform_sampling.setInputCloud (cloud);
+  uniform_sampling.setRadiusSearch (sampling_radius);
+  uniform_sampling.compute (sampled_indices);
+  keypoints.reset (new pcl::PointCloud<PointType> ());
+  pcl::copyPointCloud (*cloud, sampled_indices.points, *keypoints);
+
+  rf.reset (new pcl::PointCloud<RFType> ());
+  wp2::SHOTLRFEstimation<PointType, NormalType, DescriptorType, RFType> feature_est;
+  feature_est.setKernel (shot_kernel_);
+  feature_est.setDescriptorRadius (descr_rad_);
+  feature_est.setReferenceFrameRadius (rf_rad_);
+  feature_est.setInputCloud (keypoints);
+  feature_est.setInputNormals (normals);
+  feature_est.setSearchSurface (cloud);
+  feature_est.compute (descriptors, rf);
+}
+
+//  Stage 1: scene files into memory
+void
+loadStage (const std::vector<std::string> &files, wp2::BoundedQueue<Scene> *scenes)
+{
+  pcl::PCDReader reader;
+  for (size_t f = 0; f < files.size (); ++f)
+  {
+    const double start = wp2::Profiler::now ();
+    Scene scene;
+    scene.name = fs::path (files[f]).filename ().string ();
+    scene.cloud.reset (new pcl::PointCloud<PointType> ());
+    if (reader.read (files[f], *scene.cloud) < 0)
+    {
+      std::cout << "Error loading scene cloud " << files[f] << std::endl;
+      continue;
+    }
+    addStats (load_stats_, wp2::Profiler::now () - start, 1);
+    scenes->push (scene);
+  }
+  scenes->close ();
+}
+
+//  Stage 2: voxel filter, plane removal and Euclidean clusters; one object per cluster
+void
+segmentStage (wp2::BoundedQueue<Scene> *scenes, wp2::BoundedQueue<Object> *objects)
+{
+  Scene scene;
+  while (scenes->pop (scene))
+  {
+    const double start = wp2::Profiler::now ();
+    pcl::PointCloud<PointType>::Ptr cloud_filtered (new pcl::PointCloud<PointType> ());
+    pcl::VoxelGrid<PointType> vg;
+    vg.setInputCloud (scene.cloud);
+    vg.setLeafSize (leaf_size_, leaf_size_, leaf_size_);
+    vg.filter (*cloud_filtered);
+    scene.cloud.reset ();
+
+    wp2::MultiPlaneExtractor<PointType> plane_extractor;
+    plane_extractor.setInputCloud (cloud_filtered);
+    plane_extractor.setDistanceThreshold (plane_thresh_);
+    plane_extractor.setMaxIterations (200);
+    plane_extractor.setRemainingFraction (remaining_fraction_);
+    std::vector<pcl::PointIndices> planes;
+    std::vector<pcl::ModelCoefficients> coefficients;
+    plane_extractor.extract (planes, coefficients);
+
+    wp2::VoxelClusterExtraction<PointType> ec;
+    ec.setClusterTolerance (cluster_tol_);
+    ec.setMinClusterSize (min_cluster_size_);
+    ec.setMaxClusterSize (max_cluster_size_);
+    ec.setInputCloud (cloud_filtered);
+    ec.setIndices (boost::shared_ptr<std::vector<int> > (new std::vector<int> (plane_extractor.getRemainingIndices ())));
+    std::vector<pcl::PointIndices> cluster_indices;
+    ec.extract (cluster_indices);
+
+    std::cout << scene.name << ": " << cloud_filtered->size () << " points after filtering, " << planes.size ()
+              << " planes, " << cluster_indices.size () << " objects" << std::endl;
+    addStats (segment_stats_, wp2::Profiler::now () - start, 1);
+
+    for (size_t c = 0; c < cluster_indices.size (); ++c)
+    {
+      Object object;
+      object.scene = scene.name;
+      object.id = static_cast<int> (c);
+      object.cloud.reset (new pcl::PointCloud<PointType> ());
+      pcl::copyPointCloud (*cloud_filtered, cluster_indices[c].indices, *object.cloud);
+      objects->push (object);
+    }
+  }
+  objects->close ();
+}
+
+//  Stage 3: features of each object; several of these may run on the same queues
+void
+featureStage (wp2::BoundedQueue<Object> *objects, wp2::BoundedQueue<ObjectFeatures> *features)
+{
+  Object object;
+  while (objects->pop (object))
+  {
+    const double start = wp2::Profiler::now ();
+    ObjectFeatures result;
+    result.scene = object.scene;
+    result.id = object.id;
+    result.cloud = object.cloud;
+    result.descriptors.reset (new wp2::DescriptorMatrix ());
+    computeFeatures (object.cloud, scene_ss_, result.keypoints, result.rf, *result.descriptors);
+    addStats (feature_stats_, wp2::Profiler::now () - start, 1);
+    features->push (result);
+  }
+  features->close ();
+}
+
+//  Descriptors of every model in one HNSW graph labelled by model, built while the first scene is segmented
+void
+buildLibrary (wp2::search::HNSWIndex &library, std::vector<Model> &models)
+{
+  const double start = wp2::Profiler::now ();
+  const std::vector<std::string> files = listPCDFiles (model_path);
+  pcl::PointCloud<PointType>::Ptr cloud (new pcl::PointCloud<PointType> ());
+  wp2::DescriptorMatrix descriptors;
+  for (size_t f = 0; f < files.size (); ++f)
+  {
+    if (pcl::io::loadPCDFile (files[f], *cloud) < 0)
+    {
+      std::cout << "Error loading model cloud " << files[f] << std::endl;
+      continue;
+    }
+    Model model;
+    model.filename = files[f];
+    computeFeatures (cloud, model_ss_, model.keypoints, model.rf, descriptors);
+    descriptors.compact ();
+    const int label = library.addLabel (files[f]);
+    library.insert (descriptors, label);
+    models.resize (label + 1);
+    models[label] = model;
+  }
+  addStats (library_stats_, wp2::Profiler::now () - start, static_cast<long> (models.size ()));
+  std::cout << "Model library: " << library.getNumberOfLabels () << " models, " << library.size () << " descriptors" << std::endl;
+}
+
+//  Stage 4: one library search per object, grouping against every model with enough matches; the label is the model
+//  with the most instances, then the most grouped correspondences
+void
+matchStage (wp2::BoundedQueue<ObjectFeatures> *features, wp2::BoundedQueue<ObjectLabel> *labels)
+{
+  wp2::search::HNSWIndex library (DescriptorType::descriptorSize ());
+  std::vector<Model> models;
+  buildLibrary (library, models);
+
+  wp2::search::DescriptorMatcher matcher;
+  matcher.setMode (match_mode_);
+  matcher.setMaxSquaredDistance (match_thresh_);
+  matcher.setLibraryNeighbors (static_cast<size_t> (std::max (library_k_, 0)));
+  wp2::PairGates<PointType> gates;
+  gates.setGroupingThreshold (cg_thresh_, use_hough_);
+  std::vector<pcl::Correspondences> library_corrs;
+  wp2::SparseHough3DGrouping<PointType, PointType, RFType, RFType> hough;
+  hough.setHoughBinSize (cg_size_);
+  hough.setHoughThreshold (cg_thresh_);
+  hough.setUseInterpolation (true);
+  hough.setUseDistanceWeight (false);
+  wp2::GeometricConsistencyGroupingSIMD<PointType, PointType> gc;
+  gc.setGCSize (cg_size_);
+  gc.setGCThreshold (cg_thresh_);
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > rototranslations;
+  std::vector<pcl::Correspondences> clustered_corrs;
+
+  ObjectFeatures object;
+  while (features->pop (object))
+  {
+    const double start = wp2::Profiler::now ();
+    ObjectLabel label;
+    label.scene = object.scene;
+    label.id = object.id;
+    label.points = object.cloud->size ();
+    Eigen::Vector4f centroid;
+    pcl::compute3DCentroid (*object.cloud, centroid);
+    label.centroid[0] = centroid[0];
+    label.centroid[1] = centroid[1];
+    label.centroid[2] = centroid[2];
+    label.instances = 0;
+    label.correspondences = 0;
+
+    //  k nearest over the whole library, then the nearest per model: every model gets the matches it would get
+    //  alone, not only the one whose descriptor is the global nearest
+    matcher.match (library, *object.descriptors, library_corrs);
+    size_t best_grouped = 0;
+    for (size_t m = 0; m < library_corrs.size (); ++m)
+    {
+      if (gates.checkCorrespondences (library_corrs[m].size ()) != wp2::GATE_PASS)
+      {
+        continue;
+      }
+      pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences (library_corrs[m]));
+      if (use_hough_)
+      {
+        hough.setInputCloud (models[m].keypoints);
+        hough.setInputRf (models[m].rf);
+        hough.setSceneCloud (object.keypoints);
+        hough.setSceneRf (object.rf);
+        hough.setModelSceneCorrespondences (model_scene_corrs);
+        hough.recognize (rototranslations, clustered_corrs);
+      }
+      else
+      {
+        gc.setInputCloud (models[m].keypoints);
+        gc.setSceneCloud (object.keypoints);
+        gc.setModelSceneCorrespondences (model_scene_corrs);
+        gc.recognize (rototranslations, clustered_corrs);
+      }
+
+      size_t grouped = 0;
+      for (size_t i = 0; i < clustered_corrs.size (); ++i)
+      {
+        grouped = std::max (grouped, clustered_corrs[i].size ());
+      }
+      const int instances = static_cast<int> (rototranslations.size ());
+      if (instances > 0 && (instances > label.instances || (instances == label.instances && grouped > best_grouped)))
+      {
+        label.model = models[m].filename;
+        label.instances = instances;
+        label.correspondences = library_corrs[m].size ();
+        best_grouped = grouped;
+      }
+    }
+    addStats (match_stats_, wp2::Profiler::now () - start, 1);
+    labels->push (label);
+  }
+  labels->close ();
+}
+
+void
+printStage (const char *name, const StageStats &stats, const std::string &queue_info)
+{
+  std::cout << "  " << name << ": " << stats.items << " items, " << stats.busy_ms << " ms busy";
+  if (stats.items > 0)
+  {
+    std::cout << " (" << stats.busy_ms / stats.items << " ms each)";
+  }
+  std::cout << queue_info << std::endl;
+}
+
+std::string
+queueInfo (size_t max_size, size_t waits)
+{
+  std::stringstream ss;
+  ss << "; output queue peak " << max_size << ", " << waits << " full waits";
+  return (ss.str ());
+}
+
+int
+main (int argc, char *argv[])
+{
+  parseCommandLine (argc, argv);
+  const std::vector<std::string> scene_files = listPCDFiles (scene_path);
+
+  wp2::BoundedQueue<Scene> scenes (queue_size_);
+  wp2::BoundedQueue<Object> objects (queue_size_);
+  wp2::BoundedQueue<ObjectFeatures> features (queue_size_, feature_workers_);
+  wp2::BoundedQueue<ObjectLabel> labels (queue_size_);
+
+  const double start = wp2::Profiler::now ();
+  boost::thread_group stages;
+  stages.create_thread (boost::bind (&loadStage, boost::cref (scene_files), &scenes));
+  stages.create_thread (boost::bind (&segmentStage, &scenes, &objects));
+  for (int w = 0; w < feature_workers_; ++w)
+  {
+    stages.create_thread (boost::bind (&featureStage, &objects, &features));
+  }
+  stages.create_thread (boost::bind (&matchStage, &features, &labels));
+
+  //  Labels as they come out of the pipeline
+  std::vector<ObjectLabel> results;
+  ObjectLabel label;
+  while (labels.pop (label))
+  {
+    std::cout << label.scene << " object " << label.id << " (" << label.points << " points): "
+              << (label.model.empty () ? std::string ("unknown") : wp2::Evaluator::labelFromFilename (label.model));
+    if (!label.model.empty ())
+    {
+      std::cout << ", " << label.instances << " instances, " << label.correspondences << " correspondences";
+    }
+    std::cout << std::endl;
+    results.push_back (label);
+  }
+  stages.join_all ();
+
+  std::cout << "Pipeline: " << scene_files.size () << " scenes, " << results.size () << " objects in "
+            << wp2::Profiler::now () - start << " ms" << std::endl;
+  printStage ("load", load_stats_, queueInfo (scenes.getMaxSize (), scenes.getNumberOfWaits ()));
+  printStage ("segmentation", segment_stats_, queueInfo (objects.getMaxSize (), objects.getNumberOfWaits ()));
+  printStage ("features", feature_stats_, queueInfo (features.getMaxSize (), features.getNumberOfWaits ()));
+  printStage ("library", library_stats_, "");
+  printStage ("matching", match_stats_, queueInfo (labels.getMaxSize (), labels.getNumberOfWaits ()));
+
+  if (!labels_filename_.empty ())
+  {
+    std::ofstream file (labels_filename_.c_str ());
+    file << "scene,object,points,x,y,z,label,model,instances,correspondences" << std::endl;
+    for (size_t r = 0; r < results.size (); ++r)
+    {
+      const ObjectLabel &l = results[r];
+      file << l.scene << "," << l.id << "," << l.points << "," << l.centroid[0] << "," << l.centroid[1] << ","
+           << l.centroid[2] << "," << (l.model.empty () ? std::string ("unknown") : wp2::Evaluator::labelFromFilename (l.model))
+           << "," << fs::path (l.model).filename ().string () << "," << l.instances << "," << l.correspondences << std::endl;
+    }
+    if (!file)
+    {
+      std::cout << "Error writing labels " << labels_filename_ << std::endl;
+      return (1);
+    }
+  }
+  return (0);
+}
@@ -18,11 +18,12 @@
 #include <pcl/visualization/pcl_visualizer.h>
 #include <pcl/common/transformation_from_correspondences.h>
 #include <pcl/filters/statistical_outlier_removal.h>
-#include <pcl/filters/passthrough.h>
 #include <pcl/sample_consensus/ransac.h>
 #include <pcl/sample_consensus/sac_model_plane.h>
 #include <pcl/console/parse.h>
 
+#include <wp2/filters/streaming_voxel_grid.h>
+
 //using namespace pcl;
 using namespace std;
 using namespace cv;
@@ -32,30 +33,27 @@ bool ransac = false;
 bool icp = false;
 bool tfc = false;
 
-void
-downsample (pcl::PointCloud<pcl::PointXYZRGB>::Ptr &points, float leaf_size,
+bool
+downsample (const char *filename, float leaf_size,
             pcl::PointCloud<pcl::PointXYZRGB>::Ptr &downsampled_out)
 {
-  //voxel grid filters
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr tmp_ptr(new pcl::PointCloud<pcl::PointXYZRGB>);
-  pcl::VoxelGrid<pcl::PointXYZRGB> vox_grid;
-  vox_grid.setSaveLeafLayout (true);
-  vox_grid.setLeafSize (leaf_size, leaf_size, leaf_size);
-  vox_grid.setInputCloud (points);
-  vox_grid.filter (*tmp_ptr);
-  //added passthrough filters
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr tmp_ptr3(new pcl::PointCloud<pcl::PointXYZRGB>);
-  pcl::PassThrough<pcl::PointXYZRGB> pass;
-  pass.setInputCloud (tmp_ptr);
-  pass.setFilterFieldName ("z");
-  pass.setFilterLimits (0.0, 3.0);
-  pass.filter (*tmp_ptr3);
-  pcl::PassThrough<pcl::PointXYZRGB> pass2;
-  pass2.setInputCloud (tmp_ptr3);
-  pass2.setFilterFieldName ("x");
-  pass2.setFilterLimits (-2.0, 1.0);
-  pass2.filter (*downsampled_out);
-
+  //voxel grid and passthrough limits in one pass, streamed from the file so the full cloud is never loaded; the
+  //limits apply to the centroids, as in the VoxelGrid -> PassThrough chain
+  wp2::StreamingVoxelGrid vox_grid;
+  vox_grid.setLeafSize (leaf_size);
+  vox_grid.setFilterLimits ("z", 0.0, 3.0);
+  vox_grid.setFilterLimits ("x", -2.0, 1.0);
+  if (!vox_grid.addFile (filename))
+  {
+    return (false);
+  }
+  if (vox_grid.getNumberOfDecompressedPoints () > 0)
+  {
+    std::cerr << "WARNING: " << filename << " is binary_compressed and was decompressed whole in memory; "
+              << "save it as binary to stream it" << std::endl;
+  }
+  vox_grid.getCentroids (*downsampled_out);
+  return (true);
 }
 
 void
@@ -318,33 +316,28 @@ void visualize_correspondences (const pcl::PointCloud<pcl::PointXYZRGB>::Ptr poi
 int transform_demo (const char * filename1, const char *filename2)
 {
   // Create some new point clouds to hold our data
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr points1 (new pcl::PointCloud<pcl::PointXYZRGB>);
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr downsampled1 (new pcl::PointCloud<pcl::PointXYZRGB>);
   pcl::PointCloud<pcl::Normal>::Ptr normals1 (new pcl::PointCloud<pcl::Normal>);
   pcl::PointCloud<pcl::PointWithScale>::Ptr keypoints1 (new pcl::PointCloud<pcl::PointWithScale>);
   pcl::PointCloud<pcl::PFHSignature125>::Ptr descriptors1 (new pcl::PointCloud<pcl::PFHSignature125>);
 
-  pcl::PointCloud<pcl::PointXYZRGB>::Ptr points2 (new pcl::PointCloud<pcl::PointXYZRGB>);
   pcl::PointCloud<pcl::PointXYZRGB>::Ptr downsampled2 (new pcl::PointCloud<pcl::PointXYZRGB>);
   pcl::PointCloud<pcl::Normal>::Ptr normals2 (new pcl::PointCloud<pcl::Normal>);
   pcl::PointCloud<pcl::PointWithScale>::Ptr keypoints2 (new pcl::PointCloud<pcl::PointWithScale>);
   pcl::PointCloud<pcl::PFHSignature125>::Ptr descriptors2 (new pcl::PointCloud<pcl::PFHSignature125>);
 
-  // Load the pair of point clouds
-  if(pcl::io::loadPCDFile (filename1, *points1)==-1)
+  // Load and downsample the pair of point clouds
+  const float voxel_grid_leaf_size = 0.01;
+  if(!downsample (filename1, voxel_grid_leaf_size, downsampled1))
   {
     PCL_ERROR ("Couldn't read first file! \n");
     return (-1);
   }
-  if(pcl::io::loadPCDFile (filename2, *points2)==-1) 
+  if(!downsample (filename2, voxel_grid_leaf_size, downsampled2))
   {
     PCL_ERROR ("Couldn't read second input file! \n");
     return (-1);
   }
-  // Downsample the cloud
-  const float voxel_grid_leaf_size = 0.01;
-  downsample (points1, voxel_grid_leaf_size, downsampled1);
-  downsample (points2, voxel_grid_leaf_size, downsampled2);  
   // save downsampled input pointclouds for debug purposes
   /* pcl::io::savePCDFileASCII ("downsampled1.pcd", *downsampled1);
      pcl::io::savePCDFileASCII ("downsampled2.pcd", *downsampled2); */
@@ -0,0 +1,14 @@
+//RUNTIME CPU FEATURE CHECKS FOR THE VECTORIZED KERNELS
+
+#include <wp2/common/cpu_features.h>
+
+bool
+wp2::hasAVX2 ()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  static const bool has_avx2 = __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+  return (has_avx2);
+#else
+  return (false);
+#endif
+}
@@ -0,0 +1,235 @@
+//NEAREST DESCRIPTOR SEARCH OVER A wp2::DescriptorMatrix
+
+#include <wp2/search/descriptor_index.h>
+#include <wp2/common/profiler.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+bool
+wp2::search::IndexParams::parseType (const std::string &name, Type &type)
+{
+  if (name == "exact")
+  {
+    type = INDEX_EXACT;
+  }
+  else if (name == "kdtree")
+  {
+    type = INDEX_KDTREE;
+  }
+  else if (name == "kmeans")
+  {
+    type = INDEX_KMEANS;
+  }
+  else if (name == "linear")
+  {
+    type = INDEX_LINEAR;
+  }
+  else if (name == "hnsw")
+  {
+    type = INDEX_HNSW;
+  }
+  else
+  {
+    return (false);
+  }
+  return (true);
+}
+
+const char *
+wp2::search::IndexParams::typeName (Type type)
+{
+  switch (type)
+  {
+    case INDEX_KDTREE:
+      return ("kdtree");
+    case INDEX_KMEANS:
+      return ("kmeans");
+    case INDEX_LINEAR:
+      return ("linear");
+    case INDEX_HNSW:
+      return ("hnsw");
+    default:
+      return ("exact");
+  }
+}
+
+std::string
+wp2::search::IndexParams::toString () const
+{
+  std::stringstream ss;
+  ss << typeName (type);
+  if (type == INDEX_KDTREE)
+  {
+    ss << " trees=" << trees << " checks=" << checks;
+  }
+  else if (type == INDEX_KMEANS)
+  {
+    ss << " branching=" << branching << " iterations=" << iterations << " checks=" << checks;
+  }
+  else if (type == INDEX_HNSW)
+  {
+    ss << " neighbors=" << neighbors << " ef_construction=" << ef_construction << " checks=" << checks;
+  }
+  return (ss.str ());
+}
+
+void
+wp2::search::DescriptorIndex::setInputMatrix (wp2::DescriptorMatrix &matrix)
+{
+  matrix.compact ();
+  matrix_ = &matrix;
+  index_.reset ();
+  graph_.reset ();
+  if (matrix.rows () == 0)
+  {
+    return;
+  }
+
+  //  All rows are valid after compact (), so node i is row i
+  if (params_.type == IndexParams::INDEX_HNSW)
+  {
+    graph_.reset (new HNSWIndex (matrix.dims (), params_.neighbors, params_.ef_construction));
+    if (params_.checks > 0)
+    {
+      graph_->setEfSearch (params_.checks);
+    }
+    graph_->insert (matrix, 0);
+    return;
+  }
+
+  flann::Matrix<float> dataset (matrix.data (), matrix.rows (), matrix.dims (), matrix.stride () * sizeof (float));
+  switch (params_.type)
+  {
+    case IndexParams::INDEX_KDTREE:
+      index_.reset (new flann::Index<Distance> (dataset, flann::KDTreeIndexParams (params_.trees)));
+      break;
+    case IndexParams::INDEX_KMEANS:
+      index_.reset (new flann::Index<Distance> (dataset, flann::KMeansIndexParams (params_.branching, params_.iterations)));
+      break;
+    case IndexParams::INDEX_LINEAR:
+      index_.reset (new flann::Index<Distance> (dataset, flann::LinearIndexParams ()));
+      break;
+    default:
+      index_.reset (new flann::Index<Distance> (dataset, flann::KDTreeSingleIndexParams (15, false)));
+  }
+  index_->buildIndex ();
+}
+
+size_t
+wp2::search::DescriptorIndex::knnSearch (const wp2::DescriptorMatrix &queries, size_t k, std::vector<int> &indices,
+                                         std::vector<float> &sqr_dists, unsigned int nr_threads) const
+{
+  if (graph_)
+  {
+    return (graph_->knnSearch (queries, k, indices, sqr_dists, nr_threads));
+  }
+
+  k = std::min (k, size ());
+  indices.resize (queries.rows () * k);
+  sqr_dists.resize (queries.rows () * k);
+  if (k == 0 || queries.rows () == 0)
+  {
+    return (k);
+  }
+
+  flann::Matrix<float> query (const_cast<float *> (queries.data ()), queries.rows (), queries.dims (),
+                              queries.stride () * sizeof (float));
+  flann::Matrix<int> result_indices (&indices[0], queries.rows (), k);
+  flann::Matrix<float> result_dists (&sqr_dists[0], queries.rows (), k);
+
+  //  The exact kd-tree searches without limit, as pcl::KdTreeFLANN
+  const bool approximate = params_.type == IndexParams::INDEX_KDTREE || params_.type == IndexParams::INDEX_KMEANS;
+  flann::SearchParams params (approximate ? params_.checks : -1, 0.0f);
+  params.cores = static_cast<int> (nr_threads);
+  index_->knnSearch (query, result_indices, result_dists, k, params);
+  return (k);
+}
+
+wp2::search::IndexParams
+wp2::search::DescriptorIndex::autotune (wp2::DescriptorMatrix &data, wp2::DescriptorMatrix &queries, float target_recall,
+                                        size_t nr_samples, unsigned int nr_threads)
+{
+  IndexParams best;
+  data.compact ();
+  queries.compact ();
+  if (data.rows () == 0 || queries.rows () == 0 || nr_samples == 0)
+  {
+    return (best);
+  }
+
+  //  Evenly spread sample of the queries
+  const size_t step = std::max<size_t> (1, queries.rows () / nr_samples);
+  const size_t nr_queries = (queries.rows () + step - 1) / step;
+  wp2::DescriptorMatrix sample (nr_queries, queries.dims ());
+  for (size_t i = 0; i < nr_queries; ++i)
+  {
+    std::memcpy (sample.row (i), queries.row (i * step), queries.stride () * sizeof (float));
+  }
+
+  //  Ground truth by brute force
+  std::vector<int> indices;
+  std::vector<float> exact_dists, sqr_dists;
+  {
+    DescriptorIndex linear;
+    IndexParams params;
+    params.type = IndexParams::INDEX_LINEAR;
+    linear.setParams (params);
+    linear.setInputMatrix (data);
+    linear.knnSearch (sample, 1, indices, exact_dists, nr_threads);
+  }
+
+  std::vector<IndexParams> candidates (1);
+  const int checks[] = {16, 32, 64, 128, 256, 512};
+  const int trees[] = {1, 4, 8};
+  const int branchings[] = {16, 32};
+  for (size_t c = 0; c < sizeof (checks) / sizeof (checks[0]); ++c)
+  {
+    IndexParams params;
+    params.checks = checks[c];
+    params.type = IndexParams::INDEX_KDTREE;
+    for (size_t t = 0; t < sizeof (trees) / sizeof (trees[0]); ++t)
+    {
+      params.trees = trees[t];
+      candidates.push_back (params);
+    }
+    params.type = IndexParams::INDEX_KMEANS;
+    for (size_t b = 0; b < sizeof (branchings) / sizeof (branchings[0]); ++b)
+    {
+      params.branching = branchings[b];
+      candidates.push_back (params);
+    }
+  }
+
+  //  Build time counts once, query time scaled to the whole query set
+  const double scale = static_cast<double> (queries.rows ()) / static_cast<double> (nr_queries);
+  double best_cost = -1.0;
+  for (size_t c = 0; c < candidates.size (); ++c)
+  {
+    DescriptorIndex index;
+    index.setParams (candidates[c]);
+    const double start = wp2::Profiler::now ();
+    index.setInputMatrix (data);
+    const double built = wp2::Profiler::now ();
+    index.knnSearch (sample, 1, indices, sqr_dists, nr_threads);
+    const double cost = (built - start) + (wp2::Profiler::now () - built) * scale;
+
+    //  A different row at the same distance is as good as the exact one
+    size_t hits = 0;
+    for (size_t i = 0; i < nr_queries; ++i)
+    {
+      if (sqr_dists[i] <= exact_dists[i] * 1.00001f)
+      {
+        ++hits;
+      }
+    }
+    const float recall = static_cast<float> (hits) / static_cast<float> (nr_queries);
+    if (recall >= target_recall && (best_cost < 0.0 || cost < best_cost))
+    {
+      best = candidates[c];
+      best_cost = cost;
+    }
+  }
+  return (best);
+}
@@ -0,0 +1,212 @@
+//MODEL-SCENE DESCRIPTOR MATCHING
+
+#include <wp2/search/descriptor_matcher.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+bool
+wp2::search::DescriptorMatcher::parseMode (const std::string &name, Mode &mode)
+{
+  if (name == "nn")
+  {
+    mode = MATCH_THRESHOLD;
+  }
+  else if (name == "ratio")
+  {
+    mode = MATCH_RATIO;
+  }
+  else if (name == "mutual")
+  {
+    mode = MATCH_MUTUAL;
+  }
+  else
+  {
+    return (false);
+  }
+  return (true);
+}
+
+const char *
+wp2::search::DescriptorMatcher::modeName (Mode mode)
+{
+  switch (mode)
+  {
+    case MATCH_RATIO:
+      return ("ratio");
+    case MATCH_MUTUAL:
+      return ("mutual");
+    default:
+      return ("nn");
+  }
+}
+
+void
+wp2::search::DescriptorMatcher::match (wp2::DescriptorMatrix &model, wp2::DescriptorMatrix &scene,
+                                       pcl::Correspondences &correspondences)
+{
+  correspondences.clear ();
+  nr_candidates_ = 0;
+
+  model_index_.setInputMatrix (model);
+  scene.compact ();
+
+  //  Scene -> model, with the runner-up when the ratio test needs it
+  const size_t k = model_index_.knnSearch (scene, mode_ == MATCH_RATIO ? 2 : 1, forward_indices_, forward_dists_, threads_);
+  if (k == 0)
+  {
+    return;
+  }
+
+  //  Model -> scene, for the mutual check
+  if (mode_ == MATCH_MUTUAL)
+  {
+    scene_index_.setInputMatrix (scene);
+    scene_index_.knnSearch (model, 1, reverse_indices_, reverse_dists_, threads_);
+  }
+
+  const float sqr_ratio = ratio_ * ratio_;
+  for (size_t i = 0; i < scene.rows (); ++i)
+  {
+    const int nearest = forward_indices_[i * k];
+    const float sqr_dist = forward_dists_[i * k];
+    if (nearest < 0 || !(sqr_dist < max_sqr_dist_))
+    {
+      continue;
+    }
+    ++nr_candidates_;
+
+    //  With a single model descriptor there is no runner-up and the match is unambiguous
+    if (mode_ == MATCH_RATIO && k == 2 && !(sqr_dist < sqr_ratio * forward_dists_[i * k + 1]))
+    {
+      continue;
+    }
+    if (mode_ == MATCH_MUTUAL && reverse_indices_[nearest] != static_cast<int> (i))
+    {
+      continue;
+    }
+
+    correspondences.push_back (pcl::Correspondence (model.getIndex (nearest), scene.getIndex (i), sqr_dist));
+  }
+}
+
+void
+wp2::search::DescriptorMatcher::match (const HNSWIndex &library, wp2::DescriptorMatrix &scene,
+                                       std::vector<pcl::Correspondences> &correspondences)
+{
+  const size_t nr_labels = library.getNumberOfLabels ();
+  correspondences.resize (nr_labels);
+  for (size_t l = 0; l < correspondences.size (); ++l)
+  {
+    correspondences[l].clear ();
+  }
+  nr_candidates_ = 0;
+
+  scene.compact ();
+  const size_t per_label = mode_ == MATCH_RATIO ? 2 : 1;
+  const size_t neighbors = library_neighbors_ > 0 ? library_neighbors_ : 4 * per_label * std::max (nr_labels, size_t (1));
+  const size_t k = library.knnSearch (scene, std::max (neighbors, per_label), forward_indices_, forward_dists_, threads_);
+  if (k == 0)
+  {
+    return;
+  }
+  //  With the whole library in the list, a model without a runner-up among them has none at all
+  const bool complete = k == library.size ();
+
+  //  Nearest descriptor of every model among the k neighbours of each scene descriptor, under the threshold
+  label_matches_.clear ();
+  label_slots_.assign (nr_labels, -1);
+  for (size_t i = 0; i < scene.rows (); ++i)
+  {
+    const size_t first = label_matches_.size ();
+    float bound = std::numeric_limits<float>::max ();
+    for (size_t j = 0; j < k; ++j)
+    {
+      const int node = forward_indices_[i * k + j];
+      if (node < 0)
+      {
+        break;
+      }
+      const float sqr_dist = forward_dists_[i * k + j];
+      bound = sqr_dist;
+      const int label = library.getLabel (node);
+      int &slot = label_slots_[label];
+      if (slot < 0)
+      {
+        if (sqr_dist < max_sqr_dist_)
+        {
+          LabelMatch match;
+          match.row = static_cast<int> (i);
+          match.node = node;
+          match.sqr_dist = sqr_dist;
+          match.runner_up = -1.0f;
+          slot = static_cast<int> (label_matches_.size ());
+          label_matches_.push_back (match);
+        }
+        else
+        {
+          //  The nearest of this model is over the threshold
+          slot = std::numeric_limits<int>::max ();
+        }
+      }
+      else if (slot != std::numeric_limits<int>::max () && label_matches_[slot].runner_up < 0.0f)
+      {
+        label_matches_[slot].runner_up = sqr_dist;
+      }
+    }
+    for (size_t m = first; m < label_matches_.size (); ++m)
+    {
+      if (label_matches_[m].runner_up < 0.0f)
+      {
+        label_matches_[m].runner_up = complete ? std::numeric_limits<float>::max () : bound;
+      }
+    }
+    for (size_t j = 0; j < k && forward_indices_[i * k + j] >= 0; ++j)
+    {
+      label_slots_[library.getLabel (forward_indices_[i * k + j])] = -1;
+    }
+  }
+  nr_candidates_ = label_matches_.size ();
+
+  //  Library -> scene, for the mutual check, from the library descriptors kept for some model
+  if (mode_ == MATCH_MUTUAL)
+  {
+    library_nodes_.clear ();
+    for (size_t m = 0; m < label_matches_.size (); ++m)
+    {
+      library_nodes_.push_back (label_matches_[m].node);
+    }
+    std::sort (library_nodes_.begin (), library_nodes_.end ());
+    library_nodes_.erase (std::unique (library_nodes_.begin (), library_nodes_.end ()), library_nodes_.end ());
+
+    library_descriptors_.resize (library_nodes_.size (), library.dims ());
+    for (size_t r = 0; r < library_nodes_.size (); ++r)
+    {
+      std::memcpy (library_descriptors_.row (r), library.getDescriptor (library_nodes_[r]), library.dims () * sizeof (float));
+    }
+    scene_index_.setInputMatrix (scene);
+    scene_index_.knnSearch (library_descriptors_, 1, reverse_indices_, reverse_dists_, threads_);
+  }
+
+  const float sqr_ratio = ratio_ * ratio_;
+  for (size_t m = 0; m < label_matches_.size (); ++m)
+  {
+    const LabelMatch &match = label_matches_[m];
+    if (mode_ == MATCH_RATIO && !(match.sqr_dist < sqr_ratio * match.runner_up))
+    {
+      continue;
+    }
+    if (mode_ == MATCH_MUTUAL)
+    {
+      const size_t r = std::lower_bound (library_nodes_.begin (), library_nodes_.end (), match.node) - library_nodes_.begin ();
+      if (reverse_indices_[r] != match.row)
+      {
+        continue;
+      }
+    }
+
+    correspondences[library.getLabel (match.node)].push_back (
+        pcl::Correspondence (library.getId (match.node), scene.getIndex (match.row), match.sqr_dist));
+  }
+}
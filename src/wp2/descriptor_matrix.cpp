@@ -0,0 +1,123 @@
+//DESCRIPTOR STORAGE FOR MATCHING
+
+#include <wp2/features/descriptor_matrix.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+const size_t wp2::DescriptorMatrix::ALIGNMENT;
+const size_t wp2::DescriptorMatrix::ALIGNMENT_FLOATS;
+
+wp2::DescriptorMatrix::~DescriptorMatrix ()
+{
+  std::free (data_);
+}
+
+void
+wp2::DescriptorMatrix::resize (size_t rows, size_t dims)
+{
+  const size_t stride = (dims + ALIGNMENT_FLOATS - 1) / ALIGNMENT_FLOATS * ALIGNMENT_FLOATS;
+  const size_t size = rows * stride;
+  if (size > capacity_)
+  {
+    std::free (data_);
+    data_ = NULL;
+    capacity_ = 0;
+    void *memory = NULL;
+    if (posix_memalign (&memory, ALIGNMENT, size * sizeof (float)) != 0)
+    {
+      throw std::bad_alloc ();
+    }
+    data_ = static_cast<float *> (memory);
+    capacity_ = size;
+  }
+
+  rows_ = rows;
+  dims_ = dims;
+  stride_ = stride;
+  invalid_.assign ((rows + 63) / 64, 0);
+  indices_.clear ();
+
+  //  Padding is zeroed once so that whole-stride kernels add nothing from it
+  if (stride > dims)
+  {
+    for (size_t i = 0; i < rows; ++i)
+    {
+      std::fill (row (i) + dims, row (i) + stride, 0.0f);
+    }
+  }
+}
+
+void
+wp2::DescriptorMatrix::setValid (size_t i, bool valid)
+{
+  const boost::uint64_t bit = static_cast<boost::uint64_t> (1) << (i & 63);
+  if (valid)
+  {
+    invalid_[i >> 6] &= ~bit;
+  }
+  else
+  {
+    invalid_[i >> 6] |= bit;
+  }
+}
+
+void
+wp2::DescriptorMatrix::updateValidity ()
+{
+  for (size_t i = 0; i < rows_; ++i)
+  {
+    setValid (i, dims_ > 0 && (boost::math::isfinite) (row (i)[0]));
+  }
+}
+
+size_t
+wp2::DescriptorMatrix::getNumberOfValid () const
+{
+  size_t nr_invalid = 0;
+  for (size_t w = 0; w < invalid_.size (); ++w)
+  {
+    for (boost::uint64_t word = invalid_[w]; word != 0; word &= word - 1)
+    {
+      ++nr_invalid;
+    }
+  }
+  return (rows_ - nr_invalid);
+}
+
+void
+wp2::DescriptorMatrix::compact ()
+{
+  //  Row map kept in place, so repeated compactions reuse its capacity
+  if (indices_.empty ())
+  {
+    indices_.resize (rows_);
+    for (size_t i = 0; i < rows_; ++i)
+    {
+      indices_[i] = static_cast<int> (i);
+    }
+  }
+
+  size_t kept = 0;
+  for (size_t i = 0; i < rows_; ++i)
+  {
+    if (!isValid (i))
+    {
+      continue;
+    }
+    if (kept != i)
+    {
+      std::memcpy (row (kept), row (i), stride_ * sizeof (float));
+      indices_[kept] = indices_[i];
+    }
+    ++kept;
+  }
+
+  rows_ = kept;
+  indices_.resize (kept);
+  invalid_.assign ((kept + 63) / 64, 0);
+}
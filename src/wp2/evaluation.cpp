@@ -0,0 +1,252 @@
+//RECOGNITION QUALITY OF A PARAMETER SET
+
+#include <wp2/common/evaluation.h>
+#include <wp2/common/csv.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+  const char *
+  outcome (bool expected, bool detected)
+  {
+    if (detected)
+    {
+      return (expected ? "TP" : "FP");
+    }
+    return (expected ? "FN" : "TN");
+  }
+}
+
+std::string
+wp2::Evaluator::labelFromFilename (const std::string &filename)
+{
+  std::string name (filename);
+  const size_t slash = name.find_last_of ("/\\");
+  if (slash != std::string::npos)
+  {
+    name = name.substr (slash + 1);
+  }
+  const size_t dash = name.find ("-");
+  if (dash != std::string::npos)
+  {
+    return (name.substr (0, dash));
+  }
+  const size_t dot = name.find_last_of (".");
+  return (dot != std::string::npos ? name.substr (0, dot) : name);
+}
+
+void
+wp2::Evaluator::addLabel (const std::string &label)
+{
+  if (std::find (labels_.begin (), labels_.end (), label) == labels_.end ())
+  {
+    labels_.push_back (label);
+  }
+}
+
+void
+wp2::Evaluator::addPair (const std::string &model, const std::string &scene, const std::string &model_label,
+                         const std::vector<std::string> &scene_labels, long instances, double ms)
+{
+  Pair pair;
+  pair.model = model;
+  pair.scene = scene;
+  pair.model_label = model_label;
+  pair.expected = std::find (scene_labels.begin (), scene_labels.end (), model_label) != scene_labels.end ();
+  pair.instances = instances;
+  pair.ms = ms;
+  pairs_.push_back (pair);
+
+  const bool detected = instances > 0;
+  addLabel (model_label);
+  Counts &counts = per_label_[model_label];
+  if (detected)
+  {
+    ++(pair.expected ? counts.tp : counts.fp);
+  }
+  else
+  {
+    ++(pair.expected ? counts.fn : counts.tn);
+  }
+
+  //  A scene naming the same object twice still counts once per pair
+  std::vector<std::string> truths (scene_labels);
+  std::sort (truths.begin (), truths.end ());
+  truths.erase (std::unique (truths.begin (), truths.end ()), truths.end ());
+  for (size_t i = 0; i < truths.size (); ++i)
+  {
+    addLabel (truths[i]);
+    ++truth_pairs_[truths[i]];
+    if (detected)
+    {
+      ++confusion_[truths[i]][model_label];
+    }
+  }
+}
+
+wp2::Evaluator::Counts
+wp2::Evaluator::getTotals () const
+{
+  Counts totals;
+  for (std::map<std::string, Counts>::const_iterator it = per_label_.begin (); it != per_label_.end (); ++it)
+  {
+    totals.tp += it->second.tp;
+    totals.fp += it->second.fp;
+    totals.fn += it->second.fn;
+    totals.tn += it->second.tn;
+  }
+  return (totals);
+}
+
+void
+wp2::Evaluator::timeStats (double &mean, double &p50, double &p90) const
+{
+  mean = p50 = p90 = 0.0;
+  if (pairs_.empty ())
+  {
+    return;
+  }
+  std::vector<double> times (pairs_.size ());
+  double sum = 0.0;
+  for (size_t i = 0; i < pairs_.size (); ++i)
+  {
+    times[i] = pairs_[i].ms;
+    sum += times[i];
+  }
+  std::sort (times.begin (), times.end ());
+  mean = sum / static_cast<double> (times.size ());
+
+  //  Nearest rank, as in wp2::Profiler
+  const size_t n = times.size ();
+  p50 = times[std::min (n - 1, static_cast<size_t> (std::max (1.0, std::ceil (0.5 * static_cast<double> (n)))) - 1)];
+  p90 = times[std::min (n - 1, static_cast<size_t> (std::max (1.0, std::ceil (0.9 * static_cast<double> (n)))) - 1)];
+}
+
+bool
+wp2::Evaluator::writePairs (const std::string &filename) const
+{
+  std::ofstream file (filename.c_str ());
+  if (!file)
+  {
+    return (false);
+  }
+
+  file << "model,scene,model_label,expected,instances,outcome,ms\n";
+  file << std::fixed << std::setprecision (3);
+  for (size_t i = 0; i < pairs_.size (); ++i)
+  {
+    const Pair &pair = pairs_[i];
+    file << wp2::csvField (pair.model) << "," << wp2::csvField (pair.scene) << "," << wp2::csvField (pair.model_label) << ","
+         << (pair.expected ? 1 : 0) << "," << pair.instances << "," << outcome (pair.expected, pair.instances > 0)
+         << "," << pair.ms << "\n";
+  }
+  return (!file.fail ());
+}
+
+bool
+wp2::Evaluator::appendSummary (const std::string &filename) const
+{
+  bool is_new;
+  {
+    std::ifstream existing (filename.c_str ());
+    is_new = !existing || existing.peek () == std::ifstream::traits_type::eof ();
+  }
+
+  std::ofstream file (filename.c_str (), std::ios::app);
+  if (!file)
+  {
+    return (false);
+  }
+  if (is_new)
+  {
+    file << "parameters,pairs,tp,fp,fn,tn,precision,recall,f1,mean_ms,p50_ms,p90_ms\n";
+  }
+
+  const Counts totals = getTotals ();
+  double mean, p50, p90;
+  timeStats (mean, p50, p90);
+  file << wp2::csvField (parameters_) << "," << pairs_.size () << "," << totals.tp << "," << totals.fp << ","
+       << totals.fn << "," << totals.tn << std::fixed << std::setprecision (4) << "," << totals.precision ()
+       << "," << totals.recall () << "," << totals.f1 () << std::setprecision (3) << "," << mean << "," << p50
+       << "," << p90 << "\n";
+  return (!file.fail ());
+}
+
+void
+wp2::Evaluator::printSummary (std::ostream &os) const
+{
+  const std::ios::fmtflags flags = os.flags ();
+  const std::streamsize precision = os.precision ();
+
+  if (!parameters_.empty ())
+  {
+    os << "Parameters: " << parameters_ << std::endl;
+  }
+  os << "Recognition quality over " << pairs_.size () << " pairs:" << std::endl;
+  os << std::left << std::setw (16) << "object" << std::right << std::setw (6) << "TP" << std::setw (6) << "FP"
+     << std::setw (6) << "FN" << std::setw (6) << "TN" << std::setw (11) << "precision" << std::setw (9) << "recall"
+     << std::setw (8) << "F1" << std::endl;
+  os << std::fixed << std::setprecision (3);
+
+  std::vector<std::string> rows;
+  for (size_t l = 0; l < labels_.size (); ++l)
+  {
+    if (per_label_.find (labels_[l]) != per_label_.end ())
+    {
+      rows.push_back (labels_[l]);
+    }
+  }
+  for (size_t r = 0; r <= rows.size (); ++r)
+  {
+    const bool total = r == rows.size ();
+    const Counts counts = total ? getTotals () : per_label_.find (rows[r])->second;
+    os << std::left << std::setw (16) << (total ? std::string ("all") : rows[r]) << std::right
+       << std::setw (6) << counts.tp << std::setw (6) << counts.fp << std::setw (6) << counts.fn
+       << std::setw (6) << counts.tn << std::setw (11) << counts.precision () << std::setw (9) << counts.recall ()
+       << std::setw (8) << counts.f1 () << std::endl;
+  }
+
+  double mean, p50, p90;
+  timeStats (mean, p50, p90);
+  os << std::setprecision (2) << "Pair time (ms): mean " << mean << ", p50 " << p50 << ", p90 " << p90 << std::endl;
+
+  //  Rows: object in the scene; columns: model found in it; last column: pairs run on such scenes
+  os << "Confusion matrix (scene object x model found):" << std::endl;
+  os << std::left << std::setw (16) << "" << std::right;
+  for (size_t m = 0; m < rows.size (); ++m)
+  {
+    os << std::setw (10) << rows[m].substr (0, 9);
+  }
+  os << std::setw (10) << "pairs" << std::endl;
+  for (size_t t = 0; t < labels_.size (); ++t)
+  {
+    std::map<std::string, long>::const_iterator pairs = truth_pairs_.find (labels_[t]);
+    if (pairs == truth_pairs_.end ())
+    {
+      continue;
+    }
+    std::map<std::string, std::map<std::string, long> >::const_iterator row = confusion_.find (labels_[t]);
+    os << std::left << std::setw (16) << labels_[t].substr (0, 15) << std::right;
+    for (size_t m = 0; m < rows.size (); ++m)
+    {
+      long count = 0;
+      if (row != confusion_.end ())
+      {
+        std::map<std::string, long>::const_iterator cell = row->second.find (rows[m]);
+        if (cell != row->second.end ())
+        {
+          count = cell->second;
+        }
+      }
+      os << std::setw (10) << count;
+    }
+    os << std::setw (10) << pairs->second << std::endl;
+  }
+
+  os.flags (flags);
+  os.precision (precision);
+}
@@ -0,0 +1,119 @@
+//GEOMETRIC CONSISTENCY CHECK
+//THE AVX PATH ONLY USES MUL / ADD / SUB / SQRT (NO FMA), SO THE NORMS AND THEIR DIFFERENCE ROUND EXACTLY AS THE
+//SCALAR ONES
+
+#include <wp2/recognition/geometric_consistency_kernel.h>
+#include <wp2/common/cpu_features.h>
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WP2_GC_AVX2 1
+#include <immintrin.h>
+#define WP2_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+void
+wp2::gc::ConsensusSet::clear ()
+{
+  sx.clear ();
+  sy.clear ();
+  sz.clear ();
+  mx.clear ();
+  my.clear ();
+  mz.clear ();
+}
+
+void
+wp2::gc::ConsensusSet::push_back (const float scene[3], const float model[3])
+{
+  sx.push_back (scene[0]);
+  sy.push_back (scene[1]);
+  sz.push_back (scene[2]);
+  mx.push_back (model[0]);
+  my.push_back (model[1]);
+  mz.push_back (model[2]);
+}
+
+bool
+wp2::gc::isConsistent (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size)
+{
+  if (set.size () >= 8 && wp2::hasAVX2 ())
+  {
+    return (isConsistentAVX2 (set, scene, model, gc_size));
+  }
+  return (isConsistentScalar (set, scene, model, gc_size));
+}
+
+bool
+wp2::gc::isConsistentScalar (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size, size_t first)
+{
+  for (size_t k = first; k < set.size (); ++k)
+  {
+    const float rx = set.sx[k] - scene[0], ry = set.sy[k] - scene[1], rz = set.sz[k] - scene[2];
+    const float tx = set.mx[k] - model[0], ty = set.my[k] - model[1], tz = set.mz[k] - model[2];
+    const float dist_ref = std::sqrt (rx * rx + ry * ry + rz * rz);
+    const float dist_trg = std::sqrt (tx * tx + ty * ty + tz * tz);
+
+    const double distance = std::fabs (dist_ref - dist_trg);
+    if (distance > gc_size)
+    {
+      return (false);
+    }
+  }
+  return (true);
+}
+
+#ifdef WP2_GC_AVX2
+
+namespace
+{
+  WP2_TARGET_AVX2 inline __m256
+  norm_ps (__m256 x, __m256 y, __m256 z)
+  {
+    return (_mm256_sqrt_ps (_mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (x, x), _mm256_mul_ps (y, y)), _mm256_mul_ps (z, z))));
+  }
+
+  WP2_TARGET_AVX2 inline int
+  exceeds (__m128 distance, __m256d gc_size)
+  {
+    return (_mm256_movemask_pd (_mm256_cmp_pd (_mm256_cvtps_pd (distance), gc_size, _CMP_GT_OQ)));
+  }
+}
+
+WP2_TARGET_AVX2 bool
+wp2::gc::isConsistentAVX2 (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size)
+{
+  const __m256 scene_x = _mm256_set1_ps (scene[0]), scene_y = _mm256_set1_ps (scene[1]), scene_z = _mm256_set1_ps (scene[2]);
+  const __m256 model_x = _mm256_set1_ps (model[0]), model_y = _mm256_set1_ps (model[1]), model_z = _mm256_set1_ps (model[2]);
+  const __m256d limit = _mm256_set1_pd (gc_size);
+
+  size_t k = 0;
+  for (; k + 8 <= set.size (); k += 8)
+  {
+    const __m256 dist_ref = norm_ps (_mm256_sub_ps (_mm256_loadu_ps (&set.sx[k]), scene_x),
+                                     _mm256_sub_ps (_mm256_loadu_ps (&set.sy[k]), scene_y),
+                                     _mm256_sub_ps (_mm256_loadu_ps (&set.sz[k]), scene_z));
+    const __m256 dist_trg = norm_ps (_mm256_sub_ps (_mm256_loadu_ps (&set.mx[k]), model_x),
+                                     _mm256_sub_ps (_mm256_loadu_ps (&set.my[k]), model_y),
+                                     _mm256_sub_ps (_mm256_loadu_ps (&set.mz[k]), model_z));
+
+    //  Difference in single precision, compared in double against gc_size
+    const __m256 distance = _mm256_andnot_ps (_mm256_set1_ps (-0.0f), _mm256_sub_ps (dist_ref, dist_trg));
+    if (exceeds (_mm256_castps256_ps128 (distance), limit) | exceeds (_mm256_extractf128_ps (distance, 1), limit))
+    {
+      return (false);
+    }
+  }
+  return (isConsistentScalar (set, scene, model, gc_size, k));
+}
+
+#else
+
+bool
+wp2::gc::isConsistentAVX2 (const ConsensusSet &set, const float scene[3], const float model[3], double gc_size)
+{
+  return (isConsistentScalar (set, scene, model, gc_size));
+}
+
+#endif
@@ -0,0 +1,706 @@
+//HIERARCHICAL NAVIGABLE SMALL WORLD GRAPH OVER DESCRIPTORS
+
+#include <wp2/search/hnsw_index.h>
+
+#include <pcl/console/print.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+  //  File layout: header, label names, then vectors, labels, ids, levels, bottom links, upper link offsets and
+  //  upper links, every section starting on a SECTION_ALIGNMENT boundary so the mapping can be read in place.
+  //  Version 2 added the descriptor parameters to the header.
+  const char MAGIC[8] = {'W', 'P', '2', 'H', 'N', 'S', 'W', '2'};
+  const size_t SECTION_ALIGNMENT = 64;
+
+  struct FileHeader
+  {
+    char magic[8];
+    long long dims;
+    long long stride;
+    long long neighbors;
+    long long ef_construction;
+    long long size;
+    long long entry;
+    long long max_level;
+    long long nr_labels;
+    long long upper_size;
+    double sampling_size;
+    double support_radius;
+  };
+
+  size_t
+  padding (size_t offset)
+  {
+    return ((SECTION_ALIGNMENT - offset % SECTION_ALIGNMENT) % SECTION_ALIGNMENT);
+  }
+
+  void
+  writeSection (std::ofstream &file, const void *data, size_t bytes, size_t &offset)
+  {
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    if (bytes > 0)
+    {
+      file.write (static_cast<const char *> (data), bytes);
+    }
+    offset += bytes;
+    const size_t pad = padding (offset);
+    file.write (zeros, pad);
+    offset += pad;
+  }
+
+  //  Start of the next section of the mapping, NULL past its end
+  const char *
+  readSection (const char *base, size_t map_size, size_t bytes, size_t &offset)
+  {
+    if (offset + bytes > map_size)
+    {
+      return (NULL);
+    }
+    const char *section = base + offset;
+    offset += bytes;
+    offset += padding (offset);
+    return (section);
+  }
+}
+
+wp2::search::HNSWIndex::HNSWIndex (size_t dims, int neighbors, int ef_construction, unsigned int seed)
+  : dims_ (dims)
+  , stride_ ((dims + wp2::DescriptorMatrix::ALIGNMENT_FLOATS - 1) / wp2::DescriptorMatrix::ALIGNMENT_FLOATS *
+             wp2::DescriptorMatrix::ALIGNMENT_FLOATS)
+  , neighbors_ (std::max (neighbors, 2))
+  , max_links0_ (2 * std::max (neighbors, 2))
+  , ef_construction_ (std::max (ef_construction, 1))
+  , ef_search_ (64)
+  , level_mult_ (1.0 / std::log (static_cast<double> (std::max (neighbors, 2))))
+  , rng_ (seed)
+  , sampling_size_ (0.0f)
+  , support_radius_ (0.0f)
+  , size_ (0)
+  , entry_ (-1)
+  , max_level_ (-1)
+  , mapped_ (false)
+  , map_base_ (NULL)
+  , map_size_ (0)
+  , map_vectors_ (NULL)
+  , map_labels_ (NULL)
+  , map_ids_ (NULL)
+  , map_levels_ (NULL)
+  , map_links0_ (NULL)
+  , map_upper_offsets_ (NULL)
+  , map_upper_links_ (NULL)
+  , visited_tag_ (0)
+{
+}
+
+wp2::search::HNSWIndex::~HNSWIndex ()
+{
+  unmap ();
+}
+
+int
+wp2::search::HNSWIndex::addLabel (const std::string &name)
+{
+  label_names_.push_back (name);
+  return (static_cast<int> (label_names_.size ()) - 1);
+}
+
+int
+wp2::search::HNSWIndex::findLabel (const std::string &name) const
+{
+  std::vector<std::string>::const_iterator found = std::find (label_names_.begin (), label_names_.end (), name);
+  return (found == label_names_.end () ? -1 : static_cast<int> (found - label_names_.begin ()));
+}
+
+const int *
+wp2::search::HNSWIndex::links (int node, int level) const
+{
+  if (level == 0)
+  {
+    return ((mapped_ ? map_links0_ : &links0_[0]) + static_cast<size_t> (node) * (max_links0_ + 1));
+  }
+  const size_t offset = static_cast<size_t> (level - 1) * (neighbors_ + 1);
+  if (mapped_)
+  {
+    return (map_upper_links_ + map_upper_offsets_[node] + offset);
+  }
+  return (&upper_links_[node][offset]);
+}
+
+int *
+wp2::search::HNSWIndex::mutableLinks (int node, int level)
+{
+  if (level == 0)
+  {
+    return (&links0_[static_cast<size_t> (node) * (max_links0_ + 1)]);
+  }
+  return (&upper_links_[node][static_cast<size_t> (level - 1) * (neighbors_ + 1)]);
+}
+
+float
+wp2::search::HNSWIndex::distance (const float *a, const float *b) const
+{
+  //  Four independent sums so the compiler can keep several vector lanes busy
+  float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+  size_t i = 0;
+  for (; i + 4 <= dims_; i += 4)
+  {
+    const float d0 = a[i] - b[i];
+    const float d1 = a[i + 1] - b[i + 1];
+    const float d2 = a[i + 2] - b[i + 2];
+    const float d3 = a[i + 3] - b[i + 3];
+    sum0 += d0 * d0;
+    sum1 += d1 * d1;
+    sum2 += d2 * d2;
+    sum3 += d3 * d3;
+  }
+  for (; i < dims_; ++i)
+  {
+    const float d = a[i] - b[i];
+    sum0 += d * d;
+  }
+  return ((sum0 + sum1) + (sum2 + sum3));
+}
+
+int
+wp2::search::HNSWIndex::greedySearch (const float *query, int entry, float &entry_dist, int level) const
+{
+  bool moved = true;
+  while (moved)
+  {
+    moved = false;
+    const int *node_links = links (entry, level);
+    for (int j = 1; j <= node_links[0]; ++j)
+    {
+      const float sqr_dist = distance (query, vector (node_links[j]));
+      if (sqr_dist < entry_dist)
+      {
+        entry_dist = sqr_dist;
+        entry = node_links[j];
+        moved = true;
+      }
+    }
+  }
+  return (entry);
+}
+
+void
+wp2::search::HNSWIndex::searchLayer (const float *query, int entry, float entry_dist, size_t ef, int level,
+                                     std::vector<unsigned int> &visited, unsigned int &tag,
+                                     std::vector<Candidate> &result) const
+{
+  //  Tags instead of clearing the visited flags on every call
+  if (++tag == 0)
+  {
+    std::fill (visited.begin (), visited.end (), 0);
+    tag = 1;
+  }
+
+  std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > frontier;  // closest on top
+  std::priority_queue<Candidate> best;                                                       // farthest on top
+  visited[entry] = tag;
+  frontier.push (Candidate (entry_dist, entry));
+  best.push (Candidate (entry_dist, entry));
+
+  while (!frontier.empty ())
+  {
+    const Candidate current = frontier.top ();
+    if (current.first > best.top ().first && best.size () >= ef)
+    {
+      break;
+    }
+    frontier.pop ();
+
+    const int *node_links = links (current.second, level);
+    for (int j = 1; j <= node_links[0]; ++j)
+    {
+      const int neighbour = node_links[j];
+      if (visited[neighbour] == tag)
+      {
+        continue;
+      }
+      visited[neighbour] = tag;
+
+      const float sqr_dist = distance (query, vector (neighbour));
+      if (best.size () < ef || sqr_dist < best.top ().first)
+      {
+        frontier.push (Candidate (sqr_dist, neighbour));
+        best.push (Candidate (sqr_dist, neighbour));
+        if (best.size () > ef)
+        {
+          best.pop ();
+        }
+      }
+    }
+  }
+
+  result.resize (best.size ());
+  for (size_t i = best.size (); i > 0; --i)
+  {
+    result[i - 1] = best.top ();
+    best.pop ();
+  }
+}
+
+void
+wp2::search::HNSWIndex::selectNeighbors (std::vector<Candidate> &candidates, size_t max_links) const
+{
+  if (candidates.size () <= max_links)
+  {
+    return;
+  }
+
+  //  A candidate closer to an already kept neighbour than to the base is reached through it; skipping it keeps
+  //  links pointing in different directions, which is what keeps the graph navigable on clustered data
+  std::vector<Candidate> selected;
+  selected.reserve (max_links);
+  for (size_t i = 0; i < candidates.size () && selected.size () < max_links; ++i)
+  {
+    bool keep = true;
+    for (size_t j = 0; j < selected.size (); ++j)
+    {
+      if (distance (vector (candidates[i].second), vector (selected[j].second)) < candidates[i].first)
+      {
+        keep = false;
+        break;
+      }
+    }
+    if (keep)
+    {
+      selected.push_back (candidates[i]);
+    }
+  }
+  candidates.swap (selected);
+}
+
+void
+wp2::search::HNSWIndex::connect (int neighbour, int node, float sqr_dist, int level)
+{
+  int *neighbour_links = mutableLinks (neighbour, level);
+  const int max_links = level == 0 ? max_links0_ : neighbors_;
+  if (neighbour_links[0] < max_links)
+  {
+    neighbour_links[++neighbour_links[0]] = node;
+    return;
+  }
+
+  //  Full: keep the best spread of the old links and the new one, seen from the neighbour
+  std::vector<Candidate> candidates;
+  candidates.reserve (max_links + 1);
+  candidates.push_back (Candidate (sqr_dist, node));
+  const float *base = vector (neighbour);
+  for (int j = 1; j <= neighbour_links[0]; ++j)
+  {
+    candidates.push_back (Candidate (distance (base, vector (neighbour_links[j])), neighbour_links[j]));
+  }
+  std::sort (candidates.begin (), candidates.end ());
+  selectNeighbors (candidates, max_links);
+
+  neighbour_links[0] = static_cast<int> (candidates.size ());
+  for (size_t j = 0; j < candidates.size (); ++j)
+  {
+    neighbour_links[j + 1] = candidates[j].second;
+  }
+}
+
+void
+wp2::search::HNSWIndex::insert (const float *descriptor, int label, int id)
+{
+  detach ();
+
+  //  Exponentially decaying level, as in the skip list the layers generalize
+  const double uniform = (static_cast<double> (rng_ ()) + 0.5) / 4294967296.0;
+  const int level = static_cast<int> (-std::log (uniform) * level_mult_);
+  const int node = static_cast<int> (size_);
+
+  vectors_.resize ((size_ + 1) * stride_, 0.0f);
+  std::memcpy (&vectors_[size_ * stride_], descriptor, dims_ * sizeof (float));
+  labels_.push_back (label);
+  ids_.push_back (id);
+  levels_.push_back (level);
+  links0_.resize ((size_ + 1) * (max_links0_ + 1), 0);
+  upper_links_.push_back (std::vector<int> (static_cast<size_t> (level) * (neighbors_ + 1), 0));
+  visited_.push_back (0);
+  ++size_;
+
+  if (node == 0)
+  {
+    entry_ = node;
+    max_level_ = level;
+    return;
+  }
+
+  const float *query = vector (node);
+  int current = entry_;
+  float current_dist = distance (query, vector (current));
+  for (int l = max_level_; l > level; --l)
+  {
+    current = greedySearch (query, current, current_dist, l);
+  }
+
+  std::vector<Candidate> candidates;
+  for (int l = std::min (level, max_level_); l >= 0; --l)
+  {
+    searchLayer (query, current, current_dist, ef_construction_, l, visited_, visited_tag_, candidates);
+    current = candidates[0].second;
+    current_dist = candidates[0].first;
+
+    selectNeighbors (candidates, neighbors_);
+    int *node_links = mutableLinks (node, l);
+    node_links[0] = static_cast<int> (candidates.size ());
+    for (size_t j = 0; j < candidates.size (); ++j)
+    {
+      node_links[j + 1] = candidates[j].second;
+      connect (candidates[j].second, node, candidates[j].first, l);
+    }
+  }
+
+  if (level > max_level_)
+  {
+    entry_ = node;
+    max_level_ = level;
+  }
+}
+
+void
+wp2::search::HNSWIndex::insert (const wp2::DescriptorMatrix &matrix, int label)
+{
+  if (matrix.dims () != dims_)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::insert] Error! Descriptors have %zu dimensions, the index %zu.\n",
+               matrix.dims (), dims_);
+    return;
+  }
+  for (size_t i = 0; i < matrix.rows (); ++i)
+  {
+    if (matrix.isValid (i))
+    {
+      insert (matrix.row (i), label, static_cast<int> (matrix.getIndex (i)));
+    }
+  }
+}
+
+size_t
+wp2::search::HNSWIndex::knnSearch (const wp2::DescriptorMatrix &queries, size_t k, std::vector<int> &indices,
+                                   std::vector<float> &sqr_dists, unsigned int nr_threads) const
+{
+  k = std::min (k, size_);
+  const int nr_queries = static_cast<int> (queries.rows ());
+  indices.assign (queries.rows () * k, -1);
+  sqr_dists.assign (queries.rows () * k, std::numeric_limits<float>::max ());
+  if (k == 0 || nr_queries == 0)
+  {
+    return (k);
+  }
+  if (queries.dims () != dims_)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::knnSearch] Error! Descriptors have %zu dimensions, the index %zu.\n",
+               queries.dims (), dims_);
+    return (k);
+  }
+
+  const size_t ef = std::max (k, static_cast<size_t> (std::max (ef_search_, 1)));
+
+#ifdef _OPENMP
+  int threads = nr_threads == 0 ? omp_get_num_procs () : static_cast<int> (nr_threads);
+#pragma omp parallel num_threads (threads)
+#endif
+  {
+    //  Per thread, so queries never share search state
+    std::vector<unsigned int> visited (size_, 0);
+    unsigned int tag = 0;
+    std::vector<Candidate> result;
+
+#ifdef _OPENMP
+#pragma omp for schedule (dynamic, 16)
+#endif
+    for (int q = 0; q < nr_queries; ++q)
+    {
+      const float *query = queries.row (q);
+      int current = entry_;
+      float current_dist = distance (query, vector (current));
+      for (int l = max_level_; l > 0; --l)
+      {
+        current = greedySearch (query, current, current_dist, l);
+      }
+      searchLayer (query, current, current_dist, ef, 0, visited, tag, result);
+
+      const size_t found = std::min (k, result.size ());
+      for (size_t j = 0; j < found; ++j)
+      {
+        indices[q * k + j] = result[j].second;
+        sqr_dists[q * k + j] = result[j].first;
+      }
+    }
+  }
+  return (k);
+}
+
+bool
+wp2::search::HNSWIndex::save (const std::string &filename) const
+{
+  std::ofstream file (filename.c_str (), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::save] Error! Cannot write %s.\n", filename.c_str ());
+    return (false);
+  }
+
+  //  Upper layers flattened behind per node offsets, whether they live in memory or in a mapping
+  std::vector<long long> upper_offsets (size_ + 1, 0);
+  for (size_t i = 0; i < size_; ++i)
+  {
+    upper_offsets[i + 1] = upper_offsets[i] + static_cast<long long> (levelData ()[i]) * (neighbors_ + 1);
+  }
+
+  FileHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, MAGIC, sizeof (MAGIC));
+  header.dims = static_cast<long long> (dims_);
+  header.stride = static_cast<long long> (stride_);
+  header.neighbors = neighbors_;
+  header.ef_construction = ef_construction_;
+  header.size = static_cast<long long> (size_);
+  header.entry = entry_;
+  header.max_level = max_level_;
+  header.nr_labels = static_cast<long long> (label_names_.size ());
+  header.upper_size = upper_offsets[size_];
+  header.sampling_size = sampling_size_;
+  header.support_radius = support_radius_;
+
+  size_t offset = 0;
+  writeSection (file, &header, sizeof (header), offset);
+
+  std::string names;
+  for (size_t i = 0; i < label_names_.size (); ++i)
+  {
+    const long long length = static_cast<long long> (label_names_[i].size ());
+    names.append (reinterpret_cast<const char *> (&length), sizeof (length));
+    names.append (label_names_[i]);
+  }
+  writeSection (file, names.data (), names.size (), offset);
+
+  if (size_ > 0)
+  {
+    writeSection (file, vector (0), size_ * stride_ * sizeof (float), offset);
+    writeSection (file, labelData (), size_ * sizeof (int), offset);
+    writeSection (file, idData (), size_ * sizeof (int), offset);
+    writeSection (file, levelData (), size_ * sizeof (int), offset);
+    writeSection (file, links (0, 0), size_ * (max_links0_ + 1) * sizeof (int), offset);
+    writeSection (file, &upper_offsets[0], upper_offsets.size () * sizeof (long long), offset);
+    for (size_t i = 0; i < size_; ++i)
+    {
+      for (int l = 1; l <= levelData ()[i]; ++l)
+      {
+        file.write (reinterpret_cast<const char *> (links (static_cast<int> (i), l)), (neighbors_ + 1) * sizeof (int));
+      }
+    }
+  }
+
+  if (!file)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::save] Error! Writing %s failed.\n", filename.c_str ());
+    return (false);
+  }
+  return (true);
+}
+
+bool
+wp2::search::HNSWIndex::load (const std::string &filename, float sampling_size, float support_radius)
+{
+  clear ();
+
+  const int fd = open (filename.c_str (), O_RDONLY);
+  if (fd < 0)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! Cannot open %s.\n", filename.c_str ());
+    return (false);
+  }
+  struct stat info;
+  if (fstat (fd, &info) != 0 || info.st_size < static_cast<off_t> (sizeof (FileHeader)))
+  {
+    close (fd);
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! %s is not an index.\n", filename.c_str ());
+    return (false);
+  }
+  const size_t map_size = static_cast<size_t> (info.st_size);
+  void *base = mmap (NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+  {
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! Cannot map %s.\n", filename.c_str ());
+    return (false);
+  }
+  //  Graph walks touch the file all over
+  madvise (base, map_size, MADV_RANDOM);
+
+  const char *bytes = static_cast<const char *> (base);
+  FileHeader header;
+  std::memcpy (&header, bytes, sizeof (header));
+  if (std::memcmp (header.magic, MAGIC, sizeof (MAGIC) - 1) == 0 && header.magic[7] != MAGIC[7])
+  {
+    munmap (base, map_size);
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! %s was written by another version of the index, rebuild it.\n",
+               filename.c_str ());
+    return (false);
+  }
+  bool valid = std::memcmp (header.magic, MAGIC, sizeof (MAGIC)) == 0 && header.dims > 0 &&
+               header.stride >= header.dims && header.neighbors >= 2 && header.size >= 0 && header.nr_labels >= 0 &&
+               header.upper_size >= 0;
+
+  size_t offset = sizeof (header);
+  offset += padding (offset);
+  std::vector<std::string> names;
+  for (long long i = 0; valid && i < header.nr_labels; ++i)
+  {
+    long long length = 0;
+    if (offset + sizeof (length) > map_size)
+    {
+      valid = false;
+      break;
+    }
+    std::memcpy (&length, bytes + offset, sizeof (length));
+    offset += sizeof (length);
+    if (length < 0 || offset + static_cast<size_t> (length) > map_size)
+    {
+      valid = false;
+      break;
+    }
+    names.push_back (std::string (bytes + offset, static_cast<size_t> (length)));
+    offset += static_cast<size_t> (length);
+  }
+  offset += padding (offset);
+
+  const size_t size = valid ? static_cast<size_t> (header.size) : 0;
+  const size_t stride = valid ? static_cast<size_t> (header.stride) : 0;
+  const size_t max_links0 = valid ? 2 * static_cast<size_t> (header.neighbors) : 0;
+  const char *vectors = NULL, *labels = NULL, *ids = NULL, *levels = NULL, *links0 = NULL, *upper_offsets = NULL,
+             *upper_links = NULL;
+  if (valid && size > 0)
+  {
+    vectors = readSection (bytes, map_size, size * stride * sizeof (float), offset);
+    labels = readSection (bytes, map_size, size * sizeof (int), offset);
+    ids = readSection (bytes, map_size, size * sizeof (int), offset);
+    levels = readSection (bytes, map_size, size * sizeof (int), offset);
+    links0 = readSection (bytes, map_size, size * (max_links0 + 1) * sizeof (int), offset);
+    upper_offsets = readSection (bytes, map_size, (size + 1) * sizeof (long long), offset);
+    upper_links = readSection (bytes, map_size, static_cast<size_t> (header.upper_size) * sizeof (int), offset);
+    valid = vectors != NULL && labels != NULL && ids != NULL && levels != NULL && links0 != NULL &&
+            upper_offsets != NULL && upper_links != NULL && header.entry >= 0 && header.entry < header.size;
+  }
+  if (!valid)
+  {
+    munmap (base, map_size);
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! %s is not an index or is truncated.\n", filename.c_str ());
+    return (false);
+  }
+  if ((sampling_size != 0.0f && static_cast<float> (header.sampling_size) != sampling_size) ||
+      (support_radius != 0.0f && static_cast<float> (header.support_radius) != support_radius))
+  {
+    munmap (base, map_size);
+    PCL_ERROR ("[wp2::search::HNSWIndex::load] Error! %s holds descriptors of sampling size %g and radius %g, not %g "
+               "and %g.\n", filename.c_str (), header.sampling_size, header.support_radius, sampling_size, support_radius);
+    return (false);
+  }
+
+  dims_ = static_cast<size_t> (header.dims);
+  stride_ = stride;
+  neighbors_ = static_cast<int> (header.neighbors);
+  max_links0_ = static_cast<int> (max_links0);
+  ef_construction_ = static_cast<int> (header.ef_construction);
+  level_mult_ = 1.0 / std::log (static_cast<double> (neighbors_));
+  sampling_size_ = static_cast<float> (header.sampling_size);
+  support_radius_ = static_cast<float> (header.support_radius);
+  size_ = size;
+  entry_ = size > 0 ? static_cast<int> (header.entry) : -1;
+  max_level_ = size > 0 ? static_cast<int> (header.max_level) : -1;
+  label_names_.swap (names);
+
+  mapped_ = true;
+  map_base_ = base;
+  map_size_ = map_size;
+  map_vectors_ = reinterpret_cast<const float *> (vectors);
+  map_labels_ = reinterpret_cast<const int *> (labels);
+  map_ids_ = reinterpret_cast<const int *> (ids);
+  map_levels_ = reinterpret_cast<const int *> (levels);
+  map_links0_ = reinterpret_cast<const int *> (links0);
+  map_upper_offsets_ = reinterpret_cast<const long long *> (upper_offsets);
+  map_upper_links_ = reinterpret_cast<const int *> (upper_links);
+  return (true);
+}
+
+void
+wp2::search::HNSWIndex::clear ()
+{
+  unmap ();
+  size_ = 0;
+  entry_ = -1;
+  max_level_ = -1;
+  label_names_.clear ();
+  vectors_.clear ();
+  labels_.clear ();
+  ids_.clear ();
+  levels_.clear ();
+  links0_.clear ();
+  upper_links_.clear ();
+  visited_.clear ();
+  visited_tag_ = 0;
+}
+
+void
+wp2::search::HNSWIndex::detach ()
+{
+  if (!mapped_)
+  {
+    return;
+  }
+
+  vectors_.assign (map_vectors_, map_vectors_ + size_ * stride_);
+  labels_.assign (map_labels_, map_labels_ + size_);
+  ids_.assign (map_ids_, map_ids_ + size_);
+  levels_.assign (map_levels_, map_levels_ + size_);
+  links0_.assign (map_links0_, map_links0_ + size_ * (max_links0_ + 1));
+  upper_links_.resize (size_);
+  for (size_t i = 0; i < size_; ++i)
+  {
+    upper_links_[i].assign (map_upper_links_ + map_upper_offsets_[i], map_upper_links_ + map_upper_offsets_[i + 1]);
+  }
+  visited_.assign (size_, 0);
+  visited_tag_ = 0;
+  unmap ();
+}
+
+void
+wp2::search::HNSWIndex::unmap ()
+{
+  if (map_base_ != NULL)
+  {
+    munmap (map_base_, map_size_);
+  }
+  mapped_ = false;
+  map_base_ = NULL;
+  map_size_ = 0;
+  map_vectors_ = NULL;
+  map_labels_ = NULL;
+  map_ids_ = NULL;
+  map_levels_ = NULL;
+  map_links0_ = NULL;
+  map_upper_offsets_ = NULL;
+  map_upper_links_ = NULL;
+}
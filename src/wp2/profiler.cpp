@@ -0,0 +1,297 @@
+//PER-STAGE TIMERS AND COUNTERS FOR THE RECOGNITION BINARIES
+
+#include <wp2/common/profiler.h>
+#include <wp2/common/csv.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <time.h>
+
+namespace
+{
+  void
+  addName (std::vector<std::string> &names, const std::string &name)
+  {
+    if (std::find (names.begin (), names.end (), name) == names.end ())
+    {
+      names.push_back (name);
+    }
+  }
+
+  //  Nearest-rank percentile of sorted values
+  double
+  percentile (const std::vector<double> &sorted, double p)
+  {
+    size_t rank = static_cast<size_t> (std::ceil (p / 100.0 * static_cast<double> (sorted.size ())));
+    if (rank > 0)
+    {
+      --rank;
+    }
+    return (sorted[std::min (rank, sorted.size () - 1)]);
+  }
+
+  std::string
+  jsonString (const std::string &str)
+  {
+    std::string quoted ("\"");
+    for (size_t i = 0; i < str.size (); ++i)
+    {
+      const char c = str[i];
+      if (c == '"' || c == '\\')
+      {
+        quoted += '\\';
+        quoted += c;
+      }
+      else if (static_cast<unsigned char> (c) < 0x20)
+      {
+        char escaped[8];
+        std::sprintf (escaped, "\\u%04x", static_cast<int> (c));
+        quoted += escaped;
+      }
+      else
+      {
+        quoted += c;
+      }
+    }
+    return (quoted + "\"");
+  }
+}
+
+double
+wp2::Profiler::now ()
+{
+  timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (static_cast<double> (ts.tv_sec) * 1e3 + static_cast<double> (ts.tv_nsec) * 1e-6);
+}
+
+void
+wp2::Profiler::beginPair (const std::string &model, const std::string &scene)
+{
+  if (!enabled_)
+  {
+    return;
+  }
+  if (open_)
+  {
+    endPair ();
+  }
+
+  Record record;
+  record.model = model;
+  record.scene = scene;
+  records_.push_back (record);
+  open_ = true;
+  pair_start_ = now ();
+}
+
+void
+wp2::Profiler::endPair ()
+{
+  if (!enabled_ || !open_)
+  {
+    return;
+  }
+  records_.back ().times["total"] = now () - pair_start_;
+  open_ = false;
+}
+
+void
+wp2::Profiler::addTime (const std::string &stage, double ms)
+{
+  if (!enabled_ || !open_)
+  {
+    return;
+  }
+  addName (stages_, stage);
+  records_.back ().times[stage] += ms;
+}
+
+void
+wp2::Profiler::setCount (const std::string &counter, long value)
+{
+  if (!enabled_ || !open_)
+  {
+    return;
+  }
+  addName (counters_, counter);
+  records_.back ().counts[counter] = value;
+}
+
+wp2::Profiler::Stats
+wp2::Profiler::computeStats (const std::string &stage) const
+{
+  std::vector<double> values;
+  values.reserve (records_.size ());
+  for (size_t i = 0; i < records_.size (); ++i)
+  {
+    std::map<std::string, double>::const_iterator it = records_[i].times.find (stage);
+    if (it != records_[i].times.end ())
+    {
+      values.push_back (it->second);
+    }
+  }
+
+  Stats stats;
+  if (values.empty ())
+  {
+    return (stats);
+  }
+  std::sort (values.begin (), values.end ());
+
+  double sum = 0.0;
+  for (size_t i = 0; i < values.size (); ++i)
+  {
+    sum += values[i];
+  }
+  stats.n = values.size ();
+  stats.mean = sum / static_cast<double> (values.size ());
+  stats.p50 = percentile (values, 50.0);
+  stats.p90 = percentile (values, 90.0);
+  stats.p99 = percentile (values, 99.0);
+  stats.max = values.back ();
+  return (stats);
+}
+
+void
+wp2::Profiler::writeCSV (std::ostream &os) const
+{
+  os << "model,scene";
+  for (size_t s = 0; s < stages_.size (); ++s)
+  {
+    os << "," << wp2::csvField (stages_[s]) << "_ms";
+  }
+  os << ",total_ms";
+  for (size_t c = 0; c < counters_.size (); ++c)
+  {
+    os << "," << wp2::csvField (counters_[c]);
+  }
+  os << "\n";
+
+  os << std::fixed << std::setprecision (3);
+  for (size_t i = 0; i < records_.size (); ++i)
+  {
+    const Record &record = records_[i];
+    os << wp2::csvField (record.model) << "," << wp2::csvField (record.scene);
+
+    //  Stages a pair did not run are left empty
+    for (size_t s = 0; s < stages_.size (); ++s)
+    {
+      os << ",";
+      std::map<std::string, double>::const_iterator it = record.times.find (stages_[s]);
+      if (it != record.times.end ())
+      {
+        os << it->second;
+      }
+    }
+    os << ",";
+    std::map<std::string, double>::const_iterator total = record.times.find ("total");
+    if (total != record.times.end ())
+    {
+      os << total->second;
+    }
+    for (size_t c = 0; c < counters_.size (); ++c)
+    {
+      os << ",";
+      std::map<std::string, long>::const_iterator it = record.counts.find (counters_[c]);
+      if (it != record.counts.end ())
+      {
+        os << it->second;
+      }
+    }
+    os << "\n";
+  }
+}
+
+void
+wp2::Profiler::writeJSON (std::ostream &os) const
+{
+  os << std::fixed << std::setprecision (3);
+  os << "{\n  \"pairs\": [";
+  for (size_t i = 0; i < records_.size (); ++i)
+  {
+    const Record &record = records_[i];
+    os << (i == 0 ? "\n" : ",\n");
+    os << "    {\"model\": " << jsonString (record.model) << ", \"scene\": " << jsonString (record.scene);
+
+    os << ", \"times_ms\": {";
+    bool first = true;
+    for (std::map<std::string, double>::const_iterator it = record.times.begin (); it != record.times.end (); ++it)
+    {
+      os << (first ? "" : ", ") << jsonString (it->first) << ": " << it->second;
+      first = false;
+    }
+
+    os << "}, \"counts\": {";
+    first = true;
+    for (std::map<std::string, long>::const_iterator it = record.counts.begin (); it != record.counts.end (); ++it)
+    {
+      os << (first ? "" : ", ") << jsonString (it->first) << ": " << it->second;
+      first = false;
+    }
+    os << "}}";
+  }
+  os << "\n  ],\n  \"summary\": {";
+
+  std::vector<std::string> stages (stages_);
+  stages.push_back ("total");
+  for (size_t s = 0; s < stages.size (); ++s)
+  {
+    const Stats stats = computeStats (stages[s]);
+    os << (s == 0 ? "\n" : ",\n");
+    os << "    " << jsonString (stages[s]) << ": {\"n\": " << stats.n << ", \"mean\": " << stats.mean
+       << ", \"p50\": " << stats.p50 << ", \"p90\": " << stats.p90 << ", \"p99\": " << stats.p99
+       << ", \"max\": " << stats.max << "}";
+  }
+  os << "\n  }\n}\n";
+}
+
+bool
+wp2::Profiler::write (const std::string &filename) const
+{
+  std::ofstream file (filename.c_str ());
+  if (!file)
+  {
+    return (false);
+  }
+
+  const std::string json (".json");
+  if (filename.size () >= json.size () && filename.compare (filename.size () - json.size (), json.size (), json) == 0)
+  {
+    writeJSON (file);
+  }
+  else
+  {
+    writeCSV (file);
+  }
+  return (!file.fail ());
+}
+
+void
+wp2::Profiler::printSummary (std::ostream &os) const
+{
+  std::vector<std::string> stages (stages_);
+  stages.push_back ("total");
+
+  const std::ios::fmtflags flags = os.flags ();
+  const std::streamsize precision = os.precision ();
+
+  os << "Stage timings over " << records_.size () << " pairs (ms):" << std::endl;
+  os << std::left << std::setw (14) << "stage" << std::right
+     << std::setw (7) << "n" << std::setw (11) << "mean" << std::setw (11) << "p50"
+     << std::setw (11) << "p90" << std::setw (11) << "p99" << std::setw (11) << "max" << std::endl;
+  os << std::fixed << std::setprecision (2);
+  for (size_t s = 0; s < stages.size (); ++s)
+  {
+    const Stats stats = computeStats (stages[s]);
+    os << std::left << std::setw (14) << stages[s] << std::right
+       << std::setw (7) << stats.n << std::setw (11) << stats.mean << std::setw (11) << stats.p50
+       << std::setw (11) << stats.p90 << std::setw (11) << stats.p99 << std::setw (11) << stats.max << std::endl;
+  }
+
+  os.flags (flags);
+  os.precision (precision);
+}
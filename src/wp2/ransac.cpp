@@ -0,0 +1,736 @@
+//PARALLEL RANSAC FOR PLANES, CYLINDERS AND SPHERES
+
+#include <wp2/segmentation/ransac.h>
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <Eigen/Dense>
+
+#include <cmath>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+  //  Points whose distances are computed at once, and the SPRT step
+  const size_t kBlock = 256;
+
+  //  Hypotheses per parallel batch; fixed, so the result does not depend on the thread count
+  const int kBatch = 64;
+
+  //  Cost of fitting a hypothesis in point evaluations, for the SPRT threshold
+  const double kFitCost = 200.0;
+}
+
+void
+wp2::SACPoints::erase (const std::vector<int> &positions)
+{
+  size_t kept = 0;
+  size_t next = 0;
+  for (size_t i = 0; i < indices.size (); ++i)
+  {
+    if (next < positions.size () && positions[next] == static_cast<int> (i))
+    {
+      ++next;
+      continue;
+    }
+    indices[kept] = indices[i];
+    x[kept] = x[i];
+    y[kept] = y[i];
+    z[kept] = z[i];
+    if (hasNormals ())
+    {
+      nx[kept] = nx[i];
+      ny[kept] = ny[i];
+      nz[kept] = nz[i];
+      curvature[kept] = curvature[i];
+    }
+    ++kept;
+  }
+  indices.resize (kept);
+  x.resize (kept);
+  y.resize (kept);
+  z.resize (kept);
+  if (hasNormals ())
+  {
+    nx.resize (kept);
+    ny.resize (kept);
+    nz.resize (kept);
+    curvature.resize (kept);
+  }
+}
+
+wp2::ParallelRansac::ParallelRansac (unsigned int nr_threads)
+  : model_ (MODEL_PLANE)
+  , threshold_ (0.01f)
+  , normal_weight_ (0.0f)
+  , min_radius_ (0.0f)
+  , max_radius_ (std::numeric_limits<float>::max ())
+  , max_iterations_ (1000)
+  , probability_ (0.99)
+  , early_exit_ (EARLY_EXIT_SPRT)
+  , min_inlier_ratio_ (0.0)
+  , pretest_size_ (1)
+  , optimize_ (true)
+  , threads_ (nr_threads)
+  , seed_ (1)
+  , epsilon_ (0.1)
+  , delta_ (0.01)
+  , log_a_ (0.0)
+  , iterations_ (0)
+  , rejected_ (0)
+{
+}
+
+int
+wp2::ParallelRansac::sampleSize () const
+{
+  switch (model_)
+  {
+    case MODEL_CYLINDER:
+      return (2);
+    case MODEL_SPHERE:
+      return (4);
+    default:
+      return (3);
+  }
+}
+
+bool
+wp2::ParallelRansac::computeModel (const SACPoints &points, std::vector<float> &coefficients)
+{
+  iterations_ = 0;
+  rejected_ = 0;
+  coefficients.clear ();
+  const int sample_size = sampleSize ();
+  const size_t n = points.size ();
+  if (n < static_cast<size_t> (sample_size) || max_iterations_ <= 0 || (model_ == MODEL_CYLINDER && !points.hasNormals ()))
+  {
+    return (false);
+  }
+
+#ifdef _OPENMP
+  int nr_threads = threads_ == 0 ? omp_get_num_procs () : static_cast<int> (threads_);
+#endif
+
+  boost::mt19937 rng (seed_);
+  //  Without a guess of epsilon, delta is 0 too and the SPRT stays off until a first model gives one
+  epsilon_ = std::min (std::max (min_inlier_ratio_, 0.0), 1.0);
+  delta_ = std::min (0.01, 0.5 * epsilon_);
+  updateSPRT ();
+  double rejected_inliers = 0.0, rejected_checked = 0.0;
+
+  const int pretest_size = early_exit_ == EARLY_EXIT_TDD ? std::max (pretest_size_, 0) : 0;
+  std::vector<Hypothesis> hypotheses (kBatch);
+  std::vector<int> samples (kBatch * sample_size);
+  std::vector<int> pretests (kBatch * pretest_size);
+  int best_score = -1;
+  float best[7];
+  int bound = max_iterations_;
+
+  while (iterations_ < bound)
+  {
+    //  Samples drawn serially; a sample with a repeated point is degenerate and still counts as an iteration
+    const int batch = std::min (kBatch, bound - iterations_);
+    for (int h = 0; h < batch; ++h)
+    {
+      int *sample = &samples[h * sample_size];
+      hypotheses[h].valid = true;
+      for (int s = 0; s < sample_size; ++s)
+      {
+        sample[s] = static_cast<int> (rng () % n);
+        for (int t = 0; t < s; ++t)
+        {
+          hypotheses[h].valid = hypotheses[h].valid && sample[t] != sample[s];
+        }
+      }
+      for (int s = 0; s < pretest_size; ++s)
+      {
+        pretests[h * pretest_size + s] = static_cast<int> (rng () % n);
+      }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads (nr_threads) schedule (dynamic, 1)
+#endif
+    for (int h = 0; h < batch; ++h)
+    {
+      Hypothesis &hypothesis = hypotheses[h];
+      hypothesis.score = -1;
+      hypothesis.checked = 0;
+      hypothesis.seen = 0;
+      if (hypothesis.valid && fit (points, &samples[h * sample_size], hypothesis.c))
+      {
+        score (points, pretest_size > 0 ? &pretests[h * pretest_size] : NULL, pretest_size, hypothesis);
+      }
+      else
+      {
+        hypothesis.valid = false;
+      }
+    }
+
+    //  Most inliers, first drawn on ties
+    bool improved = false;
+    for (int h = 0; h < batch; ++h)
+    {
+      ++iterations_;
+      const Hypothesis &hypothesis = hypotheses[h];
+      if (!hypothesis.valid)
+      {
+        continue;
+      }
+      if (hypothesis.score < 0)
+      {
+        ++rejected_;
+        rejected_inliers += hypothesis.seen;
+        rejected_checked += hypothesis.checked;
+      }
+      else if (hypothesis.score > best_score)
+      {
+        best_score = hypothesis.score;
+        std::copy (hypothesis.c, hypothesis.c + 7, best);
+        improved = true;
+      }
+    }
+    if (!improved && rejected_checked == 0.0)
+    {
+      continue;
+    }
+
+    //  The SPRT takes the inlier ratio of good models from the best one, above the minimum ratio, and that of bad
+    //  models from the rejected ones. While epsilon is not above delta the SPRT is off and every hypothesis is
+    //  scored in full, so a small model is never rejected for falling short of a larger guess.
+    const double ratio = static_cast<double> (std::max (best_score, 0)) / static_cast<double> (n);
+    if (early_exit_ == EARLY_EXIT_SPRT)
+    {
+      epsilon_ = std::min (std::max (min_inlier_ratio_, ratio), 1.0);
+      if (rejected_checked > 0.0)
+      {
+        delta_ = std::max (rejected_inliers / rejected_checked, 1e-4);
+      }
+      else if (delta_ <= 0.0)
+      {
+        delta_ = std::min (0.01, 0.5 * epsilon_);
+      }
+      updateSPRT ();
+    }
+
+    //  k = log (1 - p) / log (1 - P (good sample survives)), as pcl::RandomSampleConsensus
+    if (best_score >= sample_size && probability_ < 1.0)
+    {
+      double good = std::pow (ratio, sample_size);
+      if (early_exit_ == EARLY_EXIT_TDD)
+      {
+        good *= std::pow (ratio, pretest_size);
+      }
+      else if (early_exit_ == EARLY_EXIT_SPRT && log_a_ > 0.0)
+      {
+        good *= 1.0 - std::exp (-log_a_);
+      }
+      if (good >= 1.0)
+      {
+        bound = iterations_;
+      }
+      else if (good > 0.0)
+      {
+        const double k = std::log (1.0 - probability_) / std::log (1.0 - good);
+        if (k < static_cast<double> (max_iterations_))
+        {
+          bound = std::max (iterations_, static_cast<int> (std::ceil (k)));
+        }
+      }
+    }
+  }
+
+  if (best_score < sample_size)
+  {
+    return (false);
+  }
+  coefficients.assign (best, best + 7);
+  coefficients.resize (model_ == MODEL_CYLINDER ? 7 : 4);
+
+  if (optimize_)
+  {
+    std::vector<float> refined = coefficients;
+    refine (points, refined);
+    if (countInliers (points, &refined[0], 0, n) >= countInliers (points, &coefficients[0], 0, n))
+    {
+      coefficients = refined;
+    }
+  }
+  return (true);
+}
+
+void
+wp2::ParallelRansac::selectWithinDistance (const SACPoints &points, const std::vector<float> &coefficients,
+                                           std::vector<int> &positions) const
+{
+  positions.clear ();
+  float c[7] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  std::copy (coefficients.begin (), coefficients.begin () + std::min<size_t> (coefficients.size (), 7), c);
+  float distances[kBlock];
+  for (size_t begin = 0; begin < points.size (); begin += kBlock)
+  {
+    const size_t end = std::min (points.size (), begin + kBlock);
+    computeDistances (points, c, begin, end, distances);
+    for (size_t i = begin; i < end; ++i)
+    {
+      if (distances[i - begin] <= threshold_)
+      {
+        positions.push_back (static_cast<int> (i));
+      }
+    }
+  }
+}
+
+bool
+wp2::ParallelRansac::segment (const SACPoints &points, std::vector<int> &inliers, std::vector<float> &coefficients)
+{
+  inliers.clear ();
+  if (!computeModel (points, coefficients))
+  {
+    return (false);
+  }
+  selectWithinDistance (points, coefficients, inliers);
+  for (size_t i = 0; i < inliers.size (); ++i)
+  {
+    inliers[i] = points.indices[inliers[i]];
+  }
+  std::sort (inliers.begin (), inliers.end ());
+  return (true);
+}
+
+bool
+wp2::ParallelRansac::parseModel (const std::string &name, Model &model)
+{
+  if (name == "plane")
+  {
+    model = MODEL_PLANE;
+  }
+  else if (name == "cylinder")
+  {
+    model = MODEL_CYLINDER;
+  }
+  else if (name == "sphere")
+  {
+    model = MODEL_SPHERE;
+  }
+  else
+  {
+    return (false);
+  }
+  return (true);
+}
+
+const char *
+wp2::ParallelRansac::modelName (Model model)
+{
+  switch (model)
+  {
+    case MODEL_CYLINDER:
+      return ("cylinder");
+    case MODEL_SPHERE:
+      return ("sphere");
+    default:
+      return ("plane");
+  }
+}
+
+bool
+wp2::ParallelRansac::parseEarlyExit (const std::string &name, EarlyExit &early_exit)
+{
+  if (name == "none")
+  {
+    early_exit = EARLY_EXIT_NONE;
+  }
+  else if (name == "tdd")
+  {
+    early_exit = EARLY_EXIT_TDD;
+  }
+  else if (name == "sprt")
+  {
+    early_exit = EARLY_EXIT_SPRT;
+  }
+  else
+  {
+    return (false);
+  }
+  return (true);
+}
+
+const char *
+wp2::ParallelRansac::earlyExitName (EarlyExit early_exit)
+{
+  switch (early_exit)
+  {
+    case EARLY_EXIT_TDD:
+      return ("tdd");
+    case EARLY_EXIT_SPRT:
+      return ("sprt");
+    default:
+      return ("none");
+  }
+}
+
+bool
+wp2::ParallelRansac::fit (const SACPoints &points, const int *sample, float *c) const
+{
+  switch (model_)
+  {
+    case MODEL_PLANE:
+    {
+      const Eigen::Vector3f p0 (points.x[sample[0]], points.y[sample[0]], points.z[sample[0]]);
+      const Eigen::Vector3f p1 (points.x[sample[1]], points.y[sample[1]], points.z[sample[1]]);
+      const Eigen::Vector3f p2 (points.x[sample[2]], points.y[sample[2]], points.z[sample[2]]);
+      const Eigen::Vector3f normal = (p1 - p0).cross (p2 - p0);
+      const float norm = normal.norm ();
+      if (norm < 1e-12f)
+      {
+        return (false);
+      }
+      const Eigen::Vector3f unit = normal / norm;
+      c[0] = unit[0];
+      c[1] = unit[1];
+      c[2] = unit[2];
+      c[3] = -unit.dot (p0);
+      return (true);
+    }
+    case MODEL_CYLINDER:
+    {
+      //  Closest points of the two normal lines, as pcl::SampleConsensusModelCylinder
+      const Eigen::Vector3f p1 (points.x[sample[0]], points.y[sample[0]], points.z[sample[0]]);
+      const Eigen::Vector3f p2 (points.x[sample[1]], points.y[sample[1]], points.z[sample[1]]);
+      const Eigen::Vector3f n1 (points.nx[sample[0]], points.ny[sample[0]], points.nz[sample[0]]);
+      const Eigen::Vector3f n2 (points.nx[sample[1]], points.ny[sample[1]], points.nz[sample[1]]);
+      const Eigen::Vector3f w = n1 + p1 - p2;
+      const float a = n1.dot (n1), b = n1.dot (n2), cc = n2.dot (n2), d = n1.dot (w), e = n2.dot (w);
+      const float denominator = a * cc - b * b;
+      float sc, tc;
+      if (denominator < 1e-8f)
+      {
+        sc = 0.0f;
+        tc = b > cc ? d / b : e / cc;
+      }
+      else
+      {
+        sc = (b * e - cc * d) / denominator;
+        tc = (a * e - b * d) / denominator;
+      }
+      //  w is taken from p1 + n1, so the first line starts there too
+      const Eigen::Vector3f point = p1 + n1 + sc * n1;
+      Eigen::Vector3f direction = p2 + tc * n2 - point;
+      const float norm = direction.norm ();
+      if (!pcl_isfinite (norm) || norm < 1e-12f)
+      {
+        return (false);
+      }
+      direction /= norm;
+      const float radius = (p1 - point).cross (direction).norm ();
+      if (radius < min_radius_ || radius > max_radius_)
+      {
+        return (false);
+      }
+      for (int k = 0; k < 3; ++k)
+      {
+        c[k] = point[k];
+        c[3 + k] = direction[k];
+      }
+      c[6] = radius;
+      return (true);
+    }
+    case MODEL_SPHERE:
+    {
+      //  |p - center|^2 equal for the four points: three linear equations in the center
+      const Eigen::Vector3d p0 (points.x[sample[0]], points.y[sample[0]], points.z[sample[0]]);
+      Eigen::Matrix3d system;
+      Eigen::Vector3d rhs;
+      for (int s = 1; s < 4; ++s)
+      {
+        const Eigen::Vector3d p (points.x[sample[s]], points.y[sample[s]], points.z[sample[s]]);
+        system.row (s - 1) = 2.0 * (p - p0).transpose ();
+        rhs[s - 1] = p.squaredNorm () - p0.squaredNorm ();
+      }
+      if (std::abs (system.determinant ()) < 1e-12)
+      {
+        return (false);
+      }
+      const Eigen::Vector3d center = system.partialPivLu ().solve (rhs);
+      const float radius = static_cast<float> ((p0 - center).norm ());
+      if (!pcl_isfinite (radius) || radius < min_radius_ || radius > max_radius_)
+      {
+        return (false);
+      }
+      for (int k = 0; k < 3; ++k)
+      {
+        c[k] = static_cast<float> (center[k]);
+      }
+      c[3] = radius;
+      return (true);
+    }
+  }
+  return (false);
+}
+
+void
+wp2::ParallelRansac::computeDistances (const SACPoints &points, const float *c, size_t begin, size_t end,
+                                       float *distances) const
+{
+  //  Branch-free over packed coordinates, so the compiler vectorizes it
+  const int count = static_cast<int> (end - begin);
+  const float *xs = &points.x[begin], *ys = &points.y[begin], *zs = &points.z[begin];
+  const bool normals = points.hasNormals () && normal_weight_ > 0.0f;
+  const float *nxs = normals ? &points.nx[begin] : NULL;
+  const float *nys = normals ? &points.ny[begin] : NULL;
+  const float *nzs = normals ? &points.nz[begin] : NULL;
+  const float *curvatures = normals ? &points.curvature[begin] : NULL;
+  const float weight = normal_weight_;
+
+  switch (model_)
+  {
+    case MODEL_PLANE:
+    {
+      const float a = c[0], b = c[1], cc = c[2], d = c[3];
+      for (int i = 0; i < count; ++i)
+      {
+        distances[i] = std::abs (a * xs[i] + b * ys[i] + cc * zs[i] + d);
+      }
+      if (normals)
+      {
+        //  min (angle, pi - angle) between the point normal and the plane normal, weighted down on curved points as
+        //  pcl::SampleConsensusModelNormalPlane does
+        for (int i = 0; i < count; ++i)
+        {
+          const float cosine = std::min (std::abs (a * nxs[i] + b * nys[i] + cc * nzs[i]), 1.0f);
+          const float point_weight = weight * (1.0f - curvatures[i]);
+          distances[i] = std::abs (point_weight * std::acos (cosine) + (1.0f - point_weight) * distances[i]);
+        }
+      }
+      break;
+    }
+    case MODEL_CYLINDER:
+    {
+      const float px = c[0], py = c[1], pz = c[2], ux = c[3], uy = c[4], uz = c[5], radius = c[6];
+      for (int i = 0; i < count; ++i)
+      {
+        const float vx = xs[i] - px, vy = ys[i] - py, vz = zs[i] - pz;
+        const float along = vx * ux + vy * uy + vz * uz;
+        const float rx = vx - along * ux, ry = vy - along * uy, rz = vz - along * uz;
+        const float axis_distance = std::sqrt (rx * rx + ry * ry + rz * rz);
+        float distance = std::abs (axis_distance - radius);
+        if (normals)
+        {
+          //  Angle between the point normal and the radial direction
+          const float cosine = std::min (std::abs (nxs[i] * rx + nys[i] * ry + nzs[i] * rz) / std::max (axis_distance, 1e-12f), 1.0f);
+          distance = std::abs (weight * std::acos (cosine) + (1.0f - weight) * distance);
+        }
+        distances[i] = distance;
+      }
+      break;
+    }
+    case MODEL_SPHERE:
+    {
+      const float cx = c[0], cy = c[1], cz = c[2], radius = c[3];
+      for (int i = 0; i < count; ++i)
+      {
+        const float vx = xs[i] - cx, vy = ys[i] - cy, vz = zs[i] - cz;
+        distances[i] = std::abs (std::sqrt (vx * vx + vy * vy + vz * vz) - radius);
+      }
+      break;
+    }
+  }
+}
+
+int
+wp2::ParallelRansac::countInliers (const SACPoints &points, const float *c, size_t begin, size_t end) const
+{
+  float distances[kBlock];
+  int count = 0;
+  for (size_t block = begin; block < end; block += kBlock)
+  {
+    const size_t block_end = std::min (end, block + kBlock);
+    computeDistances (points, c, block, block_end, distances);
+    const int size = static_cast<int> (block_end - block);
+    for (int i = 0; i < size; ++i)
+    {
+      count += distances[i] <= threshold_;
+    }
+  }
+  return (count);
+}
+
+void
+wp2::ParallelRansac::score (const SACPoints &points, const int *pretest, int pretest_size, Hypothesis &h) const
+{
+  const size_t n = points.size ();
+
+  //  T(d,d): d random points must all be inliers
+  for (int s = 0; s < pretest_size; ++s)
+  {
+    h.checked = s + 1;
+    if (countInliers (points, h.c, pretest[s], pretest[s] + 1) == 0)
+    {
+      return;
+    }
+    h.seen = s + 1;
+  }
+
+  //  SPRT: the log likelihood ratio of bad over good grows by log ((1 - delta) / (1 - epsilon)) per outlier and
+  //  log (delta / epsilon) per inlier; the hypothesis is rejected once it passes log A. The points are shuffled,
+  //  so every block is a fresh random sample.
+  if (early_exit_ == EARLY_EXIT_SPRT && log_a_ > 0.0)
+  {
+    const double log_inlier = std::log (delta_ / epsilon_);
+    const double log_outlier = std::log ((1.0 - delta_) / (1.0 - epsilon_));
+    double log_lambda = 0.0;
+    int inliers = 0;
+    for (size_t begin = 0; begin < n; begin += kBlock)
+    {
+      const size_t end = std::min (n, begin + kBlock);
+      const int block_inliers = countInliers (points, h.c, begin, end);
+      inliers += block_inliers;
+      log_lambda += block_inliers * log_inlier + static_cast<double> (end - begin - block_inliers) * log_outlier;
+      if (log_lambda > log_a_)
+      {
+        h.checked = static_cast<int> (end);
+        h.seen = inliers;
+        return;
+      }
+    }
+    h.score = inliers;
+    return;
+  }
+
+  h.score = countInliers (points, h.c, 0, n);
+}
+
+void
+wp2::ParallelRansac::refine (const SACPoints &points, std::vector<float> &coefficients) const
+{
+  std::vector<int> positions;
+  selectWithinDistance (points, coefficients, positions);
+  const size_t count = positions.size ();
+  if (count < static_cast<size_t> (sampleSize ()) + 1)
+  {
+    return;
+  }
+
+  switch (model_)
+  {
+    case MODEL_PLANE:
+    {
+      //  Least squares plane, as SACSegmentation::setOptimizeCoefficients
+      Eigen::Vector3d sum = Eigen::Vector3d::Zero ();
+      Eigen::Matrix3d products = Eigen::Matrix3d::Zero ();
+      for (size_t i = 0; i < count; ++i)
+      {
+        const Eigen::Vector3d p (points.x[positions[i]], points.y[positions[i]], points.z[positions[i]]);
+        sum += p;
+        products += p * p.transpose ();
+      }
+      const Eigen::Vector3d centroid = sum / static_cast<double> (count);
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver (products / static_cast<double> (count) - centroid * centroid.transpose ());
+      const Eigen::Vector3d normal = solver.eigenvectors ().col (0).normalized ();
+      coefficients[0] = static_cast<float> (normal[0]);
+      coefficients[1] = static_cast<float> (normal[1]);
+      coefficients[2] = static_cast<float> (normal[2]);
+      coefficients[3] = static_cast<float> (-normal.dot (centroid));
+      break;
+    }
+    case MODEL_CYLINDER:
+    {
+      //  The axis is the direction the inlier normals are most perpendicular to; the section is the least squares
+      //  circle of the inliers projected on the plane across it (Kasa fit)
+      Eigen::Matrix3d scatter = Eigen::Matrix3d::Zero ();
+      for (size_t i = 0; i < count; ++i)
+      {
+        const Eigen::Vector3d normal (points.nx[positions[i]], points.ny[positions[i]], points.nz[positions[i]]);
+        scatter += normal * normal.transpose ();
+      }
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver (scatter);
+      const Eigen::Vector3d axis = solver.eigenvectors ().col (0).normalized ();
+      const Eigen::Vector3d e1 = axis.unitOrthogonal ();
+      const Eigen::Vector3d e2 = axis.cross (e1);
+
+      Eigen::Matrix3d normal_matrix = Eigen::Matrix3d::Zero ();
+      Eigen::Vector3d rhs = Eigen::Vector3d::Zero ();
+      for (size_t i = 0; i < count; ++i)
+      {
+        const Eigen::Vector3d p (points.x[positions[i]], points.y[positions[i]], points.z[positions[i]]);
+        const Eigen::Vector3d row (2.0 * p.dot (e1), 2.0 * p.dot (e2), 1.0);
+        normal_matrix += row * row.transpose ();
+        rhs += row * (p.dot (e1) * p.dot (e1) + p.dot (e2) * p.dot (e2));
+      }
+      const Eigen::Vector3d circle = normal_matrix.ldlt ().solve (rhs);
+      const double radius_sqr = circle[2] + circle[0] * circle[0] + circle[1] * circle[1];
+      if (!(radius_sqr > 0.0))
+      {
+        return;
+      }
+      const float radius = static_cast<float> (std::sqrt (radius_sqr));
+      if (radius < min_radius_ || radius > max_radius_)
+      {
+        return;
+      }
+      const Eigen::Vector3d point = circle[0] * e1 + circle[1] * e2;
+      for (int k = 0; k < 3; ++k)
+      {
+        coefficients[k] = static_cast<float> (point[k]);
+        coefficients[3 + k] = static_cast<float> (axis[k]);
+      }
+      coefficients[6] = radius;
+      break;
+    }
+    case MODEL_SPHERE:
+    {
+      //  |p|^2 = 2 p.center + (r^2 - |center|^2), linear least squares
+      Eigen::Matrix4d normal_matrix = Eigen::Matrix4d::Zero ();
+      Eigen::Vector4d rhs = Eigen::Vector4d::Zero ();
+      for (size_t i = 0; i < count; ++i)
+      {
+        const Eigen::Vector3d p (points.x[positions[i]], points.y[positions[i]], points.z[positions[i]]);
+        const Eigen::Vector4d row (2.0 * p[0], 2.0 * p[1], 2.0 * p[2], 1.0);
+        normal_matrix += row * row.transpose ();
+        rhs += row * p.squaredNorm ();
+      }
+      const Eigen::Vector4d solution = normal_matrix.ldlt ().solve (rhs);
+      const double radius_sqr = solution[3] + solution.head<3> ().squaredNorm ();
+      if (!(radius_sqr > 0.0))
+      {
+        return;
+      }
+      const float radius = static_cast<float> (std::sqrt (radius_sqr));
+      if (radius < min_radius_ || radius > max_radius_)
+      {
+        return;
+      }
+      for (int k = 0; k < 3; ++k)
+      {
+        coefficients[k] = static_cast<float> (solution[k]);
+      }
+      coefficients[3] = radius;
+      break;
+    }
+  }
+}
+
+void
+wp2::ParallelRansac::updateSPRT ()
+{
+  //  Matas and Chum: A = t_M C / m_S + 1 + log A, with C the expected log likelihood ratio of a bad model's point
+  if (epsilon_ <= delta_ || epsilon_ >= 1.0)
+  {
+    log_a_ = 0.0;
+    return;
+  }
+  const double c = (1.0 - delta_) * std::log ((1.0 - delta_) / (1.0 - epsilon_)) + delta_ * std::log (delta_ / epsilon_);
+  const double a0 = kFitCost * c + 1.0;
+  double a = a0;
+  for (int i = 0; i < 10; ++i)
+  {
+    a = a0 + std::log (a);
+  }
+  log_a_ = std::log (a);
+}
@@ -0,0 +1,652 @@
+//SHOT HISTOGRAM KERNEL
+//SCALAR PATH FOLLOWS PCL LINE BY LINE, AVX2 PATH COMPUTES THE BINS AND WEIGHTS OF 8 NEIGHBOURS AT ONCE
+//AND SCATTERS THEM IN NEIGHBOUR ORDER, SO EVERY BIN IS ACCUMULATED IN THE SAME ORDER AS IN PCL
+
+#include <wp2/features/shot_kernel.h>
+#include <wp2/common/cpu_features.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WP2_SHOT_AVX2 1
+#include <immintrin.h>
+#define WP2_TARGET_AVX2 __attribute__ ((target ("avx2,fma")))
+#endif
+
+namespace
+{
+  //  Same constants as pcl/features/impl/shot.hpp
+  const double PST_PI = 3.1415926535897932384626433832795;
+  const double PST_RAD_45 = 0.78539816339744830961566084581988;
+  const double PST_RAD_90 = 1.5707963267948966192313216916398;
+  const double PST_RAD_135 = 2.3561944901923449288469825374596;
+  const double PST_RAD_PI_7_8 = 2.7488935718910690836548129603691;
+
+  const int MAX_ANGULAR_SECTORS = 32;
+
+  inline bool
+  areEquals (double val1, double val2, double zeroDoubleEps = 1E-15)
+  {
+    return (std::abs (val1 - val2) < zeroDoubleEps);
+  }
+
+  inline bool
+  isFinite (float value)
+  {
+    return (std::fabs (value) <= std::numeric_limits<float>::max ());
+  }
+
+  //  One channel of the histogram: its bin distance for the current neighbour and where it starts
+  struct Channel
+  {
+    double bin_distance;
+    int nr_bins;
+    int offset;
+    int step_index;
+    int volume_index;
+    double weight;
+  };
+}
+
+void
+wp2::shot::Neighborhood::resize (size_t n)
+{
+  size = n;
+  const size_t padded = (n + 7) & ~static_cast<size_t> (7);
+  dx.assign (padded, 0.0f);
+  dy.assign (padded, 0.0f);
+  dz.assign (padded, 0.0f);
+  sqr_dist.assign (padded, 0.0f);
+  nx.assign (padded, 0.0f);
+  ny.assign (padded, 0.0f);
+  nz.assign (padded, 0.0f);
+  color.assign (padded, 0.0f);
+}
+
+bool
+wp2::shot::parseKernel (const std::string &name, Kernel &kernel)
+{
+  if (name.compare ("pcl") == 0)
+    kernel = KERNEL_PCL;
+  else if (name.compare ("auto") == 0)
+    kernel = KERNEL_AUTO;
+  else if (name.compare ("scalar") == 0)
+    kernel = KERNEL_SCALAR;
+  else if (name.compare ("avx2") == 0)
+    kernel = KERNEL_AVX2;
+  else
+    return (false);
+  return (true);
+}
+
+const char *
+wp2::shot::kernelName (Kernel kernel)
+{
+  switch (kernel)
+  {
+    case KERNEL_PCL:
+      return ("pcl");
+    case KERNEL_AUTO:
+      return ("auto");
+    case KERNEL_SCALAR:
+      return ("scalar");
+    case KERNEL_AVX2:
+      return ("avx2");
+  }
+  return ("unknown");
+}
+
+wp2::shot::Kernel
+wp2::shot::resolveKernel (Kernel kernel)
+{
+  if (kernel == KERNEL_AUTO || kernel == KERNEL_AVX2)
+  {
+    return (wp2::hasAVX2 () ? KERNEL_AVX2 : KERNEL_SCALAR);
+  }
+  return (kernel);
+}
+
+void
+wp2::shot::interpolate (const Neighborhood &neighborhood, const float frame[9], const Params &params, Kernel kernel, float *shot)
+{
+  if (resolveKernel (kernel) == KERNEL_AVX2)
+  {
+    interpolateAVX2 (neighborhood, frame, params, shot);
+  }
+  else
+  {
+    interpolateScalar (neighborhood, frame, params, shot);
+  }
+}
+
+void
+wp2::shot::normalizeHistogram (float *shot, int length)
+{
+  double acc_norm = 0;
+  for (int j = 0; j < length; j++)
+  {
+    acc_norm += shot[j] * shot[j];
+  }
+  acc_norm = sqrt (acc_norm);
+  for (int j = 0; j < length; j++)
+  {
+    shot[j] /= static_cast<float> (acc_norm);
+  }
+}
+
+void
+wp2::shot::interpolateScalar (const Neighborhood &neighborhood, const float frame[9], const Params &params, float *shot)
+{
+  const double radius = params.radius;
+  const double radius1_2 = radius / 2;
+  const double radius1_4 = radius / 4;
+  const double radius3_4 = (radius * 3) / 4;
+
+  const int nr_channels = params.nr_color_bins > 0 ? 2 : 1;
+  Channel channels[2];
+  channels[0].nr_bins = params.nr_shape_bins;
+  channels[0].offset = 0;
+  channels[1].nr_bins = params.nr_color_bins;
+  channels[1].offset = MAX_ANGULAR_SECTORS * (params.nr_shape_bins + 1);
+
+  for (size_t i_idx = 0; i_idx < neighborhood.size; ++i_idx)
+  {
+    //  Cosine of the normal with the frame z axis, i.e. createBinDistanceShape
+    const float normal_dot = neighborhood.nx[i_idx] * frame[6] + neighborhood.ny[i_idx] * frame[7] + neighborhood.nz[i_idx] * frame[8];
+    if (!isFinite (normal_dot))
+    {
+      continue;
+    }
+    double cosineDesc = normal_dot;
+    if (cosineDesc > 1.0)
+      cosineDesc = 1.0;
+    if (cosineDesc < -1.0)
+      cosineDesc = -1.0;
+    channels[0].bin_distance = ((1.0 + cosineDesc) * params.nr_shape_bins) / 2;
+    channels[1].bin_distance = static_cast<double> (neighborhood.color[i_idx]) * params.nr_color_bins;
+
+    double distance = sqrt (static_cast<double> (neighborhood.sqr_dist[i_idx]));
+    if (areEquals (distance, 0.0))
+      continue;
+
+    double xInFeatRef = neighborhood.dx[i_idx] * frame[0] + neighborhood.dy[i_idx] * frame[1] + neighborhood.dz[i_idx] * frame[2];
+    double yInFeatRef = neighborhood.dx[i_idx] * frame[3] + neighborhood.dy[i_idx] * frame[4] + neighborhood.dz[i_idx] * frame[5];
+    double zInFeatRef = neighborhood.dx[i_idx] * frame[6] + neighborhood.dy[i_idx] * frame[7] + neighborhood.dz[i_idx] * frame[8];
+
+    // To avoid numerical problems afterwards
+    if (fabs (yInFeatRef) < 1E-30)
+      yInFeatRef  = 0;
+    if (fabs (xInFeatRef) < 1E-30)
+      xInFeatRef  = 0;
+    if (fabs (zInFeatRef) < 1E-30)
+      zInFeatRef  = 0;
+
+    unsigned char bit4 = ((yInFeatRef > 0) || ((yInFeatRef == 0.0) && (xInFeatRef < 0))) ? 1 : 0;
+    unsigned char bit3 = static_cast<unsigned char> (((xInFeatRef > 0) || ((xInFeatRef == 0.0) && (yInFeatRef > 0))) ? !bit4 : bit4);
+
+    int desc_index = (bit4<<3) + (bit3<<2);
+
+    desc_index = desc_index << 1;
+
+    if ((xInFeatRef * yInFeatRef > 0) || (xInFeatRef == 0.0))
+      desc_index += (fabs (xInFeatRef) >= fabs (yInFeatRef)) ? 0 : 4;
+    else
+      desc_index += (fabs (xInFeatRef) > fabs (yInFeatRef)) ? 4 : 0;
+
+    desc_index += zInFeatRef > 0 ? 1 : 0;
+
+    // 2 RADII
+    desc_index += (distance > radius1_2) ? 2 : 0;
+
+    //Interpolation on the cosine (adjacent bins in the histogram)
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      Channel &ch = channels[c];
+      ch.step_index = static_cast<int> (floor (ch.bin_distance + 0.5));
+      ch.volume_index = ch.offset + desc_index * (ch.nr_bins + 1);
+      ch.bin_distance -= ch.step_index;
+      ch.weight = (1 - fabs (ch.bin_distance));
+
+      if (ch.bin_distance > 0)
+        shot[ch.volume_index + ((ch.step_index+1) % ch.nr_bins)] += static_cast<float> (ch.bin_distance);
+      else
+        shot[ch.volume_index + ((ch.step_index - 1 + ch.nr_bins) % ch.nr_bins)] -= static_cast<float> (ch.bin_distance);
+    }
+
+    //Interpolation on the distance (adjacent husks)
+    if (distance > radius1_2)   //external sphere
+    {
+      double radiusDistance = (distance - radius3_4) / radius1_2;
+
+      if (distance > radius3_4) //most external sector, votes only for itself
+      {
+        for (int c = 0; c < nr_channels; ++c)
+          channels[c].weight += 1 - radiusDistance;  //peso=1-d
+      }
+      else  //3/4 of radius, votes also for the internal sphere
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          channels[c].weight += 1 + radiusDistance;
+          shot[channels[c].offset + (desc_index - 2) * (channels[c].nr_bins+1) + channels[c].step_index] -= static_cast<float> (radiusDistance);
+        }
+      }
+    }
+    else    //internal sphere
+    {
+      double radiusDistance = (distance - radius1_4) / radius1_2;
+
+      if (distance < radius1_4) //most internal sector, votes only for itself
+      {
+        for (int c = 0; c < nr_channels; ++c)
+          channels[c].weight += 1 + radiusDistance;  //weight=1-d
+      }
+      else  //3/4 of radius, votes also for the external sphere
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          channels[c].weight += 1 - radiusDistance;
+          shot[channels[c].offset + (desc_index + 2) * (channels[c].nr_bins+1) + channels[c].step_index] += static_cast<float> (radiusDistance);
+        }
+      }
+    }
+
+    //Interpolation on the inclination (adjacent vertical volumes)
+    double inclinationCos = zInFeatRef / distance;
+    if (inclinationCos < - 1.0)
+      inclinationCos = - 1.0;
+    if (inclinationCos > 1.0)
+      inclinationCos = 1.0;
+
+    double inclination = acos (inclinationCos);
+
+    if (inclination > PST_RAD_90 || (fabs (inclination - PST_RAD_90) < 1e-30 && zInFeatRef <= 0))
+    {
+      double inclinationDistance = (inclination - PST_RAD_135) / PST_RAD_90;
+      if (inclination > PST_RAD_135)
+      {
+        for (int c = 0; c < nr_channels; ++c)
+          channels[c].weight += 1 - inclinationDistance;
+      }
+      else
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          channels[c].weight += 1 + inclinationDistance;
+          shot[channels[c].offset + (desc_index + 1) * (channels[c].nr_bins+1) + channels[c].step_index] -= static_cast<float> (inclinationDistance);
+        }
+      }
+    }
+    else
+    {
+      double inclinationDistance = (inclination - PST_RAD_45) / PST_RAD_90;
+      if (inclination < PST_RAD_45)
+      {
+        for (int c = 0; c < nr_channels; ++c)
+          channels[c].weight += 1 + inclinationDistance;
+      }
+      else
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          channels[c].weight += 1 - inclinationDistance;
+          shot[channels[c].offset + (desc_index - 1) * (channels[c].nr_bins+1) + channels[c].step_index] += static_cast<float> (inclinationDistance);
+        }
+      }
+    }
+
+    if (yInFeatRef != 0.0 || xInFeatRef != 0.0)
+    {
+      //Interpolation on the azimuth (adjacent horizontal volumes)
+      double azimuth = atan2 (yInFeatRef, xInFeatRef);
+
+      int sel = desc_index >> 2;
+      double angularSectorSpan = PST_RAD_45;
+      double angularSectorStart = - PST_RAD_PI_7_8;
+
+      double azimuthDistance = (azimuth - (angularSectorStart + angularSectorSpan*sel)) / angularSectorSpan;
+
+      assert ((azimuthDistance < 0.5 || areEquals (azimuthDistance, 0.5)) && (azimuthDistance > - 0.5 || areEquals (azimuthDistance, - 0.5)));
+
+      azimuthDistance = (std::max)(- 0.5, std::min (azimuthDistance, 0.5));
+
+      if (azimuthDistance > 0)
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          channels[c].weight += 1 - azimuthDistance;
+          int interp_index = (desc_index + 4) % MAX_ANGULAR_SECTORS;
+          shot[channels[c].offset + interp_index * (channels[c].nr_bins+1) + channels[c].step_index] += static_cast<float> (azimuthDistance);
+        }
+      }
+      else
+      {
+        for (int c = 0; c < nr_channels; ++c)
+        {
+          int interp_index = (desc_index - 4 + MAX_ANGULAR_SECTORS) % MAX_ANGULAR_SECTORS;
+          channels[c].weight += 1 + azimuthDistance;
+          shot[channels[c].offset + interp_index * (channels[c].nr_bins+1) + channels[c].step_index] -= static_cast<float> (azimuthDistance);
+        }
+      }
+    }
+
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      shot[channels[c].volume_index + channels[c].step_index] += static_cast<float> (channels[c].weight);
+    }
+  }
+}
+
+#ifdef WP2_SHOT_AVX2
+
+namespace
+{
+  WP2_TARGET_AVX2 inline __m256
+  abs_ps (__m256 x)
+  {
+    return (_mm256_andnot_ps (_mm256_set1_ps (-0.0f), x));
+  }
+
+  //  Cephes asinf polynomial, valid for |x| <= 0.5
+  WP2_TARGET_AVX2 inline __m256
+  asin_poly_ps (__m256 x)
+  {
+    const __m256 z = _mm256_mul_ps (x, x);
+    __m256 p = _mm256_set1_ps (4.2163199048E-2f);
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (2.4181311049E-2f));
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (4.5470025998E-2f));
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (7.4953002686E-2f));
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (1.6666752422E-1f));
+    return (_mm256_fmadd_ps (_mm256_mul_ps (p, z), x, x));
+  }
+
+  //  acos on [-1, 1] without going through pi/2 - asin near the ends, where that cancels
+  WP2_TARGET_AVX2 inline __m256
+  acos_ps (__m256 x)
+  {
+    const __m256 one = _mm256_set1_ps (1.0f);
+    const __m256 half = _mm256_set1_ps (0.5f);
+    const __m256 big = _mm256_cmp_ps (abs_ps (x), half, _CMP_GT_OQ);
+    const __m256 negative = _mm256_cmp_ps (x, _mm256_setzero_ps (), _CMP_LT_OQ);
+
+    //  |x| > 0.5: acos (x) = 2 asin (sqrt ((1 - |x|) / 2)), mirrored for x < 0
+    const __m256 t_big = _mm256_sqrt_ps (_mm256_mul_ps (half, _mm256_sub_ps (one, abs_ps (x))));
+    const __m256 s = asin_poly_ps (_mm256_blendv_ps (x, t_big, big));
+
+    const __m256 r_small = _mm256_sub_ps (_mm256_set1_ps (static_cast<float> (PST_RAD_90)), s);
+    const __m256 r_pos = _mm256_add_ps (s, s);
+    const __m256 r_neg = _mm256_sub_ps (_mm256_set1_ps (static_cast<float> (PST_PI)), r_pos);
+    return (_mm256_blendv_ps (r_small, _mm256_blendv_ps (r_pos, r_neg, negative), big));
+  }
+
+  //  Cephes atanf range reduction on |y| / |x| folded into [0, 1], then the quadrant from the signs.
+  //  The sign of y is taken from its sign bit, so atan2 (-0, x < 0) = -pi as with std::atan2.
+  WP2_TARGET_AVX2 inline __m256
+  atan2_ps (__m256 y, __m256 x)
+  {
+    const __m256 ax = abs_ps (x);
+    const __m256 ay = abs_ps (y);
+    const __m256 swap = _mm256_cmp_ps (ay, ax, _CMP_GT_OQ);
+    const __m256 num = _mm256_blendv_ps (ay, ax, swap);
+    const __m256 den = _mm256_blendv_ps (ax, ay, swap);
+    __m256 q = _mm256_div_ps (num, den);
+
+    const __m256 reduce = _mm256_cmp_ps (q, _mm256_set1_ps (0.4142135623730950f), _CMP_GT_OQ);
+    const __m256 one = _mm256_set1_ps (1.0f);
+    q = _mm256_blendv_ps (q, _mm256_div_ps (_mm256_sub_ps (q, one), _mm256_add_ps (q, one)), reduce);
+    const __m256 base = _mm256_and_ps (reduce, _mm256_set1_ps (static_cast<float> (PST_RAD_45)));
+
+    const __m256 z = _mm256_mul_ps (q, q);
+    __m256 p = _mm256_set1_ps (8.05374449538e-2f);
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (-1.38776856032E-1f));
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (1.99777106478E-1f));
+    p = _mm256_fmadd_ps (p, z, _mm256_set1_ps (-3.33329491539E-1f));
+    __m256 r = _mm256_add_ps (base, _mm256_fmadd_ps (_mm256_mul_ps (p, z), q, q));
+
+    r = _mm256_blendv_ps (r, _mm256_sub_ps (_mm256_set1_ps (static_cast<float> (PST_RAD_90)), r), swap);
+    r = _mm256_blendv_ps (r, _mm256_sub_ps (_mm256_set1_ps (static_cast<float> (PST_PI)), r),
+                          _mm256_cmp_ps (x, _mm256_setzero_ps (), _CMP_LT_OQ));
+    return (_mm256_xor_ps (r, _mm256_and_ps (y, _mm256_set1_ps (-0.0f))));
+  }
+
+  WP2_TARGET_AVX2 inline __m256
+  select_ps (__m256 mask, __m256 if_true, __m256 if_false)
+  {
+    return (_mm256_blendv_ps (if_false, if_true, mask));
+  }
+
+  WP2_TARGET_AVX2 inline __m256i
+  mask_epi32 (__m256 mask, int value)
+  {
+    return (_mm256_and_si256 (_mm256_castps_si256 (mask), _mm256_set1_epi32 (value)));
+  }
+
+  //  Per lane results of one block of 8 neighbours, in the order they are scattered
+  struct Votes
+  {
+    float cos_weight[2][8];
+    int cos_bin[2][8];
+    float main_weight[2][8];
+    int main_bin[2][8];
+    int step[2][8];
+    int desc[8];
+    float radial_weight[8];
+    int radial_desc[8];
+    float incl_weight[8];
+    int incl_desc[8];
+    float azim_weight[8];
+    int azim_desc[8];
+    int valid[8];
+    int has_radial[8];
+    int has_incl[8];
+    int has_azim[8];
+  } __attribute__ ((aligned (32)));
+
+  //  Cosine bin of one channel: step index, adjacent bin and weights as in interpolateSingleChannel
+  WP2_TARGET_AVX2 inline void
+  binChannel (__m256 bin_distance, int nr_bins, __m256 &int_weight, __m256i &step, __m256i &cos_bin, __m256 &cos_weight)
+  {
+    const __m256 rounded = _mm256_floor_ps (_mm256_add_ps (bin_distance, _mm256_set1_ps (0.5f)));
+    step = _mm256_cvtps_epi32 (rounded);
+    const __m256 residual = _mm256_sub_ps (bin_distance, rounded);
+    cos_weight = abs_ps (residual);
+    int_weight = _mm256_sub_ps (_mm256_set1_ps (1.0f), cos_weight);
+
+    const __m256i bins = _mm256_set1_epi32 (nr_bins);
+    const __m256i bins_minus_one = _mm256_set1_epi32 (nr_bins - 1);
+    __m256i up = _mm256_add_epi32 (step, _mm256_set1_epi32 (1));
+    up = _mm256_sub_epi32 (up, _mm256_and_si256 (_mm256_cmpgt_epi32 (up, bins_minus_one), bins));
+    __m256i down = _mm256_add_epi32 (step, bins_minus_one);
+    down = _mm256_sub_epi32 (down, _mm256_and_si256 (_mm256_cmpgt_epi32 (down, bins_minus_one), bins));
+    const __m256 positive = _mm256_cmp_ps (residual, _mm256_setzero_ps (), _CMP_GT_OQ);
+    cos_bin = _mm256_blendv_epi8 (down, up, _mm256_castps_si256 (positive));
+  }
+}
+
+WP2_TARGET_AVX2 void
+wp2::shot::interpolateAVX2 (const Neighborhood &neighborhood, const float frame[9], const Params &params, float *shot)
+{
+  const int nr_channels = params.nr_color_bins > 0 ? 2 : 1;
+  const int nr_bins[2] = { params.nr_shape_bins, params.nr_color_bins };
+  const int offsets[2] = { 0, MAX_ANGULAR_SECTORS * (params.nr_shape_bins + 1) };
+
+  const __m256 fx0 = _mm256_set1_ps (frame[0]), fx1 = _mm256_set1_ps (frame[1]), fx2 = _mm256_set1_ps (frame[2]);
+  const __m256 fy0 = _mm256_set1_ps (frame[3]), fy1 = _mm256_set1_ps (frame[4]), fy2 = _mm256_set1_ps (frame[5]);
+  const __m256 fz0 = _mm256_set1_ps (frame[6]), fz1 = _mm256_set1_ps (frame[7]), fz2 = _mm256_set1_ps (frame[8]);
+
+  const __m256 radius1_2 = _mm256_set1_ps (static_cast<float> (params.radius / 2));
+  const __m256 radius1_4 = _mm256_set1_ps (static_cast<float> (params.radius / 4));
+  const __m256 radius3_4 = _mm256_set1_ps (static_cast<float> ((params.radius * 3) / 4));
+
+  const __m256 zero = _mm256_setzero_ps ();
+  const __m256 one = _mm256_set1_ps (1.0f);
+  const __m256 tiny = _mm256_set1_ps (1E-30f);
+
+  Votes v;
+  const size_t padded = (neighborhood.size + 7) & ~static_cast<size_t> (7);
+
+  for (size_t base = 0; base < padded; base += 8)
+  {
+    const __m256 dx = _mm256_loadu_ps (&neighborhood.dx[base]);
+    const __m256 dy = _mm256_loadu_ps (&neighborhood.dy[base]);
+    const __m256 dz = _mm256_loadu_ps (&neighborhood.dz[base]);
+
+    //  Skipped lanes: NaN normal, NaN color, or (padding included) zero distance
+    const __m256 normal_dot = _mm256_fmadd_ps (_mm256_loadu_ps (&neighborhood.nz[base]), fz2,
+                              _mm256_fmadd_ps (_mm256_loadu_ps (&neighborhood.ny[base]), fz1,
+                              _mm256_mul_ps (_mm256_loadu_ps (&neighborhood.nx[base]), fz0)));
+    const __m256 distance = _mm256_sqrt_ps (_mm256_loadu_ps (&neighborhood.sqr_dist[base]));
+    __m256 valid = _mm256_and_ps (_mm256_cmp_ps (normal_dot, normal_dot, _CMP_ORD_Q),
+                                  _mm256_cmp_ps (distance, _mm256_set1_ps (1E-15f), _CMP_GE_OQ));
+
+    const __m256 cosine = _mm256_max_ps (_mm256_set1_ps (-1.0f), _mm256_min_ps (normal_dot, one));
+    __m256 bin_distance[2];
+    bin_distance[0] = _mm256_mul_ps (_mm256_mul_ps (_mm256_add_ps (one, cosine), _mm256_set1_ps (static_cast<float> (nr_bins[0]))),
+                                     _mm256_set1_ps (0.5f));
+    if (nr_channels > 1)
+    {
+      bin_distance[1] = _mm256_mul_ps (_mm256_loadu_ps (&neighborhood.color[base]), _mm256_set1_ps (static_cast<float> (nr_bins[1])));
+      valid = _mm256_and_ps (valid, _mm256_cmp_ps (bin_distance[1], bin_distance[1], _CMP_ORD_Q));
+    }
+
+    const int valid_bits = _mm256_movemask_ps (valid);
+    if (valid_bits == 0)
+    {
+      continue;
+    }
+
+    __m256 x = _mm256_fmadd_ps (dz, fx2, _mm256_fmadd_ps (dy, fx1, _mm256_mul_ps (dx, fx0)));
+    __m256 y = _mm256_fmadd_ps (dz, fy2, _mm256_fmadd_ps (dy, fy1, _mm256_mul_ps (dx, fy0)));
+    __m256 z = _mm256_fmadd_ps (dz, fz2, _mm256_fmadd_ps (dy, fz1, _mm256_mul_ps (dx, fz0)));
+    x = _mm256_andnot_ps (_mm256_cmp_ps (abs_ps (x), tiny, _CMP_LT_OQ), x);
+    y = _mm256_andnot_ps (_mm256_cmp_ps (abs_ps (y), tiny, _CMP_LT_OQ), y);
+    z = _mm256_andnot_ps (_mm256_cmp_ps (abs_ps (z), tiny, _CMP_LT_OQ), z);
+
+    //  Sector of the neighbour, the bit juggling of interpolateSingleChannel on masks
+    const __m256 x_pos = _mm256_cmp_ps (x, zero, _CMP_GT_OQ);
+    const __m256 x_neg = _mm256_cmp_ps (x, zero, _CMP_LT_OQ);
+    const __m256 x_zero = _mm256_cmp_ps (x, zero, _CMP_EQ_OQ);
+    const __m256 y_pos = _mm256_cmp_ps (y, zero, _CMP_GT_OQ);
+    const __m256 y_neg = _mm256_cmp_ps (y, zero, _CMP_LT_OQ);
+    const __m256 y_zero = _mm256_cmp_ps (y, zero, _CMP_EQ_OQ);
+    const __m256 ax = abs_ps (x);
+    const __m256 ay = abs_ps (y);
+
+    const __m256 bit4 = _mm256_or_ps (y_pos, _mm256_and_ps (y_zero, x_neg));
+    const __m256 bit3 = _mm256_xor_ps (bit4, _mm256_or_ps (x_pos, _mm256_and_ps (x_zero, y_pos)));
+    __m256i desc = _mm256_add_epi32 (mask_epi32 (bit4, 16), mask_epi32 (bit3, 8));
+
+    //  x * y > 0 from the signs, so tiny products cannot underflow to zero in single precision
+    const __m256 same_sign = _mm256_or_ps (_mm256_or_ps (_mm256_and_ps (x_pos, y_pos), _mm256_and_ps (x_neg, y_neg)), x_zero);
+    const __m256 quarter = select_ps (same_sign, _mm256_cmp_ps (ax, ay, _CMP_LT_OQ), _mm256_cmp_ps (ax, ay, _CMP_GT_OQ));
+    desc = _mm256_add_epi32 (desc, mask_epi32 (quarter, 4));
+    desc = _mm256_add_epi32 (desc, mask_epi32 (_mm256_cmp_ps (z, zero, _CMP_GT_OQ), 1));
+    const __m256 outer = _mm256_cmp_ps (distance, radius1_2, _CMP_GT_OQ);
+    desc = _mm256_add_epi32 (desc, mask_epi32 (outer, 2));
+
+    __m256 int_weight[2];
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      __m256i step, cos_bin;
+      __m256 cos_weight;
+      binChannel (bin_distance[c], nr_bins[c], int_weight[c], step, cos_bin, cos_weight);
+      const __m256i volume = _mm256_add_epi32 (_mm256_set1_epi32 (offsets[c]), _mm256_mullo_epi32 (desc, _mm256_set1_epi32 (nr_bins[c] + 1)));
+      _mm256_store_si256 (reinterpret_cast<__m256i *> (v.step[c]), step);
+      _mm256_store_si256 (reinterpret_cast<__m256i *> (v.cos_bin[c]), _mm256_add_epi32 (volume, cos_bin));
+      _mm256_store_si256 (reinterpret_cast<__m256i *> (v.main_bin[c]), _mm256_add_epi32 (volume, step));
+      _mm256_store_ps (v.cos_weight[c], cos_weight);
+    }
+
+    //  Distance: the self vote is 1 + s * d and the neighbour volume (if any) gets -s * d,
+    //  with s = -1 for the outermost and the inner-outer husk, +1 otherwise
+    const __m256 radial_distance = _mm256_div_ps (_mm256_sub_ps (distance, select_ps (outer, radius3_4, radius1_4)), radius1_2);
+    const __m256 outermost = _mm256_and_ps (outer, _mm256_cmp_ps (distance, radius3_4, _CMP_GT_OQ));
+    const __m256 innermost = _mm256_andnot_ps (outer, _mm256_cmp_ps (distance, radius1_4, _CMP_LT_OQ));
+    const __m256 has_radial = _mm256_andnot_ps (_mm256_or_ps (outermost, innermost), valid);
+    const __m256 radial_minus = _mm256_or_ps (outermost, _mm256_andnot_ps (outer, _mm256_andnot_ps (innermost, valid)));
+    const __m256 radial_signed = _mm256_xor_ps (radial_distance, _mm256_and_ps (radial_minus, _mm256_set1_ps (-0.0f)));
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      int_weight[c] = _mm256_add_ps (int_weight[c], _mm256_add_ps (one, radial_signed));
+    }
+    _mm256_store_ps (v.radial_weight, _mm256_xor_ps (radial_signed, _mm256_set1_ps (-0.0f)));
+    _mm256_store_si256 (reinterpret_cast<__m256i *> (v.radial_desc),
+                        _mm256_add_epi32 (desc, _mm256_blendv_epi8 (_mm256_set1_epi32 (2), _mm256_set1_epi32 (-2), _mm256_castps_si256 (outer))));
+    _mm256_store_ps (reinterpret_cast<float *> (v.has_radial), has_radial);
+
+    //  Inclination, same pattern. z <= 0 is the lower half, which includes the equator as in PCL.
+    const __m256 inclination_cos = _mm256_max_ps (_mm256_set1_ps (-1.0f), _mm256_min_ps (_mm256_div_ps (z, distance), one));
+    const __m256 inclination = acos_ps (inclination_cos);
+    const __m256 lower = _mm256_cmp_ps (inclination_cos, zero, _CMP_LE_OQ);
+    const __m256 inclination_distance = _mm256_div_ps (
+        _mm256_sub_ps (inclination, select_ps (lower, _mm256_set1_ps (static_cast<float> (PST_RAD_135)), _mm256_set1_ps (static_cast<float> (PST_RAD_45)))),
+        _mm256_set1_ps (static_cast<float> (PST_RAD_90)));
+    const __m256 bottom = _mm256_and_ps (lower, _mm256_cmp_ps (inclination, _mm256_set1_ps (static_cast<float> (PST_RAD_135)), _CMP_GT_OQ));
+    const __m256 top = _mm256_andnot_ps (lower, _mm256_cmp_ps (inclination, _mm256_set1_ps (static_cast<float> (PST_RAD_45)), _CMP_LT_OQ));
+    const __m256 has_incl = _mm256_andnot_ps (_mm256_or_ps (bottom, top), valid);
+    const __m256 incl_minus = _mm256_or_ps (bottom, _mm256_andnot_ps (lower, _mm256_andnot_ps (top, valid)));
+    const __m256 incl_signed = _mm256_xor_ps (inclination_distance, _mm256_and_ps (incl_minus, _mm256_set1_ps (-0.0f)));
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      int_weight[c] = _mm256_add_ps (int_weight[c], _mm256_add_ps (one, incl_signed));
+    }
+    _mm256_store_ps (v.incl_weight, _mm256_xor_ps (incl_signed, _mm256_set1_ps (-0.0f)));
+    _mm256_store_si256 (reinterpret_cast<__m256i *> (v.incl_desc),
+                        _mm256_add_epi32 (desc, _mm256_blendv_epi8 (_mm256_set1_epi32 (-1), _mm256_set1_epi32 (1), _mm256_castps_si256 (lower))));
+    _mm256_store_ps (reinterpret_cast<float *> (v.has_incl), has_incl);
+
+    //  Azimuth, only when the neighbour is off the z axis of the frame
+    const __m256 has_azim = _mm256_andnot_ps (_mm256_and_ps (x_zero, y_zero), valid);
+    const __m256 sector_start = _mm256_fmadd_ps (_mm256_cvtepi32_ps (_mm256_srai_epi32 (desc, 2)), _mm256_set1_ps (static_cast<float> (PST_RAD_45)),
+                                                 _mm256_set1_ps (static_cast<float> (-PST_RAD_PI_7_8)));
+    __m256 azimuth_distance = _mm256_div_ps (_mm256_sub_ps (atan2_ps (y, x), sector_start), _mm256_set1_ps (static_cast<float> (PST_RAD_45)));
+    azimuth_distance = _mm256_max_ps (_mm256_set1_ps (-0.5f), _mm256_min_ps (azimuth_distance, _mm256_set1_ps (0.5f)));
+    const __m256 azimuth_weight = abs_ps (azimuth_distance);
+    for (int c = 0; c < nr_channels; ++c)
+    {
+      int_weight[c] = _mm256_add_ps (int_weight[c], _mm256_and_ps (has_azim, _mm256_sub_ps (one, azimuth_weight)));
+      _mm256_store_ps (v.main_weight[c], int_weight[c]);
+    }
+    const __m256i azimuth_step = _mm256_blendv_epi8 (_mm256_set1_epi32 (MAX_ANGULAR_SECTORS - 4), _mm256_set1_epi32 (4),
+                                                     _mm256_castps_si256 (_mm256_cmp_ps (azimuth_distance, zero, _CMP_GT_OQ)));
+    _mm256_store_ps (v.azim_weight, azimuth_weight);
+    _mm256_store_si256 (reinterpret_cast<__m256i *> (v.azim_desc),
+                        _mm256_and_si256 (_mm256_add_epi32 (desc, azimuth_step), _mm256_set1_epi32 (MAX_ANGULAR_SECTORS - 1)));
+    _mm256_store_ps (reinterpret_cast<float *> (v.has_azim), has_azim);
+
+    //  Scatter, neighbour by neighbour and vote by vote in the PCL order
+    for (int l = 0; l < 8; ++l)
+    {
+      if (!(valid_bits & (1 << l)))
+      {
+        continue;
+      }
+      for (int c = 0; c < nr_channels; ++c)
+        shot[v.cos_bin[c][l]] += v.cos_weight[c][l];
+      if (v.has_radial[l])
+        for (int c = 0; c < nr_channels; ++c)
+          shot[offsets[c] + v.radial_desc[l] * (nr_bins[c] + 1) + v.step[c][l]] += v.radial_weight[l];
+      if (v.has_incl[l])
+        for (int c = 0; c < nr_channels; ++c)
+          shot[offsets[c] + v.incl_desc[l] * (nr_bins[c] + 1) + v.step[c][l]] += v.incl_weight[l];
+      if (v.has_azim[l])
+        for (int c = 0; c < nr_channels; ++c)
+          shot[offsets[c] + v.azim_desc[l] * (nr_bins[c] + 1) + v.step[c][l]] += v.azim_weight[l];
+      for (int c = 0; c < nr_channels; ++c)
+        shot[v.main_bin[c][l]] += v.main_weight[c][l];
+    }
+  }
+}
+
+#else
+
+void
+wp2::shot::interpolateAVX2 (const Neighborhood &neighborhood, const float frame[9], const Params &params, float *shot)
+{
+  interpolateScalar (neighborhood, frame, params, shot);
+}
+
+#endif
@@ -0,0 +1,564 @@
+//STREAMING VOXEL GRID
+
+#include <wp2/filters/streaming_voxel_grid.h>
+
+#include <pcl/common/io.h>
+#include <pcl/console/print.h>
+#include <pcl/io/lzf.h>
+#include <pcl/io/pcd_io.h>
+
+#include <boost/math/special_functions/fpclassify.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace
+{
+  inline float
+  readFloat (const unsigned char *record, int offset)
+  {
+    float value;
+    std::memcpy (&value, record + offset, sizeof (float));
+    return (value);
+  }
+
+  //  Byte offsets of x, y, z and rgb/rgba in the records of a cloud; false without float x, y, z
+  bool
+  getFieldOffsets (const pcl::PCLPointCloud2 &cloud, int &x_offset, int &y_offset, int &z_offset, int &rgba_offset)
+  {
+    const int x_index = pcl::getFieldIndex (cloud, "x");
+    const int y_index = pcl::getFieldIndex (cloud, "y");
+    const int z_index = pcl::getFieldIndex (cloud, "z");
+    if (x_index < 0 || y_index < 0 || z_index < 0 ||
+        cloud.fields[x_index].datatype != pcl::PCLPointField::FLOAT32 ||
+        cloud.fields[y_index].datatype != pcl::PCLPointField::FLOAT32 ||
+        cloud.fields[z_index].datatype != pcl::PCLPointField::FLOAT32)
+    {
+      return (false);
+    }
+    x_offset = cloud.fields[x_index].offset;
+    y_offset = cloud.fields[y_index].offset;
+    z_offset = cloud.fields[z_index].offset;
+
+    int rgba_index = pcl::getFieldIndex (cloud, "rgba");
+    if (rgba_index < 0)
+    {
+      rgba_index = pcl::getFieldIndex (cloud, "rgb");
+    }
+    rgba_offset = rgba_index >= 0 && (cloud.fields[rgba_index].datatype == pcl::PCLPointField::FLOAT32 ||
+                                      cloud.fields[rgba_index].datatype == pcl::PCLPointField::UINT32)
+                  ? static_cast<int> (cloud.fields[rgba_index].offset) : -1;
+    return (true);
+  }
+
+  //  Position of the first token of a field on an ASCII line, or -1
+  int
+  getFieldToken (const pcl::PCLPointCloud2 &cloud, const std::string &name)
+  {
+    int token = 0;
+    for (size_t f = 0; f < cloud.fields.size (); ++f)
+    {
+      if (cloud.fields[f].name == name)
+      {
+        return (token);
+      }
+      token += cloud.fields[f].count > 0 ? cloud.fields[f].count : 1;
+    }
+    return (-1);
+  }
+}
+
+wp2::StreamingVoxelGrid::StreamingVoxelGrid (unsigned int nr_threads)
+  : leaf_size_ (0.01f)
+  , block_size_ (65536)
+  , min_points_ (0)
+  , threads_ (nr_threads)
+  , has_color_ (false)
+  , organized_ (false)
+  , nr_points_ (0)
+  , nr_out_of_range_ (0)
+  , nr_decompressed_ (0)
+{
+  for (int d = 0; d < 3; ++d)
+  {
+    min_[d] = -std::numeric_limits<float>::max ();
+    max_[d] = std::numeric_limits<float>::max ();
+  }
+}
+
+bool
+wp2::StreamingVoxelGrid::setFilterLimits (const std::string &field_name, float min, float max)
+{
+  const int d = field_name == "x" ? 0 : field_name == "y" ? 1 : field_name == "z" ? 2 : -1;
+  if (d < 0)
+  {
+    PCL_ERROR ("[wp2::StreamingVoxelGrid::setFilterLimits] Error! Unknown field %s\n", field_name.c_str ());
+    return (false);
+  }
+  min_[d] = min;
+  max_[d] = max;
+  return (true);
+}
+
+void
+wp2::StreamingVoxelGrid::clear ()
+{
+  partitions_.clear ();
+  has_color_ = false;
+  organized_ = false;
+  nr_points_ = 0;
+  nr_out_of_range_ = 0;
+  nr_decompressed_ = 0;
+}
+
+size_t
+wp2::StreamingVoxelGrid::getNumberOfVoxels () const
+{
+  size_t nr_voxels = 0;
+  for (size_t t = 0; t < partitions_.size (); ++t)
+  {
+    nr_voxels += partitions_[t].size ();
+  }
+  return (nr_voxels);
+}
+
+void
+wp2::StreamingVoxelGrid::addPoints (const float *x, const float *y, const float *z, const unsigned int *rgba,
+                                    size_t nr_points)
+{
+  if (nr_points == 0)
+  {
+    return;
+  }
+
+  int nr_threads = 1;
+#ifdef _OPENMP
+  nr_threads = threads_ == 0 ? omp_get_num_procs () : threads_;
+#endif
+  if (partitions_.empty ())
+  {
+    partitions_.resize (nr_threads);
+  }
+  const unsigned int nr_partitions = static_cast<unsigned int> (partitions_.size ());
+
+  keys_.resize (nr_points);
+  key_partitions_.resize (nr_points);
+  const float inverse_leaf = 1.0f / leaf_size_;
+  //  A voxel reaching into the box has all its points within a leaf of it; the others cannot give a centroid in it
+  float low[3], high[3];
+  for (int d = 0; d < 3; ++d)
+  {
+    low[d] = min_[d] - leaf_size_;
+    high[d] = max_[d] + leaf_size_;
+  }
+  long nr_out_of_range = 0;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) reduction(+:nr_out_of_range)
+#endif
+  for (long i = 0; i < static_cast<long> (nr_points); ++i)
+  {
+    if (!(x[i] >= low[0] && x[i] <= high[0] && y[i] >= low[1] && y[i] <= high[1] && z[i] >= low[2] &&
+          z[i] <= high[2]))
+    {
+      //  Too far from the box, or NaN
+      keys_[i] = detail::INVALID_VOXEL;
+      continue;
+    }
+    keys_[i] = detail::voxelKey (x[i], y[i], z[i], inverse_leaf);
+    if (keys_[i] == detail::INVALID_VOXEL)
+    {
+      if ((boost::math::isfinite) (x[i]) && (boost::math::isfinite) (y[i]) && (boost::math::isfinite) (z[i]))
+      {
+        ++nr_out_of_range;
+      }
+      continue;
+    }
+    key_partitions_[i] = nr_partitions > 1 ? detail::voxelPartition (keys_[i], nr_partitions) : 0;
+  }
+
+  //  Points bucketed by partition once, in input order within each partition: every range of points counts its
+  //  valid keys per partition, then writes their positions to its own slice of each partition. slices[p * nr_threads
+  //  + r] is where range r starts in partition p
+  std::vector<size_t> slices (static_cast<size_t> (nr_partitions) * nr_threads + 1, 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) schedule(static, 1)
+#endif
+  for (int r = 0; r < nr_threads; ++r)
+  {
+    std::vector<size_t> counts (nr_partitions, 0);
+    for (size_t i = nr_points * r / nr_threads; i < nr_points * (r + 1) / nr_threads; ++i)
+    {
+      if (keys_[i] != detail::INVALID_VOXEL)
+      {
+        ++counts[key_partitions_[i]];
+      }
+    }
+    for (unsigned int p = 0; p < nr_partitions; ++p)
+    {
+      slices[static_cast<size_t> (p) * nr_threads + r + 1] = counts[p];
+    }
+  }
+  for (size_t s = 1; s < slices.size (); ++s)
+  {
+    slices[s] += slices[s - 1];
+  }
+  order_.resize (slices.back ());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads) schedule(static, 1)
+#endif
+  for (int r = 0; r < nr_threads; ++r)
+  {
+    std::vector<size_t> cursors (nr_partitions);
+    for (unsigned int p = 0; p < nr_partitions; ++p)
+    {
+      cursors[p] = slices[static_cast<size_t> (p) * nr_threads + r];
+    }
+    for (size_t i = nr_points * r / nr_threads; i < nr_points * (r + 1) / nr_threads; ++i)
+    {
+      if (keys_[i] != detail::INVALID_VOXEL)
+      {
+        order_[cursors[key_partitions_[i]]++] = i;
+      }
+    }
+  }
+
+  //  Every partition is owned by one thread, so the maps are filled without locks
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nr_threads)
+#endif
+  {
+    unsigned int first = 0;
+    unsigned int step = 1;
+#ifdef _OPENMP
+    first = omp_get_thread_num ();
+    step = omp_get_num_threads ();
+#endif
+    for (unsigned int t = first; t < nr_partitions; t += step)
+    {
+      detail::VoxelSumMap &voxels = partitions_[t];
+      const size_t end = slices[static_cast<size_t> (t + 1) * nr_threads];
+      for (size_t s = slices[static_cast<size_t> (t) * nr_threads]; s < end; ++s)
+      {
+        const size_t i = order_[s];
+        detail::VoxelSum &voxel = voxels[keys_[i]];
+        voxel.add (x[i], y[i], z[i]);
+        if (rgba != NULL)
+        {
+          voxel.addColor (rgba[i]);
+        }
+      }
+    }
+  }
+
+  nr_points_ += nr_points;
+  nr_out_of_range_ += nr_out_of_range;
+  has_color_ = has_color_ || rgba != NULL;
+}
+
+void
+wp2::StreamingVoxelGrid::addRecords (const unsigned char *data, size_t nr_points, size_t point_step, int x_offset,
+                                     int y_offset, int z_offset, int rgba_offset)
+{
+  if (nr_points == 0)
+  {
+    return;
+  }
+  x_.resize (nr_points);
+  y_.resize (nr_points);
+  z_.resize (nr_points);
+  rgba_.resize (rgba_offset >= 0 ? nr_points : 0);
+
+  int nr_threads = 1;
+#ifdef _OPENMP
+  nr_threads = threads_ == 0 ? omp_get_num_procs () : threads_;
+#pragma omp parallel for num_threads(nr_threads)
+#endif
+  for (long i = 0; i < static_cast<long> (nr_points); ++i)
+  {
+    const unsigned char *record = data + i * point_step;
+    x_[i] = readFloat (record, x_offset);
+    y_[i] = readFloat (record, y_offset);
+    z_[i] = readFloat (record, z_offset);
+    if (rgba_offset >= 0)
+    {
+      std::memcpy (&rgba_[i], record + rgba_offset, sizeof (unsigned int));
+    }
+  }
+
+  addPoints (&x_[0], &y_[0], &z_[0], rgba_offset >= 0 ? &rgba_[0] : NULL, nr_points);
+}
+
+void
+wp2::StreamingVoxelGrid::addLines (const std::vector<std::string> &lines, int x_token, int y_token, int z_token,
+                                   int rgba_token, bool rgba_float)
+{
+  const size_t nr_points = lines.size ();
+  x_.resize (nr_points);
+  y_.resize (nr_points);
+  z_.resize (nr_points);
+  rgba_.resize (rgba_token >= 0 ? nr_points : 0);
+  const int last_token = std::max (std::max (x_token, y_token), std::max (z_token, rgba_token));
+
+  int nr_threads = 1;
+#ifdef _OPENMP
+  nr_threads = threads_ == 0 ? omp_get_num_procs () : threads_;
+#pragma omp parallel for num_threads(nr_threads)
+#endif
+  for (long i = 0; i < static_cast<long> (nr_points); ++i)
+  {
+    //  A short line leaves the point non-finite, so it is skipped like a NaN
+    x_[i] = y_[i] = z_[i] = std::numeric_limits<float>::quiet_NaN ();
+    if (rgba_token >= 0)
+    {
+      rgba_[i] = 0;
+    }
+
+    const char *p = lines[i].c_str ();
+    for (int token = 0; token <= last_token && *p != '\0'; ++token)
+    {
+      while (*p == ' ' || *p == '\t')
+      {
+        ++p;
+      }
+      const char *start = p;
+      while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r')
+      {
+        ++p;
+      }
+      if (start == p)
+      {
+        break;
+      }
+
+      if (token == x_token)
+      {
+        x_[i] = static_cast<float> (std::strtod (start, NULL));
+      }
+      else if (token == y_token)
+      {
+        y_[i] = static_cast<float> (std::strtod (start, NULL));
+      }
+      else if (token == z_token)
+      {
+        z_[i] = static_cast<float> (std::strtod (start, NULL));
+      }
+      else if (token == rgba_token)
+      {
+        //  A float field may still hold the packed colour as an integer (PCDWriter::writeASCII of PCL 1.8 and
+        //  later); only a token in float form is the float with the same bits
+        if (rgba_float && std::find_first_of (start, p, ".eE", ".eE" + 3) != p)
+        {
+          const float value = static_cast<float> (std::strtod (start, NULL));
+          std::memcpy (&rgba_[i], &value, sizeof (unsigned int));
+        }
+        else
+        {
+          rgba_[i] = static_cast<unsigned int> (std::strtoul (start, NULL, 10));
+        }
+      }
+    }
+  }
+
+  addPoints (&x_[0], &y_[0], &z_[0], rgba_token >= 0 ? &rgba_[0] : NULL, nr_points);
+}
+
+bool
+wp2::StreamingVoxelGrid::addFile (const std::string &filename)
+{
+  if (leaf_size_ <= 0.0f)
+  {
+    PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! Leaf size must be positive\n");
+    return (false);
+  }
+
+  pcl::PCDReader reader;
+  pcl::PCLPointCloud2 header;
+  Eigen::Vector4f origin;
+  Eigen::Quaternionf orientation;
+  int version;
+  int data_type = 0;
+  unsigned int data_idx = 0;
+  if (reader.readHeader (filename, header, origin, orientation, version, data_type, data_idx) < 0)
+  {
+    PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! Cannot read the header of %s\n", filename.c_str ());
+    return (false);
+  }
+
+  int x_offset, y_offset, z_offset, rgba_offset;
+  if (!getFieldOffsets (header, x_offset, y_offset, z_offset, rgba_offset))
+  {
+    PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! %s has no float x, y, z fields\n", filename.c_str ());
+    return (false);
+  }
+
+  if (nr_points_ == 0)
+  {
+    organized_ = header.height > 1;
+  }
+  const size_t nr_out_of_range = nr_out_of_range_;
+  const size_t nr_points = static_cast<size_t> (header.width) * header.height;
+
+  if (data_type == 1)
+  {
+    std::ifstream file (filename.c_str (), std::ios::in | std::ios::binary);
+    file.seekg (data_idx);
+    std::vector<unsigned char> block (block_size_ * header.point_step);
+    size_t read = 0;
+    while (read < nr_points && file)
+    {
+      const size_t nr_block = std::min (block_size_, nr_points - read);
+      file.read (reinterpret_cast<char *> (&block[0]), nr_block * header.point_step);
+      const size_t nr_read = static_cast<size_t> (file.gcount ()) / header.point_step;
+      addRecords (&block[0], nr_read, header.point_step, x_offset, y_offset, z_offset, rgba_offset);
+      read += nr_read;
+    }
+    if (read != nr_points)
+    {
+      //  As pcl::PCDReader, a truncated file is an error; the points already read stay in the grid
+      PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! %s holds %lu of its %lu points\n", filename.c_str (),
+                 static_cast<unsigned long> (read), static_cast<unsigned long> (nr_points));
+      return (false);
+    }
+  }
+  else if (data_type == 0)
+  {
+    const int rgba_index = pcl::getFieldIndex (header, "rgba") >= 0 ? pcl::getFieldIndex (header, "rgba")
+                                                                       : pcl::getFieldIndex (header, "rgb");
+    const int rgba_token = rgba_offset >= 0 ? getFieldToken (header, header.fields[rgba_index].name) : -1;
+    const bool rgba_float = rgba_offset >= 0 && header.fields[rgba_index].datatype == pcl::PCLPointField::FLOAT32;
+
+    std::ifstream file (filename.c_str ());
+    file.seekg (data_idx);
+    std::vector<std::string> lines;
+    std::string line;
+    while (file)
+    {
+      lines.clear ();
+      while (lines.size () < block_size_ && std::getline (file, line))
+      {
+        if (!line.empty () && line[0] != '#')
+        {
+          lines.push_back (line);
+        }
+      }
+      if (lines.empty ())
+      {
+        break;
+      }
+      addLines (lines, getFieldToken (header, "x"), getFieldToken (header, "y"), getFieldToken (header, "z"),
+                rgba_token, rgba_float);
+    }
+  }
+  else
+  {
+    //  Compressed data is one LZF block that holds the fields as columns (every x, then every y, ...), so it has to be
+    //  decompressed whole; only the x, y, z and colour columns are then read, in blocks, with no unpacked cloud
+    PCL_WARN ("[wp2::StreamingVoxelGrid::addFile] %s is binary_compressed and is decompressed whole\n", filename.c_str ());
+    std::ifstream file (filename.c_str (), std::ios::in | std::ios::binary);
+    file.seekg (data_idx);
+    unsigned int compressed_size = 0;
+    unsigned int uncompressed_size = 0;
+    file.read (reinterpret_cast<char *> (&compressed_size), sizeof (unsigned int));
+    file.read (reinterpret_cast<char *> (&uncompressed_size), sizeof (unsigned int));
+    std::vector<unsigned char> columns;
+    if (file && compressed_size > 0 && uncompressed_size > 0)
+    {
+      std::vector<char> compressed (compressed_size);
+      columns.resize (uncompressed_size);
+      if (!file.read (&compressed[0], compressed_size) ||
+          pcl::lzfDecompress (&compressed[0], compressed_size, &columns[0], uncompressed_size) != uncompressed_size)
+      {
+        columns.clear ();
+      }
+    }
+
+    //  Start and stride of every column
+    std::vector<size_t> column_offsets (header.fields.size () + 1, 0);
+    std::vector<size_t> strides (header.fields.size ());
+    for (size_t f = 0; f < header.fields.size (); ++f)
+    {
+      strides[f] = static_cast<size_t> (pcl::getFieldSize (header.fields[f].datatype)) *
+                   (header.fields[f].count > 0 ? header.fields[f].count : 1);
+      column_offsets[f + 1] = column_offsets[f] + strides[f] * nr_points;
+    }
+    if (columns.size () < column_offsets.back ())
+    {
+      PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! Cannot decompress %s\n", filename.c_str ());
+      return (false);
+    }
+
+    const int x_index = pcl::getFieldIndex (header, "x");
+    const int y_index = pcl::getFieldIndex (header, "y");
+    const int z_index = pcl::getFieldIndex (header, "z");
+    const int rgba_index = rgba_offset < 0 ? -1 : pcl::getFieldIndex (header, "rgba") >= 0
+                                                  ? pcl::getFieldIndex (header, "rgba") : pcl::getFieldIndex (header, "rgb");
+    int nr_threads = 1;
+#ifdef _OPENMP
+    nr_threads = threads_ == 0 ? omp_get_num_procs () : threads_;
+#endif
+    for (size_t read = 0; read < nr_points; read += block_size_)
+    {
+      const long nr_block = static_cast<long> (std::min (block_size_, nr_points - read));
+      x_.resize (nr_block);
+      y_.resize (nr_block);
+      z_.resize (nr_block);
+      rgba_.resize (rgba_index >= 0 ? nr_block : 0);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nr_threads)
+#endif
+      for (long i = 0; i < nr_block; ++i)
+      {
+        x_[i] = readFloat (&columns[column_offsets[x_index] + (read + i) * strides[x_index]], 0);
+        y_[i] = readFloat (&columns[column_offsets[y_index] + (read + i) * strides[y_index]], 0);
+        z_[i] = readFloat (&columns[column_offsets[z_index] + (read + i) * strides[z_index]], 0);
+        if (rgba_index >= 0)
+        {
+          std::memcpy (&rgba_[i], &columns[column_offsets[rgba_index] + (read + i) * strides[rgba_index]],
+                       sizeof (unsigned int));
+        }
+      }
+      addPoints (&x_[0], &y_[0], &z_[0], rgba_index >= 0 ? &rgba_[0] : NULL, nr_block);
+    }
+    nr_decompressed_ += nr_points;
+  }
+
+  if (nr_out_of_range_ > nr_out_of_range)
+  {
+    PCL_ERROR ("[wp2::StreamingVoxelGrid::addFile] Error! %lu points of %s are too far for leaf size %f\n",
+               static_cast<unsigned long> (nr_out_of_range_ - nr_out_of_range), filename.c_str (), leaf_size_);
+    return (false);
+  }
+  return (true);
+}
+
+void
+wp2::StreamingVoxelGrid::getVoxels (std::vector<const detail::VoxelSum *> &voxels) const
+{
+  std::vector<std::pair<unsigned long long, const detail::VoxelSum *> > keyed;
+  keyed.reserve (getNumberOfVoxels ());
+  for (size_t t = 0; t < partitions_.size (); ++t)
+  {
+    for (detail::VoxelSumMap::const_iterator it = partitions_[t].begin (); it != partitions_[t].end (); ++it)
+    {
+      if (it->second.count > 0 && it->second.count >= min_points_ && detail::centroidInside (it->second, min_, max_))
+      {
+        keyed.push_back (std::make_pair (it->first, &it->second));
+      }
+    }
+  }
+  std::sort (keyed.begin (), keyed.end ());
+
+  voxels.resize (keyed.size ());
+  for (size_t i = 0; i < keyed.size (); ++i)
+  {
+    voxels[i] = keyed[i].second;
+  }
+}
@@ -0,0 +1,903 @@
+//BENCHMARK OF THE RECOGNITION PIPELINE ON SYNTHETIC SCENES
+//GENERATES A MODEL AND A SCENE (MODEL INSTANCES WITH RANDOM POSES, DISTRACTOR PRIMITIVES, A GROUND PLANE, NOISE)
+//FROM A FIXED SEED, THEN TIMES EACH STAGE AT SEVERAL CLOUD SIZES AND THREAD COUNTS
+//WITH --check_shot, ALSO COMPARES THE SHOT AND CSHOT KERNELS AGAINST pcl::SHOTEstimationOMP AND SHOTColorEstimationOMP
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <pcl/correspondence.h>
+#include <pcl/features/normal_3d_omp.h>
+#include <pcl/features/shot_omp.h>
+#include <pcl/keypoints/uniform_sampling.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/common/transforms.h>
+#include <pcl/console/parse.h>
+
+#include <wp2/common/profiler.h>
+#include <wp2/features/board_omp.h>
+#include <wp2/features/descriptor_matrix.h>
+#include <wp2/features/shot_lrf.h>
+#include <wp2/features/shot_simd.h>
+#include <wp2/recognition/geometric_consistency_simd.h>
+#include <wp2/recognition/hough_3d_sparse.h>
+#include <wp2/search/descriptor_matcher.h>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+typedef pcl::PointXYZRGBA PointType;
+typedef pcl::Normal NormalType;
+typedef pcl::ReferenceFrame RFType;
+typedef pcl::SHOT352 DescriptorType;
+
+//Algorithm params, as in correspondence_grouping_SHOT_Iterative_Obj-Scene_v3
+bool use_hough_ (true);
+bool share_lrf_ (false);
+bool fuse_features_ (false);
+wp2::shot::Kernel shot_kernel_ (wp2::shot::KERNEL_AUTO);
+wp2::search::DescriptorMatcher::Mode match_mode_ (wp2::search::DescriptorMatcher::MATCH_THRESHOLD);
+wp2::search::IndexParams index_params_;
+float model_ss_ (0.01f);
+float scene_ss_ (0.03f);
+float rf_rad_ (0.015f);
+float descr_rad_ (0.02f);
+float cg_size_ (0.01f);
+float cg_thresh_ (5.0f);
+
+//Benchmark params
+std::vector<int> sizes_;
+std::vector<int> threads_;
+int repeats_ (3);
+int seed_ (1);
+int instances_ (3);
+int distractors_ (6);
+float noise_ (0.0005f);
+std::string save_dir_;
+std::string csv_filename_;
+bool check_shot_ (false);
+float shot_tolerance_ (1e-5f);
+
+void
+showHelp (char *filename)
+{
+  std::cout << std::endl;
+  std::cout << "***************************************************************************" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "*             Recognition Pipeline Benchmark - Usage Guide                *" << std::endl;
+  std::cout << "*                                                                         *" << std::endl;
+  std::cout << "***************************************************************************" << std::endl << std::endl;
+  std::cout << "Usage: " << filename << " [Options]" << std::endl << std::endl;
+  std::cout << "Options:" << std::endl;
+  std::cout << "     -h:                     Show this help." << std::endl;
+  std::cout << "     -l:                     Share the BOARD reference frames with SHOT." << std::endl;
+  std::cout << "     -f:                     Compute SHOT and LRF from one shared neighbourhood" << std::endl;
+  std::cout << "                             search per keypoint (implies -l)." << std::endl;
+  std::cout << "     --algorithm (Hough|GC): Clustering algorithm used (default Hough)." << std::endl;
+  std::cout << "     --shot_kernel (pcl|scalar|avx2|auto):" << std::endl;
+  std::cout << "                             SHOT histogram code (default auto)." << std::endl;
+  std::cout << "     --match (nn|ratio|mutual): Descriptor matching mode (default nn)." << std::endl;
+  std::cout << "     --index (exact|kdtree|kmeans|linear|hnsw):" << std::endl;
+  std::cout << "                             Descriptor index (default exact)." << std::endl;
+  std::cout << "     --index_trees val:      Trees of the kd-forest (default 4)" << std::endl;
+  std::cout << "     --index_neighbors val:  Links per node of the hnsw graph (default 16)" << std::endl;
+  std::cout << "     --index_checks val:     Leaves visited per approximate query (default unlimited)" << std::endl;
+  std::cout << "     --sizes n1,n2,...:      Scene sizes in points (default 20000,80000,320000)" << std::endl;
+  std::cout << "     --threads t1,t2,...:    Thread counts (default 1,2,4,... up to the cores)" << std::endl;
+  std::cout << "     --repeats val:          Runs per size and thread count (default 3)" << std::endl;
+  std::cout << "     --seed val:             Seed of the scene generator (default 1)" << std::endl;
+  std::cout << "     --instances val:        Model instances placed in the scene (default 3)" << std::endl;
+  std::cout << "     --distractors val:      Other primitives placed in the scene (default 6)" << std::endl;
+  std::cout << "     --noise val:            Gaussian noise sigma in metres (default 0.0005)" << std::endl;
+  std::cout << "     --save dir:             Also write the generated clouds to dir as" << std::endl;
+  std::cout << "                             model_<size>.pcd and scene_<size>.pcd." << std::endl;
+  std::cout << "     --csv file:             Write the results table to file." << std::endl;
+  std::cout << "     --check_shot:           Compare the scalar and AVX2 SHOT / CSHOT descriptors of" << std::endl;
+  std::cout << "                             each scene with pcl::SHOTEstimationOMP and" << std::endl;
+  std::cout << "                             pcl::SHOTColorEstimationOMP; fails on a difference." << std::endl;
+  std::cout << "     --shot_tolerance val:   Largest difference allowed per bin (default 1e-5)" << std::endl;
+  std::cout << "     --model_ss val:         Model uniform sampling radius (default 0.01)" << std::endl;
+  std::cout << "     --scene_ss val:         Scene uniform sampling radius (default 0.03)" << std::endl;
+  std::cout << "     --rf_rad val:           Reference frame radius (default 0.015)" << std::endl;
+  std::cout << "     --descr_rad val:        Descriptor radius (default 0.02)" << std::endl;
+  std::cout << "     --cg_size val:          Cluster size (default 0.01)" << std::endl;
+  std::cout << "     --cg_thresh val:        Clustering threshold (default 5)" << std::endl << std::endl;
+}
+
+void
+parseCommandLine (int argc, char *argv[])
+{
+  //Show help
+  if (pcl::console::find_switch (argc, argv, "-h"))
+  {
+    showHelp (argv[0]);
+    exit (0);
+  }
+
+  //Program behavior
+  if (pcl::console::find_switch (argc, argv, "-l"))
+  {
+    share_lrf_ = true;
+  }
+  if (pcl::console::find_switch (argc, argv, "-f"))
+  {
+    fuse_features_ = true;
+    share_lrf_ = true;
+  }
+
+  std::string used_algorithm;
+  if (pcl::console::parse_argument (argc, argv, "--algorithm", used_algorithm) != -1)
+  {
+    if (used_algorithm.compare ("Hough") == 0)
+    {
+      use_hough_ = true;
+    }else if (used_algorithm.compare ("GC") == 0)
+    {
+      use_hough_ = false;
+    }
+    else
+    {
+      std::cout << "Wrong algorithm name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string shot_kernel;
+  if (pcl::console::parse_argument (argc, argv, "--shot_kernel", shot_kernel) != -1)
+  {
+    if (!wp2::shot::parseKernel (shot_kernel, shot_kernel_))
+    {
+      std::cout << "Wrong SHOT kernel name.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string match_mode;
+  if (pcl::console::parse_argument (argc, argv, "--match", match_mode) != -1)
+  {
+    if (!wp2::search::DescriptorMatcher::parseMode (match_mode, match_mode_))
+    {
+      std::cout << "Wrong matching mode.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+
+  std::string index_type;
+  if (pcl::console::parse_argument (argc, argv, "--index", index_type) != -1)
+  {
+    if (!wp2::search::IndexParams::parseType (index_type, index_params_.type))
+    {
+      std::cout << "Wrong index type.\n";
+      showHelp (argv[0]);
+      exit (-1);
+    }
+  }
+  pcl::console::parse_argument (argc, argv, "--index_trees", index_params_.trees);
+  pcl::console::parse_argument (argc, argv, "--index_neighbors", index_params_.neighbors);
+  pcl::console::parse_argument (argc, argv, "--index_checks", index_params_.checks);
+
+  //Benchmark parameters
+  if (pcl::console::parse_x_arguments (argc, argv, "--sizes", sizes_) == -1)
+  {
+    sizes_.push_back (20000);
+    sizes_.push_back (80000);
+    sizes_.push_back (320000);
+  }
+  if (pcl::console::parse_x_arguments (argc, argv, "--threads", threads_) == -1)
+  {
+#ifdef _OPENMP
+    const int nr_cores = omp_get_num_procs ();
+#else
+    const int nr_cores = 1;
+#endif
+    for (int t = 1; t < nr_cores; t *= 2)
+    {
+      threads_.push_back (t);
+    }
+    threads_.push_back (nr_cores);
+  }
+  pcl::console::parse_argument (argc, argv, "--repeats", repeats_);
+  pcl::console::parse_argument (argc, argv, "--seed", seed_);
+  pcl::console::parse_argument (argc, argv, "--instances", instances_);
+  pcl::console::parse_argument (argc, argv, "--distractors", distractors_);
+  pcl::console::parse_argument (argc, argv, "--noise", noise_);
+  pcl::console::parse_argument (argc, argv, "--save", save_dir_);
+  pcl::console::parse_argument (argc, argv, "--csv", csv_filename_);
+  if (pcl::console::find_switch (argc, argv, "--check_shot"))
+  {
+    check_shot_ = true;
+  }
+  pcl::console::parse_argument (argc, argv, "--shot_tolerance", shot_tolerance_);
+
+  for (size_t i = 0; i < sizes_.size (); ++i)
+  {
+    if (sizes_[i] <= 0)
+    {
+      std::cout << "Sizes must be positive.\n";
+      exit (-1);
+    }
+  }
+  for (size_t i = 0; i < threads_.size (); ++i)
+  {
+    if (threads_[i] <= 0)
+    {
+      std::cout << "Thread counts must be positive.\n";
+      exit (-1);
+    }
+  }
+  repeats_ = std::max (repeats_, 1);
+
+  //General parameters
+  pcl::console::parse_argument (argc, argv, "--model_ss", model_ss_);
+  pcl::console::parse_argument (argc, argv, "--scene_ss", scene_ss_);
+  pcl::console::parse_argument (argc, argv, "--rf_rad", rf_rad_);
+  pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
+  pcl::console::parse_argument (argc, argv, "--cg_size", cg_size_);
+  pcl::console::parse_argument (argc, argv, "--cg_thresh", cg_thresh_);
+}
+
+double
+computeCloudResolution (const pcl::PointCloud<PointType>::ConstPtr &cloud)
+{
+  double res = 0.0;
+  int n_points = 0;
+  int nres;
+  std::vector<int> indices (2);
+  std::vector<float> sqr_distances (2);
+  pcl::search::KdTree<PointType> tree;
+  tree.setInputCloud (cloud);
+
+  for (size_t i = 0; i < cloud->size (); ++i)
+  {
+    if (! pcl_isfinite ((*cloud)[i].x))
+    {
+      continue;
+    }
+    //Considering the second neighbor since the first is the point itself.
+    nres = tree.nearestKSearch (i, 2, indices, sqr_distances);
+    if (nres == 2)
+    {
+      res += sqrt (sqr_distances[1]);
+      ++n_points;
+    }
+  }
+  if (n_points != 0)
+  {
+    res /= n_points;
+  }
+  return res;
+}
+
+//
+//  Synthetic scenes
+//
+
+typedef boost::variate_generator<boost::mt19937 &, boost::uniform_01<> > Uniform;
+typedef boost::variate_generator<boost::mt19937 &, boost::normal_distribution<> > Gaussian;
+
+//  Surface patch of a primitive in the frame of its object
+struct Primitive
+{
+  enum Type {BOX, CYLINDER, SPHERE, PLANE};
+
+  Type type;
+  Eigen::Vector3f size;    // box and plane: extents; cylinder: radius, height; sphere: radius
+  Eigen::Vector3f offset;  // centre in the object frame
+  unsigned char r, g, b;
+
+  float
+  area () const
+  {
+    switch (type)
+    {
+      case BOX:
+        return (2.0f * (size[0] * size[1] + size[1] * size[2] + size[0] * size[2]));
+      case CYLINDER:
+        return (2.0f * static_cast<float> (M_PI) * size[0] * (size[0] + size[1]));
+      case SPHERE:
+        return (4.0f * static_cast<float> (M_PI) * size[0] * size[0]);
+      default:
+        return (size[0] * size[1]);
+    }
+  }
+
+  //  Uniform sample of the surface
+  Eigen::Vector3f
+  sample (Uniform &uniform) const
+  {
+    Eigen::Vector3f p;
+    switch (type)
+    {
+      case BOX:
+      {
+        const float a[3] = {size[1] * size[2], size[0] * size[2], size[0] * size[1]};
+        float pick = static_cast<float> (uniform ()) * (a[0] + a[1] + a[2]);
+        const int axis = pick < a[0] ? 0 : (pick < a[0] + a[1] ? 1 : 2);
+        for (int d = 0; d < 3; ++d)
+        {
+          p[d] = (static_cast<float> (uniform ()) - 0.5f) * size[d];
+        }
+        p[axis] = (uniform () < 0.5 ? -0.5f : 0.5f) * size[axis];
+        break;
+      }
+      case CYLINDER:
+      {
+        const float side = size[1];
+        const float cap = size[0];
+        const float angle = 2.0f * static_cast<float> (M_PI) * static_cast<float> (uniform ());
+        if (uniform () * (side + cap) < side)
+        {
+          p << size[0] * std::cos (angle), size[0] * std::sin (angle), (static_cast<float> (uniform ()) - 0.5f) * size[1];
+        }
+        else
+        {
+          const float radius = size[0] * std::sqrt (static_cast<float> (uniform ()));
+          p << radius * std::cos (angle), radius * std::sin (angle), (uniform () < 0.5 ? -0.5f : 0.5f) * size[1];
+        }
+        break;
+      }
+      case SPHERE:
+      {
+        const float z = 2.0f * static_cast<float> (uniform ()) - 1.0f;
+        const float angle = 2.0f * static_cast<float> (M_PI) * static_cast<float> (uniform ());
+        const float ring = std::sqrt (std::max (0.0f, 1.0f - z * z));
+        p << size[0] * ring * std::cos (angle), size[0] * ring * std::sin (angle), size[0] * z;
+        break;
+      }
+      default:
+        p << (static_cast<float> (uniform ()) - 0.5f) * size[0], (static_cast<float> (uniform ()) - 0.5f) * size[1], 0.0f;
+    }
+    return (p + offset);
+  }
+};
+
+struct Placement
+{
+  std::vector<Primitive> parts;
+  Eigen::Affine3f pose;
+};
+
+Primitive
+makePrimitive (Primitive::Type type, float sx, float sy, float sz, float ox, float oy, float oz,
+               unsigned char r, unsigned char g, unsigned char b)
+{
+  Primitive primitive;
+  primitive.type = type;
+  primitive.size << sx, sy, sz;
+  primitive.offset << ox, oy, oz;
+  primitive.r = r;
+  primitive.g = g;
+  primitive.b = b;
+  return (primitive);
+}
+
+//  The model: a box with a cylinder on one end and a sphere on a side, asymmetric so that its pose is defined
+std::vector<Primitive>
+modelParts ()
+{
+  std::vector<Primitive> parts;
+  parts.push_back (makePrimitive (Primitive::BOX, 0.12f, 0.08f, 0.06f, 0.0f, 0.0f, 0.03f, 200, 60, 60));
+  parts.push_back (makePrimitive (Primitive::CYLINDER, 0.025f, 0.08f, 0.0f, 0.035f, 0.015f, 0.10f, 60, 200, 60));
+  parts.push_back (makePrimitive (Primitive::SPHERE, 0.03f, 0.0f, 0.0f, -0.05f, -0.055f, 0.03f, 60, 60, 200));
+  return (parts);
+}
+
+float
+totalArea (const std::vector<Placement> &placements)
+{
+  float area = 0.0f;
+  for (size_t i = 0; i < placements.size (); ++i)
+  {
+    for (size_t j = 0; j < placements[i].parts.size (); ++j)
+    {
+      area += placements[i].parts[j].area ();
+    }
+  }
+  return (area);
+}
+
+//  Samples the placements at the given density (points per square metre), plus noise
+void
+samplePlacements (const std::vector<Placement> &placements, double density, Uniform &uniform, Gaussian &gaussian,
+                  pcl::PointCloud<PointType> &cloud)
+{
+  for (size_t i = 0; i < placements.size (); ++i)
+  {
+    for (size_t j = 0; j < placements[i].parts.size (); ++j)
+    {
+      const Primitive &part = placements[i].parts[j];
+      const int nr_points = static_cast<int> (part.area () * density + 0.5);
+      for (int k = 0; k < nr_points; ++k)
+      {
+        const Eigen::Vector3f p = placements[i].pose * part.sample (uniform);
+        PointType point;
+        point.x = p[0] + noise_ * static_cast<float> (gaussian ());
+        point.y = p[1] + noise_ * static_cast<float> (gaussian ());
+        point.z = p[2] + noise_ * static_cast<float> (gaussian ());
+        point.r = part.r;
+        point.g = part.g;
+        point.b = part.b;
+        point.a = 255;
+        cloud.push_back (point);
+      }
+    }
+  }
+}
+
+//  Scene of about nr_points points and the model at the same density. Same seed and size, same clouds.
+void
+generateClouds (int nr_points, pcl::PointCloud<PointType> &model, pcl::PointCloud<PointType> &scene)
+{
+  boost::mt19937 rng (static_cast<boost::uint32_t> (seed_) * 7919u + static_cast<boost::uint32_t> (nr_points));
+  Uniform uniform (rng, boost::uniform_01<> ());
+  Gaussian gaussian (rng, boost::normal_distribution<> (0.0, 1.0));
+
+  std::vector<Placement> objects (1);
+  objects[0].parts = modelParts ();
+  objects[0].pose = Eigen::Affine3f::Identity ();
+
+  //  Ground plane, model instances and distractors on it, each turned about the vertical
+  std::vector<Placement> placements;
+  Placement ground;
+  ground.parts.push_back (makePrimitive (Primitive::PLANE, 1.2f, 1.2f, 0.0f, 0.0f, 0.0f, 0.0f, 120, 120, 120));
+  ground.pose = Eigen::Affine3f::Identity ();
+  placements.push_back (ground);
+
+  for (int i = 0; i < instances_ + distractors_; ++i)
+  {
+    Placement placement;
+    if (i < instances_)
+    {
+      placement.parts = modelParts ();
+    }
+    else
+    {
+      const int kind = static_cast<int> (uniform () * 3.0);
+      const float s = 0.04f + 0.06f * static_cast<float> (uniform ());
+      if (kind == 0)
+      {
+        placement.parts.push_back (makePrimitive (Primitive::BOX, 2.0f * s, 1.5f * s, s, 0.0f, 0.0f, 0.5f * s, 180, 180, 60));
+      }
+      else if (kind == 1)
+      {
+        placement.parts.push_back (makePrimitive (Primitive::CYLINDER, 0.5f * s, 2.0f * s, 0.0f, 0.0f, 0.0f, s, 180, 60, 180));
+      }
+      else
+      {
+        placement.parts.push_back (makePrimitive (Primitive::SPHERE, 0.6f * s, 0.0f, 0.0f, 0.0f, 0.0f, 0.6f * s, 60, 180, 180));
+      }
+    }
+    const float yaw = 2.0f * static_cast<float> (M_PI) * static_cast<float> (uniform ());
+    const float x = 1.0f * (static_cast<float> (uniform ()) - 0.5f);
+    const float y = 1.0f * (static_cast<float> (uniform ()) - 0.5f);
+    placement.pose = Eigen::Translation3f (x, y, 0.0f) * Eigen::AngleAxisf (yaw, Eigen::Vector3f::UnitZ ());
+    placements.push_back (placement);
+  }
+
+  const double density = nr_points / totalArea (placements);
+
+  model.clear ();
+  scene.clear ();
+  samplePlacements (objects, density, uniform, gaussian, model);
+  samplePlacements (placements, density, uniform, gaussian, scene);
+}
+
+//
+//  Pipeline
+//
+
+struct Result
+{
+  std::map<std::string, std::vector<double> > times;  // ms per run
+  std::map<std::string, long> items;                  // work items per run, for the throughput
+  long instances;
+};
+
+void
+runPipeline (const pcl::PointCloud<PointType>::Ptr &model, const pcl::PointCloud<PointType>::Ptr &scene,
+             int nr_threads, Result &result)
+{
+  pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
+  pcl::PointCloud<PointType>::Ptr scene_keypoints (new pcl::PointCloud<PointType> ());
+  pcl::PointCloud<NormalType>::Ptr model_normals (new pcl::PointCloud<NormalType> ());
+  pcl::PointCloud<NormalType>::Ptr scene_normals (new pcl::PointCloud<NormalType> ());
+  wp2::DescriptorMatrix model_descriptors;
+  wp2::DescriptorMatrix scene_descriptors;
+  pcl::PointCloud<RFType>::Ptr model_rf (new pcl::PointCloud<RFType> ());
+  pcl::PointCloud<RFType>::Ptr scene_rf (new pcl::PointCloud<RFType> ());
+  const long nr_points = static_cast<long> (model->size () + scene->size ());
+
+  //  Cloud resolution of the scene
+  double start = wp2::Profiler::now ();
+  computeCloudResolution (scene);
+  result.times["resolution"].push_back (wp2::Profiler::now () - start);
+  result.items["resolution"] = static_cast<long> (scene->size ());
+
+  //  Normals
+  start = wp2::Profiler::now ();
+  pcl::NormalEstimationOMP<PointType, NormalType> norm_est (nr_threads);
+  norm_est.setKSearch (10);
+  norm_est.setInputCloud (model);
+  norm_est.compute (*model_normals);
+  norm_est.setInputCloud (scene);
+  norm_est.compute (*scene_normals);
+  result.times["normals"].push_back (wp2::Profiler::now () - start);
+  result.items["normals"] = nr_points;
+
+  //  Keypoints
+  start = wp2::Profiler::now ();
+  pcl::PointCloud<int> sampled_indices;
+  pcl::UniformSampling<PointType> uniform_sampling;
+  uniform_sampling.setInputCloud (model);
+  uniform_sampling.setRadiusSearch (model_ss_);
+  uniform_sampling.compute (sampled_indices);
+  pcl::copyPointCloud (*model, sampled_indices.points, *model_keypoints);
+  uniform_sampling.setInputCloud (scene);
+  uniform_sampling.setRadiusSearch (scene_ss_);
+  uniform_sampling.compute (sampled_indices);
+  pcl::copyPointCloud (*scene, sampled_indices.points, *scene_keypoints);
+  result.times["sampling"].push_back (wp2::Profiler::now () - start);
+  result.items["sampling"] = nr_points;
+
+  const long nr_keypoints = static_cast<long> (model_keypoints->size () + scene_keypoints->size ());
+
+  //  Reference frames and descriptors
+  if (fuse_features_)
+  {
+    start = wp2::Profiler::now ();
+    wp2::SHOTLRFEstimation<PointType, NormalType, DescriptorType, RFType> feature_est;
+    feature_est.setNumberOfThreads (nr_threads);
+    feature_est.setKernel (shot_kernel_);
+    feature_est.setDescriptorRadius (descr_rad_);
+    feature_est.setReferenceFrameRadius (rf_rad_);
+    feature_est.setInputCloud (model_keypoints);
+    feature_est.setInputNormals (model_normals);
+    feature_est.setSearchSurface (model);
+    feature_est.compute (model_descriptors, model_rf);
+    feature_est.setInputCloud (scene_keypoints);
+    feature_est.setInputNormals (scene_normals);
+    feature_est.setSearchSurface (scene);
+    feature_est.compute (scene_descriptors, scene_rf);
+    result.times["shot_lrf"].push_back (wp2::Profiler::now () - start);
+    result.items["shot_lrf"] = nr_keypoints;
+  }
+  else
+  {
+    if (use_hough_ || share_lrf_)
+    {
+      start = wp2::Profiler::now ();
+      wp2::BOARDLocalReferenceFrameEstimationOMP<PointType, NormalType, RFType> rf_est (nr_threads);
+      rf_est.setFindHoles (true);
+      rf_est.setRadiusSearch (rf_rad_);
+      rf_est.setInputCloud (model_keypoints);
+      rf_est.setInputNormals (model_normals);
+      rf_est.setSearchSurface (model);
+      rf_est.compute (*model_rf);
+      rf_est.setInputCloud (scene_keypoints);
+      rf_est.setInputNormals (scene_normals);
+      rf_est.setSearchSurface (scene);
+      rf_est.compute (*scene_rf);
+      result.times["lrf"].push_back (wp2::Profiler::now () - start);
+      result.items["lrf"] = nr_keypoints;
+    }
+
+    start = wp2::Profiler::now ();
+    wp2::SHOTEstimationSIMD<PointType, NormalType, DescriptorType> descr_est (nr_threads, shot_kernel_);
+    descr_est.setRadiusSearch (descr_rad_);
+    descr_est.setInputCloud (model_keypoints);
+    descr_est.setInputNormals (model_normals);
+    descr_est.setSearchSurface (model);
+    if (share_lrf_)
+    {
+      descr_est.setInputReferenceFrames (model_rf);
+    }
+    descr_est.compute (model_descriptors);
+    descr_est.setInputCloud (scene_keypoints);
+    descr_est.setInputNormals (scene_normals);
+    descr_est.setSearchSurface (scene);
+    if (share_lrf_)
+    {
+      descr_est.setInputReferenceFrames (scene_rf);
+    }
+    descr_est.compute (scene_descriptors);
+    result.times["shot"].push_back (wp2::Profiler::now () - start);
+    result.items["shot"] = nr_keypoints;
+  }
+
+  //  Matching
+  start = wp2::Profiler::now ();
+  pcl::CorrespondencesPtr model_scene_corrs (new pcl::Correspondences ());
+  wp2::search::DescriptorMatcher matcher;
+  matcher.setMode (match_mode_);
+  matcher.setIndexParams (index_params_);
+  matcher.setNumberOfThreads (nr_threads);
+  matcher.match (model_descriptors, scene_descriptors, *model_scene_corrs);
+  result.times["matching"].push_back (wp2::Profiler::now () - start);
+  result.items["matching"] = static_cast<long> (scene_descriptors.rows ());
+
+  //  Grouping
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > rototranslations;
+  std::vector<pcl::Correspondences> clustered_corrs;
+  start = wp2::Profiler::now ();
+  if (use_hough_)
+  {
+    wp2::SparseHough3DGrouping<PointType, PointType, RFType, RFType> clusterer (nr_threads);
+    clusterer.setHoughBinSize (cg_size_);
+    clusterer.setHoughThreshold (cg_thresh_);
+    clusterer.setUseInterpolation (true);
+    clusterer.setUseDistanceWeight (false);
+    clusterer.setInputCloud (model_keypoints);
+    clusterer.setInputRf (model_rf);
+    clusterer.setSceneCloud (scene_keypoints);
+    clusterer.setSceneRf (scene_rf);
+    clusterer.setModelSceneCorrespondences (model_scene_corrs);
+    clusterer.recognize (rototranslations, clustered_corrs);
+  }
+  else
+  {
+    wp2::GeometricConsistencyGroupingSIMD<PointType, PointType> gc_clusterer (nr_threads);
+    gc_clusterer.setGCSize (cg_size_);
+    gc_clusterer.setGCThreshold (cg_thresh_);
+    gc_clusterer.setInputCloud (model_keypoints);
+    gc_clusterer.setSceneCloud (scene_keypoints);
+    gc_clusterer.setModelSceneCorrespondences (model_scene_corrs);
+    gc_clusterer.recognize (rototranslations, clustered_corrs);
+  }
+  result.times["grouping"].push_back (wp2::Profiler::now () - start);
+  result.items["grouping"] = static_cast<long> (model_scene_corrs->size ());
+
+  result.instances = static_cast<long> (rototranslations.size ());
+}
+
+//
+//  SHOT check
+//
+
+//  Descriptors of the PCL estimator against those of the wp2 one with the given kernel: same keypoints, same
+//  frames, bins within the tolerance. Returns false on any difference.
+template <typename DescriptorT, typename PCLEstimatorT, typename SIMDEstimatorT> bool
+compareSHOT (const char *name, PCLEstimatorT &pcl_est, SIMDEstimatorT &simd_est, wp2::shot::Kernel kernel,
+             const pcl::PointCloud<PointType>::Ptr &keypoints, const pcl::PointCloud<NormalType>::Ptr &normals,
+             const pcl::PointCloud<PointType>::Ptr &surface)
+{
+  pcl::PointCloud<DescriptorT> expected;
+  pcl_est.setRadiusSearch (descr_rad_);
+  pcl_est.setInputCloud (keypoints);
+  pcl_est.setInputNormals (normals);
+  pcl_est.setSearchSurface (surface);
+  pcl_est.compute (expected);
+
+  pcl::PointCloud<DescriptorT> actual;
+  simd_est.setKernel (kernel);
+  simd_est.setRadiusSearch (descr_rad_);
+  simd_est.setInputCloud (keypoints);
+  simd_est.setInputNormals (normals);
+  simd_est.setSearchSurface (surface);
+  simd_est.compute (actual);
+
+  const int length = static_cast<int> (sizeof (expected.points[0].descriptor) / sizeof (float));
+  long nr_invalid = 0;
+  long nr_mismatched = 0;
+  long nr_over = 0;
+  double max_diff = 0.0;
+  double sum_diff = 0.0;
+  long nr_bins = 0;
+  for (size_t i = 0; i < expected.size () && i < actual.size (); ++i)
+  {
+    const bool valid = pcl_isfinite (expected.points[i].descriptor[0]);
+    if (valid != pcl_isfinite (actual.points[i].descriptor[0]))
+    {
+      ++nr_mismatched;
+      continue;
+    }
+    if (!valid)
+    {
+      ++nr_invalid;
+      continue;
+    }
+    double diff = 0.0;
+    for (int b = 0; b < length; ++b)
+    {
+      const double d = std::fabs (expected.points[i].descriptor[b] - actual.points[i].descriptor[b]);
+      diff = std::max (diff, d);
+      sum_diff += d;
+    }
+    for (int b = 0; b < 9; ++b)
+    {
+      diff = std::max (diff, static_cast<double> (std::fabs (expected.points[i].rf[b] - actual.points[i].rf[b])));
+    }
+    nr_bins += length;
+    max_diff = std::max (max_diff, diff);
+    if (diff > shot_tolerance_)
+    {
+      ++nr_over;
+    }
+  }
+  const bool passed = expected.size () == actual.size () && nr_mismatched == 0 && nr_over == 0;
+
+  std::cout << std::left << std::setw (8) << name << std::setw (8) << wp2::shot::kernelName (kernel) << std::right
+            << std::setw (10) << expected.size () << std::setw (9) << nr_invalid << std::setw (12) << nr_mismatched
+            << std::setw (8) << nr_over << std::setw (14) << max_diff << std::setw (14)
+            << (nr_bins > 0 ? sum_diff / static_cast<double> (nr_bins) : 0.0) << "  " << (passed ? "ok" : "FAILED")
+            << std::endl;
+  return (passed);
+}
+
+//  SHOT352 and SHOT1344 of the scene keypoints, scalar and AVX2 (when the CPU has it) against PCL
+bool
+checkSHOT (const pcl::PointCloud<PointType>::Ptr &scene, int nr_threads)
+{
+  pcl::PointCloud<NormalType>::Ptr normals (new pcl::PointCloud<NormalType> ());
+  pcl::NormalEstimationOMP<PointType, NormalType> norm_est (nr_threads);
+  norm_est.setKSearch (10);
+  norm_est.setInputCloud (scene);
+  norm_est.compute (*normals);
+
+  pcl::PointCloud<PointType>::Ptr keypoints (new pcl::PointCloud<PointType> ());
+  pcl::PointCloud<int> sampled_indices;
+  pcl::UniformSampling<PointType> uniform_sampling;
+  uniform_sampling.setInputCloud (scene);
+  uniform_sampling.setRadiusSearch (scene_ss_);
+  uniform_sampling.compute (sampled_indices);
+  pcl::copyPointCloud (*scene, sampled_indices.points, *keypoints);
+
+  std::cout << std::left << std::setw (8) << "check" << std::setw (8) << "kernel" << std::right << std::setw (10)
+            << "keypoints" << std::setw (9) << "invalid" << std::setw (12) << "mismatched" << std::setw (8) << "over"
+            << std::setw (14) << "max_diff" << std::setw (14) << "mean_diff" << std::endl;
+
+  std::vector<wp2::shot::Kernel> kernels;
+  kernels.push_back (wp2::shot::KERNEL_SCALAR);
+  if (wp2::shot::resolveKernel (wp2::shot::KERNEL_AVX2) == wp2::shot::KERNEL_AVX2)
+  {
+    kernels.push_back (wp2::shot::KERNEL_AVX2);
+  }
+  else
+  {
+    std::cout << "No AVX2 on this CPU, only the scalar kernel is checked." << std::endl;
+  }
+
+  bool passed = true;
+  for (size_t k = 0; k < kernels.size (); ++k)
+  {
+    pcl::SHOTEstimationOMP<PointType, NormalType, pcl::SHOT352> shot_pcl (nr_threads);
+    wp2::SHOTEstimationSIMD<PointType, NormalType, pcl::SHOT352> shot_simd (nr_threads);
+    passed = compareSHOT<pcl::SHOT352> ("SHOT", shot_pcl, shot_simd, kernels[k], keypoints, normals, scene) && passed;
+
+    pcl::SHOTColorEstimationOMP<PointType, NormalType, pcl::SHOT1344> cshot_pcl (true, true, nr_threads);
+    wp2::SHOTColorEstimationSIMD<PointType, NormalType, pcl::SHOT1344> cshot_simd (true, true, nr_threads);
+    passed = compareSHOT<pcl::SHOT1344> ("CSHOT", cshot_pcl, cshot_simd, kernels[k], keypoints, normals, scene) && passed;
+  }
+  return (passed);
+}
+
+double
+median (std::vector<double> values)
+{
+  std::sort (values.begin (), values.end ());
+  const size_t n = values.size ();
+  return (n % 2 == 1 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]));
+}
+
+int
+main (int argc, char *argv[])
+{
+  parseCommandLine (argc, argv);
+
+  const char *stages[] = {"resolution", "normals", "sampling", "lrf", "shot", "shot_lrf", "matching", "grouping"};
+  const size_t nr_stages = sizeof (stages) / sizeof (stages[0]);
+
+  std::ofstream csv;
+  if (!csv_filename_.empty ())
+  {
+    csv.open (csv_filename_.c_str ());
+    if (!csv)
+    {
+      std::cout << "Error opening " << csv_filename_ << std::endl;
+      return (-1);
+    }
+    csv << "size,model_points,scene_points,threads,stage,items,median_ms,min_ms,items_per_s,speedup,instances\n";
+  }
+
+  std::cout << "Seed " << seed_ << ", " << instances_ << " instances, " << distractors_ << " distractors, noise "
+            << noise_ << ", " << repeats_ << " runs each, " << (use_hough_ ? "Hough" : "GC") << ", SHOT kernel "
+            << wp2::shot::kernelName (shot_kernel_) << ", matching " << wp2::search::DescriptorMatcher::modeName (match_mode_)
+            << ", index " << index_params_.toString ()
+            << std::endl;
+
+  bool shot_passed = true;
+  for (size_t s = 0; s < sizes_.size (); ++s)
+  {
+    pcl::PointCloud<PointType>::Ptr model (new pcl::PointCloud<PointType> ());
+    pcl::PointCloud<PointType>::Ptr scene (new pcl::PointCloud<PointType> ());
+    generateClouds (sizes_[s], *model, *scene);
+
+    if (!save_dir_.empty ())
+    {
+      std::stringstream model_file, scene_file;
+      model_file << save_dir_ << "/model_" << sizes_[s] << ".pcd";
+      scene_file << save_dir_ << "/scene_" << sizes_[s] << ".pcd";
+      pcl::io::savePCDFileBinary (model_file.str (), *model);
+      pcl::io::savePCDFileBinary (scene_file.str (), *scene);
+    }
+
+    std::cout << std::endl << "Scene " << scene->size () << " points, model " << model->size () << " points" << std::endl;
+    if (check_shot_)
+    {
+      shot_passed = checkSHOT (scene, threads_.back ()) && shot_passed;
+    }
+    std::cout << std::left << std::setw (12) << "stage" << std::right << std::setw (8) << "threads"
+              << std::setw (10) << "items" << std::setw (12) << "median_ms" << std::setw (12) << "min_ms"
+              << std::setw (14) << "items/s" << std::setw (9) << "speedup" << std::endl;
+
+    //  Median of the first thread count, the base of the speedups
+    std::map<std::string, double> base;
+    for (size_t t = 0; t < threads_.size (); ++t)
+    {
+      Result result;
+      for (int r = 0; r < repeats_; ++r)
+      {
+        runPipeline (model, scene, threads_[t], result);
+      }
+
+      for (size_t st = 0; st < nr_stages; ++st)
+      {
+        const std::string stage (stages[st]);
+        if (result.times.find (stage) == result.times.end ())
+        {
+          continue;
+        }
+        const std::vector<double> &times = result.times[stage];
+        const double med = median (times);
+        const double min = *std::min_element (times.begin (), times.end ());
+        const long items = result.items[stage];
+        const double rate = med > 0.0 ? 1e3 * static_cast<double> (items) / med : 0.0;
+        if (t == 0)
+        {
+          base[stage] = med;
+        }
+        const double speedup = med > 0.0 ? base[stage] / med : 0.0;
+
+        std::cout << std::left << std::setw (12) << stage << std::right << std::setw (8) << threads_[t]
+                  << std::setw (10) << items << std::fixed << std::setprecision (2)
+                  << std::setw (12) << med << std::setw (12) << min << std::setprecision (0)
+                  << std::setw (14) << rate << std::setprecision (2) << std::setw (9) << speedup << std::endl;
+        std::cout.unsetf (std::ios::fixed);
+
+        if (csv.is_open ())
+        {
+          csv << sizes_[s] << "," << model->size () << "," << scene->size () << "," << threads_[t] << ","
+              << stage << "," << items << "," << med << "," << min << "," << rate << "," << speedup << ","
+              << result.instances << "\n";
+        }
+      }
+      std::cout << "Instances found with " << threads_[t] << " threads: " << result.instances
+                << " of " << instances_ << std::endl;
+    }
+  }
+
+  if (!shot_passed)
+  {
+    std::cout << std::endl << "SHOT check FAILED: the descriptors differ from PCL's." << std::endl;
+    return (-1);
+  }
+  return (0);
+}